@@ -3,12 +3,128 @@
 #include <QSqlError>
 #include <QDebug>
 #include <QMutex>
+#include <QThread>
+#include <QAtomicInt>
 #include <QSqlRecord>
+#include <QMap>
+#include <QDateTime>
+#include <QJsonArray>
+#include <QVarLengthArray>
+#include <cstring>
+#include "movejournal.h"
+#include "gamearchiver.h"
+#include "stalldetector.h"
+#include "gamemode.h"
+#include "tracer.h"
+#include "userdirectory.h"
 
 DatabaseManager* DatabaseManager::instance = nullptr;
 QMutex mutex;
 
-DatabaseManager::DatabaseManager()
+namespace {
+
+// Запросы горячего пути: подготавливаются один раз (при старте) и переиспользуются
+const char SqlInsertUser[] = "INSERT INTO User (nickname, email, password, connection_info) VALUES (:nickname, :email, :password, :connection_info)";
+const char SqlSelectUser[] = "SELECT email, password FROM User WHERE nickname = :nickname";
+const char SqlSelectUserConflict[] = "SELECT nickname, email, password FROM User WHERE nickname = :nickname OR email = :email";
+const char SqlInsertGame[] = "INSERT INTO Game (player1, player2, current_turn, mode) VALUES (:player1, :player2, :current_turn, :mode)";
+const char SqlSaveFleet[] = "INSERT OR REPLACE INTO Fleet (game_id, player, ships) VALUES (:game_id, :player, :ships)";
+const char SqlInsertMove[] = "INSERT INTO Move (game_id, player, x, y, result) VALUES (:game_id, :player, :x, :y, :result)";
+const char SqlSelectGame[] = "SELECT player1, player2, current_turn, mode FROM Game WHERE game_id = :game_id";
+const char SqlSelectGameMode[] = "SELECT mode FROM Game WHERE game_id = :game_id";
+const char SqlSelectShot[] = "SELECT result FROM Move WHERE game_id = :game_id AND player = :player AND x = :x AND y = :y";
+const char SqlSelectFleet[] = "SELECT ships FROM Fleet WHERE game_id = :game_id AND player = :player";
+const char SqlSelectMoves[] = "SELECT player, x, y, result FROM Move WHERE game_id = :game_id ORDER BY move_id";
+const char SqlCountShipHits[] = "SELECT COUNT(*) FROM Move WHERE game_id = :game_id AND player = :player AND result IN ('hit', 'sunk') AND "
+                                "(x >= :ship_x AND x < :ship_x + :size AND y = :ship_y AND :is_horizontal = 1 OR "
+                                "y >= :ship_y AND y < :ship_y + :size AND x = :ship_x AND :is_horizontal = 0)";
+const char SqlSelectTurn[] = "SELECT current_turn FROM Game WHERE game_id = :game_id";
+const char SqlUpdateTurn[] = "UPDATE Game SET current_turn = :current_turn WHERE game_id = :game_id";
+const char SqlAdvanceTurn[] = "UPDATE Game SET current_turn = :next_turn WHERE game_id = :game_id AND current_turn = :player";
+const char SqlInsertStats[] = "INSERT OR IGNORE INTO Stats (nickname) VALUES (:nickname)";
+// Ревизия - сквозной номер изменения строки: запись в Stats идёт под блокировкой записи SQLite,
+// поэтому номера растут в порядке фиксации транзакций всех процессов, работающих с базой
+const char SqlUpdateStats[] = "UPDATE Stats SET wins = wins + :wins, losses = losses + :losses, "
+                              "shots = shots + :shots, hits = hits + :hits, "
+                              "revision = (SELECT COALESCE(MAX(revision), 0) + 1 FROM Stats) WHERE nickname = :nickname";
+const char SqlSelectStatsSince[] = "SELECT nickname, wins, losses, shots, hits, revision FROM Stats WHERE revision > :revision";
+const char SqlSelectStats[] = "SELECT wins, losses, shots, hits FROM Stats WHERE nickname = :nickname";
+const char SqlFinishGame[] = "UPDATE Game SET finished_at = :finished_at WHERE game_id = :game_id AND finished_at IS NULL";
+const char SqlSelectGameRecord[] = "SELECT player1, player2, current_turn, finished_at FROM Game WHERE game_id = :game_id";
+const char SqlSelectArchive[] = "SELECT archive FROM ArchivedGame WHERE game_id = :game_id";
+const char SqlInsertTournamentMatch[] = "INSERT INTO TournamentMatch (tournament_id, round, slot, game_id, player1, player2, winner) "
+                                        "VALUES (:tournament_id, :round, :slot, :game_id, :player1, :player2, :winner)";
+const char SqlTournamentShard[] = "UPDATE TournamentMatch SET shard = :shard WHERE game_id = :game_id";
+const char SqlTournamentResult[] = "UPDATE TournamentMatch SET winner = :winner WHERE game_id = :game_id AND winner IS NULL";
+
+const GameMode &gameModeByName(const QString &name)
+{
+    const GameMode *mode = GameMode::find(name);
+    return mode ? *mode : GameMode::classic();
+}
+
+// Проверка залпа до расчёта итогов: число выстрелов и клетки (в пределах доски, без повторов)
+SalvoResult::Status checkSalvo(const GameMode &mode, const BoardBits &shots, int slot, const QVector<QPoint> &cells, int allowedShots,
+                               QVector<GameMove> *salvo)
+{
+    if (cells.size() > allowedShots) {
+        return SalvoResult::TooManyShots;
+    }
+    if (cells.isEmpty()) {
+        return SalvoResult::InvalidShot;
+    }
+    BoardBits seen;
+    for (const QPoint &cell : cells) {
+        if (!mode.contains(cell.x(), cell.y()) || mode.testCell(shots, cell.x(), cell.y()) || mode.testCell(seen, cell.x(), cell.y())) {
+            return SalvoResult::InvalidShot;
+        }
+        mode.markCell(seen, cell.x(), cell.y());
+        salvo->append(GameMove{quint8(slot), quint8(cell.x()), quint8(cell.y()), quint8(MoveResult::Miss)});
+    }
+    return SalvoResult::Accepted;
+}
+
+} // namespace
+
+// Состояние игры в режиме журнала: всё, что нужно applyMove, без обращений к SQLite
+struct DatabaseManager::JournalGame
+{
+    QString players[2];
+    int turn; // Номер игрока, чей ход; -1 - ход не за участником игры
+    const GameMode *mode;
+    QVector<FleetShip> fleets[2];
+    BoardBits fleetCells[2]; // Клетки флота игрока
+    BoardBits shots[2]; // Клетки, по которым игрок стрелял
+    BoardBits hits[2]; // Из них попадания
+    int sunk[2]; // Сколько кораблей соперника потопил игрок
+    quint32 lastSequence; // Последняя запись журнала по этой игре
+
+    int slotOf(const QString &nickname) const
+    {
+        return nickname == players[0] ? 0 : nickname == players[1] ? 1 : -1;
+    }
+};
+
+// Соединение SQLite одного потока со своим кэшем подготовленных запросов.
+// Соединение основного потока создаётся в конструкторе, остальные (DbWorker) - при первом обращении из потока.
+struct DatabaseManager::Connection
+{
+    QSqlDatabase db;
+    QHash<const char*, QSqlQuery*> preparedQueries; // Текст запроса -> подготовленный запрос
+
+    ~Connection()
+    {
+        qDeleteAll(preparedQueries);
+        preparedQueries.clear();
+        QString name = db.connectionName();
+        db.close();
+        db = QSqlDatabase();
+        QSqlDatabase::removeDatabase(name);
+    }
+};
+
+DatabaseManager::DatabaseManager() : mainConnection(new Connection), journal(nullptr), archiver(nullptr), userDirectory(new UserDirectory),
+      loadedUserRowId(0), journalGamePool(nullptr)
 {
     if (!QSqlDatabase::drivers().contains("QSQLITE")) {
         qDebug() << "Error: SQLite driver not available!";
@@ -16,6 +132,7 @@ DatabaseManager::DatabaseManager()
         qDebug() << "SQLite driver is available.";
     }
 
+    QSqlDatabase &db = mainConnection->db;
     db = QSqlDatabase::addDatabase("QSQLITE");
     db.setDatabaseName("server_db.sqlite");
     db.setConnectOptions("QSQLITE_BUSY_TIMEOUT=1000"); // Устанавливаем тайм-аут 1 сек
@@ -25,73 +142,294 @@ DatabaseManager::DatabaseManager()
         qDebug() << "Error opening DB:" << db.lastError().text();
     } else {
         qDebug() << "Database connected successfully!";
-        QSqlQuery query(db);
-
-        bool success = query.exec("CREATE TABLE IF NOT EXISTS User ("
-                                  "nickname TEXT PRIMARY KEY, "
-                                  "email TEXT NOT NULL UNIQUE, "
-                                  "password TEXT NOT NULL, "
-                                  "connection_info TEXT)");
-        if (!success) {
-            qDebug() << "Error creating table User:" << query.lastError().text();
-        } else {
-            qDebug() << "Table User created or already exists.";
-        }
-
-        success = query.exec("CREATE TABLE IF NOT EXISTS Game ("
-                             "game_id INTEGER PRIMARY KEY AUTOINCREMENT, "
-                             "player1 TEXT NOT NULL, "
-                             "player2 TEXT NOT NULL, "
-                             "current_turn TEXT NOT NULL, "
-                             "FOREIGN KEY(player1) REFERENCES User(nickname), "
-                             "FOREIGN KEY(player2) REFERENCES User(nickname))");
-        if (!success) {
-            qDebug() << "Error creating table Game:" << query.lastError().text();
-        } else {
-            qDebug() << "Table Game created or already exists.";
-        }
-
-        success = query.exec("CREATE TABLE IF NOT EXISTS Ship ("
-                             "ship_id INTEGER PRIMARY KEY AUTOINCREMENT, "
-                             "game_id INTEGER NOT NULL, "
-                             "player TEXT NOT NULL, "
-                             "x INTEGER NOT NULL, "
-                             "y INTEGER NOT NULL, "
-                             "size INTEGER NOT NULL, "
-                             "is_horizontal INTEGER NOT NULL, "
-                             "FOREIGN KEY(game_id) REFERENCES Game(game_id), "
-                             "FOREIGN KEY(player) REFERENCES User(nickname))");
-        if (!success) {
-            qDebug() << "Error creating table Ship:" << query.lastError().text();
-        } else {
-            qDebug() << "Table Ship created or already exists.";
-        }
-
-        success = query.exec("CREATE TABLE IF NOT EXISTS Move ("
-                             "move_id INTEGER PRIMARY KEY AUTOINCREMENT, "
-                             "game_id INTEGER NOT NULL, "
-                             "player TEXT NOT NULL, "
-                             "x INTEGER NOT NULL, "
-                             "y INTEGER NOT NULL, "
-                             "result TEXT NOT NULL, "
-                             "FOREIGN KEY(game_id) REFERENCES Game(game_id), "
-                             "FOREIGN KEY(player) REFERENCES User(nickname))");
-        if (!success) {
-            qDebug() << "Error creating table Move:" << query.lastError().text();
-        } else {
-            qDebug() << "Table Move created or already exists.";
+    }
+}
+
+bool DatabaseManager::runMigrations()
+{
+    QMutexLocker locker(&mutex);
+    if (!database().isOpen()) {
+        qDebug() << "Database is not open!";
+        return false;
+    }
+
+    QSqlQuery query(database());
+
+    // Новый файл сразу создаётся с инкрементальной очисткой (режим задаётся до первой таблицы);
+    // у существующего файла прагма ничего не меняет - его переводит --enable-incremental-vacuum
+    query.exec("PRAGMA auto_vacuum = INCREMENTAL");
+
+    bool ok = true;
+    bool success = query.exec("CREATE TABLE IF NOT EXISTS User ("
+                              "nickname TEXT PRIMARY KEY, "
+                              "email TEXT NOT NULL UNIQUE, "
+                              "password TEXT NOT NULL, "
+                              "connection_info TEXT)");
+    ok = ok && success;
+    if (!success) {
+        qDebug() << "Error creating table User:" << query.lastError().text();
+    } else {
+        qDebug() << "Table User created or already exists.";
+    }
+
+    success = query.exec("CREATE TABLE IF NOT EXISTS Game ("
+                         "game_id INTEGER PRIMARY KEY AUTOINCREMENT, "
+                         "player1 TEXT NOT NULL, "
+                         "player2 TEXT NOT NULL, "
+                         "current_turn TEXT NOT NULL, "
+                         "FOREIGN KEY(player1) REFERENCES User(nickname), "
+                         "FOREIGN KEY(player2) REFERENCES User(nickname))");
+    ok = ok && success;
+    if (!success) {
+        qDebug() << "Error creating table Game:" << query.lastError().text();
+    } else {
+        qDebug() << "Table Game created or already exists.";
+    }
+
+    // Флот игрока - одна запись на игру: массив FleetShip (4 байта на корабль)
+    success = query.exec("CREATE TABLE IF NOT EXISTS Fleet ("
+                         "game_id INTEGER NOT NULL, "
+                         "player TEXT NOT NULL, "
+                         "ships BLOB NOT NULL, "
+                         "PRIMARY KEY(game_id, player), "
+                         "FOREIGN KEY(game_id) REFERENCES Game(game_id), "
+                         "FOREIGN KEY(player) REFERENCES User(nickname))");
+    ok = ok && success;
+    if (!success) {
+        qDebug() << "Error creating table Fleet:" << query.lastError().text();
+    } else {
+        qDebug() << "Table Fleet created or already exists.";
+    }
+
+    if (database().tables().contains("Ship")) {
+        ok = migrateShipRows() && ok;
+    }
+
+    success = query.exec("CREATE TABLE IF NOT EXISTS Move ("
+                         "move_id INTEGER PRIMARY KEY AUTOINCREMENT, "
+                         "game_id INTEGER NOT NULL, "
+                         "player TEXT NOT NULL, "
+                         "x INTEGER NOT NULL, "
+                         "y INTEGER NOT NULL, "
+                         "result TEXT NOT NULL, "
+                         "FOREIGN KEY(game_id) REFERENCES Game(game_id), "
+                         "FOREIGN KEY(player) REFERENCES User(nickname))");
+    ok = ok && success;
+    if (!success) {
+        qDebug() << "Error creating table Move:" << query.lastError().text();
+    } else {
+        qDebug() << "Table Move created or already exists.";
+    }
+
+    success = query.exec("CREATE TABLE IF NOT EXISTS Stats ("
+                         "nickname TEXT PRIMARY KEY, "
+                         "wins INTEGER NOT NULL DEFAULT 0, "
+                         "losses INTEGER NOT NULL DEFAULT 0, "
+                         "shots INTEGER NOT NULL DEFAULT 0, "
+                         "hits INTEGER NOT NULL DEFAULT 0, "
+                         "FOREIGN KEY(nickname) REFERENCES User(nickname))");
+    ok = ok && success;
+    if (!success) {
+        qDebug() << "Error creating table Stats:" << query.lastError().text();
+    } else {
+        qDebug() << "Table Stats created or already exists.";
+    }
+
+    // Последняя запись журнала ходов, перенесённая в таблицы (одна строка)
+    success = query.exec("CREATE TABLE IF NOT EXISTS JournalState ("
+                         "id INTEGER PRIMARY KEY CHECK (id = 1), "
+                         "applied_sequence INTEGER NOT NULL)");
+    ok = ok && success;
+    if (!success) {
+        qDebug() << "Error creating table JournalState:" << query.lastError().text();
+    } else {
+        qDebug() << "Table JournalState created or already exists.";
+    }
+
+    ok = migrateGameMode() && ok;
+    ok = migrateRetention() && ok;
+    ok = migrateTournaments() && ok;
+    ok = migrateStatsRevision() && ok;
+    return ok;
+}
+
+bool DatabaseManager::migrateGameMode()
+{
+    // Партии, созданные до появления режимов, - классические
+    if (database().record("Game").contains("mode")) {
+        return true;
+    }
+    QSqlQuery query(database());
+    if (!query.exec("ALTER TABLE Game ADD COLUMN mode TEXT NOT NULL DEFAULT 'classic'")) {
+        qDebug() << "Error adding Game.mode:" << query.lastError().text();
+        return false;
+    }
+    qDebug() << "Column Game.mode added.";
+    return true;
+}
+
+bool DatabaseManager::migrateRetention()
+{
+    QSqlQuery query(database());
+
+    // Оконченные партии помечаются временем окончания - по нему их забирает архиватор
+    if (!database().record("Game").contains("finished_at")) {
+        if (!query.exec("ALTER TABLE Game ADD COLUMN finished_at INTEGER")) {
+            qDebug() << "Error adding Game.finished_at:" << query.lastError().text();
+            return false;
+        }
+        qDebug() << "Column Game.finished_at added.";
+    }
+
+    // Частичный индекс: в нём только оконченные партии, вставка новых игр его не трогает
+    const char *const statements[] = {
+        "CREATE INDEX IF NOT EXISTS GameFinishedAt ON Game(finished_at) WHERE finished_at IS NOT NULL",
+        "CREATE INDEX IF NOT EXISTS MoveGame ON Move(game_id)",
+        // Где лежит перенесённая партия: номер игры -> файл архива
+        "CREATE TABLE IF NOT EXISTS ArchivedGame ("
+        "game_id INTEGER PRIMARY KEY, "
+        "archive TEXT NOT NULL)"
+    };
+    for (const char *sql : statements) {
+        if (!query.exec(sql)) {
+            qDebug() << "Error in retention migration:" << query.lastError().text() << "SQL:" << sql;
+            return false;
+        }
+    }
+
+    // Место, освобождённое архиватором, возвращается через PRAGMA incremental_vacuum - если файл в этом режиме.
+    // Полный VACUUM переписывает весь файл под исключительной блокировкой, поэтому при запуске его нет
+    if (query.exec("PRAGMA auto_vacuum") && query.next() && query.value(0).toInt() != 2) {
+        qDebug() << "Incremental vacuum is off: space freed by the archiver stays in the file"
+                 << "(run --enable-incremental-vacuum once with the server stopped)";
+    }
+    query.finish();
+    return true;
+}
+
+bool DatabaseManager::enableIncrementalVacuum()
+{
+    QMutexLocker locker(&mutex);
+    if (!database().isOpen()) {
+        qDebug() << "Database is not open!";
+        return false;
+    }
+    QSqlQuery query(database());
+    if (!query.exec("PRAGMA auto_vacuum") || !query.next()) {
+        qDebug() << "Error reading auto_vacuum:" << query.lastError().text();
+        return false;
+    }
+    int autoVacuum = query.value(0).toInt();
+    query.finish();
+    if (autoVacuum == 2) {
+        qDebug() << "Incremental vacuum is already enabled.";
+        return true;
+    }
+    // Режим существующего файла меняется только полным VACUUM
+    if (!query.exec("PRAGMA auto_vacuum = INCREMENTAL") || !query.exec("VACUUM")) {
+        qDebug() << "Error enabling incremental vacuum:" << query.lastError().text();
+        return false;
+    }
+    qDebug() << "Incremental vacuum enabled.";
+    return true;
+}
+
+bool DatabaseManager::migrateTournaments()
+{
+    QSqlQuery query(database());
+    // Матч тура - строка TournamentMatch; game_id NULL - свободный проход (winner задан сразу)
+    const char *const statements[] = {
+        "CREATE TABLE IF NOT EXISTS Tournament ("
+        "tournament_id INTEGER PRIMARY KEY AUTOINCREMENT, "
+        "format TEXT NOT NULL, "
+        "mode TEXT NOT NULL, "
+        "rounds INTEGER NOT NULL, "
+        "current_round INTEGER NOT NULL DEFAULT 0, "
+        "champion TEXT, "
+        "created_at INTEGER NOT NULL)",
+        "CREATE TABLE IF NOT EXISTS TournamentMatch ("
+        "tournament_id INTEGER NOT NULL, "
+        "round INTEGER NOT NULL, "
+        "slot INTEGER NOT NULL, "
+        "game_id INTEGER, "
+        "player1 TEXT NOT NULL, "
+        "player2 TEXT, "
+        "winner TEXT, "
+        "PRIMARY KEY(tournament_id, round, slot), "
+        "FOREIGN KEY(tournament_id) REFERENCES Tournament(tournament_id), "
+        "FOREIGN KEY(game_id) REFERENCES Game(game_id))",
+        "CREATE UNIQUE INDEX IF NOT EXISTS TournamentMatchGame ON TournamentMatch(game_id) WHERE game_id IS NOT NULL"
+    };
+    for (const char *sql : statements) {
+        if (!query.exec(sql)) {
+            qDebug() << "Error in tournament migration:" << query.lastError().text() << "SQL:" << sql;
+            return false;
+        }
+    }
+
+    // Шард, которому отдан матч; NULL - матч ждёт в очереди маршрутизатора свободного шарда
+    if (!database().record("TournamentMatch").contains("shard")) {
+        if (!query.exec("ALTER TABLE TournamentMatch ADD COLUMN shard INTEGER")) {
+            qDebug() << "Error adding TournamentMatch.shard:" << query.lastError().text();
+            return false;
         }
+        qDebug() << "Column TournamentMatch.shard added.";
     }
+    return true;
 }
 
 DatabaseManager::~DatabaseManager()
 {
-    if (db.isOpen()) {
-        db.close();
+    delete archiver;
+    archiver = nullptr;
+    delete journal;
+    journal = nullptr;
+    for (JournalGame *game : std::as_const(journalGames)) {
+        journalGamePool->destroy(game);
     }
+    journalGames.clear();
+    delete journalGamePool;
+    journalGamePool = nullptr;
+    delete userDirectory;
+    userDirectory = nullptr;
+    delete mainConnection;
+    mainConnection = nullptr;
     instance = nullptr;
 }
 
+QSqlDatabase &DatabaseManager::database() const
+{
+    return connection()->db;
+}
+
+DatabaseManager::Connection *DatabaseManager::connection() const
+{
+    if (QThread::currentThread() == thread()) {
+        return mainConnection;
+    }
+
+    // Рабочий поток: своё соединение с тем же файлом, закрывается при завершении потока
+    if (!threadConnections.hasLocalData()) {
+        static QAtomicInt connectionCounter;
+        Connection *threadConnection = new Connection;
+        threadConnection->db = QSqlDatabase::addDatabase("QSQLITE", QString("db_thread_%1").arg(connectionCounter.fetchAndAddRelaxed(1)));
+        threadConnection->db.setDatabaseName(mainConnection->db.databaseName());
+        threadConnection->db.setConnectOptions(mainConnection->db.connectOptions());
+        if (!threadConnection->db.open()) {
+            qDebug() << "Error opening DB in worker thread:" << threadConnection->db.lastError().text();
+        } else {
+            qDebug() << "Database connection" << threadConnection->db.connectionName() << "opened for a worker thread";
+        }
+        threadConnections.setLocalData(threadConnection);
+    }
+    return threadConnections.localData();
+}
+
+bool DatabaseManager::isJournaled() const
+{
+    return journal != nullptr;
+}
+
 DatabaseManager* DatabaseManager::getInstance()
 {
     if (!instance) {
@@ -102,19 +440,279 @@ DatabaseManager* DatabaseManager::getInstance()
 
 QSqlDatabase DatabaseManager::getDatabase()
 {
-    return db;
+    return database();
+}
+
+bool DatabaseManager::isOpen() const
+{
+    return database().isOpen();
+}
+
+bool DatabaseManager::prepareStatements()
+{
+    QMutexLocker locker(&mutex);
+    if (!database().isOpen()) {
+        qDebug() << "Database is not open!";
+        return false;
+    }
+
+    const char *const statements[] = {
+        SqlInsertUser, SqlSelectUser, SqlInsertGame, SqlSaveFleet, SqlInsertMove,
+        SqlSelectGame, SqlSelectGameMode, SqlSelectShot, SqlSelectFleet, SqlSelectMoves, SqlCountShipHits,
+        SqlSelectTurn, SqlUpdateTurn, SqlAdvanceTurn, SqlInsertStats, SqlUpdateStats, SqlSelectStats, SqlSelectStatsSince, SqlFinishGame,
+        SqlInsertTournamentMatch, SqlTournamentShard, SqlTournamentResult
+    };
+    bool ok = true;
+    for (const char *sql : statements) {
+        if (preparedQuery(sql).lastError().isValid()) {
+            ok = false;
+        }
+    }
+    qDebug() << "Prepared" << mainConnection->preparedQueries.size() << "statements";
+    return ok;
+}
+
+bool DatabaseManager::warmCache()
+{
+    QMutexLocker locker(&mutex);
+    if (!database().isOpen()) {
+        qDebug() << "Database is not open!";
+        return false;
+    }
+
+    // Проходим по таблицам и индексам горячего пути, чтобы их страницы попали в кэш SQLite и ОС
+    QSqlQuery query(database());
+    const char *const warmups[] = {
+        "SELECT COUNT(*) FROM User",
+        "SELECT COUNT(*) FROM Game",
+        "SELECT COUNT(*) FROM Fleet",
+        "SELECT COUNT(*) FROM Move",
+        "SELECT COUNT(*) FROM Stats"
+    };
+    for (const char *sql : warmups) {
+        if (!query.exec(sql)) {
+            qDebug() << "Error warming cache:" << query.lastError().text();
+            return false;
+        }
+    }
+    return true;
+}
+
+bool DatabaseManager::loadUsers()
+{
+    QMutexLocker locker(&mutex);
+    if (!database().isOpen()) {
+        qDebug() << "Database is not open!";
+        return false;
+    }
+
+    QSqlQuery query(database());
+    query.setForwardOnly(true);
+    if (!query.exec("SELECT COUNT(*) FROM User") || !query.next()) {
+        qDebug() << "Error counting users:" << query.lastError().text();
+        return false;
+    }
+    userDirectory->reset(query.value(0).toInt());
+    if (!query.exec("SELECT rowid, nickname, email, password FROM User")) {
+        qDebug() << "Error loading users:" << query.lastError().text();
+        return false;
+    }
+    while (query.next()) {
+        loadedUserRowId = qMax(loadedUserRowId, query.value(0).toLongLong());
+        userDirectory->insert(query.value(1).toString(), query.value(2).toString(), query.value(3).toString());
+    }
+    qDebug() << "User directory loaded:" << userDirectory->size() << "users";
+    return true;
+}
+
+bool DatabaseManager::loadNewUsers()
+{
+    QMutexLocker locker(&mutex);
+    if (!database().isOpen()) {
+        qDebug() << "Database is not open!";
+        return false;
+    }
+
+    // Справочник загружается до передачи сессий, а прежний процесс регистрирует игроков до самой передачи
+    QSqlQuery query(database());
+    query.setForwardOnly(true);
+    query.prepare("SELECT rowid, nickname, email, password FROM User WHERE rowid > :rowid");
+    query.bindValue(":rowid", loadedUserRowId);
+    if (!query.exec()) {
+        qDebug() << "Error loading new users:" << query.lastError().text();
+        return false;
+    }
+    int added = 0;
+    while (query.next()) {
+        loadedUserRowId = qMax(loadedUserRowId, query.value(0).toLongLong());
+        userDirectory->insert(query.value(1).toString(), query.value(2).toString(), query.value(3).toString());
+        ++added;
+    }
+    qDebug() << "User directory caught up:" << added << "users registered during startup";
+    return true;
+}
+
+QSqlQuery &DatabaseManager::preparedQuery(const char *sql)
+{
+    // Подготовленный запрос привязан к соединению - кэш у каждого потока свой
+    QHash<const char*, QSqlQuery*> &preparedQueries = connection()->preparedQueries;
+    QSqlQuery *query = preparedQueries.value(sql, nullptr);
+    if (!query) {
+        query = new QSqlQuery(database());
+        if (!query->prepare(QString::fromLatin1(sql))) {
+            qDebug() << "Error preparing statement:" << query->lastError().text() << "SQL:" << sql;
+        }
+        preparedQueries.insert(sql, query);
+    }
+    return *query;
+}
+
+bool DatabaseManager::openJournal(const QString &directory)
+{
+    QMutexLocker locker(&mutex);
+    if (!database().isOpen()) {
+        qDebug() << "Database is not open!";
+        return false;
+    }
+
+    // Состояния игр журнала - из пула: слотов хватает на JOURNAL_GAME_POOL одновременных партий (по умолчанию 256)
+    if (!journalGamePool) {
+        int poolSize = qEnvironmentVariableIntValue("JOURNAL_GAME_POOL");
+        journalGamePool = new ObjectPool<JournalGame>(poolSize > 0 ? poolSize : 256);
+    }
+
+    MoveJournal *newJournal = new MoveJournal(directory, database().databaseName(), this);
+    if (!newJournal->replay(database()) || !newJournal->open()) {
+        qDebug() << "Error opening move journal in" << directory;
+        delete newJournal;
+        return false;
+    }
+    connect(newJournal, &MoveJournal::segmentCompacted, this, &DatabaseManager::slotJournalCompacted);
+    journal = newJournal;
+    return true;
+}
+
+QJsonObject DatabaseManager::journalStats() const
+{
+    if (!journal) {
+        return QJsonObject();
+    }
+    QJsonObject stats = journal->stats();
+    stats["game_pool"] = journalGamePool->stats();
+    return stats;
+}
+
+bool DatabaseManager::startArchiver(const QString &directory)
+{
+    QMutexLocker locker(&mutex);
+    if (!database().isOpen()) {
+        qDebug() << "Database is not open!";
+        return false;
+    }
+
+    GameArchiver *newArchiver = new GameArchiver(directory, database().databaseName(), this);
+    if (!newArchiver->start()) {
+        qDebug() << "Error starting game archiver in" << directory;
+        delete newArchiver;
+        return false;
+    }
+    archiver = newArchiver;
+    return true;
+}
+
+QJsonObject DatabaseManager::archiveStats() const
+{
+    return archiver ? archiver->stats() : QJsonObject();
+}
+
+void DatabaseManager::slotJournalCompacted(quint32 lastSequence)
+{
+    StallDetector::DbScope stallScope("slotJournalCompacted");
+    QMutexLocker locker(&mutex);
+    // Игры, все записи которых уже в SQLite, при следующем обращении читаются из БД заново
+    for (auto it = journalGames.begin(); it != journalGames.end();) {
+        if (it.value()->lastSequence <= lastSequence) {
+            journalGamePool->destroy(it.value());
+            it = journalGames.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
+
+DatabaseManager::JournalGame *DatabaseManager::journalGame(int gameId)
+{
+    JournalGame *game = journalGames.value(gameId, nullptr);
+    if (game) {
+        return game;
+    }
+
+    QSqlQuery &gameQuery = preparedQuery(SqlSelectGame);
+    gameQuery.bindValue(":game_id", gameId);
+    if (!gameQuery.exec() || !gameQuery.next()) {
+        qDebug() << "Error fetching game" << gameId << ":" << gameQuery.lastError().text();
+        return nullptr;
+    }
+    game = journalGamePool->create();
+    game->players[0] = gameQuery.value(0).toString();
+    game->players[1] = gameQuery.value(1).toString();
+    game->turn = game->slotOf(gameQuery.value(2).toString());
+    game->mode = &gameModeByName(gameQuery.value(3).toString());
+    game->sunk[0] = game->sunk[1] = 0;
+    game->lastSequence = 0;
+    gameQuery.finish();
+
+    for (int slot = 0; slot < 2; ++slot) {
+        bool ok = false;
+        game->fleets[slot] = loadFleet(gameId, game->players[slot], &ok);
+        if (!ok) {
+            journalGamePool->destroy(game);
+            return nullptr;
+        }
+        for (const FleetShip &ship : game->fleets[slot]) {
+            game->mode->markShip(game->fleetCells[slot], ship);
+        }
+    }
+
+    QSqlQuery &movesQuery = preparedQuery(SqlSelectMoves);
+    movesQuery.bindValue(":game_id", gameId);
+    if (!movesQuery.exec()) {
+        qDebug() << "Error fetching moves:" << movesQuery.lastError().text();
+        journalGamePool->destroy(game);
+        return nullptr;
+    }
+    while (movesQuery.next()) {
+        int slot = game->slotOf(movesQuery.value(0).toString());
+        int x = movesQuery.value(1).toInt();
+        int y = movesQuery.value(2).toInt();
+        if (slot < 0 || !game->mode->contains(x, y)) {
+            continue;
+        }
+        game->mode->markCell(game->shots[slot], x, y);
+        MoveResult::Status status = MoveResult::statusFromString(movesQuery.value(3).toString());
+        if (status != MoveResult::Miss) {
+            game->mode->markCell(game->hits[slot], x, y);
+        }
+        if (status == MoveResult::Sunk) {
+            ++game->sunk[slot];
+        }
+    }
+    movesQuery.finish();
+
+    journalGames.insert(gameId, game);
+    return game;
 }
 
 bool DatabaseManager::addUser(const QString &nickname, const QString &email, const QString &password)
 {
+    StallDetector::DbScope stallScope("addUser");
     QMutexLocker locker(&mutex);
-    if (!db.isOpen()) {
+    if (!database().isOpen()) {
         qDebug() << "Database is not open!";
         return false;
     }
 
-    QSqlQuery query(db);
-    query.prepare("INSERT INTO User (nickname, email, password, connection_info) VALUES (:nickname, :email, :password, :connection_info)");
+    QSqlQuery &query = preparedQuery(SqlInsertUser);
     query.bindValue(":nickname", nickname);
     query.bindValue(":email", email);
     query.bindValue(":password", password);
@@ -124,16 +722,69 @@ bool DatabaseManager::addUser(const QString &nickname, const QString &email, con
 
     if (!query.exec()) {
         qDebug() << "Error adding user:" << query.lastError().text();
+        // Шарды работают с одним файлом БД: ник или e-mail мог занять другой процесс уже после загрузки справочника.
+        // Занявшие их строки попадают в справочник, и isUserTaken после отказа отвечает верно
+        QSqlQuery &conflict = preparedQuery(SqlSelectUserConflict);
+        conflict.bindValue(":nickname", nickname);
+        conflict.bindValue(":email", email);
+        if (conflict.exec()) {
+            while (conflict.next()) {
+                userDirectory->insert(conflict.value(0).toString(), conflict.value(1).toString(), conflict.value(2).toString());
+            }
+        }
+        conflict.finish();
         return false;
     }
+    userDirectory->insert(nickname, email, password);
     qDebug() << "User added successfully.";
     return true;
 }
 
+bool DatabaseManager::isUserTaken(const QString &nickname, const QString &email) const
+{
+    return userDirectory->isTaken(nickname, email);
+}
+
+bool DatabaseManager::isKnownUser(const QString &nickname) const
+{
+    return userDirectory->containsNickname(nickname);
+}
+
+bool DatabaseManager::checkLogin(const QString &nickname, const QString &password)
+{
+    if (userDirectory->containsNickname(nickname)) {
+        return userDirectory->checkPassword(nickname, password);
+    }
+
+    // Шарды работают с одним файлом БД: пользователь мог зарегистрироваться через другой процесс
+    StallDetector::DbScope stallScope("checkLogin");
+    QMutexLocker locker(&mutex);
+    if (!database().isOpen()) {
+        qDebug() << "Database is not open!";
+        return false;
+    }
+    QSqlQuery &query = preparedQuery(SqlSelectUser);
+    query.bindValue(":nickname", nickname);
+    if (!query.exec() || !query.next()) {
+        query.finish();
+        return false;
+    }
+    QString email = query.value(0).toString();
+    QString storedPassword = query.value(1).toString();
+    query.finish();
+    userDirectory->insert(nickname, email, storedPassword);
+    return storedPassword == password;
+}
+
+QJsonObject DatabaseManager::userStats() const
+{
+    return userDirectory->stats();
+}
+
 void DatabaseManager::printUsers()
 {
     QMutexLocker locker(&mutex);
-    QSqlQuery query(db);
+    QSqlQuery query(database());
     if (!query.exec("SELECT * FROM User")) {
         qDebug() << "Error fetching users:" << query.lastError().text();
         return;
@@ -146,180 +797,541 @@ void DatabaseManager::printUsers()
     }
 }
 
-int DatabaseManager::createGame(const QString &player1, const QString &player2)
+int DatabaseManager::createGame(const QString &player1, const QString &player2, const GameMode &mode)
+{
+    StallDetector::DbScope stallScope("createGame");
+    QMutexLocker locker(&mutex);
+    if (!database().isOpen()) {
+        qDebug() << "Database is not open!";
+        return -1;
+    }
+
+    int gameId = insertGame(player1, player2, mode);
+    if (gameId != -1) {
+        qDebug() << "Game created with ID:" << gameId << "between" << player1 << "and" << player2 << "mode" << mode.name;
+    }
+    return gameId;
+}
+
+int DatabaseManager::insertGame(const QString &player1, const QString &player2, const GameMode &mode)
+{
+    QSqlQuery &query = preparedQuery(SqlInsertGame);
+    query.bindValue(":player1", player1);
+    query.bindValue(":player2", player2);
+    query.bindValue(":current_turn", player1);
+    query.bindValue(":mode", QString(mode.name));
+
+    if (!query.exec()) {
+        qDebug() << "Error creating game:" << query.lastError().text();
+        return -1;
+    }
+
+    QVariant insertedId = query.lastInsertId();
+    return insertedId.isValid() ? insertedId.toInt() : -1;
+}
+
+int DatabaseManager::createTournament(const QString &format, const GameMode &mode, int rounds)
+{
+    QMutexLocker locker(&mutex);
+    if (!database().isOpen()) {
+        qDebug() << "Database is not open!";
+        return -1;
+    }
+
+    QSqlQuery query(database());
+    query.prepare("INSERT INTO Tournament (format, mode, rounds, created_at) VALUES (:format, :mode, :rounds, :created_at)");
+    query.bindValue(":format", format);
+    query.bindValue(":mode", QString(mode.name));
+    query.bindValue(":rounds", rounds);
+    query.bindValue(":created_at", QDateTime::currentSecsSinceEpoch());
+    if (!query.exec()) {
+        qDebug() << "Error creating tournament:" << query.lastError().text();
+        return -1;
+    }
+    QVariant insertedId = query.lastInsertId();
+    return insertedId.isValid() ? insertedId.toInt() : -1;
+}
+
+QVector<int> DatabaseManager::createTournamentRound(int tournamentId, int round, const QVector<QPair<QString, QString>> &pairs,
+                                                   const GameMode &mode)
+{
+    StallDetector::DbScope stallScope("createTournamentRound");
+    QMutexLocker locker(&mutex);
+    if (!database().isOpen()) {
+        qDebug() << "Database is not open!";
+        return QVector<int>();
+    }
+
+    // Весь тур - одна транзакция: партии создаются вместе со строками матчей или не создаются вовсе
+    if (!database().transaction()) {
+        qDebug() << "Failed to start transaction in createTournamentRound:" << database().lastError().text();
+        return QVector<int>();
+    }
+
+    QVector<int> gameIds;
+    gameIds.reserve(pairs.size());
+    QSqlQuery &matchQuery = preparedQuery(SqlInsertTournamentMatch);
+    for (int slot = 0; slot < pairs.size(); ++slot) {
+        const QPair<QString, QString> &pair = pairs[slot];
+        bool bye = pair.second.isEmpty();
+        int gameId = bye ? -1 : insertGame(pair.first, pair.second, mode);
+        if (!bye && gameId == -1) {
+            database().rollback();
+            return QVector<int>();
+        }
+        matchQuery.bindValue(":tournament_id", tournamentId);
+        matchQuery.bindValue(":round", round);
+        matchQuery.bindValue(":slot", slot);
+        matchQuery.bindValue(":game_id", bye ? QVariant() : QVariant(gameId));
+        matchQuery.bindValue(":player1", pair.first);
+        matchQuery.bindValue(":player2", bye ? QVariant() : QVariant(pair.second));
+        matchQuery.bindValue(":winner", bye ? QVariant(pair.first) : QVariant());
+        if (!matchQuery.exec()) {
+            qDebug() << "Error saving tournament match:" << matchQuery.lastError().text();
+            database().rollback();
+            return QVector<int>();
+        }
+        gameIds.append(gameId);
+    }
+
+    QSqlQuery roundQuery(database());
+    roundQuery.prepare("UPDATE Tournament SET current_round = :round WHERE tournament_id = :tournament_id");
+    roundQuery.bindValue(":round", round);
+    roundQuery.bindValue(":tournament_id", tournamentId);
+    if (!roundQuery.exec() || !database().commit()) {
+        qDebug() << "Failed to commit tournament round:" << database().lastError().text();
+        database().rollback();
+        return QVector<int>();
+    }
+    qDebug() << "Tournament" << tournamentId << "round" << round << "created:" << pairs.size() << "matches";
+    return gameIds;
+}
+
+bool DatabaseManager::assignTournamentMatch(int gameId, int shard)
+{
+    StallDetector::DbScope stallScope("assignTournamentMatch");
+    QMutexLocker locker(&mutex);
+    if (!database().isOpen()) {
+        qDebug() << "Database is not open!";
+        return false;
+    }
+    QSqlQuery &query = preparedQuery(SqlTournamentShard);
+    query.bindValue(":shard", shard);
+    query.bindValue(":game_id", gameId);
+    if (!query.exec()) {
+        qDebug() << "Error saving tournament match shard:" << query.lastError().text();
+        return false;
+    }
+    return true;
+}
+
+bool DatabaseManager::recordTournamentResult(int gameId, const QString &winner)
+{
+    StallDetector::DbScope stallScope("recordTournamentResult");
+    QMutexLocker locker(&mutex);
+    if (!database().isOpen()) {
+        qDebug() << "Database is not open!";
+        return false;
+    }
+    QSqlQuery &query = preparedQuery(SqlTournamentResult);
+    query.bindValue(":winner", winner);
+    query.bindValue(":game_id", gameId);
+    if (!query.exec()) {
+        qDebug() << "Error saving tournament result:" << query.lastError().text();
+        return false;
+    }
+    return query.numRowsAffected() == 1;
+}
+
+bool DatabaseManager::finishTournament(int tournamentId, const QString &champion)
+{
+    QMutexLocker locker(&mutex);
+    QSqlQuery query(database());
+    query.prepare("UPDATE Tournament SET champion = :champion WHERE tournament_id = :tournament_id");
+    query.bindValue(":champion", champion);
+    query.bindValue(":tournament_id", tournamentId);
+    if (!query.exec()) {
+        qDebug() << "Error finishing tournament:" << query.lastError().text();
+        return false;
+    }
+    return true;
+}
+
+QJsonObject DatabaseManager::tournamentStatus(int tournamentId)
 {
+    StallDetector::DbScope stallScope("tournamentStatus");
     QMutexLocker locker(&mutex);
-    if (!db.isOpen()) {
-        qDebug() << "Database is not open!";
-        return -1;
+    QJsonObject status;
+    if (!database().isOpen()) {
+        return status;
     }
 
-    QSqlQuery query(db);
-    query.prepare("INSERT INTO Game (player1, player2, current_turn) VALUES (:player1, :player2, :current_turn)");
-    query.bindValue(":player1", player1);
-    query.bindValue(":player2", player2);
-    query.bindValue(":current_turn", player1);
+    QSqlQuery query(database());
+    query.prepare("SELECT format, mode, rounds, current_round, champion FROM Tournament WHERE tournament_id = :tournament_id");
+    query.bindValue(":tournament_id", tournamentId);
+    if (!query.exec() || !query.next()) {
+        return status;
+    }
+    int currentRound = query.value(3).toInt();
+    status["tournament_id"] = tournamentId;
+    status["format"] = query.value(0).toString();
+    status["mode"] = query.value(1).toString();
+    status["rounds"] = query.value(2).toInt();
+    status["round"] = currentRound;
+    status["champion"] = query.value(4).toString();
 
+    // Матчи текущего тура: кто с кем, номер партии, шард (-1 - ждёт свободного шарда) и итог (пусто - партия идёт)
+    query.prepare("SELECT game_id, player1, player2, winner, shard FROM TournamentMatch "
+                  "WHERE tournament_id = :tournament_id AND round = :round ORDER BY slot");
+    query.bindValue(":tournament_id", tournamentId);
+    query.bindValue(":round", currentRound);
     if (!query.exec()) {
-        qDebug() << "Error creating game:" << query.lastError().text();
-        return -1;
+        qDebug() << "Error reading tournament matches:" << query.lastError().text();
+        return status;
     }
-
-    query.exec("SELECT last_insert_rowid()");
-    if (query.next()) {
-        int gameId = query.value(0).toInt();
-        qDebug() << "Game created with ID:" << gameId << "between" << player1 << "and" << player2;
-        return gameId;
+    QJsonArray matches;
+    int finished = 0;
+    int queued = 0;
+    while (query.next()) {
+        QJsonObject match;
+        match["game_id"] = query.value(0).isNull() ? -1 : query.value(0).toInt();
+        match["player1"] = query.value(1).toString();
+        match["player2"] = query.value(2).toString();
+        match["winner"] = query.value(3).toString();
+        match["shard"] = query.value(4).isNull() ? -1 : query.value(4).toInt();
+        finished += query.value(3).isNull() ? 0 : 1;
+        queued += query.value(3).isNull() && query.value(4).isNull() ? 1 : 0;
+        matches.append(match);
     }
-    return -1;
+    status["matches"] = matches;
+    status["finished"] = finished;
+    // В шарде одно лобби: одновременно идёт не больше партий, чем шардов, остальные ждут здесь
+    status["queued"] = queued;
+    return status;
 }
 
-bool DatabaseManager::saveShip(int gameId, const QString &player, int x, int y, int size, bool isHorizontal)
+bool DatabaseManager::saveShip(int gameId, const QString &player, int x, int y, int size, bool isHorizontal, QString *error)
 {
+    StallDetector::DbScope stallScope("saveShip");
     QMutexLocker locker(&mutex);
-    if (!db.isOpen()) {
+    if (!database().isOpen()) {
         qDebug() << "Database is not open!";
         return false;
     }
 
-    QSqlQuery query(db);
-    query.prepare("INSERT INTO Ship (game_id, player, x, y, size, is_horizontal) VALUES (:game_id, :player, :x, :y, :size, :is_horizontal)");
+    if (journal) {
+        JournalGame *game = journalGame(gameId);
+        int slot = game ? game->slotOf(player) : -1;
+        if (slot < 0) {
+            qDebug() << "Error saving ship: game" << gameId << "not found or" << player << "is not in it";
+            return false;
+        }
+        FleetShip ship{quint8(x), quint8(y), quint8(size), quint8(isHorizontal ? 1 : 0)};
+        GameMode::Placement placement = game->mode->checkPlacement(*game->mode, game->fleets[slot], ship);
+        if (placement != GameMode::PlacementOk) {
+            qDebug() << "Ship rejected for" << player << "in game" << gameId << ":" << GameMode::placementError(placement);
+            if (error) {
+                *error = GameMode::placementError(placement);
+            }
+            return false;
+        }
+        JournalRecord record = {};
+        record.gameId = gameId;
+        record.type = JournalRecord::Ship;
+        record.player = quint8(slot);
+        record.x = quint8(x);
+        record.y = quint8(y);
+        record.size = quint8(size);
+        record.value = isHorizontal ? 1 : 0;
+        if (!journal->append(record)) {
+            return false;
+        }
+        game->fleets[slot].append(ship);
+        game->mode->markShip(game->fleetCells[slot], ship);
+        game->lastSequence = journal->lastSequence();
+        return true;
+    }
+
+    // Корабль дописывается в упакованную запись флота игрока
+    if (!database().transaction()) {
+        qDebug() << "Failed to start transaction in saveShip:" << database().lastError().text();
+        return false;
+    }
+
+    QSqlQuery &selectQuery = preparedQuery(SqlSelectFleet);
+    selectQuery.bindValue(":game_id", gameId);
+    selectQuery.bindValue(":player", player);
+    if (!selectQuery.exec()) {
+        qDebug() << "Error fetching fleet:" << selectQuery.lastError().text();
+        database().rollback();
+        return false;
+    }
+    QByteArray ships = selectQuery.next() ? selectQuery.value(0).toByteArray() : QByteArray();
+    selectQuery.finish();
+
+    // Правила флота - по режиму партии
+    QSqlQuery &modeQuery = preparedQuery(SqlSelectGameMode);
+    modeQuery.bindValue(":game_id", gameId);
+    if (!modeQuery.exec() || !modeQuery.next()) {
+        qDebug() << "Error fetching game mode:" << modeQuery.lastError().text();
+        database().rollback();
+        return false;
+    }
+    const GameMode &mode = gameModeByName(modeQuery.value(0).toString());
+    modeQuery.finish();
+    FleetShip ship{quint8(x), quint8(y), quint8(size), quint8(isHorizontal ? 1 : 0)};
+    GameMode::Placement placement = mode.checkPlacement(mode, decodeFleet(ships), ship);
+    if (placement != GameMode::PlacementOk) {
+        qDebug() << "Ship rejected for" << player << "in game" << gameId << ":" << GameMode::placementError(placement);
+        if (error) {
+            *error = GameMode::placementError(placement);
+        }
+        database().rollback();
+        return false;
+    }
+    ships.append(encodeShip(x, y, size, isHorizontal));
+
+    QSqlQuery &query = preparedQuery(SqlSaveFleet);
     query.bindValue(":game_id", gameId);
     query.bindValue(":player", player);
-    query.bindValue(":x", x);
-    query.bindValue(":y", y);
-    query.bindValue(":size", size);
-    query.bindValue(":is_horizontal", isHorizontal ? 1 : 0);
-
+    query.bindValue(":ships", ships);
     if (!query.exec()) {
         qDebug() << "Error saving ship:" << query.lastError().text();
+        database().rollback();
+        return false;
+    }
+
+    if (!database().commit()) {
+        qDebug() << "Failed to commit transaction in saveShip:" << database().lastError().text();
+        database().rollback();
         return false;
     }
     qDebug() << "Ship saved for player" << player << "in game" << gameId;
     return true;
 }
 
-bool DatabaseManager::saveMove(int gameId, const QString &player, int x, int y, const QString &result)
+QByteArray DatabaseManager::encodeShip(int x, int y, int size, bool isHorizontal)
 {
-    // Мьютекс уже заблокирован в вызывающей функции (checkMove), поэтому здесь не блокируем
-    if (!db.isOpen()) {
-        qDebug() << "Database is not open in saveMove!";
-        return false;
-    }
+    FleetShip ship{quint8(x), quint8(y), quint8(size), quint8(isHorizontal ? 1 : 0)};
+    return QByteArray(reinterpret_cast<const char*>(&ship), sizeof(ship));
+}
 
-    qDebug() << "Starting saveMove for player" << player << "in game" << gameId << "at (" << x << "," << y << ") with result:" << result;
+QVector<FleetShip> DatabaseManager::decodeFleet(const QByteArray &blob)
+{
+    QVector<FleetShip> fleet(blob.size() / int(sizeof(FleetShip)));
+    if (!fleet.isEmpty()) {
+        memcpy(fleet.data(), blob.constData(), fleet.size() * sizeof(FleetShip));
+    }
+    return fleet;
+}
 
-    QSqlQuery query(db);
-    query.prepare("INSERT INTO Move (game_id, player, x, y, result) VALUES (:game_id, :player, :x, :y, :result)");
+QVector<FleetShip> DatabaseManager::loadFleet(int gameId, const QString &player, bool *ok)
+{
+    QSqlQuery &query = preparedQuery(SqlSelectFleet);
     query.bindValue(":game_id", gameId);
     query.bindValue(":player", player);
-    query.bindValue(":x", x);
-    query.bindValue(":y", y);
-    query.bindValue(":result", result);
-
-    qDebug() << "SQL query:" << query.lastQuery();
-    qDebug() << "Bound values:" << query.boundValues();
+    *ok = query.exec();
+    if (!*ok) {
+        qDebug() << "Error fetching fleet:" << query.lastError().text();
+        return QVector<FleetShip>();
+    }
+    QVector<FleetShip> fleet = query.next() ? decodeFleet(query.value(0).toByteArray()) : QVector<FleetShip>();
+    query.finish();
+    return fleet;
+}
 
-    try {
-        if (!query.exec()) {
-            qDebug() << "Error saving move:" << query.lastError().text();
+bool DatabaseManager::migrateStatsRevision()
+{
+    QSqlQuery query(database());
+    // Строки, записанные до появления ревизий, получают 0 и читаются только полной загрузкой
+    if (!database().record("Stats").contains("revision")) {
+        if (!query.exec("ALTER TABLE Stats ADD COLUMN revision INTEGER NOT NULL DEFAULT 0")) {
+            qDebug() << "Error adding Stats.revision:" << query.lastError().text();
             return false;
         }
-    } catch (const std::exception &e) {
-        qDebug() << "Exception in saveMove:" << e.what();
+        qDebug() << "Column Stats.revision added.";
+    }
+    if (!query.exec("CREATE INDEX IF NOT EXISTS StatsRevision ON Stats(revision)")) {
+        qDebug() << "Error creating index StatsRevision:" << query.lastError().text();
         return false;
     }
+    return true;
+}
+
+bool DatabaseManager::migrateShipRows()
+{
+    if (!database().transaction()) {
+        qDebug() << "Failed to start transaction in migrateShipRows:" << database().lastError().text();
+        return false;
+    }
+
+    QSqlQuery query(database());
+    query.setForwardOnly(true);
+    if (!query.exec("SELECT game_id, player, x, y, size, is_horizontal FROM Ship ORDER BY game_id, player, ship_id")) {
+        qDebug() << "Error reading Ship rows:" << query.lastError().text();
+        database().rollback();
+        return false;
+    }
+    QMap<QPair<int, QString>, QByteArray> fleets;
+    int rows = 0;
+    while (query.next()) {
+        fleets[qMakePair(query.value(0).toInt(), query.value(1).toString())]
+            .append(encodeShip(query.value(2).toInt(), query.value(3).toInt(), query.value(4).toInt(), query.value(5).toBool()));
+        ++rows;
+    }
+    query.finish();
+
+    QSqlQuery insertQuery(database());
+    insertQuery.prepare(SqlSaveFleet);
+    for (auto it = fleets.constBegin(); it != fleets.constEnd(); ++it) {
+        insertQuery.bindValue(":game_id", it.key().first);
+        insertQuery.bindValue(":player", it.key().second);
+        insertQuery.bindValue(":ships", it.value());
+        if (!insertQuery.exec()) {
+            qDebug() << "Error migrating fleet:" << insertQuery.lastError().text();
+            database().rollback();
+            return false;
+        }
+    }
 
-    qDebug() << "Move saved: Player" << player << "in game" << gameId << "at (" << x << "," << y << ") - Result:" << result;
+    if (!query.exec("DROP TABLE Ship") || !database().commit()) {
+        qDebug() << "Error finishing Ship migration:" << query.lastError().text() << database().lastError().text();
+        database().rollback();
+        return false;
+    }
+    qDebug() << "Migrated" << rows << "Ship rows into" << fleets.size() << "Fleet records";
     return true;
 }
 
-QString DatabaseManager::checkMove(int gameId, const QString &player, int x, int y)
+QString MoveResult::resultString() const
+{
+    return statusString(status);
+}
+
+QString MoveResult::statusString(Status status)
+{
+    switch (status) {
+    case Miss:
+        return "miss";
+    case Hit:
+        return "hit";
+    case Sunk:
+        return "sunk";
+    case AlreadyShot:
+        return "already_shot";
+    case NotYourTurn:
+        return "not_your_turn";
+    default:
+        return "error";
+    }
+}
+
+MoveResult::Status MoveResult::statusFromString(const QString &result)
+{
+    return result == "sunk" ? Sunk : result == "hit" ? Hit : Miss;
+}
+
+MoveResult DatabaseManager::applyMove(int gameId, const QString &player, int x, int y)
 {
+    StallDetector::DbScope stallScope("applyMove");
+    MoveResult moveResult;
+    moveResult.status = MoveResult::Error;
+
+    // Стадии транзакции хода для трассировки; первая - ожидание мьютекса БД
+    Tracer::StageSpan stage("lock_wait", "db");
     QMutexLocker locker(&mutex);
-    if (!db.isOpen()) {
+    stage.next("begin");
+    if (!database().isOpen()) {
         qDebug() << "Database is not open!";
-        return "error";
+        return moveResult;
     }
 
-    qDebug() << "Starting checkMove for player" << player << "in game" << gameId << "at (" << x << "," << y << ")";
+    qDebug() << "Starting applyMove for player" << player << "in game" << gameId << "at (" << x << "," << y << ")";
 
-    if (!db.transaction()) {
-        qDebug() << "Failed to start transaction in checkMove:" << db.lastError().text();
-        return "error";
+    if (journal) {
+        return applyJournaledMove(gameId, player, x, y);
     }
 
-    // Получаем оппонента
-    QSqlQuery gameQuery(db);
-    gameQuery.prepare("SELECT player1, player2 FROM Game WHERE game_id = :game_id");
+    if (!database().transaction()) {
+        qDebug() << "Failed to start transaction in applyMove:" << database().lastError().text();
+        return moveResult;
+    }
+
+    // Игроки и текущий ход - одной строкой Game
+    stage.next("select_game");
+    QSqlQuery &gameQuery = preparedQuery(SqlSelectGame);
     gameQuery.bindValue(":game_id", gameId);
     if (!gameQuery.exec() || !gameQuery.next()) {
         qDebug() << "Error fetching game:" << gameQuery.lastError().text();
-        db.rollback();
-        return "error";
+        database().rollback();
+        return moveResult;
+    }
+
+    QString player1 = gameQuery.value(0).toString();
+    QString player2 = gameQuery.value(1).toString();
+    QString currentTurn = gameQuery.value(2).toString();
+    const GameMode &mode = gameModeByName(gameQuery.value(3).toString());
+    gameQuery.finish();
+    moveResult.opponent = (player == player1) ? player2 : player1;
+    moveResult.nextTurn = currentTurn;
+
+    if (!mode.contains(x, y)) {
+        qDebug() << "Move rejected: (" << x << "," << y << ") is outside the" << mode.boardSize << "board";
+        database().rollback();
+        return moveResult;
     }
 
-    QString player1 = gameQuery.value("player1").toString();
-    QString player2 = gameQuery.value("player2").toString();
-    QString opponent = (player == player1) ? player2 : player1;
-    qDebug() << "Opponent for" << player << "is" << opponent;
+    if (currentTurn != player) {
+        qDebug() << "Move rejected: not" << player << "'s turn, current turn is" << currentTurn;
+        database().rollback();
+        moveResult.status = MoveResult::NotYourTurn;
+        return moveResult;
+    }
 
     // Проверяем, не стреляли ли уже в эту клетку
-    QSqlQuery moveQuery(db);
-    moveQuery.prepare("SELECT result FROM Move WHERE game_id = :game_id AND player = :player AND x = :x AND y = :y");
+    stage.next("select_shot");
+    QSqlQuery &moveQuery = preparedQuery(SqlSelectShot);
     moveQuery.bindValue(":game_id", gameId);
     moveQuery.bindValue(":player", player);
     moveQuery.bindValue(":x", x);
     moveQuery.bindValue(":y", y);
     if (moveQuery.exec() && moveQuery.next()) {
         qDebug() << "Cell (" << x << "," << y << ") already shot by" << player;
-        db.commit();
-        return "already_shot";
+        moveQuery.finish();
+        database().rollback();
+        moveResult.status = MoveResult::AlreadyShot;
+        return moveResult;
     }
+    moveQuery.finish();
 
-    // Проверяем, есть ли корабль оппонента в этой клетке
-    QSqlQuery shipQuery(db);
-    shipQuery.prepare("SELECT ship_id, x, y, size, is_horizontal FROM Ship WHERE game_id = :game_id AND player = :player");
-    shipQuery.bindValue(":game_id", gameId);
-    shipQuery.bindValue(":player", opponent);
-    if (!shipQuery.exec()) {
-        qDebug() << "Error fetching ships:" << shipQuery.lastError().text();
-        db.rollback();
-        return "error";
+    // Проверяем, есть ли корабль оппонента в этой клетке (флот - одна запись)
+    stage.next("load_fleet");
+    bool fleetOk = false;
+    const QVector<FleetShip> fleet = loadFleet(gameId, moveResult.opponent, &fleetOk);
+    if (!fleetOk) {
+        database().rollback();
+        return moveResult;
     }
 
     bool hit = false;
-    int shipId = -1;
     int shipSize = 0;
     int shipX = 0, shipY = 0;
     bool isHorizontal = false;
-    while (shipQuery.next()) {
-        shipX = shipQuery.value(1).toInt();
-        shipY = shipQuery.value(2).toInt();
-        shipSize = shipQuery.value(3).toInt();
-        isHorizontal = shipQuery.value(4).toBool();
-        shipId = shipQuery.value(0).toInt();
-        qDebug() << "Checking ship: id=" << shipId << ", x=" << shipX << ", y=" << shipY << ", size=" << shipSize << ", is_horizontal=" << isHorizontal;
-
-        if (isHorizontal) {
-            if (y == shipY && x >= shipX && x < shipX + shipSize) {
-                hit = true;
-                break;
-            }
-        } else {
-            if (x == shipX && y >= shipY && y < shipY + shipSize) {
-                hit = true;
-                break;
-            }
+    for (const FleetShip &ship : fleet) {
+        if (ship.covers(x, y)) {
+            hit = true;
+            shipX = ship.x;
+            shipY = ship.y;
+            shipSize = ship.size;
+            isHorizontal = ship.isHorizontal;
+            break;
         }
     }
 
-    QString result;
+    moveResult.status = MoveResult::Miss;
     if (hit) {
-        QSqlQuery hitQuery(db);
-        hitQuery.prepare("SELECT COUNT(*) FROM Move WHERE game_id = :game_id AND player = :player AND result IN ('hit', 'sunk') AND "
-                         "(x >= :ship_x AND x < :ship_x + :size AND y = :ship_y AND :is_horizontal = 1 OR "
-                         "y >= :ship_y AND y < :ship_y + :size AND x = :ship_x AND :is_horizontal = 0)");
+        stage.next("count_hits");
+        QSqlQuery &hitQuery = preparedQuery(SqlCountShipHits);
         hitQuery.bindValue(":game_id", gameId);
         hitQuery.bindValue(":player", player);
         hitQuery.bindValue(":ship_x", shipX);
@@ -328,84 +1340,393 @@ QString DatabaseManager::checkMove(int gameId, const QString &player, int x, int
         hitQuery.bindValue(":is_horizontal", isHorizontal ? 1 : 0);
         if (!hitQuery.exec() || !hitQuery.next()) {
             qDebug() << "Error counting hits:" << hitQuery.lastError().text();
-            db.rollback();
-            return "error";
+            database().rollback();
+            moveResult.status = MoveResult::Error;
+            return moveResult;
         }
 
         int hitCount = hitQuery.value(0).toInt() + 1;
-        qDebug() << "Ship id=" << shipId << ", hits=" << hitCount << ", size=" << shipSize;
-        if (hitCount >= shipSize) {
-            result = "sunk";
-            qDebug() << "Ship id=" << shipId << "sunk!";
-        } else {
-            result = "hit";
-        }
-    } else {
-        result = "miss";
+        hitQuery.finish();
+        moveResult.status = hitCount >= shipSize ? MoveResult::Sunk : MoveResult::Hit;
+    }
+
+    // Передаём ход условным UPDATE: строка меняется, только если ход всё ещё за игроком.
+    // При попадании ход остаётся у стреляющего, но условие всё равно проверяется.
+    moveResult.nextTurn = moveResult.status == MoveResult::Miss ? moveResult.opponent : player;
+    stage.next("advance_turn");
+    QSqlQuery &turnQuery = preparedQuery(SqlAdvanceTurn);
+    turnQuery.bindValue(":next_turn", moveResult.nextTurn);
+    turnQuery.bindValue(":game_id", gameId);
+    turnQuery.bindValue(":player", player);
+    if (!turnQuery.exec()) {
+        qDebug() << "Error advancing turn:" << turnQuery.lastError().text();
+        database().rollback();
+        moveResult.status = MoveResult::Error;
+        return moveResult;
+    }
+    if (turnQuery.numRowsAffected() != 1) {
+        qDebug() << "Move rejected: turn changed concurrently for game" << gameId;
+        database().rollback();
+        moveResult.status = MoveResult::NotYourTurn;
+        moveResult.nextTurn = currentTurn;
+        return moveResult;
     }
 
-    // Сохраняем ход в той же транзакции
-    QSqlQuery moveInsertQuery(db);
-    moveInsertQuery.prepare("INSERT INTO Move (game_id, player, x, y, result) VALUES (:game_id, :player, :x, :y, :result)");
+    // Ход записывается один раз, в той же транзакции
+    stage.next("insert_move");
+    QSqlQuery &moveInsertQuery = preparedQuery(SqlInsertMove);
     moveInsertQuery.bindValue(":game_id", gameId);
     moveInsertQuery.bindValue(":player", player);
     moveInsertQuery.bindValue(":x", x);
     moveInsertQuery.bindValue(":y", y);
-    moveInsertQuery.bindValue(":result", result);
+    moveInsertQuery.bindValue(":result", moveResult.resultString());
+    if (!moveInsertQuery.exec()) {
+        qDebug() << "Error saving move in applyMove:" << moveInsertQuery.lastError().text();
+        database().rollback();
+        moveResult.status = MoveResult::Error;
+        return moveResult;
+    }
+
+    stage.next("commit");
+    if (!database().commit()) {
+        qDebug() << "Failed to commit transaction in applyMove:" << database().lastError().text();
+        database().rollback();
+        moveResult.status = MoveResult::Error;
+        return moveResult;
+    }
+
+    qDebug() << "applyMove completed for" << player << "with result:" << moveResult.resultString() << "next turn:" << moveResult.nextTurn;
+    return moveResult;
+}
+
+MoveResult DatabaseManager::applyJournaledMove(int gameId, const QString &player, int x, int y)
+{
+    MoveResult moveResult;
+    moveResult.status = MoveResult::Error;
+
+    JournalGame *game = journalGame(gameId);
+    int slot = game ? game->slotOf(player) : -1;
+    if (slot < 0 || !game->mode->contains(x, y)) {
+        qDebug() << "Move rejected: game" << gameId << "not found," << player << "is not in it or the cell is off the board";
+        return moveResult;
+    }
+
+    int opponent = 1 - slot;
+    moveResult.opponent = game->players[opponent];
+    moveResult.nextTurn = game->turn >= 0 ? game->players[game->turn] : QString();
+    if (game->turn != slot) {
+        qDebug() << "Move rejected: not" << player << "'s turn, current turn is" << moveResult.nextTurn;
+        moveResult.status = MoveResult::NotYourTurn;
+        return moveResult;
+    }
+
+    if (game->mode->testCell(game->shots[slot], x, y)) {
+        qDebug() << "Cell (" << x << "," << y << ") already shot by" << player;
+        moveResult.status = MoveResult::AlreadyShot;
+        return moveResult;
+    }
+
+    // Попадание и потопление считаются битовыми масками флота и попаданий (ядро по размеру доски)
+    moveResult.status = game->mode->resolveShot(game->fleets[opponent], game->fleetCells[opponent], game->hits[slot], x, y);
+
+    int nextSlot = moveResult.status == MoveResult::Miss ? opponent : slot;
+    JournalRecord record = {};
+    record.gameId = gameId;
+    record.type = JournalRecord::Move;
+    record.player = quint8(slot);
+    record.x = quint8(x);
+    record.y = quint8(y);
+    record.value = quint8(moveResult.status);
+    if (!journal->append(record)) {
+        moveResult.status = MoveResult::Error;
+        return moveResult;
+    }
+
+    game->mode->markCell(game->shots[slot], x, y);
+    if (moveResult.status != MoveResult::Miss) {
+        game->mode->markCell(game->hits[slot], x, y);
+    }
+    if (moveResult.status == MoveResult::Sunk) {
+        ++game->sunk[slot];
+    }
+    game->turn = nextSlot;
+    game->lastSequence = journal->lastSequence();
+    moveResult.nextTurn = game->players[nextSlot];
+    qDebug() << "applyMove (journal) completed for" << player << "with result:" << moveResult.resultString() << "next turn:" << moveResult.nextTurn;
+    return moveResult;
+}
+
+SalvoResult DatabaseManager::applySalvo(int gameId, const QString &player, const QVector<QPoint> &cells)
+{
+    StallDetector::DbScope stallScope("applySalvo");
+    SalvoResult salvo;
+
+    QMutexLocker locker(&mutex);
+    if (!database().isOpen()) {
+        qDebug() << "Database is not open!";
+        return salvo;
+    }
+
+    qDebug() << "Starting applySalvo for player" << player << "in game" << gameId << "-" << cells.size() << "shots";
+
+    if (journal) {
+        return applyJournaledSalvo(gameId, player, cells);
+    }
 
-    qDebug() << "Saving move in checkMove: SQL query:" << moveInsertQuery.lastQuery();
-    qDebug() << "Bound values:" << moveInsertQuery.boundValues();
+    if (!database().transaction()) {
+        qDebug() << "Failed to start transaction in applySalvo:" << database().lastError().text();
+        return salvo;
+    }
+
+    QSqlQuery &gameQuery = preparedQuery(SqlSelectGame);
+    gameQuery.bindValue(":game_id", gameId);
+    if (!gameQuery.exec() || !gameQuery.next()) {
+        qDebug() << "Error fetching game:" << gameQuery.lastError().text();
+        database().rollback();
+        return salvo;
+    }
+    QString player1 = gameQuery.value(0).toString();
+    QString player2 = gameQuery.value(1).toString();
+    QString currentTurn = gameQuery.value(2).toString();
+    const GameMode &mode = gameModeByName(gameQuery.value(3).toString());
+    gameQuery.finish();
+    int slot = player == player1 ? 0 : player == player2 ? 1 : -1;
+    if (slot < 0) {
+        qDebug() << "Salvo rejected:" << player << "is not in game" << gameId;
+        database().rollback();
+        return salvo;
+    }
+    salvo.opponent = slot == 0 ? player2 : player1;
+    salvo.nextTurn = currentTurn;
+
+    if (currentTurn != player) {
+        qDebug() << "Salvo rejected: not" << player << "'s turn, current turn is" << currentTurn;
+        database().rollback();
+        salvo.status = SalvoResult::NotYourTurn;
+        return salvo;
+    }
+
+    // Все ходы партии - одним запросом: свои обстрелянные клетки и попадания, потери своего флота
+    BoardBits shots;
+    BoardBits hits;
+    int lostShips = 0;
+    QSqlQuery &movesQuery = preparedQuery(SqlSelectMoves);
+    movesQuery.bindValue(":game_id", gameId);
+    if (!movesQuery.exec()) {
+        qDebug() << "Error fetching moves:" << movesQuery.lastError().text();
+        database().rollback();
+        return salvo;
+    }
+    while (movesQuery.next()) {
+        QString shooter = movesQuery.value(0).toString();
+        int x = movesQuery.value(1).toInt();
+        int y = movesQuery.value(2).toInt();
+        MoveResult::Status status = MoveResult::statusFromString(movesQuery.value(3).toString());
+        if (shooter == player && mode.contains(x, y)) {
+            mode.markCell(shots, x, y);
+            if (status != MoveResult::Miss) {
+                mode.markCell(hits, x, y);
+            }
+        } else if (shooter == salvo.opponent && status == MoveResult::Sunk) {
+            ++lostShips;
+        }
+    }
+    movesQuery.finish();
+
+    bool ownFleetOk = false;
+    bool fleetOk = false;
+    const QVector<FleetShip> ownFleet = loadFleet(gameId, player, &ownFleetOk);
+    const QVector<FleetShip> fleet = loadFleet(gameId, salvo.opponent, &fleetOk);
+    if (!ownFleetOk || !fleetOk) {
+        database().rollback();
+        return salvo;
+    }
 
-    try {
+    salvo.allowedShots = ownFleet.size() - lostShips;
+    salvo.status = checkSalvo(mode, shots, slot, cells, salvo.allowedShots, &salvo.shots);
+    if (salvo.status != SalvoResult::Accepted) {
+        qDebug() << "Salvo rejected for" << player << "- shots:" << cells.size() << "allowed:" << salvo.allowedShots;
+        database().rollback();
+        return salvo;
+    }
+
+    BoardBits fleetCells;
+    for (const FleetShip &ship : fleet) {
+        mode.markShip(fleetCells, ship);
+    }
+    mode.resolveSalvo(fleet, fleetCells, hits, salvo.shots.data(), salvo.shots.size());
+
+    // После залпа ход всегда переходит к сопернику
+    salvo.nextTurn = salvo.opponent;
+    QSqlQuery &turnQuery = preparedQuery(SqlAdvanceTurn);
+    turnQuery.bindValue(":next_turn", salvo.nextTurn);
+    turnQuery.bindValue(":game_id", gameId);
+    turnQuery.bindValue(":player", player);
+    if (!turnQuery.exec()) {
+        qDebug() << "Error advancing turn:" << turnQuery.lastError().text();
+        database().rollback();
+        salvo.status = SalvoResult::Error;
+        return salvo;
+    }
+    if (turnQuery.numRowsAffected() != 1) {
+        qDebug() << "Salvo rejected: turn changed concurrently for game" << gameId;
+        database().rollback();
+        salvo.status = SalvoResult::NotYourTurn;
+        salvo.nextTurn = currentTurn;
+        return salvo;
+    }
+
+    QSqlQuery &moveInsertQuery = preparedQuery(SqlInsertMove);
+    for (const GameMove &shot : salvo.shots) {
+        moveInsertQuery.bindValue(":game_id", gameId);
+        moveInsertQuery.bindValue(":player", player);
+        moveInsertQuery.bindValue(":x", shot.x);
+        moveInsertQuery.bindValue(":y", shot.y);
+        moveInsertQuery.bindValue(":result", MoveResult::statusString(MoveResult::Status(shot.status)));
         if (!moveInsertQuery.exec()) {
-            qDebug() << "Error saving move in checkMove:" << moveInsertQuery.lastError().text();
-            db.rollback();
-            return "error";
+            qDebug() << "Error saving move in applySalvo:" << moveInsertQuery.lastError().text();
+            database().rollback();
+            salvo.status = SalvoResult::Error;
+            return salvo;
+        }
+        if (shot.status == MoveResult::Sunk) {
+            ++salvo.sunk;
         }
-    } catch (const std::exception &e) {
-        qDebug() << "Exception in checkMove while saving move:" << e.what();
-        db.rollback();
-        return "error";
     }
 
-    if (!db.commit()) {
-        qDebug() << "Failed to commit transaction in checkMove:" << db.lastError().text();
-        db.rollback();
-        return "error";
+    if (!database().commit()) {
+        qDebug() << "Failed to commit transaction in applySalvo:" << database().lastError().text();
+        database().rollback();
+        salvo.status = SalvoResult::Error;
+        return salvo;
     }
 
-    qDebug() << "checkMove completed for" << player << "with result:" << result;
-    return result;
+    qDebug() << "applySalvo completed for" << player << "-" << salvo.shots.size() << "shots," << salvo.sunk << "sunk, next turn:" << salvo.nextTurn;
+    return salvo;
+}
+
+SalvoResult DatabaseManager::applyJournaledSalvo(int gameId, const QString &player, const QVector<QPoint> &cells)
+{
+    SalvoResult salvo;
+
+    JournalGame *game = journalGame(gameId);
+    int slot = game ? game->slotOf(player) : -1;
+    if (slot < 0) {
+        qDebug() << "Salvo rejected: game" << gameId << "not found or" << player << "is not in it";
+        return salvo;
+    }
+
+    int opponent = 1 - slot;
+    salvo.opponent = game->players[opponent];
+    salvo.nextTurn = game->turn >= 0 ? game->players[game->turn] : QString();
+    if (game->turn != slot) {
+        qDebug() << "Salvo rejected: not" << player << "'s turn, current turn is" << salvo.nextTurn;
+        salvo.status = SalvoResult::NotYourTurn;
+        return salvo;
+    }
+
+    salvo.allowedShots = game->fleets[slot].size() - game->sunk[opponent];
+    salvo.status = checkSalvo(*game->mode, game->shots[slot], slot, cells, salvo.allowedShots, &salvo.shots);
+    if (salvo.status != SalvoResult::Accepted) {
+        qDebug() << "Salvo rejected for" << player << "- shots:" << cells.size() << "allowed:" << salvo.allowedShots;
+        return salvo;
+    }
+    game->mode->resolveSalvo(game->fleets[opponent], game->fleetCells[opponent], game->hits[slot], salvo.shots.data(), salvo.shots.size());
+
+    // Выстрелы залпа и передача хода - один пакет журнала: при сбое он отбрасывается целиком,
+    // а состояние игры в памяти меняется только после успешной записи
+    QVarLengthArray<JournalRecord, 32> records;
+    for (const GameMove &shot : salvo.shots) {
+        JournalRecord record = {};
+        record.gameId = gameId;
+        record.type = JournalRecord::Move;
+        record.player = quint8(slot);
+        record.x = shot.x;
+        record.y = shot.y;
+        record.value = shot.status;
+        records.append(record);
+    }
+    JournalRecord turn = {};
+    turn.gameId = gameId;
+    turn.type = JournalRecord::Turn;
+    turn.player = quint8(opponent);
+    records.append(turn);
+    if (!journal->append(records.constData(), int(records.size()))) {
+        salvo.status = SalvoResult::Error;
+        return salvo;
+    }
+
+    for (const GameMove &shot : salvo.shots) {
+        game->mode->markCell(game->shots[slot], shot.x, shot.y);
+        if (shot.status != MoveResult::Miss) {
+            game->mode->markCell(game->hits[slot], shot.x, shot.y);
+        }
+        if (shot.status == MoveResult::Sunk) {
+            ++game->sunk[slot];
+            ++salvo.sunk;
+        }
+    }
+    game->turn = opponent;
+    game->lastSequence = journal->lastSequence();
+    salvo.nextTurn = game->players[opponent];
+    qDebug() << "applySalvo (journal) completed for" << player << "-" << salvo.shots.size() << "shots," << salvo.sunk << "sunk, next turn:" << salvo.nextTurn;
+    return salvo;
 }
 
 QString DatabaseManager::getCurrentTurn(int gameId)
 {
+    StallDetector::DbScope stallScope("getCurrentTurn");
     QMutexLocker locker(&mutex);
-    if (!db.isOpen()) {
+    if (!database().isOpen()) {
         qDebug() << "Database is not open!";
         return "";
     }
 
-    QSqlQuery query(db);
-    query.prepare("SELECT current_turn FROM Game WHERE game_id = :game_id");
+    if (journal) {
+        JournalGame *game = journalGame(gameId);
+        return game && game->turn >= 0 ? game->players[game->turn] : QString();
+    }
+
+    QSqlQuery &query = preparedQuery(SqlSelectTurn);
     query.bindValue(":game_id", gameId);
     if (!query.exec() || !query.next()) {
         qDebug() << "Error fetching current turn:" << query.lastError().text();
         return "";
     }
-    return query.value("current_turn").toString();
+    QString currentTurn = query.value("current_turn").toString();
+    query.finish();
+    return currentTurn;
 }
 
 bool DatabaseManager::updateTurn(int gameId, const QString &nextPlayer)
 {
+    StallDetector::DbScope stallScope("updateTurn");
     QMutexLocker locker(&mutex);
-    if (!db.isOpen()) {
+    if (!database().isOpen()) {
         qDebug() << "Database is not open!";
         return false;
     }
 
-    QSqlQuery query(db);
-    query.prepare("UPDATE Game SET current_turn = :current_turn WHERE game_id = :game_id");
+    if (journal) {
+        JournalGame *game = journalGame(gameId);
+        int slot = game ? game->slotOf(nextPlayer) : -1;
+        if (slot < 0) {
+            qDebug() << "Error updating turn: game" << gameId << "not found or" << nextPlayer << "is not in it";
+            return false;
+        }
+        JournalRecord record = {};
+        record.gameId = gameId;
+        record.type = JournalRecord::Turn;
+        record.player = quint8(slot);
+        if (!journal->append(record)) {
+            return false;
+        }
+        game->turn = slot;
+        game->lastSequence = journal->lastSequence();
+        return true;
+    }
+
+    QSqlQuery &query = preparedQuery(SqlUpdateTurn);
     query.bindValue(":current_turn", nextPlayer);
     query.bindValue(":game_id", gameId);
     if (!query.exec()) {
@@ -415,3 +1736,193 @@ bool DatabaseManager::updateTurn(int gameId, const QString &nextPlayer)
     qDebug() << "Turn updated to" << nextPlayer << "for game" << gameId;
     return true;
 }
+
+bool DatabaseManager::finishGame(int gameId)
+{
+    StallDetector::DbScope stallScope("finishGame");
+    QMutexLocker locker(&mutex);
+    if (!database().isOpen()) {
+        qDebug() << "Database is not open!";
+        return false;
+    }
+
+    QSqlQuery &query = preparedQuery(SqlFinishGame);
+    query.bindValue(":finished_at", QDateTime::currentSecsSinceEpoch());
+    query.bindValue(":game_id", gameId);
+    if (!query.exec()) {
+        qDebug() << "Error finishing game" << gameId << ":" << query.lastError().text();
+        return false;
+    }
+    qDebug() << "Game" << gameId << "marked as finished";
+    return true;
+}
+
+GameRecord DatabaseManager::loadGameRecord(int gameId)
+{
+    StallDetector::DbScope stallScope("loadGameRecord");
+    GameRecord record;
+    QMutexLocker locker(&mutex);
+    if (!database().isOpen()) {
+        qDebug() << "Database is not open!";
+        return record;
+    }
+
+    QSqlQuery &gameQuery = preparedQuery(SqlSelectGameRecord);
+    gameQuery.bindValue(":game_id", gameId);
+    if (!gameQuery.exec()) {
+        qDebug() << "Error fetching game" << gameId << ":" << gameQuery.lastError().text();
+        return record;
+    }
+    if (!gameQuery.next()) {
+        gameQuery.finish();
+
+        // В рабочих таблицах партии нет - ищем её в архиве
+        QSqlQuery &archiveQuery = preparedQuery(SqlSelectArchive);
+        archiveQuery.bindValue(":game_id", gameId);
+        if (!archiveQuery.exec()) {
+            qDebug() << "Error fetching archive index:" << archiveQuery.lastError().text();
+            return record;
+        }
+        QString archivePath = archiveQuery.next() ? archiveQuery.value(0).toString() : QString();
+        archiveQuery.finish();
+        if (!archivePath.isEmpty()) {
+            GameArchiver::readArchivedGame(archivePath, gameId, &record);
+        }
+        return record;
+    }
+
+    record.players[0] = gameQuery.value(0).toString();
+    record.players[1] = gameQuery.value(1).toString();
+    record.currentTurn = gameQuery.value(2).toString();
+    record.finishedAt = gameQuery.value(3).toLongLong(); // NULL -> 0
+    gameQuery.finish();
+
+    for (int slot = 0; slot < 2; ++slot) {
+        bool ok = false;
+        record.fleets[slot] = loadFleet(gameId, record.players[slot], &ok);
+        if (!ok) {
+            return record;
+        }
+    }
+
+    QSqlQuery &movesQuery = preparedQuery(SqlSelectMoves);
+    movesQuery.bindValue(":game_id", gameId);
+    if (!movesQuery.exec()) {
+        qDebug() << "Error fetching moves:" << movesQuery.lastError().text();
+        return record;
+    }
+    while (movesQuery.next()) {
+        QString player = movesQuery.value(0).toString();
+        GameMove move;
+        move.player = player == record.players[0] ? 0 : 1;
+        move.x = quint8(movesQuery.value(1).toInt());
+        move.y = quint8(movesQuery.value(2).toInt());
+        move.status = quint8(MoveResult::statusFromString(movesQuery.value(3).toString()));
+        record.moves.append(move);
+    }
+    movesQuery.finish();
+
+    record.found = true;
+    return record;
+}
+
+bool DatabaseManager::recordGameResult(const PlayerStats &winnerDelta, const PlayerStats &loserDelta)
+{
+    StallDetector::DbScope stallScope("recordGameResult");
+    QMutexLocker locker(&mutex);
+    if (!database().isOpen()) {
+        qDebug() << "Database is not open!";
+        return false;
+    }
+
+    if (!database().transaction()) {
+        qDebug() << "Failed to start transaction in recordGameResult:" << database().lastError().text();
+        return false;
+    }
+
+    // Агрегаты обновляются инкрементально: к сохранённым значениям прибавляются итоги одной партии
+    for (const PlayerStats *delta : {&winnerDelta, &loserDelta}) {
+        QSqlQuery &insertQuery = preparedQuery(SqlInsertStats);
+        insertQuery.bindValue(":nickname", delta->nickname);
+
+        QSqlQuery &updateQuery = preparedQuery(SqlUpdateStats);
+        updateQuery.bindValue(":wins", delta->wins);
+        updateQuery.bindValue(":losses", delta->losses);
+        updateQuery.bindValue(":shots", delta->shots);
+        updateQuery.bindValue(":hits", delta->hits);
+        updateQuery.bindValue(":nickname", delta->nickname);
+
+        if (!insertQuery.exec() || !updateQuery.exec()) {
+            qDebug() << "Error updating stats for" << delta->nickname << ":"
+                     << insertQuery.lastError().text() << updateQuery.lastError().text();
+            database().rollback();
+            return false;
+        }
+    }
+
+    if (!database().commit()) {
+        qDebug() << "Failed to commit transaction in recordGameResult:" << database().lastError().text();
+        database().rollback();
+        return false;
+    }
+
+    qDebug() << "Stats updated: winner" << winnerDelta.nickname << "loser" << loserDelta.nickname;
+    return true;
+}
+
+PlayerStats DatabaseManager::getStats(const QString &nickname)
+{
+    StallDetector::DbScope stallScope("getStats");
+    QMutexLocker locker(&mutex);
+    PlayerStats stats;
+    stats.nickname = nickname;
+    if (!database().isOpen()) {
+        qDebug() << "Database is not open!";
+        return stats;
+    }
+
+    QSqlQuery &query = preparedQuery(SqlSelectStats);
+    query.bindValue(":nickname", nickname);
+    if (query.exec() && query.next()) {
+        stats.wins = query.value(0).toInt();
+        stats.losses = query.value(1).toInt();
+        stats.shots = query.value(2).toInt();
+        stats.hits = query.value(3).toInt();
+    }
+    query.finish();
+    return stats;
+}
+
+StatsChanges DatabaseManager::loadStatsSince(qint64 revision)
+{
+    StallDetector::DbScope stallScope("loadStatsSince");
+    QMutexLocker locker(&mutex);
+    StatsChanges result;
+    result.revision = qMax<qint64>(revision, 0);
+    if (!database().isOpen()) {
+        qDebug() << "Database is not open!";
+        return result;
+    }
+
+    QSqlQuery &query = preparedQuery(SqlSelectStatsSince);
+    query.bindValue(":revision", revision);
+    if (!query.exec()) {
+        qDebug() << "Error loading stats:" << query.lastError().text();
+        return result;
+    }
+    while (query.next()) {
+        PlayerStats stats;
+        stats.nickname = query.value(0).toString();
+        stats.wins = query.value(1).toInt();
+        stats.losses = query.value(2).toInt();
+        stats.shots = query.value(3).toInt();
+        stats.hits = query.value(4).toInt();
+        result.players.append(stats);
+        result.revision = qMax(result.revision, query.value(5).toLongLong());
+    }
+    query.finish();
+    if (revision < 0) {
+        qDebug() << "Loaded stats for" << result.players.size() << "players";
+    }
+    return result;
+}
@@ -6,6 +6,106 @@
 #include <QSqlQuery>
 #include <QSqlError>
 #include <QDebug>
+#include <QVector>
+#include <QHash>
+#include <QThreadStorage>
+#include <QJsonObject>
+#include <QPoint>
+#include <QPair>
+#include "leaderboard.h"
+#include "objectpool.h"
+
+class MoveJournal;
+class GameArchiver;
+class UserDirectory;
+struct GameMode;
+
+// Корабль в упакованной записи флота (BLOB в таблице Fleet, одна запись на игрока в игре).
+// BLOB - массив таких структур, поэтому флот читается одним memcpy.
+struct FleetShip
+{
+    quint8 x;
+    quint8 y;
+    quint8 size;
+    quint8 isHorizontal;
+
+    bool covers(int cellX, int cellY) const
+    {
+        return isHorizontal ? (cellY == y && cellX >= x && cellX < x + size)
+                            : (cellX == x && cellY >= y && cellY < y + size);
+    }
+};
+
+static_assert(sizeof(FleetShip) == 4, "FleetShip is stored as raw bytes");
+
+// Результат выстрела, обработанного одной транзакцией applyMove
+struct MoveResult
+{
+    enum Status {
+        Miss,
+        Hit,
+        Sunk,
+        AlreadyShot,
+        NotYourTurn,
+        Error
+    };
+
+    Status status;
+    QString opponent;
+    QString nextTurn; // Чей ход после выстрела
+    QString resultString() const; // "miss", "hit", "sunk", ... - как в протоколе и таблице Move
+    static QString statusString(Status status);
+    static Status statusFromString(const QString &result); // Обратное преобразование для строк таблицы Move
+};
+
+// Ход в записи партии (упакованный вид - как в архиве)
+struct GameMove
+{
+    quint8 player; // 0 - player1, 1 - player2
+    quint8 x;
+    quint8 y;
+    quint8 status; // MoveResult::Status: Miss, Hit, Sunk
+};
+
+static_assert(sizeof(GameMove) == 4, "GameMove is stored as raw bytes");
+
+// Результат залпа (режим salvo), обработанного одной транзакцией applySalvo
+struct SalvoResult
+{
+    enum Status {
+        Accepted,
+        NotYourTurn,
+        TooManyShots, // Выстрелов больше, чем кораблей на плаву
+        InvalidShot, // Клетка вне доски, повтор в залпе или уже обстрелянная
+        Error
+    };
+
+    Status status = Error;
+    QString opponent;
+    QString nextTurn;
+    QVector<GameMove> shots; // Выстрелы залпа с итогами (при Accepted)
+    int sunk = 0; // Сколько кораблей потоплено залпом
+    int allowedShots = 0; // Кораблей стреляющего на плаву
+};
+
+// Партия целиком: из рабочих таблиц или из архива (см. GameArchiver)
+struct GameRecord
+{
+    bool found = false;
+    bool archived = false;
+    QString players[2];
+    QString currentTurn;
+    qint64 finishedAt = 0; // Время окончания (секунды Unix), 0 - партия не окончена
+    QVector<FleetShip> fleets[2];
+    QVector<GameMove> moves; // В порядке ходов
+};
+
+// Строки Stats, изменённые после заданной ревизии (см. loadStatsSince)
+struct StatsChanges
+{
+    QVector<PlayerStats> players;
+    qint64 revision = 0; // Наибольшая ревизия среди прочитанных строк (или исходная, если изменений нет)
+};
 
 class DatabaseManager : public QObject
 {
@@ -13,26 +113,91 @@ class DatabaseManager : public QObject
 
 public:
     static DatabaseManager* getInstance();
-    QSqlDatabase getDatabase();
-    bool addUser(const QString &nickname, const QString &email, const QString &password);
+    QSqlDatabase getDatabase(); // Соединение вызывающего потока
+    bool isJournaled() const; // Ходы пишутся в журнал основного потока (их нельзя переносить в DbWorker)
+
+    // Этапы запуска (вызываются по порядку до начала приёма клиентов)
+    bool isOpen() const;
+    bool runMigrations(); // Создание таблиц
+    bool enableIncrementalVacuum(); // Перевести существующий файл в auto_vacuum = INCREMENTAL (полный VACUUM, один раз)
+    bool prepareStatements(); // Подготовка запросов горячего пути
+    bool warmCache(); // Прогрев страниц БД
+    bool loadUsers(); // Справочник пользователей в памяти (регистрация и вход без запросов к User)
+    bool loadNewUsers(); // Дочитать в справочник строки User, добавленные после loadUsers (прежним процессом)
+    bool openJournal(const QString &directory); // Режим журнала: перенести остатки прошлого запуска и писать ходы в журнал
+    QJsonObject journalStats() const; // Пусто, если журнал не используется
+    bool startArchiver(const QString &directory); // Фоновый перенос старых оконченных партий в архивные файлы
+    QJsonObject archiveStats() const; // Пусто, если архивация не запущена
+    bool addUser(const QString &nickname, const QString &email, const QString &password); // При конфликте строки-владельцы - в справочник
+    bool isUserTaken(const QString &nickname, const QString &email) const; // Ник или e-mail уже заняты (из памяти)
+    bool isKnownUser(const QString &nickname) const; // Ник есть в справочнике - checkLogin не обратится к SQLite
+    bool checkLogin(const QString &nickname, const QString &password); // Ника нет в справочнике - дочитывается из User
+    QJsonObject userStats() const;
     void printUsers();
 
     // Методы для работы с игрой
-    int createGame(const QString &player1, const QString &player2); // Создание новой игры с инициализацией первого хода
-    bool saveShip(int gameId, const QString &player, int x, int y, int size, bool isHorizontal); // Сохранение корабля
-    bool saveMove(int gameId, const QString &player, int x, int y, const QString &result); // Сохранение хода
-    QString checkMove(int gameId, const QString &player, int x, int y); // Проверка результата выстрела
+    int createGame(const QString &player1, const QString &player2, const GameMode &mode); // Создание новой игры с инициализацией первого хода
+    bool saveShip(int gameId, const QString &player, int x, int y, int size, bool isHorizontal, QString *error = nullptr); // Сохранение корабля по правилам режима
+    MoveResult applyMove(int gameId, const QString &player, int x, int y); // Проверка хода, выстрел, запись и передача хода одной транзакцией
+    SalvoResult applySalvo(int gameId, const QString &player, const QVector<QPoint> &cells); // Залп: одна проверка хода, одна транзакция, ход всегда переходит
     QString getCurrentTurn(int gameId); // Получение текущего хода
     bool updateTurn(int gameId, const QString &nextPlayer); // Обновление текущего хода
+    bool finishGame(int gameId); // Отметить партию оконченной (после этого её может забрать архиватор)
+    GameRecord loadGameRecord(int gameId); // Партия по номеру - из рабочих таблиц или из архива
+
+    // Турниры (TournamentScheduler)
+    int createTournament(const QString &format, const GameMode &mode, int rounds);
+    QVector<int> createTournamentRound(int tournamentId, int round, const QVector<QPair<QString, QString>> &pairs,
+                                       const GameMode &mode); // Партии тура одной транзакцией; пустой второй игрок - проход (-1)
+    bool assignTournamentMatch(int gameId, int shard); // Матч отдан шарду (видно в tournamentStatus)
+    bool recordTournamentResult(int gameId, const QString &winner);
+    bool finishTournament(int tournamentId, const QString &champion);
+    QJsonObject tournamentStatus(int tournamentId); // Текущий тур и его матчи; пусто - турнира нет
+
+    // Методы для статистики игроков
+    bool recordGameResult(const PlayerStats &winnerDelta, const PlayerStats &loserDelta); // Прибавить итоги партии к агрегатам
+    PlayerStats getStats(const QString &nickname); // Статистика одного игрока
+    StatsChanges loadStatsSince(qint64 revision); // Агрегаты, изменённые после revision; -1 - все (при старте)
+
+    // Упаковка флота
+    static QByteArray encodeShip(int x, int y, int size, bool isHorizontal);
+    static QVector<FleetShip> decodeFleet(const QByteArray &blob);
+
+private slots:
+    void slotJournalCompacted(quint32 lastSequence);
 
 private:
+    struct JournalGame;
+    struct Connection;
+
     DatabaseManager();
     virtual ~DatabaseManager();
     DatabaseManager(const DatabaseManager&) = delete;
     DatabaseManager& operator=(const DatabaseManager&) = delete;
 
+    Connection *connection() const; // Соединение вызывающего потока (основной поток или DbWorker)
+    QSqlDatabase &database() const;
+    QSqlQuery &preparedQuery(const char *sql); // Подготовленный запрос из кэша соединения (вызывать под мьютексом)
+    QVector<FleetShip> loadFleet(int gameId, const QString &player, bool *ok); // Флот игрока (вызывать под мьютексом)
+    bool migrateShipRows(); // Перенос старых строк Ship в Fleet (в runMigrations)
+    bool migrateGameMode(); // Режим игры у партии (в runMigrations)
+    bool migrateRetention(); // Отметка окончания партии, индекс архива и инкрементальная очистка (в runMigrations)
+    bool migrateTournaments(); // Таблицы турниров (в runMigrations)
+    bool migrateStatsRevision(); // Ревизия строк Stats для обновления таблиц лидеров (в runMigrations)
+    int insertGame(const QString &player1, const QString &player2, const GameMode &mode); // Строка Game (вызывать под мьютексом)
+    JournalGame *journalGame(int gameId); // Состояние игры в режиме журнала (загружается из БД при первом обращении)
+    MoveResult applyJournaledMove(int gameId, const QString &player, int x, int y);
+    SalvoResult applyJournaledSalvo(int gameId, const QString &player, const QVector<QPoint> &cells);
+
     static DatabaseManager* instance;
-    QSqlDatabase db;
+    Connection *mainConnection; // Соединение потока, создавшего DatabaseManager
+    mutable QThreadStorage<Connection*> threadConnections; // Соединения рабочих потоков
+    MoveJournal *journal; // nullptr - ходы пишутся прямо в SQLite
+    GameArchiver *archiver; // nullptr - архивация выключена
+    UserDirectory *userDirectory;
+    qint64 loadedUserRowId; // Наибольший rowid User, уже загруженный в справочник
+    QHash<int, JournalGame*> journalGames; // Игры, у которых могут быть записи, ещё не перенесённые в SQLite
+    ObjectPool<JournalGame> *journalGamePool; // Слоты состояний игр журнала (создаётся в openJournal)
 };
 
 #endif // DATABASEMANAGER_H
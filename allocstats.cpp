@@ -0,0 +1,156 @@
+#include "allocstats.h"
+#include <QAtomicInteger>
+#include <QFile>
+#include <cstddef>
+
+#if defined(__GLIBC__)
+#include <malloc.h>
+#endif
+// Перехват включается при сборке (qmake CONFIG+=alloc_stats): в обычной сборке malloc/free не подменяются
+#if defined(__GLIBC__) && defined(ALLOCSTATS_HOOKS)
+#define ALLOC_HOOKS
+#endif
+#ifdef Q_OS_LINUX
+#include <unistd.h>
+#endif
+
+namespace {
+
+const char *const MessageNames[] = {"register", "login", "start_game", "place_ship", "make_move", "make_salvo", "ready_to_battle",
+                                    "other"};
+static_assert(sizeof(MessageNames) / sizeof(MessageNames[0]) == AllocStats::MessageCount, "every message type needs a name");
+
+struct MessageCounters
+{
+    QAtomicInteger<quint64> messages;
+    QAtomicInteger<quint64> allocations;
+};
+
+MessageCounters counters[AllocStats::MessageCount];
+
+#ifdef ALLOC_HOOKS
+thread_local quint64 threadAllocations = 0; // Без конструктора: доступен и до инициализации потока
+#endif
+
+} // namespace
+
+#ifdef ALLOC_HOOKS
+// Перехват выделений: только счёт, сама работа - в реализации glibc
+extern "C" {
+void *__libc_malloc(size_t size);
+void *__libc_calloc(size_t count, size_t size);
+void *__libc_realloc(void *pointer, size_t size);
+void __libc_free(void *pointer);
+
+void *malloc(size_t size)
+{
+    ++threadAllocations;
+    return __libc_malloc(size);
+}
+
+void *calloc(size_t count, size_t size)
+{
+    ++threadAllocations;
+    return __libc_calloc(count, size);
+}
+
+void *realloc(void *pointer, size_t size)
+{
+    ++threadAllocations;
+    return __libc_realloc(pointer, size);
+}
+
+void free(void *pointer)
+{
+    __libc_free(pointer);
+}
+}
+#endif
+
+AllocStats::Message AllocStats::messageType(QByteArrayView type)
+{
+    for (int i = 0; i < Other; ++i) {
+        if (type == MessageNames[i]) {
+            return Message(i);
+        }
+    }
+    return Other;
+}
+
+quint64 AllocStats::allocations()
+{
+#ifdef ALLOC_HOOKS
+    return threadAllocations;
+#else
+    return 0;
+#endif
+}
+
+bool AllocStats::isEnabled()
+{
+#ifdef ALLOC_HOOKS
+    return true;
+#else
+    return false;
+#endif
+}
+
+void AllocStats::countMessage(int message)
+{
+    ++counters[message].messages;
+}
+
+void AllocStats::record(int message, quint64 allocations)
+{
+    counters[message].allocations.fetchAndAddRelaxed(allocations);
+}
+
+QJsonObject AllocStats::stats()
+{
+    QJsonObject stats;
+    stats["enabled"] = isEnabled();
+    for (int i = 0; i < MessageCount; ++i) {
+        quint64 messages = counters[i].messages.loadRelaxed();
+        if (messages == 0) {
+            continue;
+        }
+        quint64 allocations = counters[i].allocations.loadRelaxed();
+        QJsonObject message;
+        message["messages"] = qint64(messages);
+        message["allocations"] = qint64(allocations);
+        message["per_message"] = double(allocations) / messages;
+        stats[MessageNames[i]] = message;
+    }
+    return stats;
+}
+
+qint64 AllocStats::residentBytes()
+{
+#ifdef Q_OS_LINUX
+    // /proc/self/statm: размер и резидентная часть в страницах
+    QFile statm("/proc/self/statm");
+    if (!statm.open(QIODevice::ReadOnly)) {
+        return -1;
+    }
+    QList<QByteArray> fields = statm.readAll().split(' ');
+    if (fields.size() < 2) {
+        return -1;
+    }
+    return fields[1].toLongLong() * sysconf(_SC_PAGESIZE);
+#else
+    return -1;
+#endif
+}
+
+qint64 AllocStats::heapBytes()
+{
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 33))
+    struct mallinfo2 info = mallinfo2();
+    return qint64(info.uordblks + info.hblkhd);
+#elif defined(__GLIBC__)
+    struct mallinfo info = mallinfo();
+    return qint64(unsigned(info.uordblks)) + qint64(unsigned(info.hblkhd));
+#else
+    return -1;
+#endif
+}
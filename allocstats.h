@@ -0,0 +1,84 @@
+#ifndef ALLOCSTATS_H
+#define ALLOCSTATS_H
+
+#include <QtGlobal>
+#include <QByteArrayView>
+#include <QJsonObject>
+
+// Счётчики выделений памяти по типам сообщений.
+// В сборке с CONFIG+=alloc_stats на glibc malloc/calloc/realloc перехватываются (через них идут и new, и буферы QString/QByteArray/QJsonObject)
+// и считаются в thread_local счётчике потока. Scope относит выделения своего потока за время области
+// к типу сообщения; DbCall переносит тип вместе с сопрограммой в DbWorker и обратно, поэтому
+// в per_message попадает весь путь запроса, а не только его синхронная часть.
+// Без этого ключа или без glibc счётчики остаются нулевыми (stats: enabled = false).
+// Здесь же - объём памяти процесса для отчёта по компонентам (MyTcpServer::getMemoryReport).
+class AllocStats
+{
+public:
+    enum Message {
+        Register,
+        Login,
+        StartGame,
+        PlaceShip,
+        MakeMove,
+        MakeSalvo,
+        ReadyToBattle,
+        Other,
+        MessageCount
+    };
+
+    // newMessage = true - область начинает обработку сообщения и засчитывает его при закрытии;
+    // иначе (DbCall) продолжает уже засчитанное сообщение в другом потоке или после возобновления
+    class Scope
+    {
+    public:
+        explicit Scope(int message, bool newMessage = false)
+            : mPrevious(sCurrent), mStart(allocations()), mNewMessage(newMessage)
+        {
+            sCurrent = message;
+        }
+        ~Scope()
+        {
+            if (sCurrent >= 0) {
+                record(sCurrent, allocations() - mStart);
+                if (mNewMessage) {
+                    countMessage(sCurrent);
+                }
+            }
+            sCurrent = mPrevious;
+        }
+        Scope(const Scope&) = delete;
+        Scope& operator=(const Scope&) = delete;
+
+        void setMessage(int message) { sCurrent = message; } // Тип стал известен после декодирования
+
+    private:
+        int mPrevious;
+        quint64 mStart;
+        bool mNewMessage;
+    };
+
+    static Message messageType(QByteArrayView type);
+    static int current() { return sCurrent; } // -1 - поток сейчас не обрабатывает сообщение
+    static quint64 allocations(); // Выделения вызывающего потока с его запуска
+    static bool isEnabled();
+    static void countMessage(int message);
+    static QJsonObject stats();
+
+    static qint64 residentBytes(); // RSS процесса (Linux), -1 - неизвестно
+    static qint64 heapBytes(); // Занято в куче malloc (glibc), -1 - неизвестно
+
+    // Оценка памяти QHash: байт смещения на корзину и узел на элемент (без данных, на которые ссылаются значения)
+    template<typename Hash>
+    static qint64 hashBytes(const Hash &hash)
+    {
+        return qint64(hash.capacity()) + qint64(hash.size()) * qint64(sizeof(typename Hash::key_type) + sizeof(typename Hash::mapped_type));
+    }
+
+private:
+    static void record(int message, quint64 allocations);
+
+    static inline thread_local int sCurrent = -1;
+};
+
+#endif // ALLOCSTATS_H
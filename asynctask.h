@@ -0,0 +1,169 @@
+#ifndef ASYNCTASK_H
+#define ASYNCTASK_H
+
+#include <QObject>
+#include <QPointer>
+#include <coroutine>
+#include <cstddef>
+#include <exception>
+#include <type_traits>
+#include <utility>
+#include "allocstats.h"
+#include "dbworker.h"
+#include "requestarena.h"
+#include "tracer.h"
+
+// Сопрограммы обработчиков поверх цикла событий Qt.
+// Task<T> - ленивая задача с результатом: начинает работу, когда её ждут через co_await, и по окончании
+// сразу продолжает ожидающую сопрограмму. AsyncTask - запускаемая и забываемая сопрограмма верхнего
+// уровня (ответ клиенту, ход бота): кадр освобождается сам по её окончании.
+// onDatabase(context, fn) выполняет fn в потоке DbWorker и возобновляет сопрограмму в потоке context
+// через очередь событий - пока запрос к БД идёт, основной поток обслуживает другие соединения.
+// Результат onDatabase сохраняется в локальную переменную и ждётся отдельно: GCC 12 дважды разрушает
+// временный объект с лямбдой внутри выражения co_await.
+// Трасса запроса (Tracer) переходит вместе с сопрограммой: в DbWorker и обратно, с интервалами ожидания
+// очереди DbWorker ("db_queue") и возврата в поток context ("resume_wait").
+// Так же переходят тип сообщения для счётчиков выделений (AllocStats) и арена запроса (RequestArena),
+// из которой выделяются кадры сопрограмм.
+
+template<typename T>
+class Task
+{
+public:
+    struct promise_type
+    {
+        T value;
+        std::coroutine_handle<> continuation;
+
+        static void *operator new(std::size_t size) { return RequestArena::allocateFrame(size); }
+        static void operator delete(void *frame) { RequestArena::freeFrame(frame); }
+
+        Task get_return_object() { return Task(std::coroutine_handle<promise_type>::from_promise(*this)); }
+        std::suspend_always initial_suspend() noexcept { return {}; }
+
+        struct FinalAwaiter
+        {
+            bool await_ready() noexcept { return false; }
+            std::coroutine_handle<> await_suspend(std::coroutine_handle<promise_type> handle) noexcept
+            {
+                std::coroutine_handle<> continuation = handle.promise().continuation;
+                return continuation ? continuation : std::noop_coroutine();
+            }
+            void await_resume() noexcept {}
+        };
+
+        FinalAwaiter final_suspend() noexcept { return {}; }
+        void return_value(T result) { value = std::move(result); }
+        void unhandled_exception() { std::terminate(); }
+    };
+
+    Task(Task &&other) noexcept : mHandle(std::exchange(other.mHandle, nullptr)) {}
+    Task(const Task &) = delete;
+    Task &operator=(const Task &) = delete;
+    ~Task()
+    {
+        if (mHandle) {
+            mHandle.destroy();
+        }
+    }
+
+    bool await_ready() const noexcept { return false; }
+    std::coroutine_handle<> await_suspend(std::coroutine_handle<> awaiting) noexcept
+    {
+        mHandle.promise().continuation = awaiting;
+        return mHandle; // Симметричная передача: задача стартует без роста стека
+    }
+    T await_resume() { return std::move(mHandle.promise().value); }
+
+private:
+    explicit Task(std::coroutine_handle<promise_type> handle) : mHandle(handle) {}
+
+    std::coroutine_handle<promise_type> mHandle;
+};
+
+class AsyncTask
+{
+public:
+    struct promise_type
+    {
+        static void *operator new(std::size_t size) { return RequestArena::allocateFrame(size); }
+        static void operator delete(void *frame) { RequestArena::freeFrame(frame); }
+
+        AsyncTask get_return_object() { return AsyncTask(); }
+        std::suspend_never initial_suspend() noexcept { return {}; }
+        std::suspend_never final_suspend() noexcept { return {}; }
+        void return_void() {}
+        void unhandled_exception() { std::terminate(); }
+    };
+};
+
+// Ожидание вызова fn в потоке DbWorker. Без рабочего потока (ASYNC_DB=0) или при offload = false
+// fn выполняется сразу, без приостановки - поведение совпадает с синхронным кодом.
+template<typename Function>
+class DbCall
+{
+public:
+    using Result = std::invoke_result_t<Function&>;
+
+    DbCall(QObject *context, Function function, bool offload)
+        : mContext(context), mFunction(std::move(function)), mWorker(offload ? DbWorker::instance() : nullptr), mResult()
+    {
+    }
+
+    bool await_ready() const noexcept { return !mWorker; }
+
+    void await_suspend(std::coroutine_handle<> handle)
+    {
+        QPointer<QObject> context = mContext;
+        quint64 traceId = Tracer::current();
+        qint64 postedNs = traceId ? Tracer::now() : 0;
+        int message = AllocStats::current();
+        RequestArena *arena = RequestArena::retainCurrent();
+        mWorker->post([this, handle, context, traceId, postedNs, message, arena]() {
+            Tracer::Scope trace(traceId);
+            AllocStats::Scope allocScope(message);
+            if (traceId) {
+                Tracer::record("db_queue", "queue", traceId, postedNs, Tracer::now());
+            }
+            {
+                Tracer::Span span("db_call", "db");
+                mResult = mFunction();
+            }
+            qint64 finishedNs = traceId ? Tracer::now() : 0;
+            // Если объект-владелец уже удалён (остановка сервера), сопрограмма не возобновляется
+            if (context) {
+                QMetaObject::invokeMethod(context, [handle, traceId, finishedNs, message, arena]() {
+                    Tracer::Scope trace(traceId);
+                    AllocStats::Scope allocScope(message);
+                    RequestArena::Scope arenaScope(arena);
+                    if (traceId) {
+                        Tracer::record("resume_wait", "queue", traceId, finishedNs, Tracer::now());
+                    }
+                    handle.resume();
+                }, Qt::QueuedConnection);
+            }
+        });
+    }
+
+    Result await_resume()
+    {
+        if (!mWorker) {
+            return mFunction();
+        }
+        return std::move(mResult);
+    }
+
+private:
+    QObject *mContext;
+    Function mFunction;
+    DbWorker *mWorker;
+    Result mResult;
+};
+
+template<typename Function>
+DbCall<Function> onDatabase(QObject *context, Function function, bool offload = true)
+{
+    return DbCall<Function>(context, std::move(function), offload);
+}
+
+#endif // ASYNCTASK_H
@@ -0,0 +1,259 @@
+#ifndef BOARDKERNEL_H
+#define BOARDKERNEL_H
+
+#include <QtGlobal>
+#include <cstring>
+#include "cpufeatures.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define BOARDKERNEL_SSE2
+#endif
+
+// Битовая доска до 32x32: клетка (x, y) - бит y * size + x.
+// Хранится с запасом под самый большой режим; ядро размера N трогает только свои слова.
+struct BoardBits
+{
+    static const int MaxSize = 32;
+    static const int MaxWords = MaxSize * MaxSize / 64;
+
+    alignas(32) quint64 words[MaxWords];
+
+    BoardBits() { clear(); }
+    void clear() { memset(words, 0, sizeof(words)); }
+};
+
+// Ядро доски, специализированное по размеру при компиляции.
+// Ширина маски - целое число 128-битных блоков SSE2: 10x10 - один блок, 16x16 - два, 32x32 - восемь.
+// Циклы по блокам имеют постоянную длину и разворачиваются компилятором.
+template<int N>
+struct BoardKernel
+{
+    static_assert(N > 0 && N <= BoardBits::MaxSize, "Board does not fit BoardBits");
+
+    static const int Blocks = (N * N + 127) / 128;
+    static const int Words = Blocks * 2;
+
+    int size() const { return N; }
+
+    bool test(const BoardBits &bits, int x, int y) const
+    {
+        int bit = y * N + x;
+        return (bits.words[bit >> 6] >> (bit & 63)) & 1;
+    }
+
+    void set(BoardBits &bits, int x, int y) const
+    {
+        int bit = y * N + x;
+        bits.words[bit >> 6] |= quint64(1) << (bit & 63);
+    }
+
+    // Прямоугольник [x0, x1] x [y0, y1], обрезанный по краям доски
+    void setRect(BoardBits &bits, int x0, int y0, int x1, int y1) const
+    {
+        x0 = qMax(x0, 0);
+        y0 = qMax(y0, 0);
+        x1 = qMin(x1, N - 1);
+        y1 = qMin(y1, N - 1);
+        for (int y = y0; y <= y1; ++y) {
+            for (int x = x0; x <= x1; ++x) {
+                set(bits, x, y);
+            }
+        }
+    }
+
+    bool intersects(const BoardBits &a, const BoardBits &b) const
+    {
+#if defined(BOARDKERNEL_SSE2)
+        __m128i acc = _mm_setzero_si128();
+        for (int i = 0; i < Words; i += 2) {
+            acc = _mm_or_si128(acc, _mm_and_si128(_mm_load_si128(reinterpret_cast<const __m128i*>(a.words + i)),
+                                                  _mm_load_si128(reinterpret_cast<const __m128i*>(b.words + i))));
+        }
+        return _mm_movemask_epi8(_mm_cmpeq_epi8(acc, _mm_setzero_si128())) != 0xFFFF;
+#else
+        quint64 acc = 0;
+        for (int i = 0; i < Words; ++i) {
+            acc |= a.words[i] & b.words[i];
+        }
+        return acc != 0;
+#endif
+    }
+
+    // a &= b
+    void intersect(BoardBits &a, const BoardBits &b) const
+    {
+#if defined(BOARDKERNEL_SSE2)
+        for (int i = 0; i < Words; i += 2) {
+            __m128i *target = reinterpret_cast<__m128i*>(a.words + i);
+            _mm_store_si128(target, _mm_and_si128(_mm_load_si128(target), _mm_load_si128(reinterpret_cast<const __m128i*>(b.words + i))));
+        }
+#else
+        for (int i = 0; i < Words; ++i) {
+            a.words[i] &= b.words[i];
+        }
+#endif
+    }
+
+    // a |= b
+    void unite(BoardBits &a, const BoardBits &b) const
+    {
+#if defined(BOARDKERNEL_SSE2)
+        for (int i = 0; i < Words; i += 2) {
+            __m128i *target = reinterpret_cast<__m128i*>(a.words + i);
+            _mm_store_si128(target, _mm_or_si128(_mm_load_si128(target), _mm_load_si128(reinterpret_cast<const __m128i*>(b.words + i))));
+        }
+#else
+        for (int i = 0; i < Words; ++i) {
+            a.words[i] |= b.words[i];
+        }
+#endif
+    }
+
+    // Все клетки a есть в b
+    bool isSubset(const BoardBits &a, const BoardBits &b) const
+    {
+#if defined(BOARDKERNEL_SSE2)
+        __m128i acc = _mm_setzero_si128();
+        for (int i = 0; i < Words; i += 2) {
+            acc = _mm_or_si128(acc, _mm_andnot_si128(_mm_load_si128(reinterpret_cast<const __m128i*>(b.words + i)),
+                                                     _mm_load_si128(reinterpret_cast<const __m128i*>(a.words + i))));
+        }
+        return _mm_movemask_epi8(_mm_cmpeq_epi8(acc, _mm_setzero_si128())) == 0xFFFF;
+#else
+        quint64 acc = 0;
+        for (int i = 0; i < Words; ++i) {
+            acc |= a.words[i] & ~b.words[i];
+        }
+        return acc == 0;
+#endif
+    }
+};
+
+#if defined(CPU_AVX2_SUPPORTED)
+// Ядро для досок из чётного числа блоков (16x16 - одно слово AVX2, 32x32 - четыре).
+// Методы компилируются с AVX2 независимо от флагов сборки; вызывать только при cpuHasAvx2()
+// (режимы выбирают его в GameMode при запуске).
+template<int N>
+struct BoardKernelAvx2 : BoardKernel<N>
+{
+    static_assert(BoardKernel<N>::Blocks % 2 == 0, "AVX2 kernel needs whole 256-bit words");
+
+    static const int Words = BoardKernel<N>::Words;
+
+    CPU_TARGET_AVX2 bool intersects(const BoardBits &a, const BoardBits &b) const
+    {
+        __m256i acc = _mm256_setzero_si256();
+        for (int i = 0; i < Words; i += 4) {
+            acc = _mm256_or_si256(acc, _mm256_and_si256(_mm256_load_si256(reinterpret_cast<const __m256i*>(a.words + i)),
+                                                         _mm256_load_si256(reinterpret_cast<const __m256i*>(b.words + i))));
+        }
+        return !_mm256_testz_si256(acc, acc);
+    }
+
+    // a &= b
+    CPU_TARGET_AVX2 void intersect(BoardBits &a, const BoardBits &b) const
+    {
+        for (int i = 0; i < Words; i += 4) {
+            __m256i *target = reinterpret_cast<__m256i*>(a.words + i);
+            _mm256_store_si256(target, _mm256_and_si256(_mm256_load_si256(target),
+                                                        _mm256_load_si256(reinterpret_cast<const __m256i*>(b.words + i))));
+        }
+    }
+
+    // a |= b
+    CPU_TARGET_AVX2 void unite(BoardBits &a, const BoardBits &b) const
+    {
+        for (int i = 0; i < Words; i += 4) {
+            __m256i *target = reinterpret_cast<__m256i*>(a.words + i);
+            _mm256_store_si256(target, _mm256_or_si256(_mm256_load_si256(target),
+                                                       _mm256_load_si256(reinterpret_cast<const __m256i*>(b.words + i))));
+        }
+    }
+
+    // Все клетки a есть в b
+    CPU_TARGET_AVX2 bool isSubset(const BoardBits &a, const BoardBits &b) const
+    {
+        __m256i acc = _mm256_setzero_si256();
+        for (int i = 0; i < Words; i += 4) {
+            acc = _mm256_or_si256(acc, _mm256_andnot_si256(_mm256_load_si256(reinterpret_cast<const __m256i*>(b.words + i)),
+                                                           _mm256_load_si256(reinterpret_cast<const __m256i*>(a.words + i))));
+        }
+        return _mm256_testz_si256(acc, acc);
+    }
+};
+#endif
+
+// Обобщённое ядро: размер доски известен только во время выполнения, скалярные циклы по словам.
+// Нужно для сравнения со специализациями (GameMode::benchmark) и для режимов без своей специализации.
+struct GenericBoardKernel
+{
+    explicit GenericBoardKernel(int boardSize) : mSize(boardSize), mWords((boardSize * boardSize + 63) / 64) {}
+
+    int size() const { return mSize; }
+
+    bool test(const BoardBits &bits, int x, int y) const
+    {
+        int bit = y * mSize + x;
+        return (bits.words[bit >> 6] >> (bit & 63)) & 1;
+    }
+
+    void set(BoardBits &bits, int x, int y) const
+    {
+        int bit = y * mSize + x;
+        bits.words[bit >> 6] |= quint64(1) << (bit & 63);
+    }
+
+    void setRect(BoardBits &bits, int x0, int y0, int x1, int y1) const
+    {
+        x0 = qMax(x0, 0);
+        y0 = qMax(y0, 0);
+        x1 = qMin(x1, mSize - 1);
+        y1 = qMin(y1, mSize - 1);
+        for (int y = y0; y <= y1; ++y) {
+            for (int x = x0; x <= x1; ++x) {
+                set(bits, x, y);
+            }
+        }
+    }
+
+    bool intersects(const BoardBits &a, const BoardBits &b) const
+    {
+        for (int i = 0; i < mWords; ++i) {
+            if (a.words[i] & b.words[i]) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void intersect(BoardBits &a, const BoardBits &b) const
+    {
+        for (int i = 0; i < mWords; ++i) {
+            a.words[i] &= b.words[i];
+        }
+    }
+
+    void unite(BoardBits &a, const BoardBits &b) const
+    {
+        for (int i = 0; i < mWords; ++i) {
+            a.words[i] |= b.words[i];
+        }
+    }
+
+    bool isSubset(const BoardBits &a, const BoardBits &b) const
+    {
+        for (int i = 0; i < mWords; ++i) {
+            if (a.words[i] & ~b.words[i]) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+private:
+    int mSize;
+    int mWords;
+};
+
+#endif // BOARDKERNEL_H
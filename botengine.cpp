@@ -0,0 +1,462 @@
+#include "botengine.h"
+#include <QElapsedTimer>
+#include <QtAlgorithms>
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define BOTENGINE_SSE2
+#endif
+
+namespace {
+
+const int FleetSizes[] = {4, 3, 3, 2, 2, 2, 1, 1, 1, 1};
+const int MaxSamples = 4096; // Предел выборки расстановок для Hard
+const int MinSamples = 32; // Меньше - выборке не доверяем, остаётся карта плотности
+
+// Прибавить единицу к счётчикам клеток строки, отмеченных в mask
+inline void addRow(quint8 *acc, quint16 mask)
+{
+#ifdef BOTENGINE_SSE2
+    // Разворачиваем 16 бит маски в 16 байт 0x00/0xFF и вычитаем их из счётчиков (x - (-1) = x + 1)
+    const __m128i select = _mm_setr_epi8(1, 2, 4, 8, 16, 32, 64, char(128), 1, 2, 4, 8, 16, 32, 64, char(128));
+    __m128i bytes = _mm_unpacklo_epi64(_mm_set1_epi8(char(mask & 0xFF)), _mm_set1_epi8(char(mask >> 8)));
+    __m128i bits = _mm_cmpeq_epi8(_mm_and_si128(bytes, select), select);
+    __m128i sum = _mm_load_si128(reinterpret_cast<const __m128i*>(acc));
+    _mm_store_si128(reinterpret_cast<__m128i*>(acc), _mm_sub_epi8(sum, bits));
+#else
+    while (mask) {
+        acc[qCountTrailingZeroBits(mask)]++;
+        mask &= mask - 1;
+    }
+#endif
+}
+
+// Маски начальных клеток всех допустимых положений корабля размера size по свободным клеткам avail.
+// Возвращает общее число положений.
+int findStarts(const quint16 *avail, int size, quint16 *hStarts, quint16 *vStarts)
+{
+    int total = 0;
+    for (int r = 0; r < BotEngine::BoardSize; ++r) {
+        quint16 h = avail[r];
+        quint16 v = r + size <= BotEngine::BoardSize ? avail[r] : 0;
+        for (int k = 1; k < size; ++k) {
+            h &= avail[r] >> k;
+            if (v) {
+                v &= avail[r + k];
+            }
+        }
+        hStarts[r] = h;
+        vStarts[r] = size > 1 ? v : 0; // Однопалубный корабль не зависит от ориентации
+        total += qPopulationCount(hStarts[r]) + qPopulationCount(vStarts[r]);
+    }
+    return total;
+}
+
+// Найти положение с порядковым номером index среди масок findStarts
+BotEngine::Placement startAt(const quint16 *hStarts, const quint16 *vStarts, int size, int index)
+{
+    for (int horizontal = 1; horizontal >= 0; --horizontal) {
+        const quint16 *starts = horizontal ? hStarts : vStarts;
+        for (int r = 0; r < BotEngine::BoardSize; ++r) {
+            int count = qPopulationCount(starts[r]);
+            if (index >= count) {
+                index -= count;
+                continue;
+            }
+            quint16 mask = starts[r];
+            while (index-- > 0) {
+                mask &= mask - 1;
+            }
+            return BotEngine::Placement{int(qCountTrailingZeroBits(mask)), r, size, horizontal == 1};
+        }
+    }
+    return BotEngine::Placement{0, 0, size, true};
+}
+
+// Пометить клетки корабля в rows
+void markShip(quint16 *rows, const BotEngine::Placement &ship)
+{
+    if (ship.isHorizontal) {
+        rows[ship.y] |= quint16(((1u << ship.size) - 1) << ship.x);
+    } else {
+        for (int k = 0; k < ship.size; ++k) {
+            rows[ship.y + k] |= quint16(1u << ship.x);
+        }
+    }
+}
+
+// Пометить в rows клетки cells вместе с соседними (включая диагональные)
+void markHalo(quint16 *rows, const quint16 *cells)
+{
+    for (int r = 0; r < BotEngine::BoardSize; ++r) {
+        quint16 halo = quint16((cells[r] | cells[r] << 1 | cells[r] >> 1) & ((1u << BotEngine::BoardSize) - 1));
+        if (!halo) {
+            continue;
+        }
+        rows[r] |= halo;
+        if (r > 0) {
+            rows[r - 1] |= halo;
+        }
+        if (r + 1 < BotEngine::BoardSize) {
+            rows[r + 1] |= halo;
+        }
+    }
+}
+
+// Подсчёт числа положений оставшихся кораблей, покрывающих каждую клетку.
+// hunt - все допустимые положения, target - только проходящие через непотопленные попадания.
+void countPlacements(const quint16 *freeRows, const quint16 *hitRows, const int *remaining,
+                     quint8 (*hunt)[16], quint8 (*target)[16])
+{
+    for (int size = 1; size <= 4; ++size) {
+        int count = remaining[size];
+        if (count == 0) {
+            continue;
+        }
+        for (int r = 0; r < BotEngine::BoardSize; ++r) {
+            quint16 starts = freeRows[r];
+            quint16 span = hitRows[r];
+            for (int k = 1; k < size; ++k) {
+                starts &= freeRows[r] >> k;
+                span |= hitRows[r] >> k;
+            }
+            quint16 touching = starts & span;
+            for (int k = 0; k < size; ++k) {
+                for (int n = 0; n < count; ++n) {
+                    addRow(hunt[r], quint16(starts << k));
+                    addRow(target[r], quint16(touching << k));
+                }
+            }
+        }
+        if (size == 1) {
+            continue;
+        }
+        for (int r = 0; r + size <= BotEngine::BoardSize; ++r) {
+            quint16 starts = freeRows[r];
+            quint16 span = hitRows[r];
+            for (int k = 1; k < size; ++k) {
+                starts &= freeRows[r + k];
+                span |= hitRows[r + k];
+            }
+            quint16 touching = starts & span;
+            for (int k = 0; k < size; ++k) {
+                for (int n = 0; n < count; ++n) {
+                    addRow(hunt[r + k], starts);
+                    addRow(target[r + k], touching);
+                }
+            }
+        }
+    }
+}
+
+} // namespace
+
+BotEngine::BotEngine(Difficulty difficulty, qint64 moveBudgetNs)
+    : mDifficulty(difficulty), mMoveBudgetNs(moveBudgetNs), mRng(QRandomGenerator::global()->generate())
+{
+    reset();
+}
+
+void BotEngine::reset()
+{
+    std::memset(mMiss, 0, sizeof(mMiss));
+    std::memset(mHit, 0, sizeof(mHit));
+    std::memset(mSunk, 0, sizeof(mSunk));
+    std::memset(mHalo, 0, sizeof(mHalo));
+    std::memset(mRemaining, 0, sizeof(mRemaining));
+    for (int size : FleetSizes) {
+        mRemaining[size]++;
+    }
+    mStats = MoveStats();
+}
+
+void BotEngine::setDifficulty(Difficulty difficulty)
+{
+    mDifficulty = difficulty;
+}
+
+BotEngine::Difficulty BotEngine::difficulty() const
+{
+    return mDifficulty;
+}
+
+void BotEngine::setMoveBudget(qint64 nsecs)
+{
+    mMoveBudgetNs = nsecs;
+}
+
+qint64 BotEngine::moveBudget() const
+{
+    return mMoveBudgetNs;
+}
+
+const BotEngine::MoveStats &BotEngine::stats() const
+{
+    return mStats;
+}
+
+BotEngine::Difficulty BotEngine::difficultyFromString(const QString &name)
+{
+    if (name == "easy") {
+        return Easy;
+    }
+    if (name == "hard") {
+        return Hard;
+    }
+    return Medium;
+}
+
+QVector<BotEngine::Placement> BotEngine::randomFleet()
+{
+    QVector<Placement> fleet;
+    for (int attempt = 0; attempt < 100; ++attempt) {
+        Row blocked[Rows] = {0};
+        fleet.clear();
+        for (int size : FleetSizes) {
+            Row avail[Rows];
+            for (int r = 0; r < Rows; ++r) {
+                avail[r] = r < BoardSize ? Row(FullRow & ~blocked[r]) : 0;
+            }
+            Row hStarts[Rows];
+            Row vStarts[Rows];
+            int total = findStarts(avail, size, hStarts, vStarts);
+            if (total == 0) {
+                break;
+            }
+            Placement ship = startAt(hStarts, vStarts, size, int(mRng.bounded(quint32(total))));
+            fleet.append(ship);
+
+            // Запрещаем клетки корабля и его окрестность
+            Row cells[Rows] = {0};
+            markShip(cells, ship);
+            markHalo(blocked, cells);
+        }
+        if (fleet.size() == int(sizeof(FleetSizes) / sizeof(FleetSizes[0]))) {
+            return fleet;
+        }
+    }
+    return fleet;
+}
+
+BotEngine::Shot BotEngine::nextShot()
+{
+    QElapsedTimer timer;
+    timer.start();
+
+    // Сервер не запрещает кораблям касаться, поэтому окрестность потопленных кораблей
+    // не исключается из выстрелов, а лишь получает нулевой вес
+    Row unshot[Rows];
+    Row preferred[Rows];
+    Row freeRows[Rows]; // Клетки, где может стоять корабль (попадания - тоже)
+    bool anyPreferred = false;
+    for (int r = 0; r < Rows; ++r) {
+        unshot[r] = r < BoardSize ? Row(FullRow & ~(mMiss[r] | mHit[r] | mSunk[r])) : 0;
+        preferred[r] = Row(unshot[r] & ~mHalo[r]);
+        freeRows[r] = r < BoardSize ? Row(FullRow & ~(mMiss[r] | mSunk[r] | mHalo[r])) : 0;
+        anyPreferred = anyPreferred || preferred[r];
+    }
+
+    bool pending = hasPendingHits();
+    Shot shot;
+    mStats.lastSamples = 0;
+
+    if (mDifficulty == Easy) {
+        Row neighbours[Rows] = {0};
+        bool any = false;
+        if (pending) {
+            for (int r = 0; r < BoardSize; ++r) {
+                Row around = Row(mHit[r] << 1 | mHit[r] >> 1);
+                if (r > 0) around |= mHit[r - 1];
+                if (r + 1 < BoardSize) around |= mHit[r + 1];
+                neighbours[r] = Row(around & unshot[r]);
+                any = any || neighbours[r];
+            }
+        }
+        shot = randomShot(any ? neighbours : anyPreferred ? preferred : unshot);
+    } else {
+        alignas(16) quint8 hunt[Rows][16];
+        alignas(16) quint8 target[Rows][16];
+        std::memset(hunt, 0, sizeof(hunt));
+        std::memset(target, 0, sizeof(target));
+        countPlacements(freeRows, mHit, mRemaining, hunt, target);
+
+        quint32 scores[BoardSize * BoardSize];
+        bool useTarget = false;
+        if (pending) {
+            for (int r = 0; r < BoardSize; ++r) {
+                for (int c = 0; c < BoardSize; ++c) {
+                    scores[r * BoardSize + c] = target[r][c];
+                    useTarget = useTarget || (target[r][c] && (unshot[r] >> c & 1));
+                }
+            }
+        }
+        if (!useTarget) {
+            for (int r = 0; r < BoardSize; ++r) {
+                for (int c = 0; c < BoardSize; ++c) {
+                    scores[r * BoardSize + c] = hunt[r][c];
+                }
+            }
+
+            // Hard: дополнительно оцениваем клетки по случайным полным расстановкам флота,
+            // которые учитывают взаимное расположение кораблей. Глубина ограничена бюджетом.
+            if (mDifficulty == Hard && !pending) {
+                quint32 samples[BoardSize * BoardSize] = {0};
+                int accepted = 0;
+                int tries = 0;
+                while (accepted < MaxSamples) {
+                    Row occupied[Rows];
+                    if (sampleFleet(freeRows, occupied)) {
+                        ++accepted;
+                        for (int r = 0; r < BoardSize; ++r) {
+                            for (Row mask = occupied[r]; mask; mask &= mask - 1) {
+                                samples[r * BoardSize + qCountTrailingZeroBits(mask)]++;
+                            }
+                        }
+                    }
+                    if ((++tries & 15) == 0 && timer.nsecsElapsed() >= mMoveBudgetNs) {
+                        break;
+                    }
+                }
+                mStats.lastSamples = accepted;
+                if (accepted >= MinSamples) {
+                    std::memcpy(scores, samples, sizeof(scores));
+                }
+            }
+        }
+        shot = pickFromScores(scores, unshot);
+    }
+
+    qint64 elapsed = timer.nsecsElapsed();
+    mStats.lastMoveNs = elapsed;
+    mStats.maxMoveNs = qMax(mStats.maxMoveNs, elapsed);
+    mStats.totalNs += elapsed;
+    mStats.moves++;
+    if (elapsed > mMoveBudgetNs) {
+        mStats.budgetOverruns++;
+    }
+    return shot;
+}
+
+void BotEngine::applyResult(int x, int y, const QString &result)
+{
+    if (x < 0 || y < 0 || x >= BoardSize || y >= BoardSize) {
+        return;
+    }
+    Row bit = Row(1u << x);
+    if (result == "miss") {
+        mMiss[y] |= bit;
+    } else if (result == "hit") {
+        mHit[y] |= bit;
+    } else if (result == "sunk") {
+        mHit[y] |= bit;
+        markSunk(x, y);
+    } else if (result == "already_shot" && !((mHit[y] | mSunk[y]) & bit)) {
+        mMiss[y] |= bit; // Не стреляем туда повторно
+    }
+}
+
+BotEngine::Shot BotEngine::pickFromScores(const quint32 *scores, const Row *candidates)
+{
+    Shot best{-1, -1};
+    qint64 bestScore = -1;
+    quint32 ties = 0;
+    for (int r = 0; r < BoardSize; ++r) {
+        for (Row mask = candidates[r]; mask; mask &= mask - 1) {
+            int c = qCountTrailingZeroBits(mask);
+            qint64 score = scores[r * BoardSize + c];
+            if (score > bestScore) {
+                bestScore = score;
+                best = Shot{c, r};
+                ties = 1;
+            } else if (score == bestScore && mRng.bounded(++ties) == 0) {
+                best = Shot{c, r}; // Равные клетки выбираем случайно
+            }
+        }
+    }
+    return best;
+}
+
+BotEngine::Shot BotEngine::randomShot(const Row *candidates)
+{
+    quint32 scores[BoardSize * BoardSize] = {0};
+    return pickFromScores(scores, candidates);
+}
+
+bool BotEngine::sampleFleet(const Row *freeRows, Row *occupied)
+{
+    // Корабли выборки, как и в классических правилах, не касаются друг друга
+    Row blocked[Rows] = {0};
+    std::memset(occupied, 0, sizeof(Row) * Rows);
+    for (int size = 4; size >= 1; --size) {
+        for (int n = 0; n < mRemaining[size]; ++n) {
+            Row avail[Rows];
+            for (int r = 0; r < Rows; ++r) {
+                avail[r] = Row(freeRows[r] & ~blocked[r]);
+            }
+            Row hStarts[Rows];
+            Row vStarts[Rows];
+            int total = findStarts(avail, size, hStarts, vStarts);
+            if (total == 0) {
+                return false;
+            }
+            Row cells[Rows] = {0};
+            markShip(cells, startAt(hStarts, vStarts, size, int(mRng.bounded(quint32(total)))));
+            markHalo(blocked, cells);
+            for (int r = 0; r < BoardSize; ++r) {
+                occupied[r] |= cells[r];
+            }
+        }
+    }
+    return true;
+}
+
+void BotEngine::markSunk(int x, int y)
+{
+    // Сервер не сообщает, какие клетки принадлежали кораблю: берём самую длинную
+    // непрерывную линию попаданий через (x, y)
+    int left = x;
+    while (left > 0 && (mHit[y] >> (left - 1) & 1)) --left;
+    int right = x;
+    while (right + 1 < BoardSize && (mHit[y] >> (right + 1) & 1)) ++right;
+    int top = y;
+    while (top > 0 && (mHit[top - 1] >> x & 1)) --top;
+    int bottom = y;
+    while (bottom + 1 < BoardSize && (mHit[bottom + 1] >> x & 1)) ++bottom;
+
+    Row cells[Rows] = {0};
+    int length;
+    if (right - left >= bottom - top) {
+        length = qMin(right - left + 1, 4);
+        markShip(cells, Placement{left, y, length, true});
+    } else {
+        length = qMin(bottom - top + 1, 4);
+        markShip(cells, Placement{x, top, length, false});
+    }
+    for (int r = 0; r < BoardSize; ++r) {
+        mHit[r] &= Row(~cells[r]);
+        mSunk[r] |= cells[r];
+    }
+    markHalo(mHalo, cells);
+
+    if (mRemaining[length] > 0) {
+        mRemaining[length]--;
+        return;
+    }
+    for (int size = 4; size >= 1; --size) {
+        if (mRemaining[size] > 0) {
+            mRemaining[size]--;
+            return;
+        }
+    }
+}
+
+bool BotEngine::hasPendingHits() const
+{
+    for (int r = 0; r < BoardSize; ++r) {
+        if (mHit[r]) {
+            return true;
+        }
+    }
+    return false;
+}
@@ -0,0 +1,84 @@
+#ifndef BOTENGINE_H
+#define BOTENGINE_H
+
+#include <QString>
+#include <QVector>
+#include <QRandomGenerator>
+
+// Встроенный соперник для одиночной игры.
+// Доска 10x10 хранится битбордами (по 16 бит на строку), поэтому состояние одной
+// партии занимает около сотни байт и тысячи ботов помещаются в одном процессе.
+// Выбор выстрела - карта плотности по всем допустимым положениям оставшихся кораблей;
+// подсчёт положений ведётся построчно SSE2-векторами (скалярный вариант без SSE2).
+class BotEngine
+{
+public:
+    enum Difficulty {
+        Easy,   // Случайные выстрелы, добивание соседних клеток
+        Medium, // Карта плотности (один проход)
+        Hard    // Карта плотности + выборка расстановок флота в пределах бюджета CPU
+    };
+
+    struct Shot {
+        int x;
+        int y;
+    };
+
+    struct Placement {
+        int x;
+        int y;
+        int size;
+        bool isHorizontal;
+    };
+
+    // Замеры времени выбора хода
+    struct MoveStats {
+        qint64 lastMoveNs = 0;
+        qint64 maxMoveNs = 0;
+        qint64 totalNs = 0;
+        int moves = 0;
+        int budgetOverruns = 0; // Ходы, превысившие бюджет
+        int lastSamples = 0; // Число расстановок, просмотренных на последнем ходу (Hard)
+    };
+
+    static const int BoardSize = 10;
+
+    explicit BotEngine(Difficulty difficulty = Medium, qint64 moveBudgetNs = 2000000);
+
+    void reset(); // Новая партия: очистить доску и восстановить флот
+    void setDifficulty(Difficulty difficulty);
+    Difficulty difficulty() const;
+    void setMoveBudget(qint64 nsecs); // Бюджет времени на выбор одного хода
+    qint64 moveBudget() const;
+    const MoveStats &stats() const;
+
+    QVector<Placement> randomFleet(); // Расстановка собственного флота (корабли не касаются друг друга)
+    Shot nextShot(); // Выбор следующего выстрела
+    void applyResult(int x, int y, const QString &result); // Результат выстрела: miss / hit / sunk
+
+    static Difficulty difficultyFromString(const QString &name);
+
+private:
+    typedef quint16 Row; // Бит c строки r - клетка (x = c, y = r)
+    static const int Rows = 16; // 10 строк доски + выравнивание
+    static const Row FullRow = (1u << BoardSize) - 1;
+
+    Shot pickFromScores(const quint32 *scores, const Row *candidates);
+    Shot randomShot(const Row *candidates);
+    bool sampleFleet(const Row *blocked, Row *occupied);
+    void markSunk(int x, int y);
+    bool hasPendingHits() const;
+
+    Difficulty mDifficulty;
+    qint64 mMoveBudgetNs;
+    MoveStats mStats;
+    QRandomGenerator mRng;
+
+    Row mMiss[Rows];
+    Row mHit[Rows]; // Попадания по ещё не потопленным кораблям
+    Row mSunk[Rows];
+    Row mHalo[Rows]; // Окрестность потопленных кораблей: по классическим правилам там пусто
+    int mRemaining[5]; // Сколько кораблей каждого размера (1..4) ещё на плаву
+};
+
+#endif // BOTENGINE_H
@@ -0,0 +1,45 @@
+#ifndef CPUFEATURES_H
+#define CPUFEATURES_H
+
+#include <QtGlobal>
+
+// Расширения процессора, выбираемые во время выполнения. Сборка остаётся под базовый x86-64 (SSE2),
+// а функции с CPU_TARGET_AVX2 компилируются с AVX2 поштучно и вызываются только при cpuHasAvx2():
+// один бинарник работает и на старых процессорах, и использует 256-битные регистры на новых.
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define CPU_AVX2_SUPPORTED
+#define CPU_TARGET_AVX2 __attribute__((target("avx2")))
+#elif defined(_MSC_VER) && defined(_M_X64)
+#include <immintrin.h>
+#include <intrin.h>
+#define CPU_AVX2_SUPPORTED
+#define CPU_TARGET_AVX2 // MSVC разрешает intrinsics AVX2 без /arch:AVX2
+#endif
+
+inline bool cpuHasAvx2()
+{
+#if defined(CPU_AVX2_SUPPORTED) && defined(_MSC_VER) && !defined(__clang__)
+    // Нужны и сама инструкция, и сохранение регистров YMM операционной системой
+    int info[4];
+    __cpuid(info, 0);
+    if (info[0] < 7) {
+        return false;
+    }
+    __cpuid(info, 1);
+    const int osxsave = 1 << 27;
+    const int avx = 1 << 28;
+    if ((info[2] & (osxsave | avx)) != (osxsave | avx) || (_xgetbv(0) & 6) != 6) {
+        return false;
+    }
+    __cpuidex(info, 7, 0);
+    return (info[1] & (1 << 5)) != 0;
+#elif defined(CPU_AVX2_SUPPORTED)
+    __builtin_cpu_init(); // Может понадобиться до конструкторов libgcc (статическая инициализация)
+    return __builtin_cpu_supports("avx2");
+#else
+    return false;
+#endif
+}
+
+#endif // CPUFEATURES_H
@@ -0,0 +1,75 @@
+#include "dbworker.h"
+#include <QElapsedTimer>
+#include <QDebug>
+
+DbWorker *DbWorker::sInstance = nullptr;
+
+DbWorker::DbWorker(QObject *parent)
+    : QObject(parent), mThread(nullptr), mReceiver(nullptr), mPosted(0), mCompleted(0), mBusyUs(0), mMaxQueue(0)
+{
+}
+
+DbWorker::~DbWorker()
+{
+    if (sInstance == this) {
+        sInstance = nullptr;
+    }
+    if (mThread) {
+        // Задания, уже стоящие в очереди, выполняются до выхода потока
+        mThread->quit();
+        mThread->wait();
+    }
+}
+
+DbWorker *DbWorker::instance()
+{
+    return sInstance;
+}
+
+bool DbWorker::start()
+{
+    if (qEnvironmentVariableIsSet("ASYNC_DB") && qEnvironmentVariableIntValue("ASYNC_DB") == 0) {
+        qDebug() << "Async database worker is disabled";
+        return true;
+    }
+
+    mThread = new QThread(this);
+    mThread->setObjectName("db_worker");
+    mReceiver = new QObject;
+    mReceiver->moveToThread(mThread);
+    connect(mThread, &QThread::finished, mReceiver, &QObject::deleteLater);
+    mThread->start();
+    sInstance = this;
+
+    qDebug() << "Async database worker is started";
+    return true;
+}
+
+void DbWorker::post(std::function<void()> job)
+{
+    quint64 queued = ++mPosted - mCompleted.loadRelaxed();
+    quint64 maxQueue = mMaxQueue.loadRelaxed();
+    while (queued > maxQueue && !mMaxQueue.testAndSetRelaxed(maxQueue, queued)) {
+        maxQueue = mMaxQueue.loadRelaxed();
+    }
+
+    QMetaObject::invokeMethod(mReceiver, [this, job]() {
+        QElapsedTimer timer;
+        timer.start();
+        job();
+        mBusyUs.fetchAndAddRelaxed(quint64(timer.nsecsElapsed() / 1000));
+        ++mCompleted;
+    }, Qt::QueuedConnection);
+}
+
+QJsonObject DbWorker::stats() const
+{
+    quint64 posted = mPosted.loadRelaxed();
+    quint64 completed = mCompleted.loadRelaxed();
+    QJsonObject stats;
+    stats["jobs"] = qint64(completed);
+    stats["queued"] = qint64(posted - completed);
+    stats["max_queue"] = qint64(mMaxQueue.loadRelaxed());
+    stats["busy_ms"] = mBusyUs.loadRelaxed() / 1000.0;
+    return stats;
+}
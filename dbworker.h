@@ -0,0 +1,39 @@
+#ifndef DBWORKER_H
+#define DBWORKER_H
+
+#include <QObject>
+#include <QThread>
+#include <QAtomicInteger>
+#include <QJsonObject>
+#include <functional>
+
+// Поток запросов к БД для обработчиков-сопрограмм (см. asynctask.h).
+// Задания выполняются по одному в порядке поступления на собственном соединении SQLite
+// (DatabaseManager открывает его при первом обращении из потока). ASYNC_DB=0 - без потока,
+// запросы выполняются в основном потоке, как раньше.
+class DbWorker : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit DbWorker(QObject *parent = nullptr);
+    ~DbWorker();
+
+    static DbWorker *instance(); // nullptr - запросы к БД выполняются синхронно
+
+    bool start(); // Вызывать из основного потока перед запуском цикла событий
+    void post(std::function<void()> job); // Выполнить job в потоке БД
+    QJsonObject stats() const;
+
+private:
+    static DbWorker *sInstance;
+
+    QThread *mThread;
+    QObject *mReceiver; // Живёт в потоке БД, принимает задания
+    QAtomicInteger<quint64> mPosted;
+    QAtomicInteger<quint64> mCompleted;
+    QAtomicInteger<quint64> mBusyUs; // Суммарное время заданий
+    QAtomicInteger<quint64> mMaxQueue; // Наибольшая длина очереди
+};
+
+#endif // DBWORKER_H
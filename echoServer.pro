@@ -2,8 +2,9 @@ QT -= gui
 
 QT += network #Для работы с сетью
 QT += sql
+QT += websockets #Для браузерных клиентов
 
-CONFIG += c++11 console
+CONFIG += c++20 console
 CONFIG -= app_bundle
 
 # The following define makes your compiler emit warnings if you use
@@ -17,11 +18,38 @@ DEFINES += QT_DEPRECATED_WARNINGS
 # You can also select to disable deprecated APIs only up to a certain version of Qt.
 #DEFINES += QT_DISABLE_DEPRECATED_BEFORE=0x060000    # disables all the APIs deprecated before Qt 6.0.0
 
+# Счётчики выделений памяти по типам сообщений (AllocStats) перехватывают malloc/free glibc:
+# только для замеров, qmake CONFIG+=alloc_stats
+alloc_stats: DEFINES += ALLOCSTATS_HOOKS
+
 SOURCES += \
     DatabaseManager.cpp \
+    allocstats.cpp \
+    botengine.cpp \
+    dbworker.cpp \
+    epolltransport.cpp \
     func2serv.cpp \
+    gamearchiver.cpp \
+    gamemode.cpp \
+    leaderboard.cpp \
+    loadbench.cpp \
     main.cpp \
-    mytcpserver.cpp
+    movejournal.cpp \
+    mytcpserver.cpp \
+    nettransport.cpp \
+    ratelimiter.cpp \
+    requestarena.cpp \
+    requestscanner.cpp \
+    sessionhandoff.cpp \
+    shardlink.cpp \
+    shardrouter.cpp \
+    stalldetector.cpp \
+    startup.cpp \
+    tournamentscheduler.cpp \
+    tracer.cpp \
+    trafficcapture.cpp \
+    trafficreplay.cpp \
+    userdirectory.cpp
 
 # Default rules for deployment.
 qnx: target.path = /tmp/$${TARGET}/bin
@@ -30,5 +58,32 @@ else: unix:!android: target.path = /opt/$${TARGET}/bin
 
 HEADERS += \
     DatabaseManager.h \
+    allocstats.h \
+    asynctask.h \
+    boardkernel.h \
+    botengine.h \
+    cpufeatures.h \
+    dbworker.h \
+    epolltransport.h \
     func2serv.h \
-    mytcpserver.h
+    gamearchiver.h \
+    gamemode.h \
+    leaderboard.h \
+    loadbench.h \
+    movejournal.h \
+    mytcpserver.h \
+    nettransport.h \
+    objectpool.h \
+    ratelimiter.h \
+    requestarena.h \
+    requestscanner.h \
+    sessionhandoff.h \
+    shardlink.h \
+    shardrouter.h \
+    stalldetector.h \
+    startup.h \
+    tournamentscheduler.h \
+    tracer.h \
+    trafficcapture.h \
+    trafficreplay.h \
+    userdirectory.h
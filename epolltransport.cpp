@@ -0,0 +1,526 @@
+#include "epolltransport.h"
+#include <QSocketNotifier>
+#include <QTimer>
+#include <QElapsedTimer>
+#include <QDebug>
+
+#ifdef Q_OS_LINUX
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstring>
+#define EPOLL_SUPPORTED
+#endif
+
+namespace {
+
+const int MaxEvents = 256; // Событий за один epoll_wait
+const int ReadChunk = 4096; // Свободное место в inbox перед read()
+const int MaxPendingRequest = 64 * 1024; // Строка без перевода строки длиннее - соединение закрывается
+const int DefaultIdleReleaseMs = 10000;
+
+#ifdef EPOLL_SUPPORTED
+bool makeNonBlocking(int fd)
+{
+    int flags = fcntl(fd, F_GETFL, 0);
+    return flags != -1 && fcntl(fd, F_SETFL, flags | O_NONBLOCK) != -1;
+}
+
+void setNoDelay(int fd)
+{
+    int enable = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &enable, sizeof(enable)); // Ответы - короткие строки
+}
+#endif
+
+} // namespace
+
+bool EpollTransport::isSupported()
+{
+#ifdef EPOLL_SUPPORTED
+    return true;
+#else
+    return false;
+#endif
+}
+
+EpollTransport::EpollTransport(QObject *parent)
+    : NetTransport(parent), mEpollFd(-1), mListenFd(-1), mNotifier(nullptr), mIdleTimer(new QTimer(this)), mPaused(false), mAccepted(0),
+      mWakeups(0), mEvents(0), mReads(0), mBytesIn(0), mRequests(0), mBytesOut(0), mQueuedWrites(0), mReleasedBuffers(0),
+      mIoBufferBytes(-1)
+{
+    int idleReleaseMs = qEnvironmentVariableIsSet("NET_IDLE_RELEASE_MS") ? qEnvironmentVariableIntValue("NET_IDLE_RELEASE_MS")
+                                                                          : DefaultIdleReleaseMs;
+    if (idleReleaseMs > 0) {
+        connect(mIdleTimer, &QTimer::timeout, this, &EpollTransport::slotReleaseIdle);
+        mIdleTimer->start(idleReleaseMs);
+    }
+}
+
+EpollTransport::~EpollTransport()
+{
+    for (NetConnection *connection : connections()) {
+        connection->disconnect();
+        closeConnection(connection);
+    }
+    close();
+#ifdef EPOLL_SUPPORTED
+    if (mEpollFd >= 0) {
+        ::close(mEpollFd);
+    }
+#endif
+}
+
+bool EpollTransport::open()
+{
+#ifdef EPOLL_SUPPORTED
+    if (mEpollFd >= 0) {
+        return true;
+    }
+    mEpollFd = epoll_create1(EPOLL_CLOEXEC);
+    if (mEpollFd < 0) {
+        qDebug() << "epoll_create1 failed:" << strerror(errno);
+        return false;
+    }
+    // Дескриптор epoll готов к чтению, пока в нём есть события - этого достаточно циклу событий Qt
+    mNotifier = new QSocketNotifier(mEpollFd, QSocketNotifier::Read, this);
+    connect(mNotifier, &QSocketNotifier::activated, this, &EpollTransport::slotEvents);
+    return true;
+#else
+    return false;
+#endif
+}
+
+bool EpollTransport::listen(quint16 port)
+{
+#ifdef EPOLL_SUPPORTED
+    if (!open()) {
+        return false;
+    }
+    // Как QHostAddress::Any у QTcpServer: IPv6 с приёмом IPv4, без IPv6 - только IPv4
+    int fd = socket(AF_INET6, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    bool ipv6 = fd >= 0;
+    if (!ipv6) {
+        fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    }
+    if (fd < 0) {
+        qDebug() << "Server is NOT started:" << strerror(errno);
+        return false;
+    }
+    int enable = 1;
+    int disable = 0;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &enable, sizeof(enable));
+    int bound;
+    if (ipv6) {
+        setsockopt(fd, IPPROTO_IPV6, IPV6_V6ONLY, &disable, sizeof(disable));
+        sockaddr_in6 address;
+        memset(&address, 0, sizeof(address));
+        address.sin6_family = AF_INET6;
+        address.sin6_addr = in6addr_any;
+        address.sin6_port = htons(port);
+        bound = bind(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address));
+    } else {
+        sockaddr_in address;
+        memset(&address, 0, sizeof(address));
+        address.sin_family = AF_INET;
+        address.sin_addr.s_addr = htonl(INADDR_ANY);
+        address.sin_port = htons(port);
+        bound = bind(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address));
+    }
+    if (bound != 0 || ::listen(fd, SOMAXCONN) != 0) {
+        qDebug() << "Server is NOT started:" << strerror(errno);
+        ::close(fd);
+        return false;
+    }
+    if (!watchListener(fd)) {
+        ::close(fd);
+        return false;
+    }
+    qDebug() << "Server is started! (epoll transport)";
+    return true;
+#else
+    Q_UNUSED(port);
+    return false;
+#endif
+}
+
+bool EpollTransport::adoptListener(int descriptor)
+{
+#ifdef EPOLL_SUPPORTED
+    if (!open() || !makeNonBlocking(descriptor)) {
+        return false;
+    }
+    return watchListener(descriptor);
+#else
+    Q_UNUSED(descriptor);
+    return false;
+#endif
+}
+
+bool EpollTransport::watchListener(int descriptor)
+{
+#ifdef EPOLL_SUPPORTED
+    epoll_event event;
+    memset(&event, 0, sizeof(event));
+    event.events = EPOLLIN | EPOLLET;
+    event.data.ptr = nullptr; // nullptr - слушающий сокет
+    if (epoll_ctl(mEpollFd, EPOLL_CTL_ADD, descriptor, &event) != 0) {
+        qDebug() << "Cannot watch the listening socket:" << strerror(errno);
+        return false;
+    }
+    mListenFd = descriptor;
+    acceptConnections(); // Соединения, ждавшие в очереди до регистрации (передача сессий)
+    return true;
+#else
+    Q_UNUSED(descriptor);
+    return false;
+#endif
+}
+
+NetConnection *EpollTransport::adoptConnection(int descriptor)
+{
+#ifdef EPOLL_SUPPORTED
+    if (!open() || !makeNonBlocking(descriptor)) {
+        return nullptr;
+    }
+    setNoDelay(descriptor);
+    return watchConnection(descriptor);
+#else
+    Q_UNUSED(descriptor);
+    return nullptr;
+#endif
+}
+
+NetConnection *EpollTransport::watchConnection(int descriptor)
+{
+#ifdef EPOLL_SUPPORTED
+    NetConnection *connection = new NetConnection(this, descriptor);
+    epoll_event event;
+    memset(&event, 0, sizeof(event));
+    event.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+    event.data.ptr = connection;
+    if (epoll_ctl(mEpollFd, EPOLL_CTL_ADD, descriptor, &event) != 0) {
+        qDebug() << "Cannot watch client socket:" << strerror(errno);
+        delete connection;
+        return nullptr;
+    }
+    mConnections.insert(connection);
+    return connection;
+#else
+    Q_UNUSED(descriptor);
+    return nullptr;
+#endif
+}
+
+QList<NetConnection*> EpollTransport::connections() const
+{
+    return QList<NetConnection*>(mConnections.cbegin(), mConnections.cend());
+}
+
+void EpollTransport::pause()
+{
+    mPaused = true;
+}
+
+void EpollTransport::resume()
+{
+    mPaused = false;
+    // Edge-triggered: события за время паузы не повторятся - разбираем всё накопленное сами
+    acceptConnections();
+    for (NetConnection *connection : connections()) {
+        if (connection->isOpen()) {
+            deliver(connection);
+        }
+        if (connection->isOpen()) {
+            readConnection(connection);
+        }
+    }
+}
+
+void EpollTransport::close()
+{
+#ifdef EPOLL_SUPPORTED
+    if (mListenFd >= 0) {
+        epoll_ctl(mEpollFd, EPOLL_CTL_DEL, mListenFd, nullptr);
+        ::close(mListenFd);
+        mListenFd = -1;
+    }
+#endif
+}
+
+void EpollTransport::slotEvents()
+{
+#ifdef EPOLL_SUPPORTED
+    ++mWakeups;
+    epoll_event events[MaxEvents];
+    for (;;) {
+        int count = epoll_wait(mEpollFd, events, MaxEvents, 0);
+        if (count < 0 && errno == EINTR) {
+            continue;
+        }
+        if (count <= 0) {
+            break;
+        }
+        mEvents += count;
+        for (int i = 0; i < count; ++i) {
+            NetConnection *connection = static_cast<NetConnection*>(events[i].data.ptr);
+            if (!connection) {
+                if (!mPaused) {
+                    acceptConnections();
+                }
+                continue;
+            }
+            // Соединение могло закрыться, пока разбирались предыдущие события пачки (удаляется через deleteLater)
+            if (!connection->isOpen()) {
+                continue;
+            }
+            if ((events[i].events & EPOLLOUT) && !connection->mOutbox.isEmpty() && !writeOutbox(connection)) {
+                closeConnection(connection);
+                continue;
+            }
+            if (!mPaused && (events[i].events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR))) {
+                readConnection(connection);
+            }
+        }
+        if (count < MaxEvents) {
+            break;
+        }
+    }
+#endif
+}
+
+void EpollTransport::acceptConnections()
+{
+#ifdef EPOLL_SUPPORTED
+    while (mListenFd >= 0 && !mPaused) {
+        int fd = accept4(mListenFd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) {
+                continue;
+            }
+            if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                qDebug() << "accept failed:" << strerror(errno);
+            }
+            return;
+        }
+        setNoDelay(fd);
+        NetConnection *connection = watchConnection(fd);
+        if (!connection) {
+            ::close(fd);
+            continue;
+        }
+        ++mAccepted;
+        emit newConnection(connection);
+    }
+#endif
+}
+
+void EpollTransport::readConnection(NetConnection *connection)
+{
+#ifdef EPOLL_SUPPORTED
+    QByteArray &inbox = connection->mInbox;
+    for (;;) {
+        qsizetype used = inbox.size();
+        inbox.resize(used + ReadChunk); // Внутри уже выделенной ёмкости - без выделений памяти
+        ssize_t received = ::read(connection->mDescriptor, inbox.data() + used, ReadChunk);
+        inbox.resize(used + qMax<qsizetype>(received, 0));
+        if (received > 0) {
+            ++mReads;
+            connection->mActive = true;
+            mBytesIn += quint64(received);
+            continue; // Edge-triggered: читаем до EAGAIN, иначе следующего события может не быть
+        }
+        if (received < 0 && errno == EINTR) {
+            continue;
+        }
+        if (received < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            break;
+        }
+        // Клиент закрыл соединение или ошибка: дочитанное ещё обрабатывается
+        deliver(connection);
+        closeConnection(connection);
+        return;
+    }
+    deliver(connection);
+    if (connection->isOpen() && inbox.size() > MaxPendingRequest) {
+        qDebug() << "Closing client" << connection->mDescriptor << "- request line exceeds" << MaxPendingRequest << "bytes";
+        closeConnection(connection);
+    }
+#else
+    Q_UNUSED(connection);
+#endif
+}
+
+void EpollTransport::deliver(NetConnection *connection)
+{
+    QByteArray &inbox = connection->mInbox;
+    const char *data = inbox.constData();
+    qsizetype size = inbox.size();
+    qsizetype start = 0;
+    while (start < size && !mPaused && connection->isOpen()) {
+        const char *newline = static_cast<const char*>(memchr(data + start, '\n', size_t(size - start)));
+        qsizetype end;
+        if (newline) {
+            end = newline - data + 1;
+        } else if (data[size - 1] == '}') {
+            end = size;
+        } else {
+            break; // Неполная строка - ждём продолжения
+        }
+        qsizetype length = end - start;
+        if (length > 2 || (data[start] != '\r' && data[start] != '\n')) {
+            ++mRequests;
+            mHandler(connection, QByteArray::fromRawData(data + start, length));
+        }
+        start = end;
+    }
+    if (start > 0) {
+        inbox.remove(0, start); // Сдвиг в том же буфере
+    }
+}
+
+bool EpollTransport::send(NetConnection *connection, const char *data, qsizetype size)
+{
+#ifdef EPOLL_SUPPORTED
+    qsizetype offset = 0;
+    // Пока outbox не пуст, порядок байт сохраняет только очередь
+    while (connection->mOutbox.isEmpty() && offset < size) {
+        ssize_t sent = ::send(connection->mDescriptor, data + offset, size_t(size - offset), MSG_NOSIGNAL);
+        if (sent > 0) {
+            offset += sent;
+            continue;
+        }
+        if (sent < 0 && errno == EINTR) {
+            continue;
+        }
+        if (sent < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            break;
+        }
+        return false; // Соединение закроется по EPOLLERR / EPOLLHUP
+    }
+    mBytesOut += quint64(offset);
+    connection->mActive = true;
+    if (offset < size) {
+        ++mQueuedWrites;
+        connection->mOutbox.append(data + offset, size - offset);
+    }
+    return true;
+#else
+    Q_UNUSED(connection);
+    Q_UNUSED(data);
+    Q_UNUSED(size);
+    return false;
+#endif
+}
+
+bool EpollTransport::writeOutbox(NetConnection *connection)
+{
+#ifdef EPOLL_SUPPORTED
+    QByteArray &outbox = connection->mOutbox;
+    qsizetype offset = 0;
+    while (offset < outbox.size()) {
+        ssize_t sent = ::send(connection->mDescriptor, outbox.constData() + offset, size_t(outbox.size() - offset), MSG_NOSIGNAL);
+        if (sent > 0) {
+            offset += sent;
+            continue;
+        }
+        if (sent < 0 && errno == EINTR) {
+            continue;
+        }
+        if (sent < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            break;
+        }
+        return false;
+    }
+    mBytesOut += quint64(offset);
+    outbox.remove(0, offset);
+    return true;
+#else
+    Q_UNUSED(connection);
+    return false;
+#endif
+}
+
+bool EpollTransport::flush(NetConnection *connection, int timeoutMs)
+{
+#ifdef EPOLL_SUPPORTED
+    QElapsedTimer timer;
+    timer.start();
+    while (!connection->mOutbox.isEmpty()) {
+        if (!writeOutbox(connection)) {
+            return false;
+        }
+        qint64 remainingMs = timeoutMs - timer.elapsed();
+        if (connection->mOutbox.isEmpty() || remainingMs <= 0) {
+            break;
+        }
+        pollfd descriptor = {connection->mDescriptor, POLLOUT, 0};
+        poll(&descriptor, 1, int(remainingMs));
+    }
+    return connection->mOutbox.isEmpty();
+#else
+    Q_UNUSED(connection);
+    Q_UNUSED(timeoutMs);
+    return false;
+#endif
+}
+
+void EpollTransport::closeConnection(NetConnection *connection)
+{
+#ifdef EPOLL_SUPPORTED
+    if (!connection->isOpen()) {
+        return;
+    }
+    epoll_ctl(mEpollFd, EPOLL_CTL_DEL, connection->mDescriptor, nullptr);
+    ::close(connection->mDescriptor);
+    connection->mDescriptor = -1;
+    connection->mOutbox.clear();
+    mConnections.remove(connection);
+    emit connection->disconnected();
+#else
+    Q_UNUSED(connection);
+#endif
+}
+
+void EpollTransport::slotReleaseIdle()
+{
+    // Соединения всё равно обходятся здесь - заодно считаем их буферы, чтобы stats() не делал своего обхода
+    qint64 bufferBytes = 0;
+    for (NetConnection *connection : std::as_const(mConnections)) {
+        if (!connection->mActive && connection->mInbox.isEmpty() && connection->mOutbox.isEmpty()
+            && (connection->mInbox.capacity() > 0 || connection->mOutbox.capacity() > 0)) {
+            connection->mInbox = QByteArray();
+            connection->mOutbox = QByteArray();
+            ++mReleasedBuffers;
+        }
+        connection->mActive = false;
+        bufferBytes += connection->mInbox.capacity() + connection->mOutbox.capacity();
+    }
+    mIoBufferBytes = bufferBytes;
+}
+
+QJsonObject EpollTransport::stats() const
+{
+    QJsonObject stats;
+    stats["name"] = name();
+    stats["connections"] = mConnections.size();
+    stats["accepted"] = qint64(mAccepted);
+    stats["wakeups"] = qint64(mWakeups);
+    stats["events"] = qint64(mEvents);
+    stats["events_per_wakeup"] = mWakeups ? double(mEvents) / mWakeups : 0.0;
+    stats["reads"] = qint64(mReads);
+    stats["bytes_in"] = qint64(mBytesIn);
+    stats["requests"] = qint64(mRequests);
+    stats["bytes_out"] = qint64(mBytesOut);
+    stats["queued_writes"] = qint64(mQueuedWrites);
+    if (mIoBufferBytes >= 0) {
+        stats["io_buffer_bytes"] = mIoBufferBytes;
+    }
+    stats["released_buffers"] = qint64(mReleasedBuffers);
+    return stats;
+}
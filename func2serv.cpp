@@ -1,8 +1,10 @@
 #include "func2serv.h"
 #include "DatabaseManager.h"
 #include "mytcpserver.h"
+#include "tracer.h"
 #include <QJsonDocument>
 #include <QJsonObject>
+#include <QJsonArray>
 #include <QDebug>
 
 // Функция формирования JSON-ответа
@@ -16,24 +18,30 @@ QByteArray createJsonResponse(const QString &type, const QString &status, const
 }
 
 // Функция парсинга команд
-QByteArray parse(const QString &input, MyTcpServer *server) {
+Task<QByteArray> parse(QString input, MyTcpServer *server) {
     qDebug() << "Received input:" << input;
-    QJsonDocument doc = QJsonDocument::fromJson(input.toUtf8());
+    QJsonDocument doc;
+    {
+        Tracer::Span span("parse_json");
+        doc = QJsonDocument::fromJson(input.toUtf8());
+    }
     if (!doc.isObject()) {
         qDebug() << "Invalid JSON format, input:" << input;
-        return createJsonResponse("error", "error", "Invalid JSON format");
+        co_return createJsonResponse("error", "error", "Invalid JSON format");
     }
 
     QJsonObject jsonObj = doc.object();
     if (!jsonObj.contains("type")) {
         qDebug() << "Missing type field in JSON, input:" << input;
-        return createJsonResponse("error", "error", "Missing type field");
+        co_return createJsonResponse("error", "error", "Missing type field");
     }
 
     QString type = jsonObj["type"].toString();
     qDebug() << "Parsed type:" << type;
     if (type == "register") {
-        QByteArray response = handleRegister(input);
+        // Проверка и вставка пользователя - в потоке БД, основной поток тем временем обслуживает других
+        auto registerUser = onDatabase(server, [input]() { return handleRegister(input); });
+        QByteArray response = co_await registerUser;
         QJsonDocument doc = QJsonDocument::fromJson(response);
         if (doc.isObject()) {
             QJsonObject obj = doc.object();
@@ -43,9 +51,12 @@ QByteArray parse(const QString &input, MyTcpServer *server) {
                 response = QJsonDocument(obj).toJson(QJsonDocument::Compact) + "\r\n";
             }
         }
-        return response;
+        co_return response;
     } else if (type == "login") {
-        QByteArray response = slotLogin(input);
+        // Известный справочнику ник проверяется в памяти на месте, без перехода в DbWorker
+        bool offload = !DatabaseManager::getInstance()->isKnownUser(jsonObj["nickname"].toString());
+        auto login = onDatabase(server, [input]() { return slotLogin(input); }, offload);
+        QByteArray response = co_await login;
         QJsonDocument doc = QJsonDocument::fromJson(response);
         if (doc.isObject()) {
             QJsonObject obj = doc.object();
@@ -55,19 +66,27 @@ QByteArray parse(const QString &input, MyTcpServer *server) {
                 response = QJsonDocument(obj).toJson(QJsonDocument::Compact) + "\r\n";
             }
         }
-        return response;
+        co_return response;
     } else if (type == "start_game") {
-        return handleStartGame(input, server);
+        co_return co_await handleStartGame(input, server);
     } else if (type == "place_ship") {
-        return handlePlaceShip(input, server);
+        co_return co_await handlePlaceShip(input, server);
     } else if (type == "make_move") {
-        return handleMakeMove(input, server);
+        co_return co_await handleMakeMove(input, server);
+    } else if (type == "make_salvo") {
+        co_return co_await handleMakeSalvo(input, server);
     } else if (type == "ready_to_battle") {
-        return createJsonResponse("ready_to_battle", "success", "Ready status received");
+        co_return createJsonResponse("ready_to_battle", "success", "Ready status received");
+    } else if (type == "leaderboard") {
+        co_return co_await handleLeaderboard(input, server);
+    } else if (type == "game_history") {
+        co_return co_await handleGameHistory(input, server);
+    } else if (type == "tournament_status") {
+        co_return co_await handleTournamentStatus(input, server);
     }
 
     qDebug() << "Unknown command type:" << type;
-    return createJsonResponse("error", "error", "Unknown command");
+    co_return createJsonResponse("error", "error", "Unknown command");
 }
 
 bool parseRegisterData(const QString &data, QString &nickname, QString &email, QString &password) {
@@ -108,34 +127,26 @@ QByteArray handleRegister(const QString &data) {
     if (!parseRegisterData(data, nickname, email, password)) {
         return createJsonResponse("register", "error", "Invalid registration data");
     }
+    if (MyTcpServer::isBot(nickname)) {
+        return createJsonResponse("register", "error", "Nickname is reserved"); // Ник встроенного бота
+    }
 
     DatabaseManager *db = DatabaseManager::getInstance();
-    QSqlDatabase database = db->getDatabase();
-    if (!database.isOpen()) {
+    if (!db->isOpen()) {
         qDebug() << "Database is not open in handleRegister";
         return createJsonResponse("register", "error", "Database is not open");
     }
 
-    QSqlQuery query(database);
-    query.prepare("SELECT COUNT(*) FROM User WHERE nickname = :nickname OR email = :email");
-    query.bindValue(":nickname", nickname);
-    query.bindValue(":email", email);
-
-    qDebug() << "Executing query in handleRegister: SELECT COUNT(*) FROM User WHERE nickname =" << nickname << "OR email =" << email;
-
-    if (!query.exec()) {
-        qDebug() << "Database query failed (SELECT) in handleRegister:" << query.lastError().text();
-        return createJsonResponse("register", "error", "Database query failed");
-    }
-
-    query.next();
-    if (query.value(0).toInt() > 0) {
+    // Занятость ника и e-mail - по справочнику в памяти, SQLite нужен только для вставки
+    if (db->isUserTaken(nickname, email)) {
         return createJsonResponse("register", "error", "User already exists");
     }
 
     bool success = db->addUser(nickname, email, password);
     if (success) {
         return createJsonResponse("register", "success", "User registered successfully");
+    } else if (db->isUserTaken(nickname, email)) {
+        return createJsonResponse("register", "error", "User already exists"); // Зарегистрирован через другой шард
     } else {
         return createJsonResponse("register", "error", "Registration failed");
     }
@@ -146,27 +157,17 @@ QByteArray slotLogin(const QString &data) {
     if (!parseLoginData(data, nickname, password)) {
         return createJsonResponse("login", "error", "Invalid login data");
     }
+    if (MyTcpServer::isBot(nickname)) {
+        return createJsonResponse("login", "error", "Nickname is reserved");
+    }
 
     DatabaseManager *db = DatabaseManager::getInstance();
-    QSqlDatabase database = db->getDatabase();
-    if (!database.isOpen()) {
+    if (!db->isOpen()) {
         qDebug() << "Database is not open in slotLogin";
         return createJsonResponse("login", "error", "Database is not open");
     }
 
-    QSqlQuery query(database);
-    query.prepare("SELECT * FROM User WHERE nickname = :nickname AND password = :password");
-    query.bindValue(":nickname", nickname);
-    query.bindValue(":password", password);
-
-    qDebug() << "Executing query in slotLogin: SELECT * FROM User WHERE nickname =" << nickname << "AND password =" << password;
-
-    if (!query.exec()) {
-        qDebug() << "Database query failed (SELECT) in slotLogin:" << query.lastError().text();
-        return createJsonResponse("login", "error", "Database query failed");
-    }
-
-    if (query.next()) {
+    if (db->checkLogin(nickname, password)) {
         qDebug() << "Login successful";
         return createJsonResponse("login", "success", "Login successful");
     } else {
@@ -175,35 +176,83 @@ QByteArray slotLogin(const QString &data) {
     }
 }
 
-QByteArray handleStartGame(const QString &data, MyTcpServer *server) {
+Task<QByteArray> handleStartGame(QString data, MyTcpServer *server) {
     QJsonDocument doc = QJsonDocument::fromJson(data.toUtf8());
     if (!doc.isObject()) {
-        return createJsonResponse("start_game", "error", "Invalid JSON format");
+        co_return createJsonResponse("start_game", "error", "Invalid JSON format");
     }
 
     QJsonObject jsonObj = doc.object();
     QString nickname = jsonObj["nickname"].toString();
     if (nickname.isEmpty()) {
-        return createJsonResponse("start_game", "error", "Missing nickname");
+        co_return createJsonResponse("start_game", "error", "Missing nickname");
     }
 
     if (!server) {
-        return createJsonResponse("start_game", "error", "Server error");
+        co_return createJsonResponse("start_game", "error", "Server error");
+    }
+
+    // Игра против встроенного бота: бот становится вторым игроком
+    bool vsBot = jsonObj["vs_bot"].toBool();
+    if (vsBot && server->getPlayerCount() != 0) {
+        co_return createJsonResponse("start_game", "error", "Game already in progress");
+    }
+
+    // Режим игры (по умолчанию классический 10x10); у матча турнира режим задан турниром
+    QString modeName = jsonObj["mode"].toString();
+    const GameMode *scheduledMode = server->scheduledMode(nickname);
+    if (scheduledMode && vsBot) {
+        co_return createJsonResponse("start_game", "error", "Tournament game cannot be played against the bot");
+    }
+    const GameMode *mode = scheduledMode ? scheduledMode : modeName.isEmpty() ? &GameMode::classic() : GameMode::find(modeName);
+    if (!mode) {
+        co_return createJsonResponse("start_game", "error", "Unknown game mode, expected one of: " + GameMode::names().join(", "));
+    }
+    if (vsBot && mode != &GameMode::classic()) {
+        co_return createJsonResponse("start_game", "error", "Bot plays classic mode only");
+    }
+    if (!server->selectGameMode(*mode)) {
+        co_return createJsonResponse("start_game", "error", "Game mode does not match the waiting player");
     }
 
     server->addPlayerToGame(nickname);
+    if (vsBot && !server->addBotToGame(jsonObj["difficulty"].toString())) {
+        co_return createJsonResponse("start_game", "error", "Failed to add bot");
+    }
     if (server->getPlayerCount() == 2) {
         QString opponent = server->getOpponent(nickname);
-        DatabaseManager *db = DatabaseManager::getInstance();
-        int gameId = db->createGame(nickname, opponent);
+        // Партия турнира создана заранее вместе со всем туром - новую не создаём
+        int gameId = server->scheduledGame(nickname, opponent);
+        if (gameId == -1) {
+            DatabaseManager *db = DatabaseManager::getInstance();
+            auto createGame = onDatabase(server, [db, nickname, opponent, mode]() { return db->createGame(nickname, opponent, *mode); });
+            gameId = co_await createGame;
+            // Пока партия создавалась, игрок или соперник мог уйти: созданная партия сразу считается оконченной
+            if (gameId != -1 && !server->isGameCurrent(-1, nickname, opponent)) {
+                qDebug() << "Game" << gameId << "for" << nickname << "and" << opponent << "is abandoned: a player left while it was created";
+                auto finishGame = onDatabase(server, [db, gameId]() { return db->finishGame(gameId); });
+                co_await finishGame;
+                co_return createJsonResponse("start_game", "error", "Opponent left before the game was created");
+            }
+        }
         if (gameId != -1) {
             server->currentGameId = gameId;
+            if (MyTcpServer::isBot(opponent)) {
+                co_await server->placeBotFleet(gameId);
+                if (!server->isGameCurrent(gameId, nickname, opponent)) {
+                    co_return createJsonResponse("start_game", "error", "Game is over");
+                }
+            }
             QJsonObject responseObj;
             responseObj["type"] = "game_ready";
             responseObj["status"] = "success";
             responseObj["message"] = "Please place your ships and confirm readiness";
             responseObj["game_id"] = gameId;
             responseObj["opponent"] = opponent;
+            QJsonObject modeObj = mode->toJson();
+            for (auto it = modeObj.constBegin(); it != modeObj.constEnd(); ++it) {
+                responseObj[it.key()] = it.value();
+            }
             QByteArray response = QJsonDocument(responseObj).toJson(QJsonDocument::Compact) + "\r\n";
             server->sendMessageToUser(nickname, response);
 
@@ -211,23 +260,23 @@ QByteArray handleStartGame(const QString &data, MyTcpServer *server) {
             response = QJsonDocument(responseObj).toJson(QJsonDocument::Compact) + "\r\n";
             server->sendMessageToUser(opponent, response);
         } else {
-            return createJsonResponse("start_game", "error", "Failed to create game");
+            co_return createJsonResponse("start_game", "error", "Failed to create game");
         }
     }
 
-    return createJsonResponse("start_game", "waiting", "Waiting for opponent");
+    co_return createJsonResponse("start_game", "waiting", "Waiting for opponent");
 }
 
-QByteArray handlePlaceShip(const QString &data, MyTcpServer *server) {
+Task<QByteArray> handlePlaceShip(QString data, MyTcpServer *server) {
     QJsonDocument doc = QJsonDocument::fromJson(data.toUtf8());
     if (!doc.isObject()) {
-        return createJsonResponse("place_ship", "error", "Invalid JSON format");
+        co_return createJsonResponse("place_ship", "error", "Invalid JSON format");
     }
 
     QJsonObject jsonObj = doc.object();
     if (!jsonObj.contains("nickname") || !jsonObj.contains("game_id") || !jsonObj.contains("x") ||
         !jsonObj.contains("y") || !jsonObj.contains("size") || !jsonObj.contains("is_horizontal")) {
-        return createJsonResponse("place_ship", "error", "Missing required fields");
+        co_return createJsonResponse("place_ship", "error", "Missing required fields");
     }
 
     QString nickname = jsonObj["nickname"].toString();
@@ -238,44 +287,53 @@ QByteArray handlePlaceShip(const QString &data, MyTcpServer *server) {
     bool isHorizontal = jsonObj["is_horizontal"].toBool();
 
     if (nickname.isEmpty()) {
-        return createJsonResponse("place_ship", "error", "Invalid nickname");
+        co_return createJsonResponse("place_ship", "error", "Invalid nickname");
     }
 
     if (gameId != server->getGameId()) {
-        return createJsonResponse("place_ship", "error", "Invalid game ID");
+        co_return createJsonResponse("place_ship", "error", "Invalid game ID");
     }
 
-    // Проверка корректности координат и размера
-    if (x < 0 || y < 0 || size < 1 || size > 4 || x >= 10 || y >= 10) {
-        return createJsonResponse("place_ship", "error", "Invalid ship coordinates or size");
+    // Проверка корректности координат и размера по доске режима; состав флота и касания проверяет saveShip
+    const GameMode &mode = server->getGameMode();
+    if (x < 0 || y < 0 || size < 1 || size > GameMode::MaxShipSize || x >= mode.boardSize || y >= mode.boardSize) {
+        co_return createJsonResponse("place_ship", "error", "Invalid ship coordinates or size");
     }
-    if (isHorizontal && x + size > 10) {
-        return createJsonResponse("place_ship", "error", "Ship exceeds horizontal board limits");
+    if (isHorizontal && x + size > mode.boardSize) {
+        co_return createJsonResponse("place_ship", "error", "Ship exceeds horizontal board limits");
     }
-    if (!isHorizontal && y + size > 10) {
-        return createJsonResponse("place_ship", "error", "Ship exceeds vertical board limits");
+    if (!isHorizontal && y + size > mode.boardSize) {
+        co_return createJsonResponse("place_ship", "error", "Ship exceeds vertical board limits");
     }
 
+    // Как и выстрел: в потоке БД, кроме режима журнала (журнал пишется только из основного потока)
     DatabaseManager *db = DatabaseManager::getInstance();
-    if (db->saveShip(gameId, nickname, x, y, size, isHorizontal)) {
+    auto saveShip = onDatabase(server, [db, gameId, nickname, x, y, size, isHorizontal]() {
+        QString error;
+        bool saved = db->saveShip(gameId, nickname, x, y, size, isHorizontal, &error);
+        return qMakePair(saved, error);
+    }, !db->isJournaled());
+    QPair<bool, QString> saved = co_await saveShip;
+    QString error = saved.second;
+    if (saved.first) {
         qDebug() << "Ship placed successfully for" << nickname << ": game_id=" << gameId
                  << ", x=" << x << ", y=" << y << ", size=" << size << ", is_horizontal=" << isHorizontal;
-        return createJsonResponse("place_ship", "success", "Ship placed successfully");
+        co_return createJsonResponse("place_ship", "success", "Ship placed successfully");
     } else {
-        qDebug() << "Failed to place ship for" << nickname << ": game_id=" << gameId;
-        return createJsonResponse("place_ship", "error", "Failed to place ship");
+        qDebug() << "Failed to place ship for" << nickname << ": game_id=" << gameId << error;
+        co_return createJsonResponse("place_ship", "error", error.isEmpty() ? QString("Failed to place ship") : error);
     }
 }
 
-QByteArray handleMakeMove(const QString &data, MyTcpServer *server) {
+Task<QByteArray> handleMakeMove(QString data, MyTcpServer *server) {
     QJsonDocument doc = QJsonDocument::fromJson(data.toUtf8());
     if (!doc.isObject()) {
-        return createJsonResponse("make_move", "error", "Invalid JSON format");
+        co_return createJsonResponse("make_move", "error", "Invalid JSON format");
     }
 
     QJsonObject jsonObj = doc.object();
     if (!jsonObj.contains("nickname") || !jsonObj.contains("game_id") || !jsonObj.contains("x") || !jsonObj.contains("y")) {
-        return createJsonResponse("make_move", "error", "Missing required fields");
+        co_return createJsonResponse("make_move", "error", "Missing required fields");
     }
 
     QString nickname = jsonObj["nickname"].toString();
@@ -284,31 +342,29 @@ QByteArray handleMakeMove(const QString &data, MyTcpServer *server) {
     int y = jsonObj["y"].toInt();
 
     if (gameId != server->getGameId()) {
-        return createJsonResponse("make_move", "error", "Invalid game ID");
+        co_return createJsonResponse("make_move", "error", "Invalid game ID");
     }
 
+    // Ходы журнала пишутся только из основного потока - в режиме журнала выстрел выполняется сразу
     DatabaseManager *db = DatabaseManager::getInstance();
-    QString currentTurn = db->getCurrentTurn(gameId);
-    if (currentTurn != nickname) {
-        return createJsonResponse("make_move", "error", "Not your turn");
+    auto applyMove = onDatabase(server, [db, gameId, nickname, x, y]() { return db->applyMove(gameId, nickname, x, y); },
+                                !db->isJournaled());
+    MoveResult move = co_await applyMove;
+    if (move.status == MoveResult::NotYourTurn) {
+        co_return createJsonResponse("make_move", "error", "Not your turn");
     }
 
-    QString result = db->checkMove(gameId, nickname, x, y);
-    if (result == "error") {
-        return createJsonResponse("make_move", "error", "Failed to process move");
+    if (move.status == MoveResult::Error) {
+        co_return createJsonResponse("make_move", "error", "Failed to process move");
     }
 
-    if (result == "already_shot") {
-        return createJsonResponse("make_move", "error", "Cell already shot");
+    if (move.status == MoveResult::AlreadyShot) {
+        co_return createJsonResponse("make_move", "error", "Cell already shot");
     }
 
-    db->saveMove(gameId, nickname, x, y, result);
-
-    QString opponent = server->getOpponent(nickname);
-    QString nextTurn = (result != "hit" && result != "sunk") ? opponent : nickname;
-    if (result != "hit" && result != "sunk") {
-        db->updateTurn(gameId, opponent);
-    }
+    QString result = move.resultString();
+    QString opponent = move.opponent;
+    QString nextTurn = move.nextTurn;
 
     QJsonObject response;
     response["type"] = "make_move";
@@ -328,5 +384,174 @@ QByteArray handleMakeMove(const QString &data, MyTcpServer *server) {
 
     server->sendMessageToUser(opponent, QJsonDocument(opponentResponse).toJson(QJsonDocument::Compact) + "\r\n");
 
-    return QJsonDocument(response).toJson(QJsonDocument::Compact) + "\r\n";
+    co_return QJsonDocument(response).toJson(QJsonDocument::Compact) + "\r\n";
+}
+
+Task<QByteArray> handleMakeSalvo(QString data, MyTcpServer *server) {
+    QJsonDocument doc = QJsonDocument::fromJson(data.toUtf8());
+    if (!doc.isObject()) {
+        co_return createJsonResponse("make_salvo", "error", "Invalid JSON format");
+    }
+
+    QJsonObject jsonObj = doc.object();
+    if (!jsonObj.contains("nickname") || !jsonObj.contains("game_id") || !jsonObj["shots"].isArray()) {
+        co_return createJsonResponse("make_salvo", "error", "Missing required fields");
+    }
+
+    QString nickname = jsonObj["nickname"].toString();
+    int gameId = jsonObj["game_id"].toInt();
+    if (gameId != server->getGameId()) {
+        co_return createJsonResponse("make_salvo", "error", "Invalid game ID");
+    }
+
+    // Выстрелы залпа: [{"x": 1, "y": 2}, ...]
+    const QJsonArray shots = jsonObj["shots"].toArray();
+    QVector<QPoint> cells;
+    cells.reserve(shots.size());
+    for (const QJsonValue &shot : shots) {
+        QJsonObject cell = shot.toObject();
+        if (!cell.contains("x") || !cell.contains("y")) {
+            co_return createJsonResponse("make_salvo", "error", "Each shot needs x and y");
+        }
+        cells.append(QPoint(cell["x"].toInt(), cell["y"].toInt()));
+    }
+
+    co_return co_await server->processSalvo(nickname, gameId, cells);
+}
+
+static QJsonObject statsToJson(const PlayerStats &stats) {
+    QJsonObject obj;
+    obj["nickname"] = stats.nickname;
+    obj["wins"] = stats.wins;
+    obj["losses"] = stats.losses;
+    obj["shots"] = stats.shots;
+    obj["hits"] = stats.hits;
+    obj["accuracy"] = stats.accuracy();
+    return obj;
+}
+
+Task<QByteArray> handleLeaderboard(QString data, MyTcpServer *server) {
+    QJsonDocument doc = QJsonDocument::fromJson(data.toUtf8());
+    if (!doc.isObject()) {
+        co_return createJsonResponse("leaderboard", "error", "Invalid JSON format");
+    }
+
+    if (!server) {
+        co_return createJsonResponse("leaderboard", "error", "Server error");
+    }
+
+    QJsonObject jsonObj = doc.object();
+    int limit = jsonObj.contains("limit") ? jsonObj["limit"].toInt() : 10;
+    limit = qBound(1, limit, 100);
+
+    // Таблица в памяти шарда знает только его партии - перед ответом она догоняет общую Stats
+    co_await server->refreshLeaderboard();
+
+    QJsonArray top;
+    int position = 1;
+    for (const PlayerStats &stats : server->getTopPlayers(limit)) {
+        QJsonObject entry = statsToJson(stats);
+        entry["rank"] = position++;
+        top.append(entry);
+    }
+
+    QJsonObject response;
+    response["type"] = "leaderboard";
+    response["status"] = "success";
+    response["top"] = top;
+
+    // Место и статистика запрашивающего игрока, если он указан
+    QString nickname = jsonObj["nickname"].toString();
+    if (!nickname.isEmpty()) {
+        QJsonObject me = statsToJson(server->getPlayerStats(nickname));
+        me["rank"] = server->getPlayerRank(nickname);
+        response["me"] = me;
+    }
+
+    co_return QJsonDocument(response).toJson(QJsonDocument::Compact) + "\r\n";
+}
+
+Task<QByteArray> handleGameHistory(QString data, MyTcpServer *server) {
+    QJsonDocument doc = QJsonDocument::fromJson(data.toUtf8());
+    if (!doc.isObject()) {
+        co_return createJsonResponse("game_history", "error", "Invalid JSON format");
+    }
+
+    QJsonObject jsonObj = doc.object();
+    if (!jsonObj.contains("game_id")) {
+        co_return createJsonResponse("game_history", "error", "Missing game_id");
+    }
+    int gameId = jsonObj["game_id"].toInt();
+
+    // Партия читается из рабочих таблиц или, если уже перенесена, из архива
+    DatabaseManager *db = DatabaseManager::getInstance();
+    auto loadRecord = onDatabase(server, [db, gameId]() { return db->loadGameRecord(gameId); });
+    GameRecord record = co_await loadRecord;
+    if (!record.found) {
+        co_return createJsonResponse("game_history", "error", "Game not found");
+    }
+
+    static const char *const Results[] = {"miss", "hit", "sunk"};
+    QJsonArray moves;
+    for (const GameMove &move : record.moves) {
+        QJsonObject entry;
+        entry["player"] = record.players[move.player];
+        entry["x"] = move.x;
+        entry["y"] = move.y;
+        entry["result"] = Results[qMin<int>(move.status, MoveResult::Sunk)];
+        moves.append(entry);
+    }
+
+    QJsonObject response;
+    response["type"] = "game_history";
+    response["status"] = "success";
+    response["game_id"] = gameId;
+    response["archived"] = record.archived;
+    response["players"] = QJsonArray{record.players[0], record.players[1]};
+    response["finished_at"] = record.finishedAt;
+    response["moves"] = moves;
+
+    // Расстановку показываем только для оконченной партии
+    if (record.finishedAt > 0) {
+        QJsonArray fleets;
+        for (const QVector<FleetShip> &fleet : record.fleets) {
+            QJsonArray ships;
+            for (const FleetShip &ship : fleet) {
+                QJsonObject entry;
+                entry["x"] = ship.x;
+                entry["y"] = ship.y;
+                entry["size"] = ship.size;
+                entry["is_horizontal"] = ship.isHorizontal != 0;
+                ships.append(entry);
+            }
+            fleets.append(ships);
+        }
+        response["fleets"] = fleets;
+    }
+
+    co_return QJsonDocument(response).toJson(QJsonDocument::Compact) + "\r\n";
+}
+
+Task<QByteArray> handleTournamentStatus(QString data, MyTcpServer *server) {
+    QJsonDocument doc = QJsonDocument::fromJson(data.toUtf8());
+    if (!doc.isObject()) {
+        co_return createJsonResponse("tournament_status", "error", "Invalid JSON format");
+    }
+
+    QJsonObject jsonObj = doc.object();
+    if (!jsonObj.contains("tournament_id")) {
+        co_return createJsonResponse("tournament_status", "error", "Missing tournament_id");
+    }
+
+    // Турнир ведёт маршрутизатор, ход туров виден любому шарду через общую БД
+    DatabaseManager *db = DatabaseManager::getInstance();
+    int tournamentId = jsonObj["tournament_id"].toInt();
+    auto loadStatus = onDatabase(server, [db, tournamentId]() { return db->tournamentStatus(tournamentId); });
+    QJsonObject response = co_await loadStatus;
+    if (response.isEmpty()) {
+        co_return createJsonResponse("tournament_status", "error", "Tournament not found");
+    }
+    response["type"] = "tournament_status";
+    response["status"] = "success";
+    co_return QJsonDocument(response).toJson(QJsonDocument::Compact) + "\r\n";
 }
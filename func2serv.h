@@ -3,18 +3,24 @@
 
 #include <QByteArray>
 #include <QString>
+#include "asynctask.h"
 
-// Функция обработки запросов
-QByteArray parse(const QString &input, class MyTcpServer *server);
+// Функция обработки запросов (сопрограмма: запросы к БД выполняются в DbWorker, параметры - по значению,
+// так как задача стартует позже вызова)
+Task<QByteArray> parse(QString input, class MyTcpServer *server);
 
 // Функции работы с БД и игрой
 bool parseRegisterData(const QString &data, QString &nickname, QString &email, QString &password);
 bool parseLoginData(const QString &data, QString &nickname, QString &password);
 QByteArray handleRegister(const QString &data);
 QByteArray slotLogin(const QString &data);
-QByteArray handleStartGame(const QString &data, MyTcpServer *server);
-QByteArray handlePlaceShip(const QString &data, MyTcpServer *server);
-QByteArray handleMakeMove(const QString &data, MyTcpServer *server);
+Task<QByteArray> handleStartGame(QString data, MyTcpServer *server);
+Task<QByteArray> handlePlaceShip(QString data, MyTcpServer *server);
+Task<QByteArray> handleMakeMove(QString data, MyTcpServer *server);
+Task<QByteArray> handleMakeSalvo(QString data, MyTcpServer *server);
+Task<QByteArray> handleLeaderboard(QString data, MyTcpServer *server);
+Task<QByteArray> handleGameHistory(QString data, MyTcpServer *server);
+Task<QByteArray> handleTournamentStatus(QString data, MyTcpServer *server);
 QByteArray createJsonResponse(const QString &type, const QString &status, const QString &message);
 
 #endif // FUNC2SERV_H
@@ -0,0 +1,452 @@
+#include "gamearchiver.h"
+#include <QSqlQuery>
+#include <QSqlError>
+#include <QDateTime>
+#include <QMap>
+#include <QThread>
+#include <QDebug>
+#include <cstring>
+
+namespace {
+
+const quint8 PackVersion = 1;
+const int PackHeaderSize = 3; // Версия и число кораблей каждого игрока
+
+const char SqlArchiveCandidates[] = "SELECT game_id, finished_at FROM Game WHERE finished_at IS NOT NULL AND finished_at < :cutoff "
+                                    "ORDER BY finished_at LIMIT :limit";
+const char SqlArchiveGame[] = "SELECT player1, player2, current_turn, finished_at FROM Game WHERE game_id = :game_id";
+const char SqlArchiveFleets[] = "SELECT player, ships FROM Fleet WHERE game_id = :game_id";
+const char SqlArchiveMoves[] = "SELECT player, x, y, result FROM Move WHERE game_id = :game_id ORDER BY move_id";
+const char SqlCreateArchiveTable[] = "CREATE TABLE IF NOT EXISTS archive.GameArchive ("
+                                     "game_id INTEGER PRIMARY KEY, "
+                                     "player1 TEXT NOT NULL, "
+                                     "player2 TEXT NOT NULL, "
+                                     "current_turn TEXT NOT NULL, "
+                                     "finished_at INTEGER NOT NULL, "
+                                     "data BLOB NOT NULL)";
+const char SqlInsertArchived[] = "INSERT OR REPLACE INTO archive.GameArchive (game_id, player1, player2, current_turn, finished_at, data) "
+                                 "VALUES (:game_id, :player1, :player2, :current_turn, :finished_at, :data)";
+const char SqlInsertArchiveIndex[] = "INSERT OR REPLACE INTO ArchivedGame (game_id, archive) VALUES (:game_id, :archive)";
+const char SqlDeleteMoves[] = "DELETE FROM Move WHERE game_id = :game_id";
+const char SqlDeleteFleets[] = "DELETE FROM Fleet WHERE game_id = :game_id";
+const char SqlDeleteGame[] = "DELETE FROM Game WHERE game_id = :game_id";
+const char SqlSelectArchived[] = "SELECT player1, player2, current_turn, finished_at, data FROM GameArchive WHERE game_id = :game_id";
+
+} // namespace
+
+ArchiveWorker::ArchiveWorker(const QString &databaseName, const QString &directory, int afterDays, int batchSize)
+    : mDatabaseName(databaseName), mDirectory(directory), mAfterDays(afterDays), mBatchSize(batchSize)
+{
+}
+
+ArchiveWorker::~ArchiveWorker()
+{
+    if (mDb.isValid()) {
+        QString connectionName = mDb.connectionName();
+        mDb.close();
+        mDb = QSqlDatabase();
+        QSqlDatabase::removeDatabase(connectionName);
+    }
+}
+
+bool ArchiveWorker::openDatabase()
+{
+    if (!mDb.isValid()) {
+        // Соединение создаётся в потоке архиватора - в нём же и используется
+        mDb = QSqlDatabase::addDatabase("QSQLITE", "game_archiver");
+        mDb.setDatabaseName(mDatabaseName);
+        mDb.setConnectOptions("QSQLITE_BUSY_TIMEOUT=5000");
+    }
+    if (!mDb.isOpen() && !mDb.open()) {
+        qDebug() << "Game archiver cannot open DB:" << mDb.lastError().text();
+        return false;
+    }
+    return true;
+}
+
+void ArchiveWorker::run()
+{
+    if (!openDatabase()) {
+        emit finished(0, 0, 0, false);
+        return;
+    }
+
+    // Пачки по mBatchSize партий: рабочие соединения ждут блокировку не дольше одной пачки
+    int total = 0;
+    qint64 bytes = 0;
+    bool ok = true;
+    for (;;) {
+        int games = 0;
+        if (!archiveBatch(&games, &bytes)) {
+            ok = false;
+            break;
+        }
+        if (games == 0) {
+            break;
+        }
+        total += games;
+    }
+
+    int freedPages = 0;
+    if (total > 0) {
+        freedPages = incrementalVacuum();
+        if (freedPages < 0) {
+            ok = false;
+            freedPages = 0;
+        }
+    }
+    emit finished(total, bytes, freedPages, ok);
+}
+
+bool ArchiveWorker::archiveBatch(int *games, qint64 *bytes)
+{
+    QSqlQuery query(mDb);
+    query.setForwardOnly(true);
+    query.prepare(SqlArchiveCandidates);
+    query.bindValue(":cutoff", QDateTime::currentSecsSinceEpoch() - qint64(mAfterDays) * 86400);
+    query.bindValue(":limit", mBatchSize);
+    if (!query.exec()) {
+        qDebug() << "Error selecting games to archive:" << query.lastError().text();
+        return false;
+    }
+    QMap<QString, QVector<int>> groups; // Файл архива -> партии
+    while (query.next()) {
+        groups[GameArchiver::archivePath(mDirectory, query.value(1).toLongLong())].append(query.value(0).toInt());
+        ++*games;
+    }
+    query.finish();
+
+    for (auto it = groups.constBegin(); it != groups.constEnd(); ++it) {
+        if (!archiveGroup(it.key(), it.value(), bytes)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool ArchiveWorker::archiveGroup(const QString &path, const QVector<int> &gameIds, qint64 *bytes)
+{
+    QSqlQuery attachQuery(mDb);
+    attachQuery.prepare("ATTACH DATABASE :path AS archive");
+    attachQuery.bindValue(":path", path);
+    if (!attachQuery.exec()) {
+        qDebug() << "Error attaching archive" << path << ":" << attachQuery.lastError().text();
+        return false;
+    }
+
+    bool ok = true;
+    qint64 written = 0;
+    {
+        // Запросы к archive.* должны быть закрыты до DETACH
+        QSqlQuery createQuery(mDb);
+        ok = createQuery.exec(SqlCreateArchiveTable);
+        if (!ok) {
+            qDebug() << "Error creating archive table in" << path << ":" << createQuery.lastError().text();
+        }
+        ok = ok && mDb.transaction();
+
+        QSqlQuery insertArchived(mDb);
+        QSqlQuery insertIndex(mDb);
+        QSqlQuery deleteMoves(mDb);
+        QSqlQuery deleteFleets(mDb);
+        QSqlQuery deleteGame(mDb);
+        ok = ok && insertArchived.prepare(SqlInsertArchived) && insertIndex.prepare(SqlInsertArchiveIndex)
+             && deleteMoves.prepare(SqlDeleteMoves) && deleteFleets.prepare(SqlDeleteFleets) && deleteGame.prepare(SqlDeleteGame);
+
+        for (int i = 0; ok && i < gameIds.size(); ++i) {
+            int gameId = gameIds[i];
+            GameRecord record;
+            if (!loadGame(gameId, &record)) {
+                ok = false;
+                break;
+            }
+            QByteArray data = GameArchiver::pack(record);
+            written += data.size();
+
+            insertArchived.bindValue(":game_id", gameId);
+            insertArchived.bindValue(":player1", record.players[0]);
+            insertArchived.bindValue(":player2", record.players[1]);
+            insertArchived.bindValue(":current_turn", record.currentTurn);
+            insertArchived.bindValue(":finished_at", record.finishedAt);
+            insertArchived.bindValue(":data", data);
+            insertIndex.bindValue(":game_id", gameId);
+            insertIndex.bindValue(":archive", path);
+            deleteMoves.bindValue(":game_id", gameId);
+            deleteFleets.bindValue(":game_id", gameId);
+            deleteGame.bindValue(":game_id", gameId);
+            ok = insertArchived.exec() && insertIndex.exec() && deleteMoves.exec() && deleteFleets.exec() && deleteGame.exec();
+        }
+
+        if (ok && mDb.commit()) {
+            qDebug() << "Archived" << gameIds.size() << "games into" << path << "(" << written << "bytes)";
+            *bytes += written;
+        } else {
+            qDebug() << "Error archiving games into" << path << ":" << insertArchived.lastError().text() << insertIndex.lastError().text()
+                     << deleteGame.lastError().text() << mDb.lastError().text();
+            mDb.rollback();
+            ok = false;
+        }
+    }
+
+    if (!attachQuery.exec("DETACH DATABASE archive")) {
+        qDebug() << "Error detaching archive" << path << ":" << attachQuery.lastError().text();
+    }
+    return ok;
+}
+
+bool ArchiveWorker::loadGame(int gameId, GameRecord *record)
+{
+    QSqlQuery query(mDb);
+    query.setForwardOnly(true);
+    query.prepare(SqlArchiveGame);
+    query.bindValue(":game_id", gameId);
+    if (!query.exec() || !query.next()) {
+        qDebug() << "Error reading game" << gameId << "for archive:" << query.lastError().text();
+        return false;
+    }
+    record->players[0] = query.value(0).toString();
+    record->players[1] = query.value(1).toString();
+    record->currentTurn = query.value(2).toString();
+    record->finishedAt = query.value(3).toLongLong();
+    query.finish();
+
+    query.prepare(SqlArchiveFleets);
+    query.bindValue(":game_id", gameId);
+    if (!query.exec()) {
+        qDebug() << "Error reading fleets of game" << gameId << ":" << query.lastError().text();
+        return false;
+    }
+    while (query.next()) {
+        int slot = query.value(0).toString() == record->players[0] ? 0 : 1;
+        record->fleets[slot] = DatabaseManager::decodeFleet(query.value(1).toByteArray());
+    }
+    query.finish();
+
+    query.prepare(SqlArchiveMoves);
+    query.bindValue(":game_id", gameId);
+    if (!query.exec()) {
+        qDebug() << "Error reading moves of game" << gameId << ":" << query.lastError().text();
+        return false;
+    }
+    while (query.next()) {
+        GameMove move;
+        move.player = query.value(0).toString() == record->players[0] ? 0 : 1;
+        move.x = quint8(query.value(1).toInt());
+        move.y = quint8(query.value(2).toInt());
+        move.status = quint8(MoveResult::statusFromString(query.value(3).toString()));
+        record->moves.append(move);
+    }
+    query.finish();
+
+    record->found = true;
+    return true;
+}
+
+int ArchiveWorker::incrementalVacuum()
+{
+    QSqlQuery query(mDb);
+    if (!query.exec("PRAGMA freelist_count") || !query.next()) {
+        qDebug() << "Error reading freelist_count:" << query.lastError().text();
+        return -1;
+    }
+    int freePages = query.value(0).toInt();
+    query.finish();
+
+    // Каждый шаг прагмы освобождает одну страницу, а драйвер Qt делает за exec() ровно один шаг
+    // (строк без столбцов он не читает). Поэтому exec() повторяется по числу свободных страниц -
+    // в одной транзакции, чтобы не сбрасывать файл на диск после каждой страницы.
+    QSqlQuery vacuumQuery(mDb);
+    bool ok = vacuumQuery.prepare("PRAGMA incremental_vacuum") && mDb.transaction();
+    for (int i = 0; ok && i < freePages; ++i) {
+        ok = vacuumQuery.exec();
+    }
+    vacuumQuery.finish();
+    if (!ok || !mDb.commit()) {
+        qDebug() << "Error in incremental_vacuum:" << vacuumQuery.lastError().text() << mDb.lastError().text();
+        mDb.rollback();
+        return -1;
+    }
+
+    if (!query.exec("PRAGMA freelist_count") || !query.next()) {
+        qDebug() << "Error reading freelist_count:" << query.lastError().text();
+        return -1;
+    }
+    int freedPages = freePages - query.value(0).toInt();
+    query.finish();
+    qDebug() << "Incremental vacuum returned" << freedPages << "pages";
+    return freedPages;
+}
+
+GameArchiver::GameArchiver(const QString &directory, const QString &databaseName, QObject *parent)
+    : QObject(parent), mDirectory(directory), mDatabaseName(databaseName),
+      mAfterDays(30), mIntervalS(3600), mBatchSize(100),
+      mTimer(nullptr), mThread(nullptr), mWorker(nullptr), mRunning(false),
+      mRuns(0), mFailures(0), mArchivedGames(0), mArchivedBytes(0), mFreedPages(0)
+{
+    if (qEnvironmentVariableIsSet("ARCHIVE_AFTER_DAYS")) {
+        mAfterDays = qMax(0, qEnvironmentVariableIntValue("ARCHIVE_AFTER_DAYS"));
+    }
+    if (qEnvironmentVariableIntValue("ARCHIVE_INTERVAL_S") > 0) {
+        mIntervalS = qEnvironmentVariableIntValue("ARCHIVE_INTERVAL_S");
+    }
+    if (qEnvironmentVariableIntValue("ARCHIVE_BATCH") > 0) {
+        mBatchSize = qEnvironmentVariableIntValue("ARCHIVE_BATCH");
+    }
+}
+
+GameArchiver::~GameArchiver()
+{
+    if (mThread) {
+        mThread->quit();
+        mThread->wait(); // Текущий проход доводится до конца
+    }
+}
+
+bool GameArchiver::start()
+{
+    if (!mDirectory.mkpath(".")) {
+        qDebug() << "Error creating archive directory" << mDirectory.path();
+        return false;
+    }
+
+    mThread = new QThread(this);
+    mWorker = new ArchiveWorker(mDatabaseName, mDirectory.path(), mAfterDays, mBatchSize);
+    mWorker->moveToThread(mThread);
+    connect(mThread, &QThread::finished, mWorker, &QObject::deleteLater);
+    connect(this, &GameArchiver::runRequested, mWorker, &ArchiveWorker::run);
+    connect(mWorker, &ArchiveWorker::finished, this, &GameArchiver::slotFinished);
+    mThread->start();
+
+    mTimer = new QTimer(this);
+    connect(mTimer, &QTimer::timeout, this, &GameArchiver::slotRun);
+    mTimer->start(mIntervalS * 1000);
+
+    qDebug() << "Game archiver is started in" << mDirectory.path() << "- after days:" << mAfterDays
+             << "interval s:" << mIntervalS << "batch:" << mBatchSize;
+    slotRun(); // Первый проход сразу: накопленное до включения архивации
+    return true;
+}
+
+QJsonObject GameArchiver::stats() const
+{
+    QJsonObject stats;
+    stats["running"] = mRunning;
+    stats["runs"] = qint64(mRuns);
+    stats["failures"] = qint64(mFailures);
+    stats["archived_games"] = qint64(mArchivedGames);
+    stats["archived_bytes"] = qint64(mArchivedBytes);
+    stats["freed_pages"] = qint64(mFreedPages);
+    stats["after_days"] = mAfterDays;
+    return stats;
+}
+
+void GameArchiver::slotRun()
+{
+    if (mRunning) {
+        return; // Предыдущий проход ещё идёт
+    }
+    mRunning = true;
+    emit runRequested();
+}
+
+void GameArchiver::slotFinished(int games, qint64 bytes, int freedPages, bool ok)
+{
+    mRunning = false;
+    ++mRuns;
+    if (!ok) {
+        ++mFailures;
+    }
+    mArchivedGames += games;
+    mArchivedBytes += bytes;
+    mFreedPages += freedPages;
+    if (games > 0 || !ok) {
+        qDebug() << "Archive run" << (ok ? "done:" : "FAILED:") << games << "games," << bytes << "bytes," << freedPages << "pages freed";
+    }
+}
+
+QString GameArchiver::archivePath(const QDir &directory, qint64 finishedAt)
+{
+    QDate date = QDateTime::fromSecsSinceEpoch(finishedAt).toUTC().date();
+    return directory.filePath(QString("games-%1-%2.sqlite").arg(date.year()).arg(date.month(), 2, 10, QChar('0')));
+}
+
+QByteArray GameArchiver::pack(const GameRecord &record)
+{
+    QByteArray raw;
+    raw.reserve(PackHeaderSize + (record.fleets[0].size() + record.fleets[1].size()) * int(sizeof(FleetShip))
+                + record.moves.size() * int(sizeof(GameMove)));
+    raw.append(char(PackVersion));
+    raw.append(char(record.fleets[0].size()));
+    raw.append(char(record.fleets[1].size()));
+    for (const QVector<FleetShip> &fleet : record.fleets) {
+        raw.append(reinterpret_cast<const char*>(fleet.constData()), fleet.size() * int(sizeof(FleetShip)));
+    }
+    raw.append(reinterpret_cast<const char*>(record.moves.constData()), record.moves.size() * int(sizeof(GameMove)));
+    return qCompress(raw);
+}
+
+bool GameArchiver::unpack(const QByteArray &data, GameRecord *record)
+{
+    QByteArray raw = qUncompress(data);
+    if (raw.size() < PackHeaderSize || quint8(raw[0]) != PackVersion) {
+        return false;
+    }
+    int ships[2] = {quint8(raw[1]), quint8(raw[2])};
+    int offset = PackHeaderSize;
+    int movesBytes = raw.size() - offset - (ships[0] + ships[1]) * int(sizeof(FleetShip));
+    if (movesBytes < 0 || movesBytes % int(sizeof(GameMove)) != 0) {
+        return false;
+    }
+
+    for (int slot = 0; slot < 2; ++slot) {
+        record->fleets[slot].resize(ships[slot]);
+        if (ships[slot] > 0) {
+            memcpy(record->fleets[slot].data(), raw.constData() + offset, ships[slot] * sizeof(FleetShip));
+        }
+        offset += ships[slot] * int(sizeof(FleetShip));
+    }
+    record->moves.resize(movesBytes / int(sizeof(GameMove)));
+    if (!record->moves.isEmpty()) {
+        memcpy(record->moves.data(), raw.constData() + offset, movesBytes);
+    }
+    return true;
+}
+
+bool GameArchiver::readArchivedGame(const QString &path, int gameId, GameRecord *record)
+{
+    // Читают и основной поток, и DbWorker: соединение QSqlDatabase можно использовать только в потоке, который его создал
+    const QString connectionName = QString("archive_reader_%1").arg(quintptr(QThread::currentThread()), 0, 16);
+    bool ok = false;
+    {
+        QSqlDatabase archive = QSqlDatabase::contains(connectionName) ? QSqlDatabase::database(connectionName, false)
+                                                                      : QSqlDatabase::addDatabase("QSQLITE", connectionName);
+        archive.setDatabaseName(path);
+        archive.setConnectOptions("QSQLITE_OPEN_READONLY");
+        if (!archive.open()) {
+            qDebug() << "Error opening archive" << path << ":" << archive.lastError().text();
+            return false;
+        }
+
+        QSqlQuery query(archive);
+        query.prepare(SqlSelectArchived);
+        query.bindValue(":game_id", gameId);
+        if (!query.exec()) {
+            qDebug() << "Error reading archived game" << gameId << ":" << query.lastError().text();
+        } else if (query.next()) {
+            record->players[0] = query.value(0).toString();
+            record->players[1] = query.value(1).toString();
+            record->currentTurn = query.value(2).toString();
+            record->finishedAt = query.value(3).toLongLong();
+            ok = unpack(query.value(4).toByteArray(), record);
+            if (!ok) {
+                qDebug() << "Corrupted archive record for game" << gameId << "in" << path;
+            }
+        }
+        query.finish();
+        query.clear();
+        archive.close();
+    }
+    record->found = ok;
+    record->archived = ok;
+    return ok;
+}
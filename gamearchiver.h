@@ -0,0 +1,92 @@
+#ifndef GAMEARCHIVER_H
+#define GAMEARCHIVER_H
+
+#include <QObject>
+#include <QDir>
+#include <QTimer>
+#include <QThread>
+#include <QSqlDatabase>
+#include <QJsonObject>
+#include "DatabaseManager.h"
+
+// Перенос оконченных партий из рабочих таблиц в архивные файлы.
+// Живёт в отдельном потоке со своим соединением SQLite. За один проход забирает пачками
+// партии, оконченные раньше порога, и для каждого месяца окончания:
+// ATTACH файла games-ГГГГ-ММ.sqlite -> одна транзакция (запись в архив, ArchivedGame, удаление
+// из Game/Fleet/Move) -> DETACH. В конце прохода - PRAGMA incremental_vacuum основного файла.
+class ArchiveWorker : public QObject
+{
+    Q_OBJECT
+
+public:
+    ArchiveWorker(const QString &databaseName, const QString &directory, int afterDays, int batchSize);
+    ~ArchiveWorker();
+
+public slots:
+    void run();
+
+signals:
+    void finished(int games, qint64 bytes, int freedPages, bool ok);
+
+private:
+    bool openDatabase();
+    bool archiveBatch(int *games, qint64 *bytes); // *games == 0 - переносить больше нечего
+    bool archiveGroup(const QString &path, const QVector<int> &gameIds, qint64 *bytes);
+    bool loadGame(int gameId, GameRecord *record);
+    int incrementalVacuum(); // Сколько страниц возвращено ОС, -1 - ошибка
+
+    QString mDatabaseName;
+    QDir mDirectory;
+    int mAfterDays;
+    int mBatchSize;
+    QSqlDatabase mDb;
+};
+
+// Запуск проходов ArchiveWorker по таймеру (ARCHIVE_INTERVAL_S) и их статистика.
+// Чтение перенесённых партий - readArchivedGame, по пути из таблицы ArchivedGame основной БД.
+class GameArchiver : public QObject
+{
+    Q_OBJECT
+
+public:
+    GameArchiver(const QString &directory, const QString &databaseName, QObject *parent = nullptr);
+    ~GameArchiver();
+
+    bool start();
+    QJsonObject stats() const;
+
+    // Файл архива для партии, оконченной в момент finishedAt (разбиение по месяцам)
+    static QString archivePath(const QDir &directory, qint64 finishedAt);
+    // Сжатая запись партии: [версия][кораблей 1][кораблей 2][FleetShip...][GameMove...] через qCompress
+    static QByteArray pack(const GameRecord &record);
+    static bool unpack(const QByteArray &data, GameRecord *record);
+    // Чтение перенесённой партии (своё соединение только для чтения)
+    static bool readArchivedGame(const QString &path, int gameId, GameRecord *record);
+
+signals:
+    void runRequested();
+
+private slots:
+    void slotRun();
+    void slotFinished(int games, qint64 bytes, int freedPages, bool ok);
+
+private:
+    QDir mDirectory;
+    QString mDatabaseName;
+    int mAfterDays; // Через сколько дней после окончания партия уходит в архив
+    int mIntervalS; // Период проходов
+    int mBatchSize; // Партий в одной транзакции
+
+    QTimer *mTimer;
+    QThread *mThread;
+    ArchiveWorker *mWorker;
+    bool mRunning;
+
+    quint64 mRuns;
+    quint64 mFailures;
+    quint64 mArchivedGames;
+    quint64 mArchivedBytes;
+    quint64 mFreedPages;
+};
+
+#endif // GAMEARCHIVER_H
@@ -0,0 +1,354 @@
+#include "gamemode.h"
+#include <QElapsedTimer>
+#include <QJsonArray>
+#include <QVarLengthArray>
+#include <QDebug>
+
+namespace {
+
+inline int shipEndX(const FleetShip &ship)
+{
+    return ship.isHorizontal ? ship.x + ship.size - 1 : ship.x;
+}
+
+inline int shipEndY(const FleetShip &ship)
+{
+    return ship.isHorizontal ? ship.y : ship.y + ship.size - 1;
+}
+
+// Общие алгоритмы для специализированного и обобщённого ядра
+template<class Kernel>
+GameMode::Placement checkPlacementWith(const Kernel &kernel, const GameMode &mode, const QVector<FleetShip> &fleet, const FleetShip &ship)
+{
+    if (ship.size < 1 || ship.size > GameMode::MaxShipSize || mode.fleet[ship.size] == 0) {
+        return GameMode::BadShipSize;
+    }
+    if (shipEndX(ship) >= kernel.size() || shipEndY(ship) >= kernel.size()) {
+        return GameMode::OutOfBoard;
+    }
+
+    int sameSize = 0;
+    BoardBits occupied;
+    for (const FleetShip &placed : fleet) {
+        if (placed.size == ship.size) {
+            ++sameSize;
+        }
+        kernel.setRect(occupied, placed.x, placed.y, shipEndX(placed), shipEndY(placed));
+    }
+    if (sameSize >= mode.fleet[ship.size]) {
+        return GameMode::TooManyShips;
+    }
+
+    // Корабль вместе с окрестностью в одну клетку не должен задевать флот
+    BoardBits halo;
+    kernel.setRect(halo, ship.x - 1, ship.y - 1, shipEndX(ship) + 1, shipEndY(ship) + 1);
+    return kernel.intersects(occupied, halo) ? GameMode::ShipsTouch : GameMode::PlacementOk;
+}
+
+template<class Kernel>
+MoveResult::Status resolveShotWith(const Kernel &kernel, const QVector<FleetShip> &fleet, const BoardBits &fleetCells,
+                                   const BoardBits &hits, int x, int y)
+{
+    if (!kernel.test(fleetCells, x, y)) {
+        return MoveResult::Miss; // Промах определяется одной проверкой бита, без обхода флота
+    }
+    for (const FleetShip &ship : fleet) {
+        if (!ship.covers(x, y)) {
+            continue;
+        }
+        BoardBits shipCells;
+        kernel.setRect(shipCells, ship.x, ship.y, shipEndX(ship), shipEndY(ship));
+        BoardBits hit = hits;
+        kernel.set(hit, x, y);
+        return kernel.isSubset(shipCells, hit) ? MoveResult::Sunk : MoveResult::Hit;
+    }
+    return MoveResult::Miss;
+}
+
+template<class Kernel>
+void resolveSalvoWith(const Kernel &kernel, const QVector<FleetShip> &fleet, const BoardBits &fleetCells, const BoardBits &hits,
+                      GameMove *shots, int count)
+{
+    // Весь залп - одной маской: попадания = залп & флот, потопление - по маске попаданий после залпа
+    BoardBits salvoHits;
+    for (int i = 0; i < count; ++i) {
+        kernel.set(salvoHits, shots[i].x, shots[i].y);
+    }
+    kernel.intersect(salvoHits, fleetCells);
+    BoardBits allHits = hits;
+    kernel.unite(allHits, salvoHits);
+
+    // Корабль, потопленный залпом, отмечается на последнем попавшем в него выстреле
+    QVarLengthArray<int, 32> lastShot(fleet.size());
+    for (int ship = 0; ship < fleet.size(); ++ship) {
+        lastShot[ship] = -1;
+    }
+    for (int i = 0; i < count; ++i) {
+        GameMove &shot = shots[i];
+        shot.status = MoveResult::Miss;
+        if (!kernel.test(salvoHits, shot.x, shot.y)) {
+            continue;
+        }
+        shot.status = MoveResult::Hit;
+        for (int ship = 0; ship < fleet.size(); ++ship) {
+            if (fleet[ship].covers(shot.x, shot.y)) {
+                lastShot[ship] = i;
+                break;
+            }
+        }
+    }
+    for (int ship = 0; ship < fleet.size(); ++ship) {
+        if (lastShot[ship] < 0) {
+            continue;
+        }
+        const FleetShip &target = fleet[ship];
+        BoardBits shipCells;
+        kernel.setRect(shipCells, target.x, target.y, shipEndX(target), shipEndY(target));
+        if (kernel.isSubset(shipCells, allHits)) {
+            shots[lastShot[ship]].status = MoveResult::Sunk;
+        }
+    }
+}
+
+template<int N>
+GameMode::Placement checkPlacementFor(const GameMode &mode, const QVector<FleetShip> &fleet, const FleetShip &ship)
+{
+    return checkPlacementWith(BoardKernel<N>(), mode, fleet, ship);
+}
+
+template<int N>
+MoveResult::Status resolveShotFor(const QVector<FleetShip> &fleet, const BoardBits &fleetCells, const BoardBits &hits, int x, int y)
+{
+    return resolveShotWith(BoardKernel<N>(), fleet, fleetCells, hits, x, y);
+}
+
+template<int N>
+void resolveSalvoFor(const QVector<FleetShip> &fleet, const BoardBits &fleetCells, const BoardBits &hits, GameMove *shots, int count)
+{
+    resolveSalvoWith(BoardKernel<N>(), fleet, fleetCells, hits, shots, count);
+}
+
+#if defined(CPU_AVX2_SUPPORTED)
+// Те же входы с ядром AVX2: алгоритмы встраиваются в функцию с целевым AVX2 и компилируются под него
+template<int N>
+CPU_TARGET_AVX2 GameMode::Placement checkPlacementAvx2(const GameMode &mode, const QVector<FleetShip> &fleet, const FleetShip &ship)
+{
+    return checkPlacementWith(BoardKernelAvx2<N>(), mode, fleet, ship);
+}
+
+template<int N>
+CPU_TARGET_AVX2 MoveResult::Status resolveShotAvx2(const QVector<FleetShip> &fleet, const BoardBits &fleetCells, const BoardBits &hits,
+                                                   int x, int y)
+{
+    return resolveShotWith(BoardKernelAvx2<N>(), fleet, fleetCells, hits, x, y);
+}
+
+template<int N>
+CPU_TARGET_AVX2 void resolveSalvoAvx2(const QVector<FleetShip> &fleet, const BoardBits &fleetCells, const BoardBits &hits,
+                                      GameMove *shots, int count)
+{
+    resolveSalvoWith(BoardKernelAvx2<N>(), fleet, fleetCells, hits, shots, count);
+}
+
+// Ядра режима выбираются один раз, при статической инициализации таблицы режимов
+const bool UseAvx2 = cpuHasAvx2();
+#define WIDE_KERNELS(N) \
+    UseAvx2 ? checkPlacementAvx2<N> : checkPlacementFor<N>, \
+    UseAvx2 ? resolveShotAvx2<N> : resolveShotFor<N>, \
+    UseAvx2 ? resolveSalvoAvx2<N> : resolveSalvoFor<N>
+#else
+#define WIDE_KERNELS(N) checkPlacementFor<N>, resolveShotFor<N>, resolveSalvoFor<N>
+#endif
+
+GameMode::Placement checkPlacementGeneric(const GameMode &mode, const QVector<FleetShip> &fleet, const FleetShip &ship)
+{
+    return checkPlacementWith(GenericBoardKernel(mode.boardSize), mode, fleet, ship);
+}
+
+const GameMode Modes[] = {
+    {"classic", 10, {0, 4, 3, 2, 1, 0, 0}, false, checkPlacementFor<10>, resolveShotFor<10>, resolveSalvoFor<10>},
+    {"large", 16, {0, 5, 4, 3, 2, 1, 0}, false, WIDE_KERNELS(16)},
+    {"huge", 32, {0, 8, 6, 5, 4, 3, 2}, false, WIDE_KERNELS(32)},
+    {"salvo", 10, {0, 4, 3, 2, 1, 0, 0}, true, checkPlacementFor<10>, resolveShotFor<10>, resolveSalvoFor<10>}
+};
+
+const int MaxPlacementAttempts = 10000;
+
+} // namespace
+
+bool GameMode::testCell(const BoardBits &bits, int x, int y) const
+{
+    int bit = y * boardSize + x;
+    return (bits.words[bit >> 6] >> (bit & 63)) & 1;
+}
+
+void GameMode::markCell(BoardBits &bits, int x, int y) const
+{
+    int bit = y * boardSize + x;
+    bits.words[bit >> 6] |= quint64(1) << (bit & 63);
+}
+
+void GameMode::markShip(BoardBits &bits, const FleetShip &ship) const
+{
+    GenericBoardKernel(boardSize).setRect(bits, ship.x, ship.y, shipEndX(ship), shipEndY(ship));
+}
+
+int GameMode::shipCount() const
+{
+    int count = 0;
+    for (int size = 1; size <= MaxShipSize; ++size) {
+        count += fleet[size];
+    }
+    return count;
+}
+
+QJsonObject GameMode::toJson() const
+{
+    QJsonArray ships;
+    for (int size = MaxShipSize; size >= 1; --size) {
+        if (fleet[size] > 0) {
+            ships.append(QJsonObject{{"size", size}, {"count", fleet[size]}});
+        }
+    }
+    QJsonObject obj;
+    obj["mode"] = name;
+    obj["board_size"] = boardSize;
+    obj["fleet"] = ships;
+    obj["salvo"] = salvo;
+    return obj;
+}
+
+QVector<FleetShip> GameMode::randomFleet(QRandomGenerator &rng) const
+{
+    // Крупные корабли первыми: для мелких место найдётся всегда
+    QVector<FleetShip> ships;
+    for (int size = MaxShipSize; size >= 1; --size) {
+        for (int i = 0; i < fleet[size]; ++i) {
+            for (int attempt = 0; attempt < MaxPlacementAttempts; ++attempt) {
+                FleetShip ship{quint8(rng.bounded(boardSize)), quint8(rng.bounded(boardSize)), quint8(size), quint8(rng.bounded(2))};
+                if (checkPlacement(*this, ships, ship) == PlacementOk) {
+                    ships.append(ship);
+                    break;
+                }
+            }
+        }
+    }
+    return ships;
+}
+
+const GameMode &GameMode::classic()
+{
+    return Modes[0];
+}
+
+const GameMode *GameMode::find(const QString &name)
+{
+    for (const GameMode &mode : Modes) {
+        if (name == QLatin1String(mode.name)) {
+            return &mode;
+        }
+    }
+    return nullptr;
+}
+
+QStringList GameMode::names()
+{
+    QStringList list;
+    for (const GameMode &mode : Modes) {
+        list.append(mode.name);
+    }
+    return list;
+}
+
+QString GameMode::placementError(Placement placement)
+{
+    switch (placement) {
+    case PlacementOk:
+        return QString();
+    case OutOfBoard:
+        return "Ship exceeds board limits";
+    case BadShipSize:
+        return "Invalid ship size for this game mode";
+    case TooManyShips:
+        return "All ships of this size are already placed";
+    case ShipsTouch:
+        return "Ships must not overlap or touch";
+    }
+    return QString();
+}
+
+void GameMode::benchmark(int rounds)
+{
+    QRandomGenerator rng(20240601);
+#if defined(CPU_AVX2_SUPPORTED)
+    qDebug() << "Board kernels for 16x16 and 32x32:" << (UseAvx2 ? "AVX2" : "SSE2");
+#endif
+    for (const GameMode &mode : Modes) {
+        if (mode.salvo) {
+            continue; // Та же доска, что у классического режима
+        }
+        // Флот, пробные корабли и выстрелы готовятся заранее - замер не включает генератор
+        QVector<FleetShip> ships = mode.randomFleet(rng);
+        BoardBits fleetCells;
+        for (const FleetShip &ship : ships) {
+            mode.markShip(fleetCells, ship);
+        }
+        BoardBits hits;
+        for (int y = 0; y < mode.boardSize; ++y) {
+            for (int x = 0; x < mode.boardSize; ++x) {
+                if (mode.testCell(fleetCells, x, y) && rng.bounded(2)) {
+                    mode.markCell(hits, x, y);
+                }
+            }
+        }
+        QVector<FleetShip> probes(256);
+        for (FleetShip &probe : probes) {
+            quint8 size = quint8(1 + rng.bounded(MaxShipSize));
+            probe = FleetShip{quint8(rng.bounded(mode.boardSize)), quint8(rng.bounded(mode.boardSize)), size, quint8(rng.bounded(2))};
+        }
+        int cells = mode.boardSize * mode.boardSize;
+
+        GenericBoardKernel generic(mode.boardSize);
+        QElapsedTimer timer;
+        int sink = 0;
+
+        timer.start();
+        for (int round = 0; round < rounds; ++round) {
+            for (const FleetShip &probe : probes) {
+                sink += mode.checkPlacement(mode, ships, probe);
+            }
+        }
+        qint64 placeSpecializedNs = timer.nsecsElapsed();
+
+        timer.restart();
+        for (int round = 0; round < rounds; ++round) {
+            for (const FleetShip &probe : probes) {
+                sink += checkPlacementGeneric(mode, ships, probe);
+            }
+        }
+        qint64 placeGenericNs = timer.nsecsElapsed();
+
+        timer.restart();
+        for (int round = 0; round < rounds; ++round) {
+            for (int cell = 0; cell < cells; ++cell) {
+                sink += mode.resolveShot(ships, fleetCells, hits, cell % mode.boardSize, cell / mode.boardSize);
+            }
+        }
+        qint64 shotSpecializedNs = timer.nsecsElapsed();
+
+        timer.restart();
+        for (int round = 0; round < rounds; ++round) {
+            for (int cell = 0; cell < cells; ++cell) {
+                sink += resolveShotWith(generic, ships, fleetCells, hits, cell % mode.boardSize, cell / mode.boardSize);
+            }
+        }
+        qint64 shotGenericNs = timer.nsecsElapsed();
+
+        double placements = double(rounds) * probes.size();
+        double shots = double(rounds) * cells;
+        qDebug() << "Board" << mode.name << mode.boardSize << "x" << mode.boardSize << "-" << ships.size() << "ships;"
+                 << "placement ns: specialized" << placeSpecializedNs / placements << "generic" << placeGenericNs / placements
+                 << "; shot ns: specialized" << shotSpecializedNs / shots << "generic" << shotGenericNs / shots
+                 << "(checksum" << sink << ")";
+    }
+}
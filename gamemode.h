@@ -0,0 +1,55 @@
+#ifndef GAMEMODE_H
+#define GAMEMODE_H
+
+#include <QString>
+#include <QStringList>
+#include <QVector>
+#include <QJsonObject>
+#include <QRandomGenerator>
+#include "boardkernel.h"
+#include "DatabaseManager.h"
+
+// Режим игры: размер доски, состав флота и правило ходов (classic 10x10, large 16x16, huge 32x32;
+// salvo - классическая доска, но за ход - залп из стольких выстрелов, сколько у игрока кораблей на плаву).
+// Проверки расстановки и выстрела идут через ядро доски, специализированное по размеру (BoardKernel<N>);
+// режим хранит указатели на функции своей специализации, поэтому выбор ядра делается один раз -
+// при создании партии, а классическая доска не платит за поддержку больших.
+struct GameMode
+{
+    enum Placement {
+        PlacementOk,
+        OutOfBoard,
+        BadShipSize, // Кораблей такого размера в режиме нет
+        TooManyShips, // Все корабли такого размера уже расставлены
+        ShipsTouch // Пересекается с другим кораблём или касается его
+    };
+
+    static const int MaxShipSize = 6;
+
+    const char *name;
+    int boardSize;
+    int fleet[MaxShipSize + 1]; // Сколько кораблей каждого размера
+    bool salvo; // Ход - залп make_salvo вместо одиночного make_move
+
+    // Ядра специализации
+    Placement (*checkPlacement)(const GameMode &mode, const QVector<FleetShip> &fleet, const FleetShip &ship);
+    MoveResult::Status (*resolveShot)(const QVector<FleetShip> &fleet, const BoardBits &fleetCells, const BoardBits &hits, int x, int y);
+    // Итог каждого выстрела залпа (shots[i].status); выстрелы уже проверены на границы и повторы
+    void (*resolveSalvo)(const QVector<FleetShip> &fleet, const BoardBits &fleetCells, const BoardBits &hits, GameMove *shots, int count);
+
+    bool contains(int x, int y) const { return x >= 0 && y >= 0 && x < boardSize && y < boardSize; }
+    bool testCell(const BoardBits &bits, int x, int y) const;
+    void markCell(BoardBits &bits, int x, int y) const;
+    void markShip(BoardBits &bits, const FleetShip &ship) const;
+    int shipCount() const; // Сколько кораблей нужно потопить для победы
+    QJsonObject toJson() const; // Размер доски и состав флота - для клиента
+    QVector<FleetShip> randomFleet(QRandomGenerator &rng) const; // Полный флот без касаний
+
+    static const GameMode &classic();
+    static const GameMode *find(const QString &name); // nullptr - нет такого режима
+    static QStringList names();
+    static QString placementError(Placement placement); // Текст ошибки для ответа place_ship
+    static void benchmark(int rounds); // Сравнение специализированных и обобщённых ядер по всем режимам
+};
+
+#endif // GAMEMODE_H
@@ -0,0 +1,198 @@
+#include "leaderboard.h"
+#include <QRandomGenerator>
+
+struct Leaderboard::Node
+{
+    PlayerStats stats;
+    quint32 priority;
+    int size;
+    Node *left;
+    Node *right;
+};
+
+Leaderboard::Leaderboard() : root(nullptr)
+{
+}
+
+Leaderboard::~Leaderboard()
+{
+    destroy(root);
+}
+
+bool Leaderboard::before(const PlayerStats &a, const PlayerStats &b)
+{
+    if (a.wins != b.wins) {
+        return a.wins > b.wins;
+    }
+    // Сравниваем точность без деления: a.hits / a.shots > b.hits / b.shots
+    qint64 lhs = qint64(a.hits) * qMax(b.shots, 1);
+    qint64 rhs = qint64(b.hits) * qMax(a.shots, 1);
+    if (lhs != rhs) {
+        return lhs > rhs;
+    }
+    if (a.losses != b.losses) {
+        return a.losses < b.losses;
+    }
+    return a.nickname < b.nickname;
+}
+
+int Leaderboard::sizeOf(Node *node)
+{
+    return node ? node->size : 0;
+}
+
+void Leaderboard::recalc(Node *node)
+{
+    node->size = 1 + sizeOf(node->left) + sizeOf(node->right);
+}
+
+// left - все узлы, стоящие в рейтинге выше key; right - остальные
+void Leaderboard::split(Node *node, const PlayerStats &key, Node *&left, Node *&right)
+{
+    if (!node) {
+        left = right = nullptr;
+        return;
+    }
+    if (before(node->stats, key)) {
+        split(node->right, key, node->right, right);
+        left = node;
+    } else {
+        split(node->left, key, left, node->left);
+        right = node;
+    }
+    recalc(node);
+}
+
+Leaderboard::Node* Leaderboard::merge(Node *left, Node *right)
+{
+    if (!left) return right;
+    if (!right) return left;
+    if (left->priority > right->priority) {
+        left->right = merge(left->right, right);
+        recalc(left);
+        return left;
+    }
+    right->left = merge(left, right->left);
+    recalc(right);
+    return right;
+}
+
+Leaderboard::Node* Leaderboard::erase(Node *node, const PlayerStats &key)
+{
+    if (!node) {
+        return nullptr;
+    }
+    if (node->stats.nickname == key.nickname) {
+        Node *rest = merge(node->left, node->right);
+        delete node;
+        return rest;
+    }
+    if (before(key, node->stats)) {
+        node->left = erase(node->left, key);
+    } else {
+        node->right = erase(node->right, key);
+    }
+    recalc(node);
+    return node;
+}
+
+void Leaderboard::destroy(Node *node)
+{
+    if (!node) {
+        return;
+    }
+    destroy(node->left);
+    destroy(node->right);
+    delete node;
+}
+
+void Leaderboard::collect(Node *node, int limit, QVector<PlayerStats> &out)
+{
+    if (!node || out.size() >= limit) {
+        return;
+    }
+    collect(node->left, limit, out);
+    if (out.size() < limit) {
+        out.append(node->stats);
+    }
+    collect(node->right, limit, out);
+}
+
+void Leaderboard::insert(const PlayerStats &stats)
+{
+    Node *node = new Node{stats, QRandomGenerator::global()->generate(), 1, nullptr, nullptr};
+    Node *left = nullptr;
+    Node *right = nullptr;
+    split(root, stats, left, right);
+    root = merge(merge(left, node), right);
+    byNickname.insert(stats.nickname, stats);
+}
+
+void Leaderboard::rebuild(const QVector<PlayerStats> &all)
+{
+    clear();
+    byNickname.reserve(all.size());
+    for (const PlayerStats &stats : all) {
+        update(stats);
+    }
+}
+
+void Leaderboard::update(const PlayerStats &stats)
+{
+    auto it = byNickname.constFind(stats.nickname);
+    if (it != byNickname.constEnd()) {
+        root = erase(root, it.value());
+    }
+    insert(stats);
+}
+
+void Leaderboard::clear()
+{
+    destroy(root);
+    root = nullptr;
+    byNickname.clear();
+}
+
+QVector<PlayerStats> Leaderboard::top(int limit) const
+{
+    QVector<PlayerStats> result;
+    limit = qBound(0, limit, sizeOf(root));
+    result.reserve(limit);
+    collect(root, limit, result);
+    return result;
+}
+
+int Leaderboard::rank(const QString &nickname) const
+{
+    auto it = byNickname.constFind(nickname);
+    if (it == byNickname.constEnd()) {
+        return 0;
+    }
+    const PlayerStats &key = it.value();
+    int position = 0;
+    Node *node = root;
+    while (node) {
+        if (node->stats.nickname == nickname) {
+            return position + sizeOf(node->left) + 1;
+        }
+        if (before(key, node->stats)) {
+            node = node->left;
+        } else {
+            position += sizeOf(node->left) + 1;
+            node = node->right;
+        }
+    }
+    return 0;
+}
+
+PlayerStats Leaderboard::stats(const QString &nickname) const
+{
+    PlayerStats empty;
+    empty.nickname = nickname;
+    return byNickname.value(nickname, empty);
+}
+
+int Leaderboard::size() const
+{
+    return sizeOf(root);
+}
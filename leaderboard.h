@@ -0,0 +1,58 @@
+#ifndef LEADERBOARD_H
+#define LEADERBOARD_H
+
+#include <QHash>
+#include <QString>
+#include <QVector>
+
+// Накопленная статистика игрока (хранится в таблице Stats)
+struct PlayerStats
+{
+    QString nickname;
+    int wins = 0;
+    int losses = 0;
+    int shots = 0;
+    int hits = 0;
+
+    double accuracy() const { return shots > 0 ? double(hits) / shots : 0.0; }
+};
+
+// Таблица лидеров: дерево порядковой статистики (декартово дерево с размерами поддеревьев).
+// Top-N и "моё место" выполняются за O(log n) (+N для выдачи списка).
+// Порядок: больше побед -> выше точность -> меньше поражений -> ник по алфавиту.
+class Leaderboard
+{
+public:
+    Leaderboard();
+    ~Leaderboard();
+    Leaderboard(const Leaderboard&) = delete;
+    Leaderboard& operator=(const Leaderboard&) = delete;
+
+    void rebuild(const QVector<PlayerStats> &all); // Полная перестройка (при старте сервера)
+    void update(const PlayerStats &stats); // Вставка или обновление одного игрока
+    void clear();
+
+    QVector<PlayerStats> top(int limit) const; // Первые limit игроков
+    int rank(const QString &nickname) const; // Место игрока (с 1), 0 - если игрока нет
+    PlayerStats stats(const QString &nickname) const;
+    int size() const;
+
+private:
+    struct Node;
+
+    static bool before(const PlayerStats &a, const PlayerStats &b);
+    static int sizeOf(Node *node);
+    static void recalc(Node *node);
+    static void split(Node *node, const PlayerStats &key, Node *&left, Node *&right);
+    static Node* merge(Node *left, Node *right);
+    static Node* erase(Node *node, const PlayerStats &key);
+    static void destroy(Node *node);
+    static void collect(Node *node, int limit, QVector<PlayerStats> &out);
+
+    void insert(const PlayerStats &stats);
+
+    Node *root;
+    QHash<QString, PlayerStats> byNickname; // Ник -> текущая статистика (ключ в дереве)
+};
+
+#endif // LEADERBOARD_H
@@ -0,0 +1,384 @@
+#include "loadbench.h"
+#include <QCoreApplication>
+#include <QJsonDocument>
+#include <QHostAddress>
+#include <QUrl>
+#include <QDebug>
+#include <algorithm>
+
+namespace {
+
+// Стандартный флот без касаний: x, y, размер, горизонтально
+const int Fleet[][4] = {
+    {0, 0, 4, 1},
+    {0, 2, 3, 1}, {4, 2, 3, 1},
+    {0, 4, 2, 1}, {3, 4, 2, 1}, {6, 4, 2, 1},
+    {0, 6, 1, 1}, {2, 6, 1, 1}, {4, 6, 1, 1}, {6, 6, 1, 1}
+};
+const int FleetSize = int(sizeof(Fleet) / sizeof(Fleet[0]));
+const int BoardCells = 100;
+const int ConnectionsPerSourceAddress = 25000; // Эфемерных портов на один адрес - около 28 тыс.
+const int HealthTimeoutMs = 5000;
+const int PassPauseMs = 1000; // Между проходами: сервер закрывает партии отключившихся клиентов
+
+qint64 percentile(QVector<qint64> values, double fraction)
+{
+    if (values.isEmpty()) {
+        return 0;
+    }
+    int index = qMin(int(values.size() * fraction), int(values.size()) - 1);
+    std::nth_element(values.begin(), values.begin() + index, values.end());
+    return values[index];
+}
+
+} // namespace
+
+LoadBench::LoadBench(const QString &host, quint16 port, int clients, int seconds, int idleConnections, quint16 healthPort,
+                     quint16 webSocketPort, QObject *parent)
+    : QObject(parent), mHost(host), mPort(port), mHealthPort(healthPort), mWebSocketPort(webSocketPort), mWebSocketPass(false),
+      mSeconds(qMax(1, seconds)), mIdlePending(0), mIdleConnected(0), mIdleSessions(0),
+      mIdlePassword(qEnvironmentVariable("BENCH_IDLE_PASSWORD")),
+      mResidentBeforeIdle(-1), mRequests(0), mMoves(0), mGames(0), mErrors(0), mDisconnects(0)
+{
+    // Чётное число: клиенты встречаются в лобби попарно
+    mClients.resize(qMax(2, clients + clients % 2));
+    mIdle.resize(qMax(0, idleConnections));
+}
+
+void LoadBench::start()
+{
+    if (mIdle.isEmpty()) {
+        startPlayers();
+        return;
+    }
+    // Простаивающие соединения - до игроков: когда лобби занято, сервер новых не принимает
+    qDebug() << "Benchmark: opening" << mIdle.size() << "idle connections to" << mHost << ":" << mPort
+             << (mIdlePassword.isEmpty() ? "without login (set BENCH_IDLE_PASSWORD for logged-in sessions)" : "with login");
+    mResidentBeforeIdle = reportMemory("before idle connections");
+    QHostAddress server(mHost);
+    bool rotateSources = server.protocol() == QAbstractSocket::IPv4Protocol && server.isLoopback();
+    mIdlePending = mIdle.size();
+    for (int i = 0; i < mIdle.size(); ++i) {
+        QTcpSocket *socket = new QTcpSocket(this);
+        mIdle[i] = socket;
+        if (rotateSources) {
+            socket->bind(QHostAddress(quint32(0x7f000001) + quint32(i / ConnectionsPerSourceAddress)));
+        }
+        connect(socket, &QTcpSocket::connected, this, [this, socket, i]() {
+            disconnect(socket, &QTcpSocket::errorOccurred, this, nullptr); // Обрыв позже - уже не ошибка соединения
+            ++mIdleConnected;
+            if (mIdlePassword.isEmpty()) {
+                idleSettled();
+                return;
+            }
+            // Вход под idle-N; учётной записи ещё нет - регистрация (сервер заводит сессию и после неё).
+            // Дальше соединение молчит и ответов не читает
+            QString nickname = QString("idle-%1").arg(i);
+            connect(socket, &QTcpSocket::readyRead, this, [this, socket, nickname]() {
+                while (socket->canReadLine()) {
+                    QJsonObject reply = QJsonDocument::fromJson(socket->readLine()).object();
+                    bool success = reply["status"].toString() == "success";
+                    if (reply["type"].toString() == "login" && !success) {
+                        socket->write(QJsonDocument(QJsonObject{{"type", "register"}, {"nickname", nickname},
+                                                                {"email", nickname + "@bench.local"}, {"password", mIdlePassword}})
+                                          .toJson(QJsonDocument::Compact) + "\r\n");
+                        continue;
+                    }
+                    if (success) {
+                        ++mIdleSessions;
+                    } else {
+                        qDebug() << "Idle connection" << nickname << "has no session:" << reply["message"].toString();
+                    }
+                    disconnect(socket, &QTcpSocket::readyRead, this, nullptr);
+                    idleSettled();
+                    return;
+                }
+            });
+            // Сервер закрыл соединение до ответа - вход не состоялся, но ждать его больше нечего
+            connect(socket, &QTcpSocket::disconnected, this, [this, socket]() {
+                if (disconnect(socket, &QTcpSocket::readyRead, this, nullptr)) {
+                    idleSettled();
+                }
+            });
+            socket->write(QJsonDocument(QJsonObject{{"type", "login"}, {"nickname", nickname}, {"password", mIdlePassword}})
+                              .toJson(QJsonDocument::Compact) + "\r\n");
+        });
+        connect(socket, &QTcpSocket::errorOccurred, this, &LoadBench::idleSettled);
+        socket->connectToHost(mHost, mPort);
+    }
+}
+
+void LoadBench::idleSettled()
+{
+    if (mIdlePending > 0 && --mIdlePending == 0) {
+        qDebug() << "Idle connections established:" << mIdleConnected << "of" << mIdle.size() << "- logged in:" << mIdleSessions;
+        reportMemory("with idle connections");
+        startPlayers();
+    }
+}
+
+void LoadBench::startPlayers()
+{
+    quint16 port = mWebSocketPass ? mWebSocketPort : mPort;
+    qDebug() << "Benchmark:" << mClients.size() << "clients against" << mHost << ":" << port << "over"
+             << (mWebSocketPass ? "WebSocket" : "TCP") << "for" << mSeconds << "s";
+    mRequests = mMoves = mGames = mErrors = mDisconnects = 0;
+    mLatencyUs.clear();
+    mClock.start();
+    // Свои ники на каждом проходе: сессии прошлого прохода сервер мог ещё не снять
+    QString prefix = QString("bench%1-%2").arg(QCoreApplication::applicationPid()).arg(QLatin1String(mWebSocketPass ? "ws-" : ""));
+    for (int i = 0; i < mClients.size(); ++i) {
+        Client &client = mClients[i];
+        client = Client();
+        client.nickname = prefix + QString::number(i);
+        auto registerClient = [this, i]() {
+            const Client &client = mClients[i];
+            send(i, QJsonObject{{"type", "register"}, {"nickname", client.nickname},
+                                {"email", client.nickname + "@bench.local"}, {"password", "bench"}});
+        };
+        if (mWebSocketPass) {
+            client.webSocket = new QWebSocket(QString(), QWebSocketProtocol::VersionLatest, this);
+            connect(client.webSocket, &QWebSocket::textMessageReceived, this, [this, i](const QString &message) {
+                onData(i, message.toUtf8() + '\n');
+            });
+            connect(client.webSocket, &QWebSocket::disconnected, this, [this]() { ++mDisconnects; });
+            connect(client.webSocket, &QWebSocket::connected, this, registerClient);
+            client.webSocket->open(QUrl(QString("ws://%1:%2").arg(mHost).arg(port)));
+        } else {
+            client.socket = new QTcpSocket(this);
+            client.socket->setSocketOption(QAbstractSocket::LowDelayOption, 1);
+            connect(client.socket, &QTcpSocket::readyRead, this, [this, i]() { onData(i, mClients[i].socket->readAll()); });
+            connect(client.socket, &QTcpSocket::disconnected, this, [this]() { ++mDisconnects; });
+            connect(client.socket, &QTcpSocket::connected, this, registerClient);
+            client.socket->connectToHost(mHost, port);
+        }
+    }
+    QTimer::singleShot(mSeconds * 1000, this, &LoadBench::report);
+}
+
+QJsonObject LoadBench::serverMemory()
+{
+    if (mHealthPort == 0) {
+        return QJsonObject();
+    }
+    // Отчёт о состоянии - HTTP с Connection: close; JSON после заголовков
+    QTcpSocket health;
+    health.connectToHost(mHost, mHealthPort);
+    if (!health.waitForConnected(HealthTimeoutMs)) {
+        return QJsonObject();
+    }
+    health.write("GET /health HTTP/1.0\r\n\r\n");
+    QByteArray response;
+    while (health.waitForReadyRead(HealthTimeoutMs)) {
+        response += health.readAll();
+    }
+    response += health.readAll();
+    int body = response.indexOf("\r\n\r\n");
+    if (body < 0) {
+        return QJsonObject();
+    }
+    return QJsonDocument::fromJson(response.mid(body + 4)).object()["memory"].toObject();
+}
+
+qint64 LoadBench::reportMemory(const QString &stage)
+{
+    QJsonObject memory = serverMemory();
+    if (memory.isEmpty()) {
+        return -1;
+    }
+    qint64 resident = memory["resident_bytes"].toInteger(-1);
+    int connections = memory["connections"].toInt();
+    qDebug() << "Server memory" << stage << "- connections:" << connections << "resident MB:" << resident / (1024 * 1024)
+             << "heap per connection:" << qint64(memory["heap_per_connection"].toDouble());
+    if (mResidentBeforeIdle >= 0 && resident >= 0 && mIdleConnected > 0) {
+        qDebug() << "Resident growth per idle connection:" << (resident - mResidentBeforeIdle) / mIdleConnected << "bytes";
+    }
+    return resident;
+}
+
+void LoadBench::onData(int index, const QByteArray &data)
+{
+    Client &client = mClients[index];
+    client.pending += data;
+    int newline;
+    while ((newline = client.pending.indexOf('\n')) >= 0) {
+        QByteArray line = client.pending.left(newline).trimmed();
+        client.pending.remove(0, newline + 1);
+        QJsonDocument doc = QJsonDocument::fromJson(line);
+        if (doc.isObject()) {
+            onMessage(index, doc.object());
+        }
+    }
+}
+
+void LoadBench::onMessage(int index, const QJsonObject &message)
+{
+    Client &client = mClients[index];
+    QString type = message["type"].toString();
+    QString status = message["status"].toString();
+    bool isMine = message["current_turn"].toString() == client.nickname;
+
+    if (!client.awaiting.isEmpty() && (type == client.awaiting || type == "error")) {
+        // Ответ на свой запрос
+        mLatencyUs.append(mClock.nsecsElapsed() / 1000 - client.sentAtUs);
+        ++mRequests;
+        QString request = client.awaiting;
+        client.awaiting.clear();
+        if (status == "error" && request != "register") { // Повторная регистрация - не ошибка
+            ++mErrors;
+        }
+
+        if (request == "register") {
+            client.stage = LoggingIn;
+            send(index, QJsonObject{{"type", "login"}, {"nickname", client.nickname}, {"password", "bench"}});
+            return;
+        }
+        if (request == "login") {
+            if (status == "success") {
+                startGame(index);
+            }
+            return;
+        }
+        if (request == "place_ship") {
+            ++client.shipsPlaced;
+        } else if (request == "make_move") {
+            ++mMoves;
+            client.myTurn = type == "make_move" && isMine;
+        }
+    } else if (type == "game_ready") {
+        client.gameId = message["game_id"].toInt();
+        client.shipsPlaced = 0;
+        client.stage = Placing;
+    } else if (type == "game_start") {
+        client.stage = Playing;
+        client.nextCell = 0;
+        client.myTurn = isMine;
+    } else if (type == "move_result") {
+        client.myTurn = isMine;
+    } else if (type == "game_over" || type == "gameover") {
+        if (message["winner"].toString() == client.nickname) {
+            ++mGames;
+        }
+        client.stage = Finished;
+        client.myTurn = false;
+    }
+
+    // Следующий запрос - только после ответа на предыдущий (сервер разбирает одно сообщение за чтение)
+    if (!client.awaiting.isEmpty()) {
+        return;
+    }
+    if (client.stage == Placing) {
+        if (client.shipsPlaced < FleetSize) {
+            const int *ship = Fleet[client.shipsPlaced];
+            send(index, QJsonObject{{"type", "place_ship"}, {"nickname", client.nickname}, {"game_id", client.gameId},
+                                    {"x", ship[0]}, {"y", ship[1]}, {"size", ship[2]}, {"is_horizontal", ship[3] != 0}});
+        } else {
+            client.stage = Ready;
+            send(index, QJsonObject{{"type", "ready_to_battle"}, {"nickname", client.nickname}});
+        }
+    } else if (client.stage == Playing && client.myTurn) {
+        shoot(index);
+    } else if (client.stage == Finished) {
+        startGame(index);
+    }
+}
+
+void LoadBench::send(int index, const QJsonObject &request)
+{
+    Client &client = mClients[index];
+    client.awaiting = request["type"].toString();
+    client.sentAtUs = mClock.nsecsElapsed() / 1000;
+    QByteArray json = QJsonDocument(request).toJson(QJsonDocument::Compact);
+    if (client.webSocket) {
+        client.webSocket->sendTextMessage(QString::fromUtf8(json)); // Кадр - уже граница запроса
+    } else {
+        client.socket->write(json + "\r\n");
+    }
+}
+
+void LoadBench::startGame(int index)
+{
+    Client &client = mClients[index];
+    client.stage = Waiting;
+    client.gameId = -1;
+    send(index, QJsonObject{{"type", "start_game"}, {"nickname", client.nickname}});
+}
+
+void LoadBench::shoot(int index)
+{
+    Client &client = mClients[index];
+    if (client.nextCell >= BoardCells) {
+        client.myTurn = false;
+        return;
+    }
+    int cell = client.nextCell++;
+    send(index, QJsonObject{{"type", "make_move"}, {"nickname", client.nickname}, {"game_id", client.gameId},
+                            {"x", cell % 10}, {"y", cell / 10}});
+}
+
+void LoadBench::report()
+{
+    PassResult pass;
+    pass.transport = mWebSocketPass ? "websocket" : "tcp";
+    pass.seconds = mClock.nsecsElapsed() / 1e9;
+    pass.requests = mRequests;
+    pass.moves = mMoves;
+    pass.games = mGames;
+    pass.errors = mErrors;
+    pass.disconnects = mDisconnects;
+    pass.p50Us = percentile(mLatencyUs, 0.5);
+    pass.p99Us = percentile(mLatencyUs, 0.99);
+    mPasses.append(pass);
+
+    qDebug() << "Benchmark" << pass.transport << "finished in" << pass.seconds << "s:" << mClients.size() << "clients,"
+             << mGames << "games," << mRequests << "requests," << mMoves << "moves," << mErrors << "errors,"
+             << mDisconnects << "disconnects";
+    qDebug() << "Throughput:" << qint64(mRequests / pass.seconds) << "requests/s," << qint64(mMoves / pass.seconds) << "moves/s";
+    qDebug() << "Latency us: p50" << pass.p50Us << "p99" << pass.p99Us;
+
+    for (Client &client : mClients) {
+        // Сигналы закрытых соединений не должны попасть в счётчики следующего прохода
+        if (client.socket) {
+            disconnect(client.socket, nullptr, this, nullptr);
+            client.socket->abort();
+            client.socket->deleteLater();
+        }
+        if (client.webSocket) {
+            disconnect(client.webSocket, nullptr, this, nullptr);
+            client.webSocket->abort();
+            client.webSocket->deleteLater();
+        }
+    }
+    if (!mWebSocketPass && mWebSocketPort != 0) {
+        mWebSocketPass = true;
+        QTimer::singleShot(PassPauseMs, this, &LoadBench::startPlayers);
+        return;
+    }
+    finish();
+}
+
+void LoadBench::finish()
+{
+    if (mPasses.size() > 1) {
+        qDebug() << "Transport comparison (requests/s, moves/s, p50 us, p99 us):";
+        for (const PassResult &pass : mPasses) {
+            qDebug().noquote() << QString("  %1 %2 %3 %4 %5").arg(pass.transport, -10)
+                                      .arg(qint64(pass.requests / pass.seconds), 10).arg(qint64(pass.moves / pass.seconds), 10)
+                                      .arg(pass.p50Us, 10).arg(pass.p99Us, 10);
+        }
+    }
+    if (!mIdle.isEmpty()) {
+        int held = 0;
+        for (QTcpSocket *socket : mIdle) {
+            held += socket->state() == QAbstractSocket::ConnectedState ? 1 : 0;
+            socket->abort();
+        }
+        qDebug() << "Idle connections held to the end:" << held << "of" << mIdle.size();
+    }
+    reportMemory("after the run");
+    bool ok = true;
+    for (const PassResult &pass : mPasses) {
+        ok = ok && pass.requests > 0;
+    }
+    emit finished(ok ? 0 : 1);
+}
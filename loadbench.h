@@ -0,0 +1,113 @@
+#ifndef LOADBENCH_H
+#define LOADBENCH_H
+
+#include <QObject>
+#include <QTcpSocket>
+#include <QWebSocket>
+#include <QTimer>
+#include <QElapsedTimer>
+#include <QJsonObject>
+#include <QVector>
+
+// Нагрузочный прогон по обычному протоколу: N клиентов регистрируются, попарно встречаются
+// в лобби, расставляют флот и играют партии до конца, пока не истечёт время.
+// Итог - суммарная пропускная способность (запросов и ходов в секунду) и задержки ответов.
+// Против маршрутизатора с разным числом шардов показывает, как пропускная способность
+// растёт с числом шардов (в одном шарде одновременно идёт одна партия).
+// idleConnections открывает до начала игры столько же простаивающих соединений, которые молчат. Они нагружают
+// транспорт сервера (QTcpSocket или NET_TRANSPORT=epoll) числом сокетов, не занимая лобби. С BENCH_IDLE_PASSWORD
+// каждое соединение входит под учётной записью idle-N с этим паролем (при первом прогоне она создаётся, дальше
+// используется та же), и на сервере есть ещё и сессия; без него соединения остаются без входа.
+// С healthPort прогон снимает отчёт о памяти сервера до и после открытия простаивающих соединений
+// и в конце: резидентная память и её прирост на соединение. К локальному серверу соединения идут
+// с разных адресов 127.0.0.x - на одном адресе портов хватает примерно на 28 тыс. соединений.
+// С webSocketPort после прохода по TCP те же игры повторяются через WebSocket-слушатель сервера
+// (та же длительность и число клиентов), и итоги двух транспортов печатаются рядом.
+class LoadBench : public QObject
+{
+    Q_OBJECT
+
+public:
+    LoadBench(const QString &host, quint16 port, int clients, int seconds, int idleConnections = 0, quint16 healthPort = 0,
+              quint16 webSocketPort = 0, QObject *parent = nullptr);
+
+    void start();
+
+signals:
+    void finished(int exitCode);
+
+private:
+    enum Stage {
+        Registering,
+        LoggingIn,
+        Waiting, // start_game отправлен, ждём game_ready
+        Placing,
+        Ready, // Флот расставлен, ждём game_start
+        Playing,
+        Finished // Партия окончена, следующий start_game - после ответа на последний запрос
+    };
+
+    struct Client {
+        QTcpSocket *socket = nullptr;
+        QWebSocket *webSocket = nullptr; // Вместо socket на проходе через WebSocket
+        QString nickname;
+        QByteArray pending; // Неполная строка ответа
+        Stage stage = Registering;
+        QString awaiting; // Тип запроса без ответа, пусто - можно отправлять
+        qint64 sentAtUs = 0;
+        int gameId = -1;
+        int shipsPlaced = 0;
+        int nextCell = 0;
+        bool myTurn = false;
+    };
+
+    // Итоги одного прохода (TCP или WebSocket)
+    struct PassResult {
+        QString transport;
+        double seconds = 0;
+        quint64 requests = 0;
+        quint64 moves = 0;
+        quint64 games = 0;
+        quint64 errors = 0;
+        quint64 disconnects = 0;
+        qint64 p50Us = 0;
+        qint64 p99Us = 0;
+    };
+
+    void startPlayers();
+    QJsonObject serverMemory(); // Раздел "memory" отчёта о состоянии сервера, пусто - недоступен
+    qint64 reportMemory(const QString &stage); // Резидентная память сервера, -1 - недоступна
+    void idleSettled(); // Простаивающее соединение установлено или не удалось
+    void onData(int index, const QByteArray &data); // Ответы сервера: строки JSON через "\n"
+    void onMessage(int index, const QJsonObject &message);
+    void send(int index, const QJsonObject &request);
+    void startGame(int index);
+    void shoot(int index);
+    void report(); // Итог прохода; после TCP - проход через WebSocket, если он задан
+    void finish();
+
+    QString mHost;
+    quint16 mPort;
+    quint16 mHealthPort; // 0 - память сервера не снимается
+    quint16 mWebSocketPort; // 0 - только TCP
+    bool mWebSocketPass;
+    int mSeconds;
+    QVector<Client> mClients;
+    QVector<QTcpSocket*> mIdle;
+    int mIdlePending; // Ещё не установленные простаивающие соединения
+    int mIdleConnected;
+    int mIdleSessions; // Простаивающие соединения, вошедшие под своей учётной записью
+    QString mIdlePassword; // BENCH_IDLE_PASSWORD, пусто - простаивающие соединения не входят
+    qint64 mResidentBeforeIdle;
+    QElapsedTimer mClock;
+
+    quint64 mRequests;
+    quint64 mMoves;
+    quint64 mGames;
+    quint64 mErrors;
+    quint64 mDisconnects;
+    QVector<qint64> mLatencyUs;
+    QVector<PassResult> mPasses;
+};
+
+#endif // LOADBENCH_H
@@ -1,9 +1,149 @@
 #include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QFile>
+#include <QDebug>
 #include "mytcpserver.h"
+#include "startup.h"
+#include "trafficreplay.h"
+#include "shardrouter.h"
+#include "loadbench.h"
+#include "stalldetector.h"
+#include "dbworker.h"
+#include "gamemode.h"
+#include "tracer.h"
+#include "requestscanner.h"
+#include "DatabaseManager.h"
 
 int main(int argc, char *argv[])
 {
     QCoreApplication a(argc, argv);
+
+    QCommandLineParser parser;
+    parser.addHelpOption();
+    QCommandLineOption replayOption("replay", "Replay a traffic capture against a running server.", "file");
+    QCommandLineOption hostOption("host", "Server host for --replay.", "host", "127.0.0.1");
+    QCommandLineOption portOption("port", "Server port for --replay.", "port", "33333");
+    QCommandLineOption speedOption("speed", "Replay speed factor (1 - recorded timing).", "factor", "1");
+    QCommandLineOption replayPasswordOption("replay-password",
+                                            "Password sent instead of the hidden one in recorded register/login requests.", "password");
+    QCommandLineOption shardsOption("shards", "Run a router on port 33333 in front of N server processes.", "count");
+    QCommandLineOption shardBasePortOption("shard-base-port", "First port of shard processes for --shards.", "port", "33400");
+    QCommandLineOption benchOption("bench", "Play games with N clients against a running server or router.", "clients");
+    QCommandLineOption durationOption("duration", "Benchmark duration in seconds for --bench.", "seconds", "10");
+    QCommandLineOption benchIdleOption("bench-idle", "Idle connections opened before --bench clients start.", "count", "0");
+    QCommandLineOption benchHealthPortOption("bench-health-port", "Server health port to read memory from during --bench (0 - off).",
+                                             "port", "33334");
+    QCommandLineOption benchWebSocketPortOption("bench-websocket-port",
+                                                "Repeat --bench over the server WebSocket port and compare with TCP (0 - TCP only).",
+                                                "port", "0");
+    QCommandLineOption benchBoardOption("bench-board", "Compare specialized and generic board kernels for every game mode.", "rounds");
+    QCommandLineOption fuzzScannerOption("fuzz-scanner", "Compare the request scanner with QJsonDocument on N mutated requests.",
+                                         "iterations");
+    QCommandLineOption fuzzSeedOption("fuzz-seed", "Random seed for --fuzz-scanner.", "seed", "1");
+    QCommandLineOption tournamentOption("tournament", "Run a tournament on the --shards router: file with one nickname per line, "
+                                        "in seeding order.", "file");
+    QCommandLineOption tournamentFormatOption("tournament-format", "Tournament format: single or swiss.", "format", "single");
+    QCommandLineOption tournamentRoundsOption("tournament-rounds", "Swiss rounds (0 - by player count).", "rounds", "0");
+    QCommandLineOption tournamentModeOption("tournament-mode", "Game mode of tournament games.", "mode", "classic");
+    QCommandLineOption incrementalVacuumOption("enable-incremental-vacuum",
+                                               "Rewrite the database once so that archived games free space (server must be stopped).");
+    parser.addOptions({replayOption, hostOption, portOption, speedOption, replayPasswordOption, shardsOption, shardBasePortOption, benchOption, durationOption,
+                       benchIdleOption, benchHealthPortOption, benchWebSocketPortOption, benchBoardOption, fuzzScannerOption, fuzzSeedOption, tournamentOption, tournamentFormatOption, tournamentRoundsOption, tournamentModeOption,
+                       incrementalVacuumOption});
+    parser.process(a);
+
+    // Замер ядер доски: без сети и БД
+    if (parser.isSet(benchBoardOption)) {
+        GameMode::benchmark(qMax(1, parser.value(benchBoardOption).toInt()));
+        return 0;
+    }
+
+    // Проверка сканера запросов: без сети и БД
+    if (parser.isSet(fuzzScannerOption)) {
+        return fuzzRequestScanner(qMax(1, parser.value(fuzzScannerOption).toInt()), parser.value(fuzzSeedOption).toUInt()) ? 0 : 1;
+    }
+
+    // Однократный перевод БД в инкрементальную очистку: полный VACUUM, сервер не запускается
+    if (parser.isSet(incrementalVacuumOption)) {
+        return DatabaseManager::getInstance()->enableIncrementalVacuum() ? 0 : 1;
+    }
+
+    // Режим воспроизведения записи трафика: сервер не запускается
+    if (parser.isSet(replayOption)) {
+        TrafficReplay replay(parser.value(hostOption), quint16(parser.value(portOption).toUInt()), parser.value(speedOption).toDouble(),
+                             parser.value(replayPasswordOption));
+        if (!replay.load(parser.value(replayOption))) {
+            return 1;
+        }
+        QObject::connect(&replay, &TrafficReplay::finished, &a, &QCoreApplication::exit);
+        replay.start();
+        return a.exec();
+    }
+
+    // Нагрузочный прогон по протоколу: сервер не запускается
+    if (parser.isSet(benchOption)) {
+        LoadBench bench(parser.value(hostOption), quint16(parser.value(portOption).toUInt()), parser.value(benchOption).toInt(),
+                        parser.value(durationOption).toInt(), parser.value(benchIdleOption).toInt(),
+                        quint16(parser.value(benchHealthPortOption).toUInt()), quint16(parser.value(benchWebSocketPortOption).toUInt()));
+        QObject::connect(&bench, &LoadBench::finished, &a, &QCoreApplication::exit);
+        bench.start();
+        return a.exec();
+    }
+
+    int port = qEnvironmentVariableIsSet("SERVER_PORT") ? qEnvironmentVariableIntValue("SERVER_PORT") : 33333;
+
+    // Маршрутизатор: игры обслуживают процессы-шарды, сам он только распределяет соединения
+    if (parser.isSet(shardsOption)) {
+        ShardRouter router(parser.value(shardsOption).toInt(), quint16(parser.value(shardBasePortOption).toUInt()));
+        // Турнир: туры создаются пакетами и раздаются шардам по мере их освобождения.
+        // Первый тур создаётся до запуска шардов, чтобы миграции маршрутизатора не спорили с ними за БД
+        if (parser.isSet(tournamentOption)) {
+            QFile playersFile(parser.value(tournamentOption));
+            TournamentScheduler::Format format;
+            const GameMode *mode = GameMode::find(parser.value(tournamentModeOption));
+            if (!playersFile.open(QIODevice::ReadOnly | QIODevice::Text)) {
+                qDebug() << "Cannot read tournament players from" << playersFile.fileName();
+                return 1;
+            }
+            if (!TournamentScheduler::parseFormat(parser.value(tournamentFormatOption), &format) || !mode) {
+                qDebug() << "Unknown tournament format or game mode";
+                return 1;
+            }
+            QStringList players;
+            while (!playersFile.atEnd()) {
+                players.append(QString::fromUtf8(playersFile.readLine()).trimmed());
+            }
+            if (!router.startTournament(format, players, *mode, parser.value(tournamentRoundsOption).toInt())) {
+                return 1;
+            }
+        }
+        if (!router.start(quint16(port))) {
+            return 1;
+        }
+        return a.exec();
+    }
+
+    // Выборочная трассировка запросов (TRACE_SAMPLE_EVERY) - до запуска потоков сервера
+    Tracer::configure();
+
+    // Готовность можно опрашивать с самого начала запуска (HEALTH_PORT=0 - отключить)
+    StartupSequence startup;
+    int healthPort = qEnvironmentVariableIsSet("HEALTH_PORT") ? qEnvironmentVariableIntValue("HEALTH_PORT") : 33334;
+    if (healthPort > 0) {
+        startup.startHealthEndpoint(quint16(healthPort));
+    }
+
     MyTcpServer myserv;
+    if (!startup.run(&myserv, quint16(port))) {
+        return 1; // Этапы запуска уже в логе; супервизор (или маршрутизатор шардов) перезапустит процесс
+    }
+
+    // Сторож цикла событий - после запуска: этапы запуска сами по себе блокируют поток
+    StallDetector stallDetector;
+    stallDetector.start();
+
+    // Поток запросов к БД для обработчиков-сопрограмм (ASYNC_DB=0 - выполнять их в основном потоке)
+    DbWorker dbWorker;
+    dbWorker.start();
     return a.exec();
 }
@@ -0,0 +1,549 @@
+#include "movejournal.h"
+#include "DatabaseManager.h"
+#include <QSqlQuery>
+#include <QSqlError>
+#include <QHash>
+#include <QMap>
+#include <QDebug>
+
+#ifdef Q_OS_WIN
+#include <windows.h>
+#include <io.h>
+#else
+#include <sys/mman.h>
+#endif
+
+namespace {
+
+const int ChecksumBytes = 14; // Всё, кроме самой контрольной суммы
+
+const char SqlJournalPlayers[] = "SELECT player1, player2 FROM Game WHERE game_id = :game_id";
+const char SqlJournalSelectFleet[] = "SELECT ships FROM Fleet WHERE game_id = :game_id AND player = :player";
+const char SqlJournalSaveFleet[] = "INSERT OR REPLACE INTO Fleet (game_id, player, ships) VALUES (:game_id, :player, :ships)";
+const char SqlJournalMove[] = "INSERT INTO Move (game_id, player, x, y, result) VALUES (:game_id, :player, :x, :y, :result)";
+const char SqlJournalTurn[] = "UPDATE Game SET current_turn = :current_turn WHERE game_id = :game_id";
+const char SqlJournalApplied[] = "SELECT applied_sequence FROM JournalState WHERE id = 1";
+const char SqlJournalSaveApplied[] = "INSERT OR REPLACE INTO JournalState (id, applied_sequence) VALUES (1, :sequence)";
+
+// Значения MoveResult::Status: Miss, Hit, Sunk
+const char *const MoveResults[] = {"miss", "hit", "sunk"};
+
+} // namespace
+
+bool JournalRecord::isValid() const
+{
+    return sequence != 0 && checksum == qChecksum(QByteArrayView(reinterpret_cast<const char*>(this), ChecksumBytes));
+}
+
+void JournalRecord::updateChecksum()
+{
+    checksum = qChecksum(QByteArrayView(reinterpret_cast<const char*>(this), ChecksumBytes));
+}
+
+JournalCompactor::JournalCompactor(const QString &databaseName) : mDatabaseName(databaseName)
+{
+}
+
+JournalCompactor::~JournalCompactor()
+{
+    if (mDb.isValid()) {
+        QString connectionName = mDb.connectionName();
+        mDb.close();
+        mDb = QSqlDatabase();
+        QSqlDatabase::removeDatabase(connectionName);
+    }
+}
+
+bool JournalCompactor::compactSegment(QSqlDatabase &db, const QString &path, quint32 *lastSequence)
+{
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly)) {
+        qDebug() << "Error opening journal segment" << path << ":" << file.errorString();
+        return false;
+    }
+    QByteArray data = file.readAll();
+    file.close();
+
+    const JournalRecord *records = reinterpret_cast<const JournalRecord*>(data.constData());
+    int count = data.size() / int(sizeof(JournalRecord));
+
+    if (!db.transaction()) {
+        qDebug() << "Failed to start transaction in compactSegment:" << db.lastError().text();
+        return false;
+    }
+
+    // Записи до applied уже в SQLite: сегмент перенесён, но не удалён до сбоя - второй раз не применяем
+    bool ok = true;
+    quint32 applied = appliedSequence(db, &ok);
+    if (!ok) {
+        db.rollback();
+        return false;
+    }
+    quint32 highest = applied;
+
+    QSqlQuery playersQuery(db);
+    QSqlQuery fleetQuery(db);
+    QSqlQuery shipQuery(db);
+    QSqlQuery moveQuery(db);
+    QSqlQuery turnQuery(db);
+    QSqlQuery appliedQuery(db);
+    playersQuery.prepare(SqlJournalPlayers);
+    fleetQuery.prepare(SqlJournalSelectFleet);
+    shipQuery.prepare(SqlJournalSaveFleet);
+    moveQuery.prepare(SqlJournalMove);
+    turnQuery.prepare(SqlJournalTurn);
+    appliedQuery.prepare(SqlJournalSaveApplied);
+
+    QHash<int, QStringList> players; // Игра -> {player1, player2}
+    QHash<int, QString> turns; // Игра -> чей ход после последней записи
+    QMap<QPair<int, QString>, QByteArray> newShips; // (игра, игрок) -> корабли, дописываемые во флот
+    int appliedRecords = 0;
+    int skipped = 0;
+    for (int i = 0; i < count && ok; ++i) {
+        const JournalRecord &record = records[i];
+        if (!record.isValid()) {
+            break; // Хвост, не дописанный до сбоя
+        }
+        *lastSequence = record.sequence;
+        if (record.sequence <= applied) {
+            ++skipped;
+            continue;
+        }
+        highest = record.sequence;
+
+        auto it = players.find(record.gameId);
+        if (it == players.end()) {
+            QStringList names;
+            playersQuery.bindValue(":game_id", record.gameId);
+            if (playersQuery.exec() && playersQuery.next()) {
+                names << playersQuery.value(0).toString() << playersQuery.value(1).toString();
+            } else {
+                qDebug() << "Journal records for unknown game" << record.gameId << "are skipped";
+            }
+            playersQuery.finish();
+            it = players.insert(record.gameId, names);
+        }
+        if (it->size() != 2 || record.player > 1) {
+            continue;
+        }
+        const QString &player = it->at(record.player);
+        const QString &opponent = it->at(1 - record.player);
+
+        switch (record.type) {
+        case JournalRecord::Ship:
+            newShips[qMakePair(int(record.gameId), player)].append(DatabaseManager::encodeShip(record.x, record.y, record.size, record.value));
+            break;
+        case JournalRecord::Move:
+            moveQuery.bindValue(":game_id", record.gameId);
+            moveQuery.bindValue(":player", player);
+            moveQuery.bindValue(":x", record.x);
+            moveQuery.bindValue(":y", record.y);
+            moveQuery.bindValue(":result", record.value < 3 ? MoveResults[record.value] : "error");
+            ok = moveQuery.exec();
+            turns[record.gameId] = record.value == 0 ? opponent : player; // Промах передаёт ход
+            break;
+        case JournalRecord::Turn:
+            turns[record.gameId] = player;
+            break;
+        default:
+            qDebug() << "Unknown journal record type" << record.type << "in" << path;
+            break;
+        }
+        ++appliedRecords;
+    }
+
+    // Флот каждого игрока обновляется одной записью
+    for (auto it = newShips.constBegin(); it != newShips.constEnd() && ok; ++it) {
+        fleetQuery.bindValue(":game_id", it.key().first);
+        fleetQuery.bindValue(":player", it.key().second);
+        ok = fleetQuery.exec();
+        if (!ok) {
+            break;
+        }
+        QByteArray ships = fleetQuery.next() ? fleetQuery.value(0).toByteArray() : QByteArray();
+        fleetQuery.finish();
+        ships.append(it.value());
+        shipQuery.bindValue(":game_id", it.key().first);
+        shipQuery.bindValue(":player", it.key().second);
+        shipQuery.bindValue(":ships", ships);
+        ok = shipQuery.exec();
+    }
+
+    // Текущий ход переносится один раз на игру - последним значением из сегмента
+    for (auto it = turns.constBegin(); it != turns.constEnd() && ok; ++it) {
+        turnQuery.bindValue(":current_turn", it.value());
+        turnQuery.bindValue(":game_id", it.key());
+        ok = turnQuery.exec();
+    }
+
+    // Отметка о перенесённых записях - в той же транзакции, что и сами записи
+    if (ok && highest != applied) {
+        appliedQuery.bindValue(":sequence", qint64(highest));
+        ok = appliedQuery.exec();
+    }
+
+    if (!ok) {
+        qDebug() << "Error compacting journal segment" << path << ":" << fleetQuery.lastError().text() << shipQuery.lastError().text()
+                 << moveQuery.lastError().text() << turnQuery.lastError().text() << appliedQuery.lastError().text();
+        db.rollback();
+        return false;
+    }
+    if (!db.commit()) {
+        qDebug() << "Failed to commit transaction in compactSegment:" << db.lastError().text();
+        db.rollback();
+        return false;
+    }
+
+    if (!QFile::remove(path)) {
+        qDebug() << "Error removing compacted journal segment" << path;
+    }
+    qDebug() << "Compacted" << appliedRecords << "journal records from" << path;
+    if (skipped > 0) {
+        qDebug() << "Skipped" << skipped << "journal records already applied before a restart";
+    }
+    return true;
+}
+
+quint32 JournalCompactor::appliedSequence(QSqlDatabase &db, bool *ok)
+{
+    QSqlQuery query(db);
+    if (!query.exec(SqlJournalApplied)) {
+        qDebug() << "Error reading JournalState:" << query.lastError().text();
+        *ok = false;
+        return 0;
+    }
+    *ok = true;
+    return query.next() ? quint32(query.value(0).toLongLong()) : 0;
+}
+
+void JournalCompactor::enqueue(const QString &path)
+{
+    mQueue.append(path);
+    if (mQueue.size() == 1) {
+        processQueue();
+    }
+}
+
+void JournalCompactor::processQueue()
+{
+    if (!mDb.isValid()) {
+        // Соединение создаётся в потоке компактора - в нём же и используется
+        mDb = QSqlDatabase::addDatabase("QSQLITE", "journal_compactor");
+        mDb.setDatabaseName(mDatabaseName);
+        mDb.setConnectOptions("QSQLITE_BUSY_TIMEOUT=5000");
+    }
+    if (!mDb.isOpen() && !mDb.open()) {
+        qDebug() << "Journal compactor cannot open DB:" << mDb.lastError().text();
+        QTimer::singleShot(1000, this, &JournalCompactor::processQueue);
+        return;
+    }
+
+    while (!mQueue.isEmpty()) {
+        QString path = mQueue.first();
+        quint32 lastSequence = 0;
+        if (!compactSegment(mDb, path, &lastSequence)) {
+            emit compacted(path, 0, false);
+            QTimer::singleShot(1000, this, &JournalCompactor::processQueue); // Повторяем тот же сегмент
+            return;
+        }
+        mQueue.removeFirst();
+        emit compacted(path, lastSequence, true);
+    }
+}
+
+MoveJournal::MoveJournal(const QString &directory, const QString &databaseName, QObject *parent)
+    : QObject(parent), mDirectory(directory), mDatabaseName(databaseName),
+      mSegmentRecords(65536), mSyncMs(10), mSealIdleMs(2000),
+      mSegmentIndex(0), mFile(nullptr), mRecords(nullptr), mUsed(0), mSynced(0), mSequence(0),
+      mSyncTimer(nullptr), mSealTimer(nullptr), mThread(nullptr), mCompactor(nullptr),
+      mAppended(0), mSyncs(0), mSealed(0), mCompacted(0), mCompactionFailures(0), mCompactedSequence(0)
+{
+    if (qEnvironmentVariableIntValue("JOURNAL_SEGMENT_RECORDS") > 0) {
+        mSegmentRecords = qEnvironmentVariableIntValue("JOURNAL_SEGMENT_RECORDS");
+    }
+    if (qEnvironmentVariableIntValue("JOURNAL_SYNC_MS") > 0) {
+        mSyncMs = qEnvironmentVariableIntValue("JOURNAL_SYNC_MS");
+    }
+    if (qEnvironmentVariableIntValue("JOURNAL_SEAL_MS") > 0) {
+        mSealIdleMs = qEnvironmentVariableIntValue("JOURNAL_SEAL_MS");
+    }
+}
+
+MoveJournal::~MoveJournal()
+{
+    // Активный сегмент остаётся на диске и будет перенесён при следующем запуске
+    if (mRecords) {
+        syncSegment();
+        mFile->unmap(reinterpret_cast<uchar*>(mRecords));
+        mRecords = nullptr;
+        mFile->close();
+    }
+    delete mFile;
+    if (mThread) {
+        mThread->quit();
+        mThread->wait();
+    }
+}
+
+bool MoveJournal::replay(QSqlDatabase &db)
+{
+    if (!mDirectory.mkpath(".")) {
+        qDebug() << "Error creating journal directory" << mDirectory.path();
+        return false;
+    }
+
+    // Незакрытые сегменты: обрезаем по последней целой записи (и последнему целому пакету) и закрываем
+    const QStringList active = mDirectory.entryList(QStringList() << "moves-*.seg", QDir::Files, QDir::Name);
+    for (const QString &name : active) {
+        int index = segmentIndex(name);
+        mSegmentIndex = qMax(mSegmentIndex, index);
+
+        QFile file(mDirectory.filePath(name));
+        if (!file.open(QIODevice::ReadWrite)) {
+            qDebug() << "Error opening journal segment" << name << ":" << file.errorString();
+            return false;
+        }
+        QByteArray data = file.readAll();
+        const JournalRecord *records = reinterpret_cast<const JournalRecord*>(data.constData());
+        int count = data.size() / int(sizeof(JournalRecord));
+        int valid = 0;
+        int scanned = 0;
+        while (scanned < count && records[scanned].isValid()) {
+            if (!records[scanned].continuesBatch()) {
+                valid = scanned + 1;
+            }
+            ++scanned;
+        }
+        if (scanned > valid) {
+            qDebug() << "Journal segment" << name << "ends with an incomplete batch of" << scanned - valid << "records, dropped";
+        }
+        file.resize(qint64(valid) * qint64(sizeof(JournalRecord)));
+        file.close();
+        if (!file.rename(segmentPath(index, true))) {
+            qDebug() << "Error sealing journal segment" << name << ":" << file.errorString();
+            return false;
+        }
+        qDebug() << "Journal segment" << name << "recovered with" << valid << "records";
+    }
+
+    // Закрытые сегменты переносим в SQLite по порядку
+    const QStringList sealed = mDirectory.entryList(QStringList() << "moves-*.sealed", QDir::Files, QDir::Name);
+    for (const QString &name : sealed) {
+        mSegmentIndex = qMax(mSegmentIndex, segmentIndex(name));
+        quint32 lastSequence = 0;
+        if (!JournalCompactor::compactSegment(db, mDirectory.filePath(name), &lastSequence)) {
+            return false;
+        }
+        mSequence = qMax(mSequence, lastSequence);
+        ++mCompacted;
+    }
+
+    // Нумерация продолжается после уже перенесённых записей, даже если их сегменты удалены:
+    // иначе новые записи приняли бы за применённые
+    bool ok = true;
+    quint32 applied = JournalCompactor::appliedSequence(db, &ok);
+    if (!ok) {
+        return false;
+    }
+    mSequence = qMax(mSequence, applied);
+    mCompactedSequence = mSequence;
+    qDebug() << "Journal replay done:" << sealed.size() << "segments, last sequence" << mSequence;
+    return true;
+}
+
+bool MoveJournal::open()
+{
+    if (!mDirectory.mkpath(".")) {
+        qDebug() << "Error creating journal directory" << mDirectory.path();
+        return false;
+    }
+
+    mThread = new QThread(this);
+    mCompactor = new JournalCompactor(mDatabaseName);
+    mCompactor->moveToThread(mThread);
+    connect(mThread, &QThread::finished, mCompactor, &QObject::deleteLater);
+    connect(this, &MoveJournal::compactRequested, mCompactor, &JournalCompactor::enqueue);
+    connect(mCompactor, &JournalCompactor::compacted, this, &MoveJournal::slotCompacted);
+    mThread->start();
+
+    mSyncTimer = new QTimer(this);
+    connect(mSyncTimer, &QTimer::timeout, this, &MoveJournal::slotSync);
+    mSyncTimer->start(mSyncMs);
+
+    mSealTimer = new QTimer(this);
+    connect(mSealTimer, &QTimer::timeout, this, &MoveJournal::slotSealIdle);
+    mSealTimer->start(qMax(mSealIdleMs / 2, 1));
+
+    qDebug() << "Move journal is open in" << mDirectory.path() << "- segment records:" << mSegmentRecords
+             << "sync ms:" << mSyncMs << "seal ms:" << mSealIdleMs;
+    return openSegment();
+}
+
+bool MoveJournal::append(JournalRecord record)
+{
+    if (!mRecords && !openSegment()) {
+        return false;
+    }
+
+    record.sequence = ++mSequence;
+    record.updateChecksum();
+    mRecords[mUsed++] = record;
+    ++mAppended;
+
+    if (mUsed == mSegmentRecords) {
+        sealSegment();
+    }
+    return true;
+}
+
+bool MoveJournal::append(const JournalRecord *records, int count)
+{
+    if (count <= 0 || count > mSegmentRecords || count - 1 > 0xFF) {
+        qDebug() << "Journal batch of" << count << "records does not fit a segment";
+        return false;
+    }
+    // Пакет не переходит через границу сегментов: компактор переносит сегмент отдельной транзакцией
+    if (mRecords && mSegmentRecords - mUsed < count) {
+        sealSegment();
+    }
+    if (!mRecords && !openSegment()) {
+        return false;
+    }
+
+    for (int i = 0; i < count; ++i) {
+        JournalRecord record = records[i];
+        record.sequence = ++mSequence;
+        record.size = quint8(count - 1 - i);
+        record.updateChecksum();
+        mRecords[mUsed++] = record;
+    }
+    mAppended += count;
+
+    if (mUsed == mSegmentRecords) {
+        sealSegment();
+    }
+    return true;
+}
+
+quint32 MoveJournal::lastSequence() const
+{
+    return mSequence;
+}
+
+QJsonObject MoveJournal::stats() const
+{
+    QJsonObject stats;
+    stats["appended"] = qint64(mAppended);
+    stats["syncs"] = qint64(mSyncs);
+    stats["sealed"] = qint64(mSealed);
+    stats["compacted"] = qint64(mCompacted);
+    stats["compaction_failures"] = qint64(mCompactionFailures);
+    stats["last_sequence"] = qint64(mSequence);
+    stats["compacted_sequence"] = qint64(mCompactedSequence);
+    stats["active_records"] = mUsed;
+    return stats;
+}
+
+void MoveJournal::slotSync()
+{
+    syncSegment();
+}
+
+void MoveJournal::slotSealIdle()
+{
+    if (mRecords && mUsed > 0 && mSegmentAge.elapsed() >= mSealIdleMs) {
+        sealSegment();
+    }
+}
+
+void MoveJournal::slotCompacted(const QString &path, quint32 lastSequence, bool ok)
+{
+    if (!ok) {
+        ++mCompactionFailures;
+        qDebug() << "Journal segment" << path << "is not compacted yet, will retry";
+        return;
+    }
+    ++mCompacted;
+    mCompactedSequence = qMax(mCompactedSequence, lastSequence);
+    emit segmentCompacted(mCompactedSequence);
+}
+
+bool MoveJournal::openSegment()
+{
+    ++mSegmentIndex;
+    qint64 bytes = qint64(mSegmentRecords) * qint64(sizeof(JournalRecord));
+    mFile = new QFile(segmentPath(mSegmentIndex, false));
+    if (!mFile->open(QIODevice::ReadWrite | QIODevice::Truncate) || !mFile->resize(bytes)) {
+        qDebug() << "Error creating journal segment" << mFile->fileName() << ":" << mFile->errorString();
+        delete mFile;
+        mFile = nullptr;
+        return false;
+    }
+
+    uchar *memory = mFile->map(0, bytes);
+    if (!memory) {
+        qDebug() << "Error mapping journal segment" << mFile->fileName() << ":" << mFile->errorString();
+        mFile->close();
+        delete mFile;
+        mFile = nullptr;
+        return false;
+    }
+
+    mRecords = reinterpret_cast<JournalRecord*>(memory);
+    mUsed = 0;
+    mSynced = 0;
+    mSegmentAge.start();
+    return true;
+}
+
+void MoveJournal::sealSegment()
+{
+    syncSegment();
+    mFile->unmap(reinterpret_cast<uchar*>(mRecords));
+    mRecords = nullptr;
+    mFile->resize(qint64(mUsed) * qint64(sizeof(JournalRecord))); // Пустой хвост не нужен
+    mFile->close();
+
+    QString sealedPath = segmentPath(mSegmentIndex, true);
+    if (mFile->rename(sealedPath)) {
+        ++mSealed;
+        emit compactRequested(sealedPath);
+    } else {
+        qDebug() << "Error sealing journal segment" << mFile->fileName() << "- it will be replayed on restart";
+    }
+    delete mFile;
+    mFile = nullptr;
+    mUsed = 0;
+    mSynced = 0;
+}
+
+bool MoveJournal::syncSegment()
+{
+    if (!mRecords || mSynced == mUsed) {
+        return true;
+    }
+
+    // Один сброс на все записи, накопленные за интервал (групповая фиксация)
+#ifdef Q_OS_WIN
+    bool ok = FlushViewOfFile(mRecords, 0) && FlushFileBuffers(HANDLE(_get_osfhandle(mFile->handle())));
+#else
+    bool ok = msync(mRecords, size_t(mSegmentRecords) * sizeof(JournalRecord), MS_SYNC) == 0;
+#endif
+    if (!ok) {
+        qDebug() << "Error syncing journal segment" << mFile->fileName();
+        return false;
+    }
+    mSynced = mUsed;
+    ++mSyncs;
+    return true;
+}
+
+QString MoveJournal::segmentPath(int index, bool sealed) const
+{
+    return mDirectory.filePath(QString("moves-%1.%2").arg(index, 8, 10, QChar('0')).arg(sealed ? "sealed" : "seg"));
+}
+
+int MoveJournal::segmentIndex(const QString &fileName)
+{
+    return fileName.mid(6, 8).toInt(); // moves-00000001.seg
+}
@@ -0,0 +1,136 @@
+#ifndef MOVEJOURNAL_H
+#define MOVEJOURNAL_H
+
+#include <QObject>
+#include <QDir>
+#include <QFile>
+#include <QTimer>
+#include <QThread>
+#include <QElapsedTimer>
+#include <QStringList>
+#include <QSqlDatabase>
+#include <QJsonObject>
+
+// Запись журнала фиксированного размера (16 байт).
+// Ник не хранится: игрок задаётся номером в строке Game (0 - player1, 1 - player2).
+struct JournalRecord
+{
+    enum Type : quint8 {
+        Ship = 1,
+        Move = 2,
+        Turn = 3
+    };
+
+    quint32 sequence; // Сквозной номер записи, 0 - пустой слот
+    qint32 gameId;
+    quint8 type;
+    quint8 player;
+    quint8 x;
+    quint8 y;
+    quint8 size; // Ship: размер корабля; Move/Turn: сколько записей пакета идёт следом (0 - последняя)
+    quint8 value; // Ship: 1 - горизонтальный; Move: MoveResult::Status
+    quint16 checksum; // CRC-16 первых 14 байт
+
+    bool isValid() const;
+    void updateChecksum(); // Посчитать контрольную сумму
+    bool continuesBatch() const { return type != Ship && size > 0; } // За записью должны следовать остальные записи пакета
+};
+
+static_assert(sizeof(JournalRecord) == 16, "JournalRecord must be 16 bytes");
+
+// Перенос закрытых сегментов журнала в таблицы Fleet/Move/Game.
+// Живёт в отдельном потоке со своим соединением SQLite; сегменты обрабатываются строго по порядку,
+// неудачный сегмент повторяется, пока не будет перенесён.
+class JournalCompactor : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit JournalCompactor(const QString &databaseName);
+    ~JournalCompactor();
+
+    // Перенести один сегмент одной транзакцией (используется и при запуске, в основном потоке)
+    // Записи с номером не больше отмеченного в JournalState уже перенесены и пропускаются
+    static bool compactSegment(QSqlDatabase &db, const QString &path, quint32 *lastSequence);
+    static quint32 appliedSequence(QSqlDatabase &db, bool *ok); // Последняя перенесённая запись, 0 - нет
+
+public slots:
+    void enqueue(const QString &path);
+
+signals:
+    void compacted(const QString &path, quint32 lastSequence, bool ok);
+
+private slots:
+    void processQueue();
+
+private:
+    QString mDatabaseName;
+    QSqlDatabase mDb;
+    QStringList mQueue;
+};
+
+// Журнал ходов и расстановок: сегменты фиксированного размера, отображённые в память (mmap).
+// Запись - копирование 16 байт; сброс на диск (msync) - групповой, по таймеру.
+// Заполненный или простаивающий сегмент закрывается (*.sealed) и уходит компактору.
+// Незакрытые сегменты после перезапуска закрываются и переносятся в SQLite до приёма клиентов.
+class MoveJournal : public QObject
+{
+    Q_OBJECT
+
+public:
+    MoveJournal(const QString &directory, const QString &databaseName, QObject *parent = nullptr);
+    ~MoveJournal();
+
+    bool replay(QSqlDatabase &db); // Перенести в SQLite всё, что осталось от прошлого запуска
+    bool open(); // Создать активный сегмент и запустить компактор
+    bool append(JournalRecord record);
+    // Пакет записей (залп и передача хода): целиком в одном сегменте; при восстановлении
+    // недописанный пакет отбрасывается полностью. Поле size записей заполняется здесь
+    bool append(const JournalRecord *records, int count);
+    quint32 lastSequence() const;
+    QJsonObject stats() const;
+
+signals:
+    void segmentCompacted(quint32 lastSequence); // Всё до lastSequence уже в SQLite
+    void compactRequested(const QString &path);
+
+private slots:
+    void slotSync();
+    void slotSealIdle();
+    void slotCompacted(const QString &path, quint32 lastSequence, bool ok);
+
+private:
+    bool openSegment();
+    void sealSegment();
+    bool syncSegment();
+    QString segmentPath(int index, bool sealed) const;
+    static int segmentIndex(const QString &fileName);
+
+    QDir mDirectory;
+    QString mDatabaseName;
+    int mSegmentRecords; // Записей в одном сегменте
+    int mSyncMs; // Интервал группового сброса на диск
+    int mSealIdleMs; // Через сколько закрывать недозаполненный сегмент
+
+    int mSegmentIndex;
+    QFile *mFile;
+    JournalRecord *mRecords; // Отображение активного сегмента
+    int mUsed;
+    int mSynced;
+    quint32 mSequence;
+    QElapsedTimer mSegmentAge;
+
+    QTimer *mSyncTimer;
+    QTimer *mSealTimer;
+    QThread *mThread;
+    JournalCompactor *mCompactor;
+
+    quint64 mAppended;
+    quint64 mSyncs;
+    quint64 mSealed;
+    quint64 mCompacted;
+    quint64 mCompactionFailures;
+    quint32 mCompactedSequence;
+};
+
+#endif // MOVEJOURNAL_H
@@ -1,25 +1,573 @@
 #include "mytcpserver.h"
 #include "func2serv.h"
 #include "DatabaseManager.h"
+#include "allocstats.h"
+#include "requestarena.h"
+#include "requestscanner.h"
+#include "stalldetector.h"
+#include "tracer.h"
 #include <QDebug>
 #include <QJsonDocument>
 #include <QJsonObject>
+#include <QJsonArray>
+#include <QTimer>
+#include <QDeadlineTimer>
+#include <QWebSocket>
 
-MyTcpServer::MyTcpServer(QObject *parent) : QObject(parent), currentGameId(-1)
+const QString MyTcpServer::BotNickname = "[bot]";
+static const int BotMaxFailedMoves = 5; // После стольких отказов подряд бот сдаётся, чтобы партия не зависла
+static const int HandoffFlushMs = 200; // Общий срок дописывания ответов всех клиентов перед передачей сессий
+
+static qint64 nicknameBytes(const QString &nickname)
+{
+    return qint64(nickname.capacity()) * qint64(sizeof(QChar));
+}
+
+MyTcpServer::MyTcpServer(QObject *parent) : QObject(parent), currentGameId(-1), mTransport(nullptr), gameMode(&GameMode::classic()), mStatsRevision(0),
+      mShardLink(nullptr), mInFlight(0), mHandoffPaused(false), mBotTurnDeferred(false), mBotFailedMoves(0), mScheduledGameId(-1),
+      mScheduledMode(nullptr), mBaselineHeapBytes(-1), mQtSockets(0), mWebSockets(0), mSessionNicknameBytes(0)
 {
+    // Бюджет времени на ход бота, мкс (по умолчанию 2 мс)
+    int botBudgetUs = qEnvironmentVariableIntValue("BOT_MOVE_BUDGET_US");
+    if (botBudgetUs > 0) {
+        bot.setMoveBudget(qint64(botBudgetUs) * 1000);
+    }
+
     mTcpServer = new QTcpServer(this);
     connect(mTcpServer, &QTcpServer::newConnection, this, &MyTcpServer::slotNewConnection);
 
-    if (!mTcpServer->listen(QHostAddress::Any, 33333)) {
+    // Собственный транспорт TCP-клиентов (NET_TRANSPORT=epoll); по умолчанию - QTcpSocket
+    mTransport = NetTransport::create(qEnvironmentVariable("NET_TRANSPORT"), this);
+    if (mTransport) {
+        connect(mTransport, &NetTransport::newConnection, this, &MyTcpServer::slotNetConnection);
+        mTransport->setRequestHandler([this](NetConnection *connection, const QByteArray &request) {
+            readNetRequest(connection, request);
+        });
+    }
+
+    mWebSocketServer = new QWebSocketServer("echoServer", QWebSocketServer::NonSecureMode, this);
+    connect(mWebSocketServer, &QWebSocketServer::newConnection, this, &MyTcpServer::slotNewWebSocketConnection);
+
+    rateLimiter.loadFromEnvironment();
+
+    // Запись трафика: CAPTURE_FILE - файл, CAPTURE_SECONDS - длина окна (0 - до остановки сервера)
+    QString captureFile = qEnvironmentVariable("CAPTURE_FILE");
+    if (!captureFile.isEmpty()) {
+        capture.start(captureFile, qEnvironmentVariableIntValue("CAPTURE_SECONDS"));
+    }
+}
+
+bool MyTcpServer::warmUp(int expectedClients)
+{
+    QMutexLocker locker(&mutex);
+    // Таблицы сессий - на всех клиентов; счётчики партии хранятся только для её участников
+    mClients.reserve(expectedClients);
+    mSocketToNickname.reserve(expectedClients);
+
+    StatsChanges all = DatabaseManager::getInstance()->loadStatsSince(-1);
+    leaderboard.rebuild(all.players);
+    mStatsRevision = all.revision;
+    qDebug() << "Leaderboard built for" << leaderboard.size() << "players";
+    return true;
+}
+
+bool MyTcpServer::startListening(quint16 port)
+{
+    mBaselineHeapBytes = AllocStats::heapBytes(); // Всё, что выделено после, - на клиентов
+    if (mTransport) {
+        return mTransport->listen(port);
+    }
+    if (!mTcpServer->listen(QHostAddress::Any, port)) {
         qDebug() << "Server is NOT started!";
-    } else {
-        qDebug() << "Server is started!";
+        return false;
     }
+    qDebug() << "Server is started!";
+    return true;
+}
+
+bool MyTcpServer::startWebSocketListening(quint16 port)
+{
+    if (!mWebSocketServer->listen(QHostAddress::Any, port)) {
+        qDebug() << "WebSocket server is NOT started:" << mWebSocketServer->errorString();
+        return false;
+    }
+    qDebug() << "WebSocket server is started on port" << port;
+    return true;
+}
+
+bool MyTcpServer::connectShardLink(const QString &serverName, int shardIndex)
+{
+    mShardLink = new ShardLink(serverName, shardIndex, this);
+    connect(mShardLink, &ShardLink::delivered, this, &MyTcpServer::slotShardDelivered);
+    connect(mShardLink, &ShardLink::matchAssigned, this, &MyTcpServer::slotShardMatch);
+    connect(mShardLink, &ShardLink::matchCancelled, this, &MyTcpServer::slotShardMatchCancelled);
+    // Клиенты, перешедшие от прежнего процесса, объявляются при соединении с маршрутизатором
+    for (auto it = mClients.constBegin(); it != mClients.constEnd(); ++it) {
+        mShardLink->announceUser(it.key());
+    }
+    mShardLink->setBotGame(players.contains(BotNickname));
+    return mShardLink->connectToRouter();
+}
+
+QJsonObject MyTcpServer::getTransportStats() const
+{
+    return mTransport ? mTransport->stats() : QJsonObject();
+}
+
+QJsonObject MyTcpServer::getMemoryReport() const
+{
+    QMutexLocker locker(&mutex);
+    QJsonObject report;
+    qint64 resident = AllocStats::residentBytes();
+    qint64 heap = AllocStats::heapBytes();
+    report["resident_bytes"] = resident;
+    report["heap_bytes"] = heap;
+
+    // Соединения по видам: у QTcpSocket свои буферы QIODevice, у NetConnection - только при обмене
+    int netConnections = mTransport ? mTransport->connectionCount() : 0;
+    int connections = mQtSockets + netConnections + mWebSockets;
+    report["connections"] = connections;
+    if (connections > 0 && heap >= 0 && mBaselineHeapBytes >= 0) {
+        report["heap_per_connection"] = double(heap - mBaselineHeapBytes) / connections;
+    }
+
+    QJsonObject transport;
+    transport["name"] = mTransport ? mTransport->name() : QString("qt");
+    transport["qt_sockets"] = mQtSockets;
+    transport["web_sockets"] = mWebSockets;
+    transport["native_connections"] = netConnections;
+    if (mTransport && mTransport->ioBufferBytes() >= 0) {
+        transport["io_buffer_bytes"] = mTransport->ioBufferBytes();
+    }
+
+    // Сессия - запись в двух индексах и строка никнейма (общая у обоих)
+    QJsonObject sessions;
+    sessions["count"] = mClients.size();
+    sessions["bytes"] = AllocStats::hashBytes(mClients) + AllocStats::hashBytes(mSocketToNickname) + mSessionNicknameBytes;
+
+    QJsonObject game;
+    game["players"] = players.size();
+    game["counters"] = sunkShips.size() + shotsFired.size() + shotsHit.size();
+    game["bytes"] = AllocStats::hashBytes(sunkShips) + AllocStats::hashBytes(shotsFired) + AllocStats::hashBytes(shotsHit);
+
+    QJsonObject components;
+    components["transport"] = transport;
+    components["sessions"] = sessions;
+    components["game"] = game;
+    components["rate_limiter"] = rateLimiter.memoryStats();
+    report["components"] = components;
+    return report;
+}
+
+QJsonObject MyTcpServer::getShardStats() const
+{
+    return mShardLink ? mShardLink->stats() : QJsonObject();
+}
+
+bool MyTcpServer::isWebSocketListening() const
+{
+    return mWebSocketServer->isListening();
+}
+
+void MyTcpServer::pauseForHandoff()
+{
+    mHandoffPaused = true;
+    mTcpServer->pauseAccepting();
+    mWebSocketServer->pauseAccepting();
+    if (mTransport) {
+        mTransport->pause();
+    }
+}
+
+void MyTcpServer::resumeAfterHandoff()
+{
+    mHandoffPaused = false;
+    mTcpServer->resumeAccepting();
+    mWebSocketServer->resumeAccepting();
+    // Запросы, пришедшие за время паузы, ждут в буферах сокетов
+    for (QTcpSocket *socket : mTcpServer->findChildren<QTcpSocket*>()) {
+        if (socket->bytesAvailable() > 0) {
+            readClient(socket);
+        }
+    }
+    if (mTransport) {
+        mTransport->resume();
+    }
+    if (mBotTurnDeferred) {
+        mBotTurnDeferred = false;
+        scheduleBotTurn();
+    }
+}
+
+bool MyTcpServer::isIdle() const
+{
+    return mInFlight == 0;
+}
+
+QJsonObject MyTcpServer::saveSession(QVector<int> &descriptors)
+{
+    QJsonObject session;
+    session["tcp_fd"] = descriptors.size();
+    descriptors.append(mTransport ? mTransport->listenerDescriptor() : int(mTcpServer->socketDescriptor()));
+    session["ws_fd"] = -1;
+    if (mWebSocketServer->isListening()) {
+        session["ws_fd"] = descriptors.size();
+        descriptors.append(int(mWebSocketServer->socketDescriptor()));
+    }
+
+    QMutexLocker locker(&mutex);
+    // Ответы дописываются до передачи с одним сроком на всех: сначала без ожидания во все соединения,
+    // затем ждём только тех, у кого остался хвост. Непрочитанные запросы уходят вместе с сокетом
+    QDeadlineTimer flushDeadline(HandoffFlushMs);
+    QList<QTcpSocket*> sockets;
+    for (QTcpSocket *socket : mTcpServer->findChildren<QTcpSocket*>()) {
+        if (socket->state() == QAbstractSocket::ConnectedState) {
+            socket->flush();
+            sockets.append(socket);
+        }
+    }
+    QList<NetConnection*> connections;
+    if (mTransport) {
+        for (NetConnection *connection : mTransport->connections()) {
+            if (connection->isOpen()) {
+                connection->flush(0);
+                connections.append(connection);
+            }
+        }
+    }
+    int unflushed = 0;
+    for (QTcpSocket *socket : sockets) {
+        while (socket->bytesToWrite() > 0 && !flushDeadline.hasExpired() &&
+               socket->waitForBytesWritten(int(flushDeadline.remainingTime()))) {
+        }
+        unflushed += socket->bytesToWrite() > 0;
+    }
+    for (NetConnection *connection : connections) {
+        unflushed += !connection->flush(int(flushDeadline.remainingTime()));
+    }
+    if (unflushed > 0) {
+        qDebug() << "Handoff:" << unflushed << "clients still had unsent responses after" << HandoffFlushMs << "ms";
+    }
+
+    QJsonArray clients;
+    for (QTcpSocket *socket : sockets) {
+        QJsonObject client;
+        client["fd"] = descriptors.size();
+        client["nickname"] = mSocketToNickname.value(socket);
+        client["pending"] = QString::fromLatin1(socket->readAll().toBase64());
+        clients.append(client);
+        descriptors.append(int(socket->socketDescriptor()));
+    }
+    // Соединения собственного транспорта передаются так же; неразобранный остаток - в pending
+    for (NetConnection *connection : connections) {
+        QJsonObject client;
+        client["fd"] = descriptors.size();
+        client["nickname"] = mSocketToNickname.value(connection);
+        client["pending"] = QString::fromLatin1(connection->takePending().toBase64());
+        clients.append(client);
+        descriptors.append(connection->descriptor());
+    }
+    session["clients"] = clients;
+
+    QJsonObject sunk;
+    for (auto it = sunkShips.constBegin(); it != sunkShips.constEnd(); ++it) {
+        sunk[it.key()] = it.value();
+    }
+    QJsonObject fired;
+    for (auto it = shotsFired.constBegin(); it != shotsFired.constEnd(); ++it) {
+        fired[it.key()] = it.value();
+    }
+    QJsonObject hit;
+    for (auto it = shotsHit.constBegin(); it != shotsHit.constEnd(); ++it) {
+        hit[it.key()] = it.value();
+    }
+    session["players"] = QJsonArray::fromStringList(players);
+    session["ready"] = QJsonArray::fromStringList(QStringList(readyPlayers.begin(), readyPlayers.end()));
+    session["sunk"] = sunk;
+    session["shots_fired"] = fired;
+    session["shots_hit"] = hit;
+    session["game_id"] = currentGameId;
+    session["mode"] = gameMode->name;
+    session["bot_difficulty"] = int(bot.difficulty());
+    return session;
+}
+
+void MyTcpServer::detachHandedOff()
+{
+    // Сначала отключаем сигналы: закрытие сокета не должно выглядеть как уход игрока
+    QList<QTcpSocket*> sockets = mTcpServer->findChildren<QTcpSocket*>();
+    for (QTcpSocket *socket : sockets) {
+        socket->disconnect(this);
+    }
+    for (QTcpSocket *socket : sockets) {
+        socket->abort(); // Только close() своей копии: соединение живёт в новом процессе
+    }
+    mTcpServer->close();
+    if (mTransport) {
+        for (NetConnection *connection : mTransport->connections()) {
+            connection->disconnect(this);
+            connection->close(); // Тоже только своя копия дескриптора
+            connection->deleteLater();
+        }
+        mTransport->close();
+    }
+
+    // WebSocket-клиенты не переносятся - переподключатся к новому процессу
+    QList<QObject*> webSockets;
+    {
+        QMutexLocker locker(&mutex);
+        for (QObject *client : mSocketToNickname.keys()) {
+            if (qobject_cast<QWebSocket*>(client)) {
+                webSockets.append(client);
+            }
+        }
+        mClients.clear();
+        mSocketToNickname.clear();
+        mSessionNicknameBytes = 0;
+    }
+    mQtSockets = 0;
+    mWebSockets = 0;
+    for (QObject *client : webSockets) {
+        client->disconnect(this);
+        static_cast<QWebSocket*>(client)->close(QWebSocketProtocol::CloseCodeGoingAway, "Server is restarting");
+    }
+    mWebSocketServer->close();
+}
+
+bool MyTcpServer::restoreSession(const QJsonObject &session, QVector<int> &descriptors)
+{
+    auto descriptorAt = [&descriptors](const QJsonValue &index) {
+        int i = index.toInt(-1);
+        return i >= 0 && i < descriptors.size() ? descriptors[i] : -1;
+    };
+
+    int tcpFd = descriptorAt(session["tcp_fd"]);
+    bool listenerTaken = tcpFd >= 0 && (mTransport ? mTransport->adoptListener(tcpFd) : mTcpServer->setSocketDescriptor(tcpFd));
+    if (!listenerTaken) {
+        qDebug() << "Cannot take over the listening socket:" << mTcpServer->errorString();
+        return false;
+    }
+    descriptors[session["tcp_fd"].toInt()] = -1;
+    int wsFd = descriptorAt(session["ws_fd"]);
+    if (wsFd >= 0 && mWebSocketServer->setSocketDescriptor(wsFd)) {
+        descriptors[session["ws_fd"].toInt()] = -1;
+    }
+
+    QVector<QPair<QObject*, QByteArray>> pending;
+    {
+        QMutexLocker locker(&mutex);
+        for (const QJsonValue &value : session["clients"].toArray()) {
+            QJsonObject client = value.toObject();
+            int fd = descriptorAt(client["fd"]);
+            if (fd < 0) {
+                continue;
+            }
+            QObject *socket = nullptr;
+            if (mTransport) {
+                NetConnection *connection = mTransport->adoptConnection(fd);
+                if (connection) {
+                    connect(connection, &NetConnection::disconnected, this, &MyTcpServer::slotClientDisconnected);
+                    socket = connection;
+                }
+            } else {
+                QTcpSocket *tcpSocket = new QTcpSocket(mTcpServer); // Как у принятых соединений: родитель - QTcpServer
+                if (tcpSocket->setSocketDescriptor(fd)) {
+                    watchClient(tcpSocket);
+                    socket = tcpSocket;
+                } else {
+                    delete tcpSocket;
+                }
+            }
+            if (!socket) {
+                continue;
+            }
+            descriptors[client["fd"].toInt()] = -1;
+            QString nickname = client["nickname"].toString();
+            if (!nickname.isEmpty()) {
+                if (!mClients.contains(nickname)) {
+                    mSessionNicknameBytes += nicknameBytes(nickname);
+                }
+                mClients.insert(nickname, socket);
+                mSocketToNickname.insert(socket, nickname);
+            }
+            QByteArray data = QByteArray::fromBase64(client["pending"].toString().toLatin1());
+            if (!data.isEmpty()) {
+                pending.append(qMakePair(socket, data));
+            }
+        }
+
+        players.clear();
+        for (const QJsonValue &player : session["players"].toArray()) {
+            players.append(player.toString());
+        }
+        readyPlayers.clear();
+        for (const QJsonValue &player : session["ready"].toArray()) {
+            readyPlayers.insert(player.toString());
+        }
+        QJsonObject sunk = session["sunk"].toObject();
+        for (auto it = sunk.constBegin(); it != sunk.constEnd(); ++it) {
+            sunkShips.insert(it.key(), it.value().toInt());
+        }
+        QJsonObject fired = session["shots_fired"].toObject();
+        for (auto it = fired.constBegin(); it != fired.constEnd(); ++it) {
+            shotsFired.insert(it.key(), it.value().toInt());
+        }
+        QJsonObject hit = session["shots_hit"].toObject();
+        for (auto it = hit.constBegin(); it != hit.constEnd(); ++it) {
+            shotsHit.insert(it.key(), it.value().toInt());
+        }
+        currentGameId = session["game_id"].toInt(-1);
+        const GameMode *mode = GameMode::find(session["mode"].toString());
+        gameMode = mode ? mode : &GameMode::classic();
+    }
+
+    // Бот восстанавливает свою доску по собственным выстрелам партии
+    DatabaseManager *db = DatabaseManager::getInstance();
+    if (currentGameId != -1 && players.contains(BotNickname)) {
+        bot.reset();
+        bot.setDifficulty(BotEngine::Difficulty(session["bot_difficulty"].toInt()));
+        GameRecord record = db->loadGameRecord(currentGameId);
+        int botIndex = record.players[1] == BotNickname ? 1 : 0;
+        for (const GameMove &move : record.moves) {
+            if (move.player == botIndex) {
+                bot.applyResult(move.x, move.y, MoveResult::statusString(MoveResult::Status(move.status)));
+            }
+        }
+        if (readyPlayers.size() == 2 && db->getCurrentTurn(currentGameId) == BotNickname) {
+            scheduleBotTurn();
+        }
+    }
+
+    // Запросы, прочитанные прежним процессом, но не обработанные
+    for (const QPair<QObject*, QByteArray> &request : pending) {
+        QObject *socket = request.first;
+        QByteArray data = request.second;
+        QTimer::singleShot(0, socket, [this, socket, data]() { writeToClient(socket, dispatchRequest(socket, data)); });
+    }
+    qDebug() << "Restored" << mSocketToNickname.size() << "sessions, game" << currentGameId << "players" << players;
+    return true;
+}
+
+void MyTcpServer::slotShardDelivered(const QString &nickname, const QByteArray &message)
+{
+    // Только своим клиентам: обратно в маршрутизатор сообщение не уходит
+    QMutexLocker locker(&mutex);
+    QObject *client = mClients.value(nickname, nullptr);
+    if (client && isClientConnected(client)) {
+        writeToClient(client, message, false);
+    }
+}
+
+void MyTcpServer::slotShardMatch(int gameId, const QString &player1, const QString &player2, const QString &mode)
+{
+    // Партия уже создана планировщиком турнира; игроки придут сюда по входу через маршрутизатор
+    QMutexLocker locker(&mutex);
+    const GameMode *gameMode = GameMode::find(mode);
+    mScheduledGameId = gameMode ? gameId : -1;
+    mScheduledPlayers = QStringList{player1, player2};
+    mScheduledMode = gameMode;
+    qDebug() << "Tournament game" << gameId << "assigned:" << player1 << "vs" << player2 << "mode" << mode;
+}
+
+void MyTcpServer::slotShardMatchCancelled(int gameId, const QString &winner)
+{
+    // Итог уже записан маршрутизатором; здесь - только снять назначение и сбросить начатую партию
+    QStringList notify;
+    {
+        QMutexLocker locker(&mutex);
+        if (gameId != mScheduledGameId) {
+            return;
+        }
+        mScheduledGameId = -1;
+        mScheduledPlayers.clear();
+        mScheduledMode = nullptr;
+        if (currentGameId == gameId) {
+            notify = players;
+        }
+    }
+    qDebug() << "Tournament game" << gameId << "cancelled by router, winner:" << winner;
+    if (notify.isEmpty()) {
+        return;
+    }
+    QJsonObject gameOverMsg;
+    gameOverMsg["type"] = "game_over";
+    gameOverMsg["status"] = "success";
+    gameOverMsg["message"] = QString("%1 победил: соперник не явился.").arg(winner);
+    gameOverMsg["winner"] = winner;
+    QByteArray gameOverResponse = QJsonDocument(gameOverMsg).toJson(QJsonDocument::Compact) + "\r\n";
+    for (const QString &player : notify) {
+        sendMessageToUser(player, gameOverResponse);
+    }
+    resetGame();
+}
+
+int MyTcpServer::scheduledGame(const QString &player1, const QString &player2) const
+{
+    QMutexLocker locker(&mutex);
+    if (mScheduledGameId != -1 && player1 != player2 && mScheduledPlayers.contains(player1) && mScheduledPlayers.contains(player2)) {
+        return mScheduledGameId;
+    }
+    return -1;
+}
+
+const GameMode *MyTcpServer::scheduledMode(const QString &nickname) const
+{
+    QMutexLocker locker(&mutex);
+    return mScheduledGameId != -1 && mScheduledPlayers.contains(nickname) ? mScheduledMode : nullptr;
+}
+
+bool MyTcpServer::isClientConnected(QObject *client) const
+{
+    if (QTcpSocket *socket = qobject_cast<QTcpSocket*>(client)) {
+        return socket->state() == QAbstractSocket::ConnectedState && socket->isValid();
+    }
+    if (QWebSocket *webSocket = qobject_cast<QWebSocket*>(client)) {
+        return webSocket->state() == QAbstractSocket::ConnectedState && webSocket->isValid();
+    }
+    if (NetConnection *connection = qobject_cast<NetConnection*>(client)) {
+        return connection->isOpen();
+    }
+    return false;
+}
+
+bool MyTcpServer::writeToClient(QObject *client, const QByteArray &message, bool flush)
+{
+    if (message.isEmpty()) {
+        return true;
+    }
+    Tracer::Span span("write", "io");
+    capture.record(client, TrafficCapture::Outbound, message);
+    if (QTcpSocket *socket = qobject_cast<QTcpSocket*>(client)) {
+        if (socket->state() != QAbstractSocket::ConnectedState) {
+            return false;
+        }
+        bool ok = socket->write(message) != -1;
+        if (flush) {
+            socket->flush();
+        }
+        return ok;
+    }
+    if (QWebSocket *webSocket = qobject_cast<QWebSocket*>(client)) {
+        if (webSocket->state() != QAbstractSocket::ConnectedState) {
+            return false;
+        }
+        // Один ответ - один кадр; разделитель "\r\n" потоку TCP нужен, кадрам WebSocket - нет
+        QByteArray frame = message.endsWith("\r\n") ? message.left(message.size() - 2) : message;
+        if (mBinaryClients.contains(client)) {
+            return webSocket->sendBinaryMessage(frame) == frame.size();
+        }
+        return webSocket->sendTextMessage(QString::fromUtf8(frame)) >= 0;
+    }
+    if (NetConnection *connection = qobject_cast<NetConnection*>(client)) {
+        return connection->write(message); // Отправляется сразу, flush не нужен
+    }
+    return false;
 }
 
 MyTcpServer::~MyTcpServer()
 {
     mTcpServer->close();
+    mWebSocketServer->close();
 }
 
 void MyTcpServer::slotNewConnection()
@@ -34,12 +582,48 @@ void MyTcpServer::slotNewConnection()
             return;
         }
 
-        connect(clientSocket, &QTcpSocket::readyRead, this, &MyTcpServer::slotServerRead);
-        connect(clientSocket, &QTcpSocket::disconnected, this, &MyTcpServer::slotClientDisconnected);
+        watchClient(clientSocket);
         qDebug() << "New client connected from" << clientSocket->peerAddress().toString();
     }
 }
 
+void MyTcpServer::slotNetConnection(NetConnection *connection)
+{
+    if (getPlayerCount() >= 2) {
+        connection->write(createJsonResponse("error", "error", "Server is full"));
+        connection->close();
+        connection->deleteLater();
+        return;
+    }
+    connect(connection, &NetConnection::disconnected, this, &MyTcpServer::slotClientDisconnected);
+}
+
+void MyTcpServer::watchClient(QTcpSocket *clientSocket)
+{
+    ++mQtSockets;
+    connect(clientSocket, &QTcpSocket::readyRead, this, &MyTcpServer::slotServerRead);
+    connect(clientSocket, &QTcpSocket::disconnected, this, &MyTcpServer::slotClientDisconnected);
+}
+
+void MyTcpServer::slotNewWebSocketConnection()
+{
+    QWebSocket *webSocket = mWebSocketServer->nextPendingConnection();
+    if (webSocket) {
+        if (getPlayerCount() >= 2) {
+            writeToClient(webSocket, createJsonResponse("error", "error", "Server is full"));
+            webSocket->close();
+            webSocket->deleteLater();
+            return;
+        }
+
+        connect(webSocket, &QWebSocket::textMessageReceived, this, &MyTcpServer::slotWebSocketTextMessage);
+        connect(webSocket, &QWebSocket::binaryMessageReceived, this, &MyTcpServer::slotWebSocketBinaryMessage);
+        connect(webSocket, &QWebSocket::disconnected, this, &MyTcpServer::slotClientDisconnected);
+        ++mWebSockets;
+        qDebug() << "New WebSocket client connected from" << webSocket->peerAddress().toString();
+    }
+}
+
 void MyTcpServer::slotServerRead()
 {
     QTcpSocket *clientSocket = qobject_cast<QTcpSocket*>(sender());
@@ -47,244 +631,592 @@ void MyTcpServer::slotServerRead()
         qDebug() << "Invalid client socket in slotServerRead";
         return;
     }
+    if (mHandoffPaused) {
+        return; // Запрос остаётся в буфере сокета и уйдёт новому процессу
+    }
+    readClient(clientSocket);
+}
 
-    QByteArray requestData = clientSocket->readAll();
-    QString request = QString::fromUtf8(requestData).trimmed();
+void MyTcpServer::readClient(QTcpSocket *clientSocket)
+{
+    // Решение о трассировке принимается один раз на запрос; сопрограммы переносят его дальше
+    Tracer::Scope trace(Tracer::sampleRequest());
+    RequestArena::Scope arena; // Кадры сопрограмм запроса
+    QByteArray requestData;
+    {
+        Tracer::Span span("read", "io");
+        requestData = clientSocket->readAll();
+    }
+    QByteArray response = dispatchRequest(clientSocket, requestData);
+    if (response.isEmpty()) {
+        return;
+    }
 
-    qDebug() << "Received raw request:" << requestData.toHex();
-    qDebug() << "Received input (parsed):" << request;
-    QByteArray response;
+    if (clientSocket->state() == QAbstractSocket::ConnectedState) {
+        Tracer::Span span("write", "io");
+        qDebug() << "Sending response to" << getNicknameBySocket(clientSocket) << ". Response:" << response;
+        capture.record(clientSocket, TrafficCapture::Outbound, response);
+        clientSocket->write(response);
+        clientSocket->flush();
+    } else {
+        qDebug() << "Cannot send response to" << getNicknameBySocket(clientSocket) << ", socket state:" << clientSocket->state();
+    }
+}
+
+void MyTcpServer::readNetRequest(NetConnection *connection, const QByteArray &requestData)
+{
+    // Как readClient, но запрос уже выделен транспортом из потока байт
+    Tracer::Scope trace(Tracer::sampleRequest());
+    RequestArena::Scope arena;
+    QByteArray response = dispatchRequest(connection, requestData);
+    if (!response.isEmpty()) {
+        qDebug() << "Sending response to" << getNicknameBySocket(connection) << ". Response:" << response;
+        writeToClient(connection, response);
+    }
+}
+
+void MyTcpServer::slotWebSocketTextMessage(const QString &message)
+{
+    QWebSocket *webSocket = qobject_cast<QWebSocket*>(sender());
+    if (!webSocket) {
+        qDebug() << "Invalid client socket in slotWebSocketTextMessage";
+        return;
+    }
+    if (mHandoffPaused) {
+        writeToClient(webSocket, createJsonResponse("error", "restarting", "Server is restarting"));
+        return;
+    }
+    Tracer::Scope trace(Tracer::sampleRequest());
+    RequestArena::Scope arena;
+    QByteArray response = dispatchRequest(webSocket, message.toUtf8());
+    writeToClient(webSocket, response);
+}
+
+void MyTcpServer::slotWebSocketBinaryMessage(const QByteArray &message)
+{
+    QWebSocket *webSocket = qobject_cast<QWebSocket*>(sender());
+    if (!webSocket) {
+        qDebug() << "Invalid client socket in slotWebSocketBinaryMessage";
+        return;
+    }
+    if (mHandoffPaused) {
+        writeToClient(webSocket, createJsonResponse("error", "restarting", "Server is restarting"));
+        return;
+    }
+    mBinaryClients.insert(webSocket); // Отвечаем клиенту тем же типом кадров
+    Tracer::Scope trace(Tracer::sampleRequest());
+    RequestArena::Scope arena;
+    QByteArray response = dispatchRequest(webSocket, message);
+    writeToClient(webSocket, response);
+}
+
+QByteArray MyTcpServer::dispatchRequest(QObject *client, const QByteArray &requestData)
+{
+    AllocStats::Scope allocScope(AllocStats::Other, true); // Уточняется после декодирования
+
+    // Поля известной схемы читаются прямо из буфера сканером - без построения JSON
+    ScannedRequest request;
+    Tracer::StageSpan stage("scan");
+    bool decoded = scanRequest(requestData, request);
+    request.fastPath = decoded;
+
+    // Корзина - по типу, найденному сканером; запрос, который сканер не принял, - класс Other.
+    // Отклонённый запрос не декодируется и не записывается: поток мусора не стоит ни одного разбора QJsonDocument
+    static const QByteArray throttledResponse = createJsonResponse("error", "rate_limited", "Too many requests");
+    stage.next("rate_limit");
+    switch (rateLimiter.check(client, decoded ? RateLimiter::classify(request.type) : RateLimiter::Other)) {
+    case RateLimiter::Banned:
+        return QByteArray();
+    case RateLimiter::Throttled:
+        return throttledResponse;
+    default:
+        break;
+    }
+
+    stage.next("capture");
+    capture.record(client, TrafficCapture::Inbound, requestData, decoded ? &request : nullptr);
+    if (!decoded) {
+        // Нестандартный запрос (экранирование, лишние поля и т.п.) - QJsonDocument с прежними правилами
+        stage.next("decode");
+        decoded = decodeRequestJson(requestData, request);
+    }
 
-    QJsonDocument doc = QJsonDocument::fromJson(request.toUtf8());
-    if (doc.isObject()) {
-        QJsonObject jsonObj = doc.object();
-        QString type = jsonObj["type"].toString();
-        QString nickname = jsonObj["nickname"].toString();
+    QByteArray response;
+    stage.next("dispatch"); // До первого запроса к БД; остаток обработчика - интервал "respond"
+    if (decoded) {
+        StallDetector::HandlerScope stallScope(request.type, request.gameId);
+        QByteArrayView type = request.type;
+        allocScope.setMessage(AllocStats::messageType(type));
+        QString nickname = sessionNickname(client, request.nickname);
 
         if (type == "register" || type == "login") {
-            if (!nickname.isEmpty()) {
-                registerClient(nickname, clientSocket);
-                response = parse(request, this);
-                qDebug() << "Clients registered:" << mClients.keys();
+            if (isBot(nickname)) {
+                response = createJsonResponse(QString::fromUtf8(type), "error", "Nickname is reserved");
+            } else if (!nickname.isEmpty()) {
+                respond(client, processAuth(client, nickname, QString::fromUtf8(requestData).trimmed()));
             } else {
                 response = createJsonResponse("error", "error", "Nickname is empty");
             }
         } else if (type == "ready_to_battle") {
             if (!nickname.isEmpty() && players.contains(nickname)) {
-                QMutexLocker locker(&mutex);
-                qDebug() << "Processing ready_to_battle for" << nickname << "- currentGameId:" << currentGameId << "- Socket state:" << clientSocket->state();
-                readyPlayers.insert(nickname);
-                qDebug() << "Player" << nickname << "is ready. Ready players:" << readyPlayers;
-                response = createJsonResponse("ready_to_battle", "success", "Ready status received");
-                if (readyPlayers.size() == 2 && currentGameId != -1) {
-                    qDebug() << "Both players ready, starting game with gameId:" << currentGameId;
-                    DatabaseManager *db = DatabaseManager::getInstance();
-                    QString player1 = players[0];
-                    db->updateTurn(currentGameId, player1);
-                    QJsonObject startMsg;
-                    startMsg["type"] = "game_start";
-                    startMsg["status"] = "success";
-                    startMsg["message"] = "Game started";
-                    startMsg["current_turn"] = player1;
-                    QByteArray startResponse = QJsonDocument(startMsg).toJson(QJsonDocument::Compact) + "\r\n";
-                    qDebug() << "Prepared game_start message:" << startResponse;
-                    for (const QString &player : mClients.keys()) {
-                        QTcpSocket *targetSocket = mClients[player];
-                        qDebug() << "Attempting to send to" << player << "- Socket state:" << targetSocket->state();
-                        if (targetSocket->state() == QAbstractSocket::ConnectedState) {
-                            bool success = targetSocket->write(startResponse);
-                            targetSocket->flush();
-                            if (success) {
-                                qDebug() << "Successfully sent game_start to" << player;
-                            } else {
-                                qDebug() << "Failed to send game_start to" << player << "- Error:" << targetSocket->errorString();
-                            }
-                        } else {
-                            qDebug() << "Cannot send to" << player << "- Socket not connected, state:" << targetSocket->state();
-                        }
-                    }
-                }
+                respond(client, processReady(nickname));
             } else {
                 response = createJsonResponse("error", "error", "Player not registered");
             }
         } else if (type == "make_move") {
-            int gameId = jsonObj["game_id"].toInt();
-            int x = jsonObj["x"].toInt();
-            int y = jsonObj["y"].toInt();
-            qDebug() << "Processing make_move for" << nickname << "in game" << gameId << "at (" << x << "," << y << ")";
-
-            DatabaseManager *db = DatabaseManager::getInstance();
-            QString currentTurn = db->getCurrentTurn(gameId);
-            qDebug() << "Current turn for game" << gameId << "is" << currentTurn;
-            if (currentTurn != nickname) {
-                response = createJsonResponse("error", "error", "Not your turn");
-                qDebug() << "Move rejected: not" << nickname << "'s turn, current turn is" << currentTurn;
-            } else {
-                QString result = db->checkMove(gameId, nickname, x, y);
-                qDebug() << "Move result for" << nickname << ":" << result;
-
-                if (result == "error") {
-                    response = createJsonResponse("error", "error", "Failed to process move");
-                    qDebug() << "Move processing failed for" << nickname;
-                } else if (result == "already_shot") {
-                    response = createJsonResponse("error", "error", "Cell already shot");
-                    qDebug() << "Move rejected: cell (" << x << "," << y << ") already shot by" << nickname;
+            respond(client, processMove(nickname, request.gameId, request.x, request.y));
+        } else {
+            qDebug() << "Processing other request type:" << type;
+            respond(client, parse(QString::fromUtf8(requestData).trimmed(), this));
+        }
+    } else {
+        qDebug() << "Failed to parse JSON for request:" << requestData;
+        response = createJsonResponse("error", "error", "Invalid JSON format");
+    }
+    return response;
+}
+
+AsyncTask MyTcpServer::respond(QPointer<QObject> client, Task<QByteArray> handler)
+{
+    // Обработчик выполняется до первого запроса к БД прямо здесь, остаток - после ответа DbWorker
+    InFlight inFlight(mInFlight);
+    Tracer::Span span("respond");
+    QByteArray response = co_await handler;
+    if (response.isEmpty()) {
+        co_return;
+    }
+    if (!client) {
+        qDebug() << "Client disconnected before the response was ready:" << response;
+        co_return;
+    }
+    qDebug() << "Sending response to" << getNicknameBySocket(client) << ". Response:" << response;
+    if (!writeToClient(client, response)) {
+        qDebug() << "Cannot send response to" << getNicknameBySocket(client) << "- socket not connected";
+    }
+}
+
+// Строка JSON в кавычках - так же, как её экранирует QJsonDocument, но сразу в буфер ответа
+static void appendJsonString(QByteArray &json, QStringView text)
+{
+    static const char hex[] = "0123456789abcdef";
+    json += '"';
+    for (qsizetype i = 0; i < text.size(); ++i) {
+        char32_t code = text[i].unicode();
+        if (code < 0x80) {
+            switch (code) {
+            case '"': json += "\\\""; break;
+            case '\\': json += "\\\\"; break;
+            case '\b': json += "\\b"; break;
+            case '\f': json += "\\f"; break;
+            case '\n': json += "\\n"; break;
+            case '\r': json += "\\r"; break;
+            case '\t': json += "\\t"; break;
+            default:
+                if (code < 0x20) {
+                    json += "\\u00";
+                    json += hex[code >> 4];
+                    json += hex[code & 0xf];
                 } else {
-                    QJsonObject moveResponse;
-                    moveResponse["type"] = "make_move";
-                    moveResponse["status"] = result;
-                    moveResponse["message"] = "Move processed";
-                    moveResponse["x"] = x;
-                    moveResponse["y"] = y;
-
-                    QJsonObject opponentResponse;
-                    opponentResponse["type"] = "move_result";
-                    opponentResponse["status"] = result;
-                    opponentResponse["x"] = x;
-                    opponentResponse["y"] = y;
-                    opponentResponse["message"] = "Opponent made a move";
-
-                    // Обновляем счётчик потопленных кораблей
-                    //QMutexLocker locker(&mutex);
-                    if (result == "sunk") {
-                        sunkShips[nickname] = sunkShips.value(nickname, 0) + 1;
-                        qDebug() << nickname << "has sunk" << sunkShips[nickname] << "ships";
-                    }
-                    if (sunkShips[nickname] >= 10) {
-                        QJsonObject gameOverMsg;
-                        gameOverMsg["type"] = "game_over";
-                        gameOverMsg["status"] = "success";
-                        gameOverMsg["message"] = QString("%1 победил! Игра окончена.").arg(nickname);
-                        gameOverMsg["winner"] = nickname;
-                        QByteArray gameOverResponse = QJsonDocument(gameOverMsg).toJson(QJsonDocument::Compact) + "\r\n";
-
-                        // Отправляем сообщение game_over обоим игрокам
-                        QString opponent = getOpponent(nickname);
-                        if (!opponent.isEmpty()) {
-                            sendMessageToUser(nickname, gameOverResponse);
-                            sendMessageToUser(opponent, gameOverResponse);
-                            qDebug() << "Game over: " << nickname << " has sunk 10 ships. Sent game_over to both players.";
-                        } else {
-                            qDebug() << "Opponent not found for " << nickname << ", sending game_over only to " << nickname;
-                            sendMessageToUser(nickname, gameOverResponse);
-                        }
-
-                        // Сбрасываем игру
-                        resetGame();
-                        response = gameOverResponse;
-                    }
-
-                    // Обновляем current_turn только один раз
-                    QString opponent = getOpponent(nickname);
-                    if (!opponent.isEmpty()) {
-                        if (result != "hit" && result != "sunk") {
-                            db->updateTurn(gameId, opponent);
-                            qDebug() << "Turn updated to" << opponent << "for game" << gameId;
-                        }
-                        moveResponse["current_turn"] = (result != "hit" && result != "sunk") ? opponent : currentTurn;
-                        opponentResponse["current_turn"] = (result != "hit" && result != "sunk") ? opponent : currentTurn;
-                    } else {
-                        qDebug() << "Opponent not found for" << nickname;
-                        moveResponse["current_turn"] = currentTurn;
-                        opponentResponse["current_turn"] = currentTurn;
-                    }
-
-                    // Отправляем ответы
-                    response = QJsonDocument(moveResponse).toJson(QJsonDocument::Compact) + "\r\n";
-                    qDebug() << "Prepared response for" << nickname << ":" << response;
-
-                    if (!opponent.isEmpty()) {
-                        QByteArray opponentMessage = QJsonDocument(opponentResponse).toJson(QJsonDocument::Compact) + "\r\n";
-                        qDebug() << "Sending move_result to" << opponent << ":" << opponentMessage;
-                        sendMessageToUser(opponent, opponentMessage);
-                    } else {
-                        qDebug() << "Opponent not found for" << nickname << "in game" << gameId;
-                    }
+                    json += char(code);
                 }
             }
+            continue;
+        }
+        if (QChar::isHighSurrogate(code) && i + 1 < text.size() && text[i + 1].isLowSurrogate()) {
+            code = QChar::surrogateToUcs4(char16_t(code), text[++i].unicode());
+        }
+        if (code < 0x800) {
+            json += char(0xc0 | (code >> 6));
+        } else if (code < 0x10000) {
+            json += char(0xe0 | (code >> 12));
+            json += char(0x80 | ((code >> 6) & 0x3f));
         } else {
-            response = parse(request, this);
-            qDebug() << "Processed other request type:" << type << ", response:" << response;
+            json += char(0xf0 | (code >> 18));
+            json += char(0x80 | ((code >> 12) & 0x3f));
+            json += char(0x80 | ((code >> 6) & 0x3f));
         }
+        json += char(0x80 | (code & 0x3f));
+    }
+    json += '"';
+}
+
+static void appendJsonInt(QByteArray &json, int value)
+{
+    char digits[12];
+    int length = 0;
+    unsigned magnitude = value < 0 ? 0u - unsigned(value) : unsigned(value);
+    do {
+        digits[length++] = char('0' + magnitude % 10);
+        magnitude /= 10;
+    } while (magnitude);
+    if (value < 0) {
+        json += '-';
+    }
+    while (length) {
+        json += digits[--length];
+    }
+}
+
+// make_move и move_result собираются без QJsonObject: одно выделение на сообщение.
+// Ключи - по алфавиту, как у QJsonDocument, так что клиенты видят те же байты
+static QByteArray moveJson(const char *type, const QString &status, const char *message, int x, int y, const QString &currentTurn)
+{
+    QByteArray json;
+    json.reserve(96 + 6 * (status.size() + currentTurn.size()));
+    json += "{\"current_turn\":";
+    appendJsonString(json, currentTurn);
+    json += ",\"message\":\"";
+    json += message;
+    json += "\",\"status\":";
+    appendJsonString(json, status);
+    json += ",\"type\":\"";
+    json += type;
+    json += "\",\"x\":";
+    appendJsonInt(json, x);
+    json += ",\"y\":";
+    appendJsonInt(json, y);
+    json += "}\r\n";
+    return json;
+}
+
+Task<QByteArray> MyTcpServer::processMove(QString nickname, int gameId, int x, int y, QString *moveResult)
+{
+    QByteArray response;
+    if (!gameMode->contains(x, y)) {
+        qDebug() << "Move rejected: (" << x << "," << y << ") is outside the board of mode" << gameMode->name;
+        co_return createJsonResponse("error", "error", "Invalid move coordinates");
+    }
+    if (gameMode->salvo) {
+        co_return createJsonResponse("error", "error", "Use make_salvo in salvo mode");
+    }
+
+    // Проверка хода, выстрел, запись и передача хода - одна транзакция (в потоке БД, кроме режима журнала:
+    // журнал ходов пишется только из основного потока)
+    DatabaseManager *db = DatabaseManager::getInstance();
+    auto applyMove = onDatabase(this, [db, gameId, nickname, x, y]() { return db->applyMove(gameId, nickname, x, y); },
+                                !db->isJournaled());
+    MoveResult move = co_await applyMove;
+    // Пока выстрел был в потоке БД, партию могли закончить или сбросить (уход игрока) -
+    // результат к ней уже не относится и не применяется
+    if (move.status != MoveResult::Error && !isGameCurrent(gameId, nickname, move.opponent)) {
+        qDebug() << "Move of" << nickname << "in game" << gameId << "dropped: the game ended while it was being applied";
+        co_return createJsonResponse("error", "error", "Game is over");
+    }
+    QString result = move.resultString();
+    if (moveResult) {
+        *moveResult = result;
+    }
+
+    if (move.status == MoveResult::NotYourTurn) {
+        response = createJsonResponse("error", "error", "Not your turn");
+        qDebug() << "Move rejected: not" << nickname << "'s turn, current turn is" << move.nextTurn;
     } else {
-        qDebug() << "Failed to parse JSON for request:" << request;
-        response = createJsonResponse("error", "error", "Invalid JSON format");
+        if (move.status == MoveResult::Error) {
+            response = createJsonResponse("error", "error", "Failed to process move");
+            qDebug() << "Move processing failed for" << nickname;
+        } else if (move.status == MoveResult::AlreadyShot) {
+            response = createJsonResponse("error", "error", "Cell already shot");
+            qDebug() << "Move rejected: cell (" << x << "," << y << ") already shot by" << nickname;
+        } else {
+            // Обновляем счётчик потопленных кораблей
+            //QMutexLocker locker(&mutex);
+            recordShot(nickname, result);
+            if (result == "sunk") {
+                sunkShips[nickname] = sunkShips.value(nickname, 0) + 1;
+                qDebug() << nickname << "has sunk" << sunkShips[nickname] << "ships";
+            }
+            if (sunkShips[nickname] >= gameMode->shipCount()) {
+                response = finishWonGame(nickname, gameId);
+            }
+
+            // Ход уже передан в applyMove
+            QString opponent = getOpponent(nickname);
+            if (opponent.isEmpty()) {
+                qDebug() << "Opponent not found for" << nickname;
+            }
+
+            // Отправляем ответы
+            response = moveJson("make_move", result, "Move processed", x, y, move.nextTurn);
+
+            if (!opponent.isEmpty()) {
+                QByteArray opponentMessage = moveJson("move_result", result, "Opponent made a move", x, y, move.nextTurn);
+                sendMessageToUser(opponent, opponentMessage);
+            } else {
+                qDebug() << "Opponent not found for" << nickname << "in game" << gameId;
+            }
+
+            // Если ход перешёл к боту (или бот продолжает после попадания) - он сходит в следующей итерации цикла событий
+            if (!opponent.isEmpty() && isBot(move.nextTurn)) {
+                scheduleBotTurn();
+            }
+        }
     }
+    co_return response;
+}
 
-    if (clientSocket->state() == QAbstractSocket::ConnectedState) {
-        qDebug() << "Sending response to" << getNicknameBySocket(clientSocket) << ". Response:" << response;
-        clientSocket->write(response);
-        clientSocket->flush();
+Task<QByteArray> MyTcpServer::processSalvo(QString nickname, int gameId, QVector<QPoint> cells)
+{
+    if (!gameMode->salvo) {
+        co_return createJsonResponse("error", "error", "Salvo is only allowed in salvo mode");
+    }
+
+    // Один залп - одна проверка хода, одна транзакция и одно сообщение сопернику
+    DatabaseManager *db = DatabaseManager::getInstance();
+    auto applySalvo = onDatabase(this, [db, gameId, nickname, cells]() { return db->applySalvo(gameId, nickname, cells); },
+                                 !db->isJournaled());
+    SalvoResult salvo = co_await applySalvo;
+    if (salvo.status != SalvoResult::Error && !isGameCurrent(gameId, nickname, salvo.opponent)) {
+        qDebug() << "Salvo of" << nickname << "in game" << gameId << "dropped: the game ended while it was being applied";
+        co_return createJsonResponse("error", "error", "Game is over");
+    }
+    switch (salvo.status) {
+    case SalvoResult::Accepted:
+        break;
+    case SalvoResult::NotYourTurn:
+        co_return createJsonResponse("error", "error", "Not your turn");
+    case SalvoResult::TooManyShots:
+        co_return createJsonResponse("error", "error", QString("Too many shots: %1 ships afloat").arg(salvo.allowedShots));
+    case SalvoResult::InvalidShot:
+        co_return createJsonResponse("error", "error", "Salvo has an invalid, repeated or already shot cell");
+    default:
+        co_return createJsonResponse("error", "error", "Failed to process salvo");
+    }
+
+    QJsonArray shots;
+    for (const GameMove &shot : salvo.shots) {
+        QString result = MoveResult::statusString(MoveResult::Status(shot.status));
+        recordShot(nickname, result);
+        shots.append(QJsonObject{{"x", shot.x}, {"y", shot.y}, {"status", result}});
+    }
+    sunkShips[nickname] = sunkShips.value(nickname, 0) + salvo.sunk;
+
+    QJsonObject salvoResponse;
+    salvoResponse["type"] = "make_salvo";
+    salvoResponse["status"] = "success";
+    salvoResponse["message"] = "Salvo processed";
+    salvoResponse["shots"] = shots;
+    salvoResponse["sunk"] = salvo.sunk;
+    salvoResponse["current_turn"] = salvo.nextTurn;
+
+    QJsonObject opponentResponse = salvoResponse;
+    opponentResponse["type"] = "move_result";
+    opponentResponse["message"] = "Opponent fired a salvo";
+    sendMessageToUser(salvo.opponent, QJsonDocument(opponentResponse).toJson(QJsonDocument::Compact) + "\r\n");
+
+    if (sunkShips[nickname] >= gameMode->shipCount()) {
+        finishWonGame(nickname, gameId);
+    }
+    co_return QJsonDocument(salvoResponse).toJson(QJsonDocument::Compact) + "\r\n";
+}
+
+Task<QByteArray> MyTcpServer::processAuth(QPointer<QObject> client, QString nickname, QString request)
+{
+    QByteArray response = co_await parse(request, this);
+    // Сессия (и объявление игрока маршрутизатору) - только после проверки пароля или создания учётной записи,
+    // иначе любой клиент мог бы занять чужой ник
+    if (client && isClientConnected(client) && QJsonDocument::fromJson(response).object()["status"].toString() == "success") {
+        registerClient(nickname, client);
+    }
+    co_return response;
+}
+
+Task<QByteArray> MyTcpServer::processReady(QString nickname)
+{
+    int gameId;
+    QString player1;
+    QString player2;
+    {
+        QMutexLocker locker(&mutex);
+        qDebug() << "Processing ready_to_battle for" << nickname << "- currentGameId:" << currentGameId;
+        readyPlayers.insert(nickname);
+        qDebug() << "Player" << nickname << "is ready. Ready players:" << readyPlayers;
+        if (readyPlayers.size() != 2 || currentGameId == -1) {
+            co_return createJsonResponse("ready_to_battle", "success", "Ready status received");
+        }
+        gameId = currentGameId;
+        player1 = players[0];
+        player2 = players[1];
+    }
+
+    // Первый ход - в потоке БД, как и выстрелы (в режиме журнала - сразу)
+    qDebug() << "Both players ready, starting game with gameId:" << gameId;
+    DatabaseManager *db = DatabaseManager::getInstance();
+    auto updateTurn = onDatabase(this, [db, gameId, player1]() { return db->updateTurn(gameId, player1); }, !db->isJournaled());
+    co_await updateTurn;
+    if (!isGameCurrent(gameId, player1, player2)) {
+        qDebug() << "Game" << gameId << "ended before it started, game_start is not sent";
+        co_return createJsonResponse("ready_to_battle", "error", "Game is over");
+    }
+
+    QJsonObject startMsg;
+    startMsg["type"] = "game_start";
+    startMsg["status"] = "success";
+    startMsg["message"] = "Game started";
+    startMsg["current_turn"] = player1;
+    QByteArray startResponse = QJsonDocument(startMsg).toJson(QJsonDocument::Compact) + "\r\n";
+    qDebug() << "Prepared game_start message:" << startResponse;
+    QMutexLocker locker(&mutex);
+    for (auto it = mClients.constBegin(); it != mClients.constEnd(); ++it) {
+        QObject *target = it.value();
+        if (isClientConnected(target)) {
+            if (writeToClient(target, startResponse)) {
+                qDebug() << "Successfully sent game_start to" << it.key();
+            } else {
+                qDebug() << "Failed to send game_start to" << it.key();
+            }
+        } else {
+            qDebug() << "Cannot send to" << it.key() << "- Socket not connected";
+        }
+    }
+    co_return createJsonResponse("ready_to_battle", "success", "Ready status received");
+}
+
+QByteArray MyTcpServer::finishWonGame(const QString &winner, int gameId)
+{
+    QJsonObject gameOverMsg;
+    gameOverMsg["type"] = "game_over";
+    gameOverMsg["status"] = "success";
+    gameOverMsg["message"] = QString("%1 победил! Игра окончена.").arg(winner);
+    gameOverMsg["winner"] = winner;
+    QByteArray gameOverResponse = QJsonDocument(gameOverMsg).toJson(QJsonDocument::Compact) + "\r\n";
+
+    // Отправляем сообщение game_over обоим игрокам; итоги в Stats - только у партий между людьми
+    QString opponent = getOpponent(winner);
+    recordGameOver(gameId, winner, !opponent.isEmpty() && !isBot(winner) && !isBot(opponent) ? opponent : QString());
+    if (!opponent.isEmpty()) {
+        sendMessageToUser(winner, gameOverResponse);
+        sendMessageToUser(opponent, gameOverResponse);
+        qDebug() << "Game over: " << winner << " has sunk" << sunkShips[winner] << "ships. Sent game_over to both players.";
     } else {
-        qDebug() << "Cannot send response to" << getNicknameBySocket(clientSocket) << ", socket state:" << clientSocket->state();
+        qDebug() << "Opponent not found for " << winner << ", sending game_over only to " << winner;
+        sendMessageToUser(winner, gameOverResponse);
     }
+
+    // Итог партии турнира - планировщику на маршрутизаторе, он сам решит, когда начинать следующий тур
+    if (mShardLink && gameId == mScheduledGameId) {
+        mShardLink->reportResult(gameId, winner);
+        QMutexLocker locker(&mutex);
+        mScheduledGameId = -1;
+        mScheduledPlayers.clear();
+        mScheduledMode = nullptr;
+    }
+
+    // Сбрасываем игру
+    resetGame();
+    return gameOverResponse;
 }
 
 void MyTcpServer::slotClientDisconnected()
 {
-    QTcpSocket *clientSocket = qobject_cast<QTcpSocket*>(sender());
-    if (clientSocket) {
-        QString nickname = getNicknameBySocket(clientSocket);
+    QObject *client = sender();
+    if (client) {
+        QString nickname = getNicknameBySocket(client);
         if (!nickname.isEmpty()) {
-            QMutexLocker locker(&mutex);
-            readyPlayers.remove(nickname);
-            sunkShips.remove(nickname); // Удаляем счётчик при отключении
-            unregisterClient(clientSocket);
-            qDebug() << "Client" << nickname << "disconnected! Socket state:" << clientSocket->state();
+            unregisterClient(client); // Сам снимает готовность и счётчик игрока
+            qDebug() << "Client" << nickname << "disconnected!";
         }
-        clientSocket->deleteLater();
+        if (qobject_cast<QTcpSocket*>(client)) {
+            --mQtSockets;
+        } else if (qobject_cast<QWebSocket*>(client)) {
+            --mWebSockets;
+        }
+        mBinaryClients.remove(client);
+        rateLimiter.forget(client);
+        capture.record(client, TrafficCapture::Close);
+        client->deleteLater();
     }
 }
 
 void MyTcpServer::sendMessageToUser(const QString &nickname, const QByteArray &message)
 {
+    if (isBot(nickname)) {
+        return; // Бот узнаёт результаты напрямую из processMove
+    }
     QMutexLocker locker(&mutex);
     if (mClients.contains(nickname)) {
-        QTcpSocket *socket = mClients[nickname];
-        if (socket && socket->state() == QAbstractSocket::ConnectedState && socket->isValid()) {
-            qint64 bytesWritten = socket->write(message);
-            if (bytesWritten == -1) {
-                qDebug() << "Failed to write to socket for" << nickname << "- Error:" << socket->errorString();
-            } else {
-                // Не используем flush, чтобы избежать блокировки
-                qDebug() << "Message queued for" << nickname << ":" << message;
+        QObject *client = mClients[nickname];
+        if (isClientConnected(client)) {
+            // Не используем flush, чтобы избежать блокировки
+            if (!writeToClient(client, message, false)) {
+                qDebug() << "Failed to write to socket for" << nickname;
             }
         } else {
-            qDebug() << "Socket for" << nickname << "is invalid or not connected. State:" << (socket ? socket->state() : -1);
+            qDebug() << "Socket for" << nickname << "is invalid or not connected.";
         }
+    } else if (mShardLink) {
+        // Игрок на другом шарде - пересылаем через маршрутизатор
+        mShardLink->forward(nickname, message);
     } else {
         qDebug() << "User" << nickname << "not found or not connected. Current clients:" << mClients.keys();
     }
 }
 
-void MyTcpServer::registerClient(const QString &nickname, QTcpSocket *socket)
+void MyTcpServer::registerClient(const QString &nickname, QObject *socket)
 {
     QMutexLocker locker(&mutex);
+    if (!mClients.contains(nickname)) {
+        mSessionNicknameBytes += nicknameBytes(nickname);
+    }
     mClients.insert(nickname, socket);
     mSocketToNickname.insert(socket, nickname);
-    sunkShips.insert(nickname, 0); // Инициализируем счётчик потопленных кораблей
-    qDebug() << "Registered client:" << nickname << "Socket state:" << socket->state();
+    if (mShardLink) {
+        mShardLink->announceUser(nickname);
+    }
 }
 
-void MyTcpServer::unregisterClient(QTcpSocket *socket)
+void MyTcpServer::unregisterClient(QObject *socket)
 {
-    QMutexLocker locker(&mutex);
-    QString nickname = mSocketToNickname.value(socket, "");
-    if (!nickname.isEmpty()) {
-        mClients.remove(nickname);
+    // Мьютекс не рекурсивный: сообщение сопернику и сброс игры - после снятия блокировки
+    QString opponent;
+    int gameId;
+    bool scheduled;
+    {
+        QMutexLocker locker(&mutex);
+        QString nickname = mSocketToNickname.value(socket, "");
+        if (nickname.isEmpty()) {
+            return;
+        }
+        auto session = mClients.find(nickname);
+        if (session != mClients.end()) {
+            mSessionNicknameBytes -= nicknameBytes(session.key());
+            mClients.erase(session);
+        }
         mSocketToNickname.remove(socket);
+        if (mShardLink) {
+            mShardLink->userGone(nickname);
+        }
         players.removeAll(nickname);
         readyPlayers.remove(nickname);
         sunkShips.remove(nickname); // Удаляем счётчик при отключении
-        QString opponent = getOpponentInternal(nickname);
-        if (!opponent.isEmpty()) {
-            sendMessageToUser(opponent, createJsonResponse("gameover", "opponent_disconnected", "Opponent disconnected"));
+        if (!players.isEmpty()) {
+            opponent = players.first();
+        }
+        gameId = currentGameId;
+        scheduled = mShardLink && gameId != -1 && gameId == mScheduledGameId;
+    }
+    if (!opponent.isEmpty()) {
+        sendMessageToUser(opponent, createJsonResponse("gameover", "opponent_disconnected", "Opponent disconnected"));
+        if (scheduled) {
+            // Партия турнира: ушедший проигрывает, итог уходит маршрутизатору, иначе тур не закончится
+            finishWonGame(opponent, gameId);
+        } else {
             resetGame();
         }
     }
 }
 
-QString MyTcpServer::getNicknameBySocket(QTcpSocket *socket)
+QString MyTcpServer::sessionNickname(QObject *client, QByteArrayView nickname)
+{
+    // Обычно клиент присылает никнейм своей сессии: строка сессии разделяется без декодирования UTF-8
+    QMutexLocker locker(&mutex);
+    QString session = mSocketToNickname.value(client);
+    if (!session.isEmpty() && QAnyStringView::equal(session, QUtf8StringView(nickname))) {
+        return session;
+    }
+    return QString::fromUtf8(nickname);
+}
+
+QString MyTcpServer::getNicknameBySocket(QObject *socket)
 {
     QMutexLocker locker(&mutex);
     return mSocketToNickname.value(socket, "");
@@ -333,7 +1265,14 @@ void MyTcpServer::resetGame()
     players.clear();
     readyPlayers.clear();
     sunkShips.clear(); // Очищаем счётчики потопленных кораблей
+    shotsFired.clear();
+    shotsHit.clear();
+    bot.reset();
+    if (mShardLink) {
+        mShardLink->setBotGame(false);
+    }
     currentGameId = -1;
+    gameMode = &GameMode::classic();
     qDebug() << "Game reset.";
 }
 
@@ -342,8 +1281,240 @@ int MyTcpServer::getGameId() const
     return currentGameId;
 }
 
+bool MyTcpServer::isGameCurrent(int gameId, const QString &player, const QString &opponent) const
+{
+    QMutexLocker locker(&mutex);
+    return currentGameId == gameId && players.contains(player) && players.contains(opponent);
+}
+
+bool MyTcpServer::selectGameMode(const GameMode &mode)
+{
+    QMutexLocker locker(&mutex);
+    if (players.isEmpty()) {
+        gameMode = &mode;
+        return true;
+    }
+    return gameMode == &mode;
+}
+
+const GameMode &MyTcpServer::getGameMode() const
+{
+    return *gameMode;
+}
+
 int MyTcpServer::getSunkShips(const QString &nickname) const
 {
     QMutexLocker locker(&mutex);
     return sunkShips.value(nickname, 0);
 }
+
+void MyTcpServer::recordShot(const QString &nickname, const QString &result)
+{
+    QMutexLocker locker(&mutex);
+    shotsFired[nickname] += 1;
+    if (result == "hit" || result == "sunk") {
+        shotsHit[nickname] += 1;
+    }
+}
+
+AsyncTask MyTcpServer::recordGameOver(int gameId, QString winner, QString loser)
+{
+    bool recordStats = !loser.isEmpty();
+    PlayerStats winnerDelta;
+    PlayerStats loserDelta;
+    if (recordStats) {
+        QMutexLocker locker(&mutex);
+        winnerDelta.nickname = winner;
+        winnerDelta.wins = 1;
+        winnerDelta.shots = shotsFired.value(winner, 0);
+        winnerDelta.hits = shotsHit.value(winner, 0);
+        loserDelta.nickname = loser;
+        loserDelta.losses = 1;
+        loserDelta.shots = shotsFired.value(loser, 0);
+        loserDelta.hits = shotsHit.value(loser, 0);
+    }
+
+    DatabaseManager *db = DatabaseManager::getInstance();
+    auto persist = onDatabase(this, [db, gameId, recordStats, winnerDelta, loserDelta]() {
+        // Партия окончена - через ARCHIVE_AFTER_DAYS её заберёт архиватор
+        db->finishGame(gameId);
+        return !recordStats || db->recordGameResult(winnerDelta, loserDelta);
+    });
+    bool saved = co_await persist;
+    if (!recordStats) {
+        co_return;
+    }
+    if (!saved) {
+        qDebug() << "Failed to persist stats for game" << gameId;
+        co_return;
+    }
+
+    // Таблица лидеров обновляется теми же приращениями, без повторного чтения из БД
+    QMutexLocker locker(&mutex);
+    for (const PlayerStats &delta : {winnerDelta, loserDelta}) {
+        PlayerStats stats = leaderboard.stats(delta.nickname);
+        stats.wins += delta.wins;
+        stats.losses += delta.losses;
+        stats.shots += delta.shots;
+        stats.hits += delta.hits;
+        leaderboard.update(stats);
+    }
+}
+
+QVector<PlayerStats> MyTcpServer::getTopPlayers(int limit) const
+{
+    QMutexLocker locker(&mutex);
+    return leaderboard.top(limit);
+}
+
+int MyTcpServer::getPlayerRank(const QString &nickname) const
+{
+    QMutexLocker locker(&mutex);
+    return leaderboard.rank(nickname);
+}
+
+PlayerStats MyTcpServer::getPlayerStats(const QString &nickname) const
+{
+    QMutexLocker locker(&mutex);
+    return leaderboard.stats(nickname);
+}
+
+Task<bool> MyTcpServer::refreshLeaderboard()
+{
+    // Stats общая для всех шардов: итоги партий других процессов видны только через неё.
+    // Дочитываются лишь строки с ревизией новее учтённой - без изменений это один поиск по индексу
+    qint64 since;
+    {
+        QMutexLocker locker(&mutex);
+        since = mStatsRevision;
+    }
+    DatabaseManager *db = DatabaseManager::getInstance();
+    auto load = onDatabase(this, [db, since]() { return db->loadStatsSince(since); });
+    StatsChanges changes = co_await load;
+
+    QMutexLocker locker(&mutex);
+    // Параллельное обновление могло уже учесть более новую ревизию - старые значения не применяются
+    if (changes.revision <= mStatsRevision) {
+        co_return false;
+    }
+    for (const PlayerStats &stats : changes.players) {
+        leaderboard.update(stats);
+    }
+    mStatsRevision = changes.revision;
+    co_return true;
+}
+
+bool MyTcpServer::isBot(const QString &nickname)
+{
+    return nickname == BotNickname;
+}
+
+bool MyTcpServer::addBotToGame(const QString &difficulty)
+{
+    QMutexLocker locker(&mutex);
+    if (players.size() != 1 || players.contains(BotNickname)) {
+        return false;
+    }
+    bot.reset();
+    bot.setDifficulty(BotEngine::difficultyFromString(difficulty));
+    mBotFailedMoves = 0;
+    players.append(BotNickname);
+    sunkShips.insert(BotNickname, 0);
+    // Бот один на процесс, как и партия: маршрутизатор не должен вести сюда второго игрока
+    if (mShardLink) {
+        mShardLink->setBotGame(true);
+    }
+    qDebug() << "Added bot to game, difficulty:" << difficulty << "move budget (ns):" << bot.moveBudget();
+    return true;
+}
+
+Task<bool> MyTcpServer::placeBotFleet(int gameId)
+{
+    DatabaseManager *db = DatabaseManager::getInstance();
+    QVector<BotEngine::Placement> fleet = bot.randomFleet();
+    auto saveFleet = onDatabase(this, [db, gameId, fleet]() {
+        bool saved = true;
+        for (const BotEngine::Placement &ship : fleet) {
+            saved = db->saveShip(gameId, BotNickname, ship.x, ship.y, ship.size, ship.isHorizontal) && saved;
+        }
+        return saved;
+    }, !db->isJournaled());
+    bool saved = co_await saveFleet;
+    QMutexLocker locker(&mutex);
+    if (currentGameId != gameId || !players.contains(BotNickname)) {
+        co_return false; // Партию сбросили, пока флот сохранялся
+    }
+    readyPlayers.insert(BotNickname);
+    co_return saved;
+}
+
+void MyTcpServer::scheduleBotTurn()
+{
+    QTimer::singleShot(0, this, &MyTcpServer::slotBotTurn);
+}
+
+void MyTcpServer::slotBotTurn()
+{
+    if (currentGameId == -1 || !players.contains(BotNickname)) {
+        return;
+    }
+    if (mHandoffPaused) {
+        mBotTurnDeferred = true;
+        return;
+    }
+
+    int gameId = currentGameId;
+    StallDetector::HandlerScope stallScope("bot_turn", gameId);
+    playBotTurn(gameId, bot.nextShot());
+}
+
+AsyncTask MyTcpServer::playBotTurn(int gameId, BotEngine::Shot shot)
+{
+    InFlight inFlight(mInFlight);
+    QString result;
+    co_await processMove(BotNickname, gameId, shot.x, shot.y, &result);
+
+    const BotEngine::MoveStats &stats = bot.stats();
+    qDebug() << "Bot shot at (" << shot.x << "," << shot.y << ") -" << result
+             << "- think time (us):" << stats.lastMoveNs / 1000
+             << "max:" << stats.maxMoveNs / 1000
+             << "samples:" << stats.lastSamples
+             << "over budget:" << stats.budgetOverruns << "of" << stats.moves;
+
+    // Выстрел закончил партию (finishWonGame её уже сбросил) или игрок ушёл, пока ход был в потоке БД
+    if (currentGameId != gameId || !players.contains(BotNickname)) {
+        co_return;
+    }
+    bot.applyResult(shot.x, shot.y, result);
+    if (result == "miss" || result == "hit" || result == "sunk") {
+        mBotFailedMoves = 0; // Следующий ход бота, если он есть, уже запланировал processMove
+        co_return;
+    }
+    if (result == "not_your_turn") {
+        co_return; // Бота разбудит выстрел соперника
+    }
+
+    // already_shot отмечен на доске бота - он выберет другую клетку; ошибку БД пробуем повторить
+    if (++mBotFailedMoves >= BotMaxFailedMoves) {
+        qDebug() << "Bot failed" << mBotFailedMoves << "moves in a row, forfeiting game" << gameId;
+        mBotFailedMoves = 0;
+        finishWonGame(getOpponent(BotNickname), gameId);
+        co_return;
+    }
+    scheduleBotTurn();
+}
+
+QJsonObject MyTcpServer::getLoadSheddingStats() const
+{
+    const RateLimiter::Counters &counters = rateLimiter.counters();
+    QJsonObject throttled;
+    for (int i = 0; i < RateLimiter::ClassCount; ++i) {
+        throttled[RateLimiter::className(RateLimiter::CommandClass(i))] = qint64(counters.throttled[i]);
+    }
+    QJsonObject stats;
+    stats["allowed"] = qint64(counters.allowed);
+    stats["throttled"] = throttled;
+    stats["banned_drops"] = qint64(counters.bannedDrops);
+    stats["bans"] = qint64(counters.bans);
+    return stats;
+}
@@ -4,10 +4,21 @@
 #include <QObject>
 #include <QTcpServer>
 #include <QTcpSocket>
+#include <QWebSocketServer>
 #include <QHash>
 #include <QMutex>
 #include <QVector>
 #include <QSet>
+#include "leaderboard.h"
+#include "botengine.h"
+#include "ratelimiter.h"
+#include "trafficcapture.h"
+#include "shardlink.h"
+#include "gamemode.h"
+#include "asynctask.h"
+#include "nettransport.h"
+#include <QJsonObject>
+#include <QPointer>
 
 class MyTcpServer : public QObject
 {
@@ -17,11 +28,31 @@ public:
     explicit MyTcpServer(QObject *parent = nullptr);
     ~MyTcpServer();
 
-    // Методы для управления клиентами
+    bool warmUp(int expectedClients); // Предварительный размер таблиц и прогрев кэшей (до приёма клиентов)
+    bool startListening(quint16 port);
+    bool startWebSocketListening(quint16 port); // Приём браузерных клиентов по WebSocket
+    QJsonObject getLoadSheddingStats() const; // Счётчики ограничения частоты запросов
+    bool connectShardLink(const QString &serverName, int shardIndex); // Работа шардом за маршрутизатором (ShardRouter)
+    QJsonObject getShardStats() const; // Пусто, если сервер запущен не шардом
+    QJsonObject getTransportStats() const; // Пусто на транспорте Qt
+    QJsonObject getMemoryReport() const; // Память процесса и оценка по компонентам (соединения, сессии, партия)
+    bool isWebSocketListening() const;
+
+    // Передача сессий новому процессу (SessionHandoff)
+    void pauseForHandoff(); // Не читать запросы и не принимать соединения
+    void resumeAfterHandoff(); // Передача не удалась - продолжаем работу
+    bool isIdle() const; // Нет обработчиков, ждущих БД
+    QJsonObject saveSession(QVector<int> &descriptors); // Снимок сессий и партии; дескрипторы сокетов - в descriptors
+    void detachHandedOff(); // Закрыть свои копии переданных сокетов, не трогая соединения
+    bool restoreSession(const QJsonObject &session, QVector<int> &descriptors); // Забранные дескрипторы заменяются на -1
+
+    // Методы для управления клиентами (клиент - QTcpSocket, QWebSocket или NetConnection)
     void sendMessageToUser(const QString &nickname, const QByteArray &message);
-    void registerClient(const QString &nickname, QTcpSocket *socket);
-    void unregisterClient(QTcpSocket *socket);
-    QString getNicknameBySocket(QTcpSocket *socket);
+    void registerClient(const QString &nickname, QObject *socket);
+    void unregisterClient(QObject *socket);
+    QString getNicknameBySocket(QObject *socket);
+    QByteArray dispatchRequest(QObject *client, const QByteArray &requestData); // Обработка одного запроса, общая для всех транспортов
+                                                                               // (пусто - ответ уйдёт, когда завершится сопрограмма)
 
     // Методы для игровой логики
     void addPlayerToGame(const QString &nickname);
@@ -31,22 +62,104 @@ public:
     int getPlayerCountInternal();
     void resetGame();
     int getGameId() const;
+    // Проверка после ожидания БД: текущая партия всё ещё gameId (-1 - ещё не создана) и оба игрока в ней
+    bool isGameCurrent(int gameId, const QString &player, const QString &opponent) const;
     int currentGameId; // ID текущей игры
+    bool selectGameMode(const GameMode &mode); // Режим задаёт первый игрок лобби, второй должен совпасть
+    int scheduledGame(const QString &player1, const QString &player2) const; // Партия турнира для этой пары, -1 - нет
+    const GameMode *scheduledMode(const QString &nickname) const; // Режим турнира, если игроку назначен матч здесь
+    const GameMode &getGameMode() const;
     int getSunkShips(const QString &nickname) const; // Получить количество потопленных кораблей
+    Task<QByteArray> processMove(QString nickname, int gameId, int x, int y, QString *moveResult = nullptr); // Выстрел игрока (или бота)
+    Task<QByteArray> processSalvo(QString nickname, int gameId, QVector<QPoint> cells); // Залп игрока (режим salvo)
+    Task<QByteArray> processReady(QString nickname); // Игрок расставил флот; второй готовый начинает бой
+    Task<QByteArray> processAuth(QPointer<QObject> client, QString nickname, QString request); // register/login; сессия - после успеха
+
+    // Методы для игры против бота
+    static const QString BotNickname;
+    static bool isBot(const QString &nickname);
+    bool addBotToGame(const QString &difficulty); // Добавить бота вторым игроком
+    Task<bool> placeBotFleet(int gameId); // Расставить корабли бота и отметить его готовым
+    void scheduleBotTurn();
+
+    // Методы для статистики и таблицы лидеров
+    void recordShot(const QString &nickname, const QString &result); // Учёт выстрела в текущей партии
+    // Отметить партию оконченной и, если задан loser, сохранить итоги в Stats и таблицу лидеров.
+    // Запись идёт в потоке БД; счётчики партии читаются сразу, до её сброса
+    AsyncTask recordGameOver(int gameId, QString winner, QString loser);
+    QVector<PlayerStats> getTopPlayers(int limit) const;
+    int getPlayerRank(const QString &nickname) const;
+    PlayerStats getPlayerStats(const QString &nickname) const;
+    Task<bool> refreshLeaderboard(); // Дочитать из Stats строки, изменённые другими шардами
 
 private:
+    // Обработчик-сопрограмма в работе (их ждёт передача сессий)
+    class InFlight
+    {
+    public:
+        explicit InFlight(int &counter) : mCounter(counter) { ++mCounter; }
+        ~InFlight() { --mCounter; }
+
+    private:
+        int &mCounter;
+    };
+
+    bool isClientConnected(QObject *client) const;
+    void readClient(QTcpSocket *clientSocket);
+    void readNetRequest(NetConnection *connection, const QByteArray &requestData); // Запрос от собственного транспорта
+    void watchClient(QTcpSocket *clientSocket);
+    QString sessionNickname(QObject *client, QByteArrayView nickname); // Никнейм сессии без копии, если совпадает с запросом
+    AsyncTask respond(QPointer<QObject> client, Task<QByteArray> handler); // Дождаться обработчика и отправить ответ
+    AsyncTask playBotTurn(int gameId, BotEngine::Shot shot);
+    QByteArray finishWonGame(const QString &winner, int gameId); // game_over обоим игрокам, итоги и сброс партии
+    bool writeToClient(QObject *client, const QByteArray &message, bool flush = true);
+
     QTcpServer *mTcpServer;
-    QHash<QString, QTcpSocket*> mClients; // Никнейм -> Сокет
-    QHash<QTcpSocket*, QString> mSocketToNickname; // Сокет -> Никнейм (для обратного поиска)
+    NetTransport *mTransport; // nullptr - TCP-клиенты на QTcpSocket
+    QWebSocketServer *mWebSocketServer;
+    // Сессии: только связь никнейма с соединением. Состояние партии (players, readyPlayers, sunkShips,
+    // shots*) заводится при входе в партию, поэтому простаивающий в лобби клиент стоит две записи хэша
+    QHash<QString, QObject*> mClients; // Никнейм -> Сокет
+    QHash<QObject*, QString> mSocketToNickname; // Сокет -> Никнейм (для обратного поиска)
+    QSet<QObject*> mBinaryClients; // WebSocket-клиенты, приславшие бинарные кадры
     QStringList players; // Список игроков в игре
     mutable QMutex mutex; // Для защиты доступа к общим данным (mutable для const методов)
     QSet<QString> readyPlayers; // Множество игроков, готовых к бою
     QHash<QString, int> sunkShips; // Счётчик потопленных кораблей для каждого игрока
+    const GameMode *gameMode; // Режим текущей партии (размер доски и флот)
+    QHash<QString, int> shotsFired; // Выстрелы игрока в текущей партии
+    QHash<QString, int> shotsHit; // Попадания игрока в текущей партии
+    Leaderboard leaderboard; // Таблица лидеров, строится из Stats при старте и дочитывается по ревизиям
+    qint64 mStatsRevision; // Последняя ревизия Stats, учтённая в leaderboard
+    BotEngine bot; // Движок встроенного соперника
+    RateLimiter rateLimiter; // Корзины токенов по соединениям и классам команд
+    TrafficCapture capture; // Запись трафика для воспроизведения (включается CAPTURE_FILE)
+    ShardLink *mShardLink; // Связь с маршрутизатором, nullptr - одиночный сервер
+    int mInFlight; // Обработчики, ждущие DbWorker
+    bool mHandoffPaused;
+    bool mBotTurnDeferred; // Ход бота пришёлся на паузу передачи
+    int mBotFailedMoves; // Выстрелы бота подряд, не принятые processMove
+    int mScheduledGameId; // Партия турнира, назначенная шарду маршрутизатором (-1 - нет)
+    QStringList mScheduledPlayers;
+    const GameMode *mScheduledMode;
+    qint64 mBaselineHeapBytes; // Куча перед приёмом клиентов - от неё считается память на соединение
+    // Счётчики для getMemoryReport: проба /health не обходит соединения и сессии под мьютексом
+    int mQtSockets; // Клиенты на QTcpSocket
+    int mWebSockets;
+    qint64 mSessionNicknameBytes; // Строки никнеймов в mClients
 
 public slots:
     void slotNewConnection();
+    void slotNetConnection(NetConnection *connection);
     void slotServerRead();
+    void slotNewWebSocketConnection();
+    void slotWebSocketTextMessage(const QString &message);
+    void slotWebSocketBinaryMessage(const QByteArray &message);
     void slotClientDisconnected();
+    void slotBotTurn();
+    void slotShardDelivered(const QString &nickname, const QByteArray &message);
+    void slotShardMatch(int gameId, const QString &player1, const QString &player2, const QString &mode);
+    void slotShardMatchCancelled(int gameId, const QString &winner);
 };
 
 #endif // MYTCPSERVER_H
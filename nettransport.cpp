@@ -0,0 +1,51 @@
+#include "nettransport.h"
+#include "epolltransport.h"
+#include <QDebug>
+
+NetConnection::NetConnection(NetTransport *transport, int descriptor)
+    : QObject(transport), mTransport(transport), mDescriptor(descriptor), mActive(false)
+{
+}
+
+bool NetConnection::write(const QByteArray &data)
+{
+    if (!isOpen()) {
+        return false;
+    }
+    return mTransport->send(this, data.constData(), data.size());
+}
+
+bool NetConnection::flush(int timeoutMs)
+{
+    return isOpen() && mTransport->flush(this, timeoutMs);
+}
+
+QByteArray NetConnection::takePending()
+{
+    QByteArray pending = mInbox;
+    mInbox.clear();
+    return pending;
+}
+
+void NetConnection::close()
+{
+    if (isOpen()) {
+        mTransport->closeConnection(this);
+    }
+}
+
+NetTransport *NetTransport::create(const QString &name, QObject *parent)
+{
+    if (name.isEmpty() || name == "qt") {
+        return nullptr;
+    }
+    if (name == "epoll") {
+        if (EpollTransport::isSupported()) {
+            return new EpollTransport(parent);
+        }
+        qDebug() << "epoll transport is not supported on this platform, using Qt sockets";
+        return nullptr;
+    }
+    qDebug() << "Unknown NET_TRANSPORT" << name << "- using Qt sockets";
+    return nullptr;
+}
@@ -0,0 +1,90 @@
+#ifndef NETTRANSPORT_H
+#define NETTRANSPORT_H
+
+#include <QObject>
+#include <QByteArray>
+#include <QJsonObject>
+#include <QList>
+#include <functional>
+
+class NetTransport;
+
+// Соединение клиента на собственном транспорте (NetTransport) - вместо QTcpSocket.
+// Входящие байты транспорт читает прямо в inbox и режет на строки-запросы; исходящие
+// отправляются сразу, а не поместившиеся в буфер ядра ждут в outbox готовности сокета.
+// Буферы выделяются при первом обмене и освобождаются, когда соединение простаивает:
+// простаивающее соединение - это объект и дескриптор, без буферов.
+class NetConnection : public QObject
+{
+    Q_OBJECT
+
+public:
+    NetConnection(NetTransport *transport, int descriptor);
+
+    int descriptor() const { return mDescriptor; }
+    bool isOpen() const { return mDescriptor >= 0; }
+    bool write(const QByteArray &data);
+    bool flush(int timeoutMs); // Дописать outbox, ожидая не дольше timeoutMs (перед передачей сессий)
+    QByteArray takePending(); // Принятый, но ещё не обработанный остаток (передаётся новому процессу)
+    void close(); // Закрыть соединение; disconnected() - как при закрытии клиентом
+
+signals:
+    void disconnected();
+
+private:
+    friend class EpollTransport;
+
+    NetTransport *mTransport;
+    int mDescriptor; // -1 - закрыто
+    QByteArray mInbox; // Прочитанное, ещё не разобранное на запросы
+    QByteArray mOutbox; // Не принятое ядром
+    bool mActive; // Был обмен с прошлой проверки простоя
+};
+
+// Сетевой транспорт TCP-клиентов под MyTcpServer. По умолчанию сервер работает на QTcpSocket;
+// NET_TRANSPORT выбирает собственный транспорт, который обходит сигнал readyRead, sender() и
+// промежуточные буферы QTcpSocket. Запросы от любого транспорта уходят в тот же dispatchRequest.
+// Запрос - строка до "\n"; остаток без перевода строки, оканчивающийся "}", тоже считается запросом,
+// как у транспорта Qt, где запрос - всё прочитанное за раз.
+class NetTransport : public QObject
+{
+    Q_OBJECT
+
+public:
+    using RequestHandler = std::function<void(NetConnection *connection, const QByteArray &request)>;
+
+    // "epoll" - EpollTransport (Linux); пусто - транспорт Qt (nullptr); неизвестное имя - тоже nullptr с сообщением
+    static NetTransport *create(const QString &name, QObject *parent = nullptr);
+
+    explicit NetTransport(QObject *parent = nullptr) : QObject(parent) {}
+
+    // Запрос передаётся обработчику без копии: байты действительны только до возврата из него
+    void setRequestHandler(RequestHandler handler) { mHandler = std::move(handler); }
+
+    virtual QString name() const = 0;
+    virtual bool listen(quint16 port) = 0;
+    virtual bool adoptListener(int descriptor) = 0; // Слушающий сокет прежнего процесса
+    virtual NetConnection *adoptConnection(int descriptor) = 0; // Соединение прежнего процесса
+    virtual int listenerDescriptor() const = 0;
+    virtual QList<NetConnection*> connections() const = 0;
+    virtual int connectionCount() const = 0; // Без обхода соединений - для проб /health
+    virtual qint64 ioBufferBytes() const = 0; // Буферы соединений на последнем обходе, -1 - не считались
+    virtual void pause() = 0; // Не читать запросы и не принимать соединения
+    virtual void resume() = 0;
+    virtual void close() = 0; // Закрыть слушающий сокет
+    virtual QJsonObject stats() const = 0;
+
+signals:
+    void newConnection(NetConnection *connection);
+
+protected:
+    friend class NetConnection;
+
+    virtual bool send(NetConnection *connection, const char *data, qsizetype size) = 0; // false - ошибка сокета
+    virtual bool flush(NetConnection *connection, int timeoutMs) = 0;
+    virtual void closeConnection(NetConnection *connection) = 0;
+
+    RequestHandler mHandler;
+};
+
+#endif // NETTRANSPORT_H
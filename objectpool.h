@@ -0,0 +1,92 @@
+#ifndef OBJECTPOOL_H
+#define OBJECTPOOL_H
+
+#include <QtGlobal>
+#include <QJsonObject>
+#include <new>
+#include <utility>
+
+// Пул объектов фиксированного размера: все слоты выделяются одним блоком при создании пула,
+// create/destroy берут и возвращают слот через список свободных - без обращений к куче.
+// Когда слоты кончаются, объект создаётся в куче (overflow в stats): пул ограничивает память
+// в обычном режиме, но не отказывает под пиковой нагрузкой.
+// Не потокобезопасен: вызывающий держит свою блокировку.
+template<typename T>
+class ObjectPool
+{
+public:
+    explicit ObjectPool(int capacity)
+        : mSlots(capacity > 0 ? new Slot[capacity] : nullptr), mFree(nullptr), mCapacity(qMax(capacity, 0)), mInUse(0),
+          mPeak(0), mOverflow(0)
+    {
+        for (int i = mCapacity - 1; i >= 0; --i) {
+            mSlots[i].next = mFree;
+            mFree = &mSlots[i];
+        }
+    }
+    ~ObjectPool() { delete[] mSlots; } // Живые объекты к этому моменту уже уничтожены владельцем
+    ObjectPool(const ObjectPool&) = delete;
+    ObjectPool& operator=(const ObjectPool&) = delete;
+
+    template<typename... Args>
+    T *create(Args&&... args)
+    {
+        ++mInUse;
+        mPeak = qMax(mPeak, mInUse);
+        if (!mFree) {
+            ++mOverflow;
+            return new T(std::forward<Args>(args)...);
+        }
+        Slot *slot = mFree;
+        mFree = slot->next;
+        return new (slot->storage) T(std::forward<Args>(args)...);
+    }
+
+    void destroy(T *object)
+    {
+        if (!object) {
+            return;
+        }
+        --mInUse;
+        if (!owns(object)) {
+            delete object;
+            return;
+        }
+        object->~T();
+        Slot *slot = reinterpret_cast<Slot*>(object);
+        slot->next = mFree;
+        mFree = slot;
+    }
+
+    QJsonObject stats() const
+    {
+        QJsonObject stats;
+        stats["capacity"] = mCapacity;
+        stats["in_use"] = mInUse;
+        stats["peak"] = mPeak;
+        stats["overflow"] = qint64(mOverflow);
+        return stats;
+    }
+
+private:
+    union Slot
+    {
+        Slot *next;
+        alignas(T) unsigned char storage[sizeof(T)];
+    };
+
+    bool owns(const T *object) const
+    {
+        const Slot *slot = reinterpret_cast<const Slot*>(object);
+        return slot >= mSlots && slot < mSlots + mCapacity;
+    }
+
+    Slot *mSlots;
+    Slot *mFree;
+    int mCapacity;
+    int mInUse;
+    int mPeak;
+    quint64 mOverflow; // Объекты, созданные в куче из-за нехватки слотов
+};
+
+#endif // OBJECTPOOL_H
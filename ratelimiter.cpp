@@ -0,0 +1,137 @@
+#include "ratelimiter.h"
+#include "allocstats.h"
+#include <QDebug>
+#include <QList>
+
+RateLimiter::RateLimiter() : mViolationsBeforeBan(20), mBanMs(30000)
+{
+    mClock.start();
+    setLimit(Auth, 5, 0.5);     // Вход и регистрация - редкие операции
+    setLimit(Move, 20, 10);     // Ходы: короткие серии, но не поток
+    setLimit(Game, 10, 2);
+    setLimit(Query, 10, 2);
+    setLimit(Other, 5, 1);
+}
+
+void RateLimiter::setLimit(CommandClass commandClass, double burst, double refillPerSecond)
+{
+    mLimits[commandClass].burst = burst;
+    mLimits[commandClass].refillPerMs = refillPerSecond / 1000.0;
+}
+
+void RateLimiter::setBanPolicy(int violationsBeforeBan, qint64 banMs)
+{
+    mViolationsBeforeBan = violationsBeforeBan;
+    mBanMs = banMs;
+}
+
+void RateLimiter::loadFromEnvironment()
+{
+    for (int i = 0; i < ClassCount; ++i) {
+        QByteArray name = QByteArray("RATE_LIMIT_") + QByteArray(className(CommandClass(i))).toUpper();
+        QList<QByteArray> parts = qgetenv(name.constData()).split(':');
+        if (parts.size() == 2) {
+            setLimit(CommandClass(i), parts[0].toDouble(), parts[1].toDouble());
+            qDebug() << "Rate limit for" << className(CommandClass(i)) << "- burst:" << parts[0] << "refill/s:" << parts[1];
+        }
+    }
+    QList<QByteArray> ban = qgetenv("RATE_LIMIT_BAN").split(':');
+    if (ban.size() == 2) {
+        setBanPolicy(ban[0].toInt(), ban[1].toLongLong());
+        qDebug() << "Rate limit ban policy - violations:" << ban[0] << "ban ms:" << ban[1];
+    }
+}
+
+RateLimiter::Decision RateLimiter::check(QObject *client, CommandClass commandClass)
+{
+    qint64 now = mClock.elapsed();
+    auto it = mClients.find(client);
+    if (it == mClients.end()) {
+        ClientState state;
+        for (int i = 0; i < ClassCount; ++i) {
+            state.buckets[i] = Bucket{float(mLimits[i].burst), quint32(now)};
+        }
+        state.violations = 0;
+        state.bannedUntilMs = 0;
+        it = mClients.insert(client, state);
+    }
+
+    ClientState &state = it.value();
+    if (state.bannedUntilMs > now) {
+        mCounters.bannedDrops++;
+        return Banned;
+    }
+
+    const Limit &limit = mLimits[commandClass];
+    Bucket &bucket = state.buckets[commandClass];
+    quint32 elapsedMs = quint32(now) - bucket.updatedMs; // Беззнаковая разность переживает переполнение
+    bucket.tokens = float(qMin(limit.burst, bucket.tokens + elapsedMs * limit.refillPerMs));
+    bucket.updatedMs = quint32(now);
+
+    if (bucket.tokens >= 1.0) {
+        bucket.tokens -= 1.0;
+        state.violations = 0;
+        mCounters.allowed++;
+        return Allow;
+    }
+
+    mCounters.throttled[commandClass]++;
+    if (mViolationsBeforeBan > 0 && ++state.violations >= mViolationsBeforeBan) {
+        state.violations = 0;
+        state.bannedUntilMs = now + mBanMs;
+        mCounters.bans++;
+        qDebug() << "Client banned for" << mBanMs << "ms after repeated" << className(commandClass) << "flooding";
+    }
+    return Throttled;
+}
+
+void RateLimiter::forget(QObject *client)
+{
+    mClients.remove(client);
+}
+
+const RateLimiter::Counters &RateLimiter::counters() const
+{
+    return mCounters;
+}
+
+QJsonObject RateLimiter::memoryStats() const
+{
+    QJsonObject stats;
+    stats["clients"] = mClients.size();
+    stats["bytes"] = AllocStats::hashBytes(mClients);
+    return stats;
+}
+
+RateLimiter::CommandClass RateLimiter::classify(QByteArrayView type)
+{
+    if (type == "make_move" || type == "make_salvo" || type == "place_ship") {
+        return Move;
+    }
+    if (type == "login" || type == "register") {
+        return Auth;
+    }
+    if (type == "start_game" || type == "ready_to_battle") {
+        return Game;
+    }
+    if (type == "leaderboard" || type == "game_history") {
+        return Query;
+    }
+    return Other;
+}
+
+const char *RateLimiter::className(CommandClass commandClass)
+{
+    switch (commandClass) {
+    case Auth:
+        return "auth";
+    case Move:
+        return "move";
+    case Game:
+        return "game";
+    case Query:
+        return "query";
+    default:
+        return "other";
+    }
+}
@@ -0,0 +1,82 @@
+#ifndef RATELIMITER_H
+#define RATELIMITER_H
+
+#include <QByteArrayView>
+#include <QHash>
+#include <QElapsedTimer>
+#include <QJsonObject>
+
+class QObject;
+
+// Ограничение частоты запросов: корзина токенов на каждое соединение и класс команд.
+// Класс команды - по полю type, найденному сканером запроса (тем же, по которому запрос будет обработан),
+// поэтому клиент не может подставить другой класс строкой в значении поля; запрос вне схемы сканера - Other.
+// Отброшенный запрос не доходит ни до разбора QJsonDocument, ни до обработчика и БД.
+class RateLimiter
+{
+public:
+    enum CommandClass {
+        Auth,  // register, login
+        Move,  // make_move, make_salvo, place_ship
+        Game,  // start_game, ready_to_battle
+        Query, // leaderboard и прочие запросы на чтение
+        Other, // неизвестные и некорректные запросы
+        ClassCount
+    };
+
+    enum Decision {
+        Allow,
+        Throttled, // Корзина пуста - запрос отклонён
+        Banned     // Соединение временно заблокировано - запрос отброшен без ответа
+    };
+
+    // Счётчики отброшенной нагрузки
+    struct Counters {
+        quint64 allowed = 0;
+        quint64 throttled[ClassCount] = {0};
+        quint64 bannedDrops = 0;
+        quint64 bans = 0;
+    };
+
+    RateLimiter();
+
+    void setLimit(CommandClass commandClass, double burst, double refillPerSecond);
+    void setBanPolicy(int violationsBeforeBan, qint64 banMs); // violationsBeforeBan = 0 - без блокировок
+    void loadFromEnvironment(); // RATE_LIMIT_<CLASS>=burst:refill, RATE_LIMIT_BAN=violations:ms
+
+    Decision check(QObject *client, CommandClass commandClass);
+    void forget(QObject *client); // Вызывать при отключении клиента
+    const Counters &counters() const;
+    QJsonObject memoryStats() const; // Состояния клиентов: число и оценка занятой памяти
+
+    static CommandClass classify(QByteArrayView type); // По значению поля type; пусто - Other
+    static const char *className(CommandClass commandClass);
+
+private:
+    struct Limit {
+        double burst;
+        double refillPerMs;
+    };
+
+    // Состояние есть у каждого соединения, приславшего запрос, - поэтому компактное:
+    // 56 байт вместо 96 (точности float хватает на корзину, время - мс от старта по модулю 2^32)
+    struct Bucket {
+        float tokens;
+        quint32 updatedMs;
+    };
+
+    struct ClientState {
+        Bucket buckets[ClassCount];
+        quint16 violations; // Отказы подряд
+        qint64 bannedUntilMs;
+    };
+
+    Limit mLimits[ClassCount];
+    int mViolationsBeforeBan;
+    qint64 mBanMs;
+    QHash<QObject*, ClientState> mClients;
+    Counters mCounters;
+    QElapsedTimer mClock;
+};
+
+#endif // RATELIMITER_H
@@ -0,0 +1,128 @@
+#include "requestarena.h"
+#include <QVector>
+#include <new>
+
+namespace {
+
+const int MaxPooledArenas = 64; // Сверх этого освободившиеся арены возвращаются в кучу
+
+// Заголовок перед кадром: из какой арены он выделен (nullptr - из кучи)
+struct alignas(std::max_align_t) FrameHeader
+{
+    RequestArena *arena;
+};
+
+thread_local QVector<RequestArena*> freeArenas;
+
+quint64 arenasCreated = 0;
+quint64 arenaFrames = 0;
+quint64 heapFrames = 0;
+std::size_t peakUsed = 0;
+
+} // namespace
+
+RequestArena::RequestArena()
+    : mUsed(0), mRefs(0)
+{
+}
+
+RequestArena::Scope::Scope()
+    : mPrevious(sCurrent)
+{
+    if (freeArenas.isEmpty()) {
+        mArena = new RequestArena;
+        ++arenasCreated;
+    } else {
+        mArena = freeArenas.takeLast();
+    }
+    mArena->mRefs = 1;
+    sCurrent = mArena;
+}
+
+RequestArena::Scope::Scope(RequestArena *arena)
+    : mArena(arena), mPrevious(sCurrent)
+{
+    sCurrent = mArena;
+}
+
+RequestArena::Scope::~Scope()
+{
+    sCurrent = mPrevious;
+    if (mArena) {
+        mArena->release();
+    }
+}
+
+RequestArena *RequestArena::retainCurrent()
+{
+    if (sCurrent) {
+        ++sCurrent->mRefs;
+    }
+    return sCurrent;
+}
+
+void *RequestArena::allocateFrame(std::size_t size)
+{
+    std::size_t total = sizeof(FrameHeader) + size;
+    RequestArena *arena = sCurrent;
+    void *memory = arena ? arena->allocate(total) : nullptr;
+    if (memory) {
+        ++arena->mRefs;
+        ++arenaFrames;
+    } else {
+        arena = nullptr;
+        memory = ::operator new(total);
+        ++heapFrames;
+    }
+    FrameHeader *header = static_cast<FrameHeader*>(memory);
+    header->arena = arena;
+    return header + 1;
+}
+
+void RequestArena::freeFrame(void *frame)
+{
+    FrameHeader *header = static_cast<FrameHeader*>(frame) - 1;
+    if (header->arena) {
+        header->arena->release();
+    } else {
+        ::operator delete(header);
+    }
+}
+
+void *RequestArena::allocate(std::size_t size)
+{
+    size = (size + alignof(std::max_align_t) - 1) & ~(alignof(std::max_align_t) - 1);
+    if (size > ArenaSize - mUsed) {
+        return nullptr;
+    }
+    void *memory = mBuffer + mUsed;
+    mUsed += size;
+    peakUsed = qMax(peakUsed, mUsed);
+    return memory;
+}
+
+void RequestArena::release()
+{
+    if (--mRefs > 0) {
+        return;
+    }
+    // Последний кадр запроса освобождён - арена сбрасывается целиком
+    mUsed = 0;
+    if (freeArenas.size() < MaxPooledArenas) {
+        freeArenas.append(this);
+    } else {
+        delete this;
+    }
+}
+
+QJsonObject RequestArena::stats()
+{
+    QJsonObject stats;
+    stats["arena_size"] = ArenaSize;
+    stats["arenas_created"] = qint64(arenasCreated);
+    stats["arenas_free"] = freeArenas.size();
+    stats["arena_frames"] = qint64(arenaFrames);
+    stats["heap_frames"] = qint64(heapFrames);
+    stats["peak_used"] = qint64(peakUsed);
+    return stats;
+}
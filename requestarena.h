@@ -0,0 +1,54 @@
+#ifndef REQUESTARENA_H
+#define REQUESTARENA_H
+
+#include <QtGlobal>
+#include <QJsonObject>
+#include <cstddef>
+
+// Монотонная арена одного запроса: кадры сопрограмм обработчика (respond, processMove, ...)
+// выделяются сдвигом указателя в блоке ArenaSize байт вместо кучи.
+// Арена живёт, пока открыта её Scope или жив хоть один кадр из неё: запрос, ждущий DbWorker,
+// держит свою арену. Когда освобождается последний кадр, арена сбрасывается целиком и
+// возвращается в пул потока - следующий запрос берёт её без выделений.
+// Кадр, не поместившийся в арену, и кадры вне Scope (DbWorker, таймеры) выделяются в куче.
+// Используется только в основном потоке: счётчик ссылок не атомарный.
+class RequestArena
+{
+public:
+    static constexpr int ArenaSize = 4096;
+
+    // Делает арену текущей для потока. Без аргумента берёт свободную арену из пула;
+    // с аргументом - входит в уже существующую и забирает одну её ссылку (см. retainCurrent).
+    class Scope
+    {
+    public:
+        Scope();
+        explicit Scope(RequestArena *arena);
+        ~Scope();
+        Scope(const Scope&) = delete;
+        Scope& operator=(const Scope&) = delete;
+
+    private:
+        RequestArena *mArena;
+        RequestArena *mPrevious;
+    };
+
+    static RequestArena *retainCurrent(); // Лишняя ссылка на текущую арену (nullptr - арены нет) для Scope(arena)
+    static void *allocateFrame(std::size_t size);
+    static void freeFrame(void *frame);
+    static QJsonObject stats();
+
+private:
+    RequestArena();
+
+    void *allocate(std::size_t size);
+    void release();
+
+    alignas(std::max_align_t) unsigned char mBuffer[ArenaSize];
+    std::size_t mUsed;
+    int mRefs;
+
+    static inline thread_local RequestArena *sCurrent = nullptr;
+};
+
+#endif // REQUESTARENA_H
@@ -0,0 +1,470 @@
+#include "requestscanner.h"
+#include "cpufeatures.h"
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QRandomGenerator>
+#include <QtAlgorithms>
+#include <QDebug>
+#include <cstring>
+#include <limits>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define REQUESTSCANNER_SSE2
+#endif
+
+namespace {
+
+// AVX2 - по проверке процессора при запуске; fuzzRequestScanner переключает его, чтобы сверить оба пути
+bool useAvx2 = cpuHasAvx2();
+
+// Первый байт, на котором строка JSON перестаёт быть "простой": кавычка, обратная косая черта,
+// управляющий символ (< 0x20) или начало многобайтового символа UTF-8 (>= 0x80).
+// Знаковое сравнение с 0x20 ловит сразу и управляющие символы, и байты >= 0x80.
+const char *findSpecialPortable(const char *p, const char *end)
+{
+#if defined(REQUESTSCANNER_SSE2)
+    const __m128i quote = _mm_set1_epi8('"');
+    const __m128i backslash = _mm_set1_epi8('\\');
+    const __m128i control = _mm_set1_epi8(0x20);
+    while (end - p >= 16) {
+        __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+        __m128i special = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(chunk, quote), _mm_cmpeq_epi8(chunk, backslash)),
+                                       _mm_cmplt_epi8(chunk, control));
+        quint32 mask = quint32(_mm_movemask_epi8(special));
+        if (mask) {
+            return p + qCountTrailingZeroBits(mask);
+        }
+        p += 16;
+    }
+#endif
+    for (; p < end; ++p) {
+        uchar c = uchar(*p);
+        if (c == '"' || c == '\\' || c < 0x20 || c >= 0x80) {
+            return p;
+        }
+    }
+    return end;
+}
+
+#if defined(CPU_AVX2_SUPPORTED)
+CPU_TARGET_AVX2 const char *findSpecialAvx2(const char *p, const char *end)
+{
+    const __m256i quote = _mm256_set1_epi8('"');
+    const __m256i backslash = _mm256_set1_epi8('\\');
+    const __m256i control = _mm256_set1_epi8(0x20);
+    while (end - p >= 32) {
+        __m256i chunk = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+        __m256i special = _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(chunk, quote), _mm256_cmpeq_epi8(chunk, backslash)),
+                                          _mm256_cmpgt_epi8(control, chunk));
+        quint32 mask = quint32(_mm256_movemask_epi8(special));
+        if (mask) {
+            return p + qCountTrailingZeroBits(mask);
+        }
+        p += 32;
+    }
+    return findSpecialPortable(p, end); // Хвост короче 32 байт
+}
+#endif
+
+const char *findSpecial(const char *p, const char *end)
+{
+#if defined(CPU_AVX2_SUPPORTED)
+    if (useAvx2) {
+        return findSpecialAvx2(p, end);
+    }
+#endif
+    return findSpecialPortable(p, end);
+}
+
+// Длина корректной последовательности UTF-8, 0 - некорректная (избыточная запись, суррогаты, > U+10FFFF)
+int utf8Length(const uchar *s, const uchar *end)
+{
+    uchar lead = s[0];
+    uchar low = 0x80;
+    uchar high = 0xBF;
+    int length;
+    if (lead >= 0xC2 && lead <= 0xDF) {
+        length = 2;
+    } else if (lead >= 0xE0 && lead <= 0xEF) {
+        length = 3;
+        if (lead == 0xE0) {
+            low = 0xA0;
+        } else if (lead == 0xED) {
+            high = 0x9F;
+        }
+    } else if (lead >= 0xF0 && lead <= 0xF4) {
+        length = 4;
+        if (lead == 0xF0) {
+            low = 0x90;
+        } else if (lead == 0xF4) {
+            high = 0x8F;
+        }
+    } else {
+        return 0;
+    }
+
+    if (end - s < length || s[1] < low || s[1] > high) {
+        return 0;
+    }
+    for (int i = 2; i < length; ++i) {
+        if (s[i] < 0x80 || s[i] > 0xBF) {
+            return 0;
+        }
+    }
+    return length;
+}
+
+struct Cursor
+{
+    const char *p;
+    const char *end;
+
+    void skipSpace()
+    {
+        while (p < end && (*p == ' ' || *p == '\n' || *p == '\r' || *p == '\t')) {
+            ++p;
+        }
+    }
+
+    bool consume(char c)
+    {
+        if (p < end && *p == c) {
+            ++p;
+            return true;
+        }
+        return false;
+    }
+
+    // Строка без экранирования; всё остальное оставляем QJsonDocument
+    bool scanString(QByteArrayView &value)
+    {
+        if (!consume('"')) {
+            return false;
+        }
+        const char *start = p;
+        for (;;) {
+            const char *special = findSpecial(p, end);
+            if (special == end) {
+                return false;
+            }
+            uchar c = uchar(*special);
+            if (c == '"') {
+                value = QByteArrayView(start, special - start);
+                p = special + 1;
+                return true;
+            }
+            if (c < 0x80) {
+                return false; // Экранирование или управляющий символ
+            }
+            int length = utf8Length(reinterpret_cast<const uchar*>(special), reinterpret_cast<const uchar*>(end));
+            if (length == 0) {
+                return false;
+            }
+            p = special + length;
+        }
+    }
+
+    // Целое в диапазоне int; дробные числа и экспонента - на общий разбор (там свои правила toInt)
+    bool scanInt(int &value)
+    {
+        bool negative = consume('-');
+        if (p == end || *p < '0' || *p > '9') {
+            return false;
+        }
+        qint64 result = 0;
+        if (*p == '0') {
+            ++p;
+        } else {
+            while (p < end && *p >= '0' && *p <= '9') {
+                result = result * 10 + (*p - '0');
+                if (result > qint64(1) << 31) {
+                    return false;
+                }
+                ++p;
+            }
+        }
+        if (p < end && (*p == '.' || *p == 'e' || *p == 'E' || (*p >= '0' && *p <= '9'))) {
+            return false;
+        }
+        result = negative ? -result : result;
+        if (result > std::numeric_limits<int>::max() || result < std::numeric_limits<int>::min()) {
+            return false;
+        }
+        value = int(result);
+        return true;
+    }
+
+    bool scanBool(bool &value)
+    {
+        if (end - p >= 4 && std::memcmp(p, "true", 4) == 0) {
+            p += 4;
+            value = true;
+            return true;
+        }
+        if (end - p >= 5 && std::memcmp(p, "false", 5) == 0) {
+            p += 5;
+            value = false;
+            return true;
+        }
+        return false;
+    }
+};
+
+quint16 fieldByName(QByteArrayView key)
+{
+    switch (key.size()) {
+    case 1:
+        return key[0] == 'x' ? ScannedRequest::X : key[0] == 'y' ? ScannedRequest::Y : 0;
+    case 4:
+        if (std::memcmp(key.data(), "type", 4) == 0) return ScannedRequest::Type;
+        if (std::memcmp(key.data(), "size", 4) == 0) return ScannedRequest::Size;
+        return 0;
+    case 5:
+        return std::memcmp(key.data(), "email", 5) == 0 ? ScannedRequest::Email : 0;
+    case 7:
+        return std::memcmp(key.data(), "game_id", 7) == 0 ? ScannedRequest::GameId : 0;
+    case 8:
+        if (std::memcmp(key.data(), "nickname", 8) == 0) return ScannedRequest::Nickname;
+        if (std::memcmp(key.data(), "password", 8) == 0) return ScannedRequest::Password;
+        return 0;
+    case 13:
+        return std::memcmp(key.data(), "is_horizontal", 13) == 0 ? ScannedRequest::IsHorizontal : 0;
+    default:
+        return 0;
+    }
+}
+
+} // namespace
+
+bool scanRequest(const QByteArray &data, ScannedRequest &out)
+{
+    Cursor cursor{data.constData(), data.constData() + data.size()};
+    cursor.skipSpace();
+    if (!cursor.consume('{')) {
+        return false;
+    }
+    cursor.skipSpace();
+
+    if (!cursor.consume('}')) {
+        for (;;) {
+            QByteArrayView key;
+            if (!cursor.scanString(key)) {
+                return false;
+            }
+            quint16 field = fieldByName(key);
+            if (field == 0 || (out.fields & field)) {
+                return false; // Незнакомое или повторное поле
+            }
+            cursor.skipSpace();
+            if (!cursor.consume(':')) {
+                return false;
+            }
+            cursor.skipSpace();
+
+            bool ok = false;
+            switch (field) {
+            case ScannedRequest::Type:
+                ok = cursor.scanString(out.type);
+                break;
+            case ScannedRequest::Nickname:
+                ok = cursor.scanString(out.nickname);
+                break;
+            case ScannedRequest::Email:
+                ok = cursor.scanString(out.email);
+                break;
+            case ScannedRequest::Password:
+                ok = cursor.scanString(out.password);
+                break;
+            case ScannedRequest::GameId:
+                ok = cursor.scanInt(out.gameId);
+                break;
+            case ScannedRequest::X:
+                ok = cursor.scanInt(out.x);
+                break;
+            case ScannedRequest::Y:
+                ok = cursor.scanInt(out.y);
+                break;
+            case ScannedRequest::Size:
+                ok = cursor.scanInt(out.size);
+                break;
+            case ScannedRequest::IsHorizontal:
+                ok = cursor.scanBool(out.isHorizontal);
+                break;
+            }
+            if (!ok) {
+                return false;
+            }
+            out.fields |= field;
+
+            cursor.skipSpace();
+            if (cursor.consume(',')) {
+                cursor.skipSpace();
+                continue;
+            }
+            if (cursor.consume('}')) {
+                break;
+            }
+            return false;
+        }
+    }
+
+    cursor.skipSpace();
+    return cursor.p == cursor.end;
+}
+
+namespace {
+
+// Общий путь - ровно то, что сервер делал с каждым запросом раньше
+bool decodeWithJson(const QByteArray &data, ScannedRequest &out)
+{
+    out = ScannedRequest();
+    QJsonDocument doc = QJsonDocument::fromJson(QString::fromUtf8(data).trimmed().toUtf8());
+    if (!doc.isObject()) {
+        return false;
+    }
+    const QJsonObject jsonObj = doc.object(); // const: operator[] не должен добавлять поля
+
+    const QByteArray type = jsonObj["type"].toString().toUtf8();
+    const QByteArray nickname = jsonObj["nickname"].toString().toUtf8();
+    const QByteArray email = jsonObj["email"].toString().toUtf8();
+    const QByteArray password = jsonObj["password"].toString().toUtf8();
+    out.fallbackStorage.reserve(type.size() + nickname.size() + email.size() + password.size());
+    auto keep = [&out](const QByteArray &value) {
+        qsizetype offset = out.fallbackStorage.size();
+        out.fallbackStorage.append(value);
+        return QByteArrayView(out.fallbackStorage.constData() + offset, value.size());
+    };
+    out.type = keep(type);
+    out.nickname = keep(nickname);
+    out.email = keep(email);
+    out.password = keep(password);
+
+    out.gameId = jsonObj["game_id"].toInt();
+    out.x = jsonObj["x"].toInt();
+    out.y = jsonObj["y"].toInt();
+    out.size = jsonObj["size"].toInt();
+    out.isHorizontal = jsonObj["is_horizontal"].toBool();
+
+    const struct {
+        const char *name;
+        ScannedRequest::Field field;
+    } fields[] = {
+        {"type", ScannedRequest::Type}, {"nickname", ScannedRequest::Nickname}, {"game_id", ScannedRequest::GameId},
+        {"x", ScannedRequest::X}, {"y", ScannedRequest::Y}, {"size", ScannedRequest::Size},
+        {"is_horizontal", ScannedRequest::IsHorizontal}, {"email", ScannedRequest::Email}, {"password", ScannedRequest::Password}
+    };
+    for (const auto &entry : fields) {
+        if (jsonObj.contains(QLatin1String(entry.name))) {
+            out.fields |= entry.field;
+        }
+    }
+    return true;
+}
+
+// Мутации разбираемого запроса: байты-разделители JSON, экранирование, граничные числа и UTF-8
+const char *const FuzzTokens[] = {
+    "{", "}", "[", "]", "\"", ":", ",", " ", "\t", "\r\n", "\\", "\\\"", "\\u0041", "\\u00e9", "\\ud83d\\ude00",
+    "0", "-", "-0", "01", "1.5", "1e3", "2147483647", "2147483648", "-2147483648", "-2147483649", "99999999999",
+    "true", "false", "null", "\"type\"", "\"nickname\"", "\"game_id\"", "\"x\"", "\"y\"", "\"size\"",
+    "\"is_horizontal\"", "\"email\"", "\"password\"", "\"extra\"", "\xc3\xa9", "\xe2\x82\xac", "\xf0\x9f\x98\x80",
+    "\xc0\xaf", "\xed\xa0\x80", "\xf4\x90\x80\x80", "\xff", "\x01", "\x7f"
+};
+
+const char *const FuzzSeeds[] = {
+    "{\"type\":\"register\",\"nickname\":\"alice\",\"email\":\"alice@example.com\",\"password\":\"secret\"}",
+    "{\"type\":\"login\",\"nickname\":\"alice\",\"password\":\"secret\"}",
+    "{\"type\":\"start_game\",\"nickname\":\"alice\"}",
+    "{\"type\":\"place_ship\",\"nickname\":\"alice\",\"game_id\":17,\"x\":3,\"y\":4,\"size\":2,\"is_horizontal\":true}",
+    "{\"type\":\"ready_to_battle\",\"nickname\":\"alice\"}",
+    "{\"type\":\"make_move\",\"nickname\":\"alice\",\"game_id\":17,\"x\":9,\"y\":0}",
+    "{ \"type\" : \"make_move\" , \"nickname\" : \"\xd0\xb8\xd0\xb3\xd1\x80\xd0\xbe\xd0\xba\" , \"game_id\" : -1 , \"x\" : 0 , \"y\" : 10 }\r\n",
+    "{\"type\":\"leaderboard\",\"nickname\":\"a-rather-long-nickname-that-crosses-a-32-byte-block\"}",
+    "{}"
+};
+
+QByteArray mutate(QByteArray data, QRandomGenerator &rng)
+{
+    int mutations = 1 + int(rng.bounded(4));
+    for (int i = 0; i < mutations; ++i) {
+        int pos = data.isEmpty() ? 0 : int(rng.bounded(quint32(data.size() + 1)));
+        switch (rng.bounded(5)) {
+        case 0: // Случайный байт
+            if (pos < data.size()) {
+                data[pos] = char(rng.bounded(256));
+            }
+            break;
+        case 1: // Удаление отрезка
+            if (pos < data.size()) {
+                data.remove(pos, 1 + int(rng.bounded(quint32(qMin<qsizetype>(8, data.size() - pos)))));
+            }
+            break;
+        case 2: // Повтор отрезка (удлиняет строки за границы блоков SIMD)
+            if (pos < data.size()) {
+                data.insert(pos, data.mid(pos, 1 + int(rng.bounded(40u))));
+            }
+            break;
+        default: // Лексема JSON
+            data.insert(pos, FuzzTokens[rng.bounded(quint32(sizeof(FuzzTokens) / sizeof(FuzzTokens[0])))]);
+            break;
+        }
+    }
+    return data;
+}
+
+bool sameRequest(const ScannedRequest &a, const ScannedRequest &b)
+{
+    return a.fields == b.fields && a.type == b.type && a.nickname == b.nickname && a.email == b.email && a.password == b.password
+           && a.gameId == b.gameId && a.x == b.x && a.y == b.y && a.size == b.size && a.isHorizontal == b.isHorizontal;
+}
+
+} // namespace
+
+bool decodeRequest(const QByteArray &data, ScannedRequest &out)
+{
+    out = ScannedRequest();
+    if (scanRequest(data, out)) {
+        out.fastPath = true;
+        return true;
+    }
+    return decodeWithJson(data, out);
+}
+
+bool decodeRequestJson(const QByteArray &data, ScannedRequest &out)
+{
+    return decodeWithJson(data, out);
+}
+
+bool fuzzRequestScanner(int iterations, quint32 seed)
+{
+    QRandomGenerator rng(seed);
+    bool avx2 = useAvx2;
+    int accepted = 0;
+    int mismatches = 0;
+    const int seedCount = int(sizeof(FuzzSeeds) / sizeof(FuzzSeeds[0]));
+    for (int i = 0; i < iterations; ++i) {
+        QByteArray input = mutate(QByteArray(FuzzSeeds[i % seedCount]), rng);
+
+        // Сканер не обязан принять запрос, но принятый должен совпасть с QJsonDocument поле в поле.
+        // Каждый вход проверяется на обоих путях поиска спецсимволов
+        ScannedRequest expected;
+        bool json = decodeWithJson(input, expected);
+        for (int pass = 0; pass < (avx2 ? 2 : 1); ++pass) {
+            useAvx2 = avx2 && pass == 0;
+            ScannedRequest scanned;
+            if (!scanRequest(input, scanned)) {
+                continue;
+            }
+            ++accepted;
+            if (!json || !sameRequest(scanned, expected)) {
+                ++mismatches;
+                qDebug() << "Scanner mismatch" << (useAvx2 ? "(AVX2)" : "(portable)") << "- QJsonDocument"
+                         << (json ? "parsed" : "rejected") << "input:" << input.toPercentEncoding(" {}[]\":,");
+            }
+        }
+    }
+    useAvx2 = avx2;
+    qDebug() << "Scanner fuzz:" << iterations << "inputs, seed" << seed << "- accepted by the scanner:" << accepted
+             << "mismatches:" << mismatches << "AVX2:" << avx2;
+    return mismatches == 0;
+}
@@ -0,0 +1,57 @@
+#ifndef REQUESTSCANNER_H
+#define REQUESTSCANNER_H
+
+#include <QByteArray>
+#include <QByteArrayView>
+#include <QString>
+
+// Запрос клиента, разобранный по известной схеме без построения дерева JSON.
+// Строковые поля - представления исходного буфера (без копирования и без экранирования);
+// при разборе через QJsonDocument они указывают в fallbackStorage.
+struct ScannedRequest
+{
+    enum Field : quint16 {
+        Type = 1 << 0,
+        Nickname = 1 << 1,
+        GameId = 1 << 2,
+        X = 1 << 3,
+        Y = 1 << 4,
+        Size = 1 << 5,
+        IsHorizontal = 1 << 6,
+        Email = 1 << 7,
+        Password = 1 << 8
+    };
+
+    QByteArrayView type;
+    QByteArrayView nickname;
+    QByteArrayView email;
+    QByteArrayView password;
+    int gameId = 0;
+    int x = 0;
+    int y = 0;
+    int size = 0;
+    bool isHorizontal = false;
+    quint16 fields = 0; // Какие поля присутствуют в запросе
+    bool fastPath = false; // Разобран сканером, QJsonDocument не понадобился
+    QByteArray fallbackStorage; // Строки, декодированные QJsonDocument
+
+    bool has(Field field) const { return fields & field; }
+};
+
+// Быстрый разбор: один проход по сырому буферу, поиск кавычек и спецсимволов SSE2
+// (AVX2 - если его поддерживает процессор, проверяется при запуске).
+// false - запрос вне быстрого пути (экранирование, лишние поля, дробные числа и т.п.), out не определён.
+bool scanRequest(const QByteArray &data, ScannedRequest &out);
+
+// Сканер, а при его отказе - QJsonDocument с теми же правилами, что и раньше.
+// false - запрос не является JSON-объектом.
+bool decodeRequest(const QByteArray &data, ScannedRequest &out);
+
+// Только QJsonDocument - для запроса, который сканер уже не принял (decodeRequest без повторного сканирования)
+bool decodeRequestJson(const QByteArray &data, ScannedRequest &out);
+
+// Дифференциальная проверка сканера: iterations мутаций типовых запросов; каждый запрос, принятый
+// сканером (на пути AVX2 и переносимом), сверяется с разбором QJsonDocument. false - есть расхождения.
+bool fuzzRequestScanner(int iterations, quint32 seed);
+
+#endif // REQUESTSCANNER_H
@@ -0,0 +1,401 @@
+#include "sessionhandoff.h"
+#include "mytcpserver.h"
+#include <QCoreApplication>
+#include <QJsonDocument>
+#include <QJsonArray>
+#include <QDebug>
+
+#ifdef Q_OS_LINUX
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstring>
+#define HANDOFF_SUPPORTED
+#endif
+
+namespace {
+
+const int DrainPollMs = 1;
+const int DrainTimeoutMs = 2000; // Дольше обработчики не ждём: ходы уже в БД, теряются только ответы
+const int PeerTimeoutMs = 2000;
+const int TakeOverTimeoutMs = 5000; // Передача вместе с ожиданием обработчиков старого процесса
+const int ExitTimeoutMs = 5000; // Сколько ждать выхода старого процесса
+const int MaxFdsPerFrame = 64; // Ядро ограничивает число дескрипторов в одном сообщении (SCM_MAX_FD)
+const quint32 MaxPayload = 64 * 1024 * 1024;
+const char TakeOverRequest[] = "takeover\n";
+
+#ifdef HANDOFF_SUPPORTED
+struct FrameHeader
+{
+    quint32 payloadSize;
+    quint32 fdCount;
+};
+
+bool makeAddress(const QString &path, sockaddr_un &address)
+{
+    QByteArray encoded = path.toLocal8Bit();
+    if (encoded.isEmpty() || encoded.size() >= int(sizeof(address.sun_path))) {
+        qDebug() << "Handoff socket path is empty or too long:" << path;
+        return false;
+    }
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    memcpy(address.sun_path, encoded.constData(), encoded.size());
+    return true;
+}
+
+void setTimeouts(int fd, int ms)
+{
+    timeval timeout;
+    timeout.tv_sec = ms / 1000;
+    timeout.tv_usec = (ms % 1000) * 1000;
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+}
+
+bool writeFully(int fd, const char *data, qint64 size)
+{
+    while (size > 0) {
+        ssize_t written = ::send(fd, data, size_t(size), MSG_NOSIGNAL);
+        if (written < 0 && errno == EINTR) {
+            continue;
+        }
+        if (written <= 0) {
+            return false;
+        }
+        data += written;
+        size -= written;
+    }
+    return true;
+}
+
+bool readFully(int fd, char *data, qint64 size)
+{
+    while (size > 0) {
+        ssize_t received = ::read(fd, data, size_t(size));
+        if (received < 0 && errno == EINTR) {
+            continue;
+        }
+        if (received <= 0) {
+            return false;
+        }
+        data += received;
+        size -= received;
+    }
+    return true;
+}
+
+// Дескрипторы прикрепляются к заголовку кадра, данные идут следом обычной записью
+bool sendFrame(int fd, const QByteArray &payload, const int *descriptors, int count)
+{
+    FrameHeader header{quint32(payload.size()), quint32(count)};
+    iovec iov{&header, sizeof(header)};
+    msghdr message;
+    memset(&message, 0, sizeof(message));
+    message.msg_iov = &iov;
+    message.msg_iovlen = 1;
+
+    QByteArray control;
+    if (count > 0) {
+        control.fill('\0', int(CMSG_SPACE(sizeof(int) * count)));
+        message.msg_control = control.data();
+        message.msg_controllen = control.size();
+        cmsghdr *cmsg = CMSG_FIRSTHDR(&message);
+        cmsg->cmsg_level = SOL_SOCKET;
+        cmsg->cmsg_type = SCM_RIGHTS;
+        cmsg->cmsg_len = CMSG_LEN(sizeof(int) * count);
+        memcpy(CMSG_DATA(cmsg), descriptors, sizeof(int) * count);
+    }
+
+    ssize_t sent;
+    do {
+        sent = ::sendmsg(fd, &message, MSG_NOSIGNAL);
+    } while (sent < 0 && errno == EINTR);
+    if (sent != ssize_t(sizeof(header))) {
+        return false;
+    }
+    return writeFully(fd, payload.constData(), payload.size());
+}
+
+bool receiveFrame(int fd, QByteArray &payload, QVector<int> &descriptors)
+{
+    FrameHeader header;
+    alignas(cmsghdr) char control[CMSG_SPACE(sizeof(int) * MaxFdsPerFrame)];
+    iovec iov{&header, sizeof(header)};
+    msghdr message;
+    memset(&message, 0, sizeof(message));
+    message.msg_iov = &iov;
+    message.msg_iovlen = 1;
+    message.msg_control = control;
+    message.msg_controllen = sizeof(control);
+
+    ssize_t received;
+    do {
+        received = ::recvmsg(fd, &message, MSG_CMSG_CLOEXEC);
+    } while (received < 0 && errno == EINTR);
+    if (received <= 0) {
+        return false;
+    }
+
+    int attached = 0;
+    for (cmsghdr *cmsg = CMSG_FIRSTHDR(&message); cmsg; cmsg = CMSG_NXTHDR(&message, cmsg)) {
+        if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS) {
+            int count = int((cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int));
+            const int *fds = reinterpret_cast<const int*>(CMSG_DATA(cmsg));
+            for (int i = 0; i < count; ++i) {
+                descriptors.append(fds[i]);
+            }
+            attached += count;
+        }
+    }
+    if ((message.msg_flags & MSG_CTRUNC)
+        || (received < ssize_t(sizeof(header)) && !readFully(fd, reinterpret_cast<char*>(&header) + received, sizeof(header) - received))
+        || header.fdCount != quint32(attached) || header.payloadSize > MaxPayload) {
+        return false;
+    }
+    payload.resize(int(header.payloadSize));
+    return readFully(fd, payload.data(), payload.size());
+}
+#endif
+
+} // namespace
+
+SessionHandoff::SessionHandoff(MyTcpServer *server, QTcpServer *healthServer, QObject *parent)
+    : QObject(parent), mServer(server), mHealthServer(healthServer), mListenFd(-1), mPeerFd(-1), mNotifier(nullptr),
+      mTakenOver(false), mTakeOverMs(0), mRestoredClients(0)
+{
+    mDrainTimer = new QTimer(this);
+    connect(mDrainTimer, &QTimer::timeout, this, &SessionHandoff::slotDrain);
+}
+
+SessionHandoff::~SessionHandoff()
+{
+    closeDescriptors();
+#ifdef HANDOFF_SUPPORTED
+    if (mPeerFd >= 0) {
+        ::close(mPeerFd);
+    }
+    if (mListenFd >= 0) {
+        ::close(mListenFd);
+    }
+#endif
+}
+
+bool SessionHandoff::takeOver(const QString &path)
+{
+#ifdef HANDOFF_SUPPORTED
+    sockaddr_un address;
+    if (!makeAddress(path, address)) {
+        return false;
+    }
+    int fd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        qDebug() << "Handoff: cannot create socket:" << strerror(errno);
+        return false;
+    }
+    if (::connect(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0) {
+        // Старого процесса нет (или он не поддерживает передачу) - обычный запуск
+        qDebug() << "Handoff: no running server at" << path << "-" << strerror(errno);
+        ::close(fd);
+        return true;
+    }
+
+    QElapsedTimer timer;
+    timer.start();
+    setTimeouts(fd, TakeOverTimeoutMs);
+    bool ok = writeFully(fd, TakeOverRequest, sizeof(TakeOverRequest) - 1);
+    QByteArray payload;
+    while (ok && payload.isEmpty()) {
+        ok = receiveFrame(fd, payload, mDescriptors);
+    }
+    QJsonDocument doc = QJsonDocument::fromJson(payload);
+    if (!ok || !doc.isObject()) {
+        qDebug() << "Handoff: transfer from the running server failed:" << strerror(errno);
+        ::close(fd);
+        closeDescriptors();
+        return false;
+    }
+    mSession = doc.object();
+
+    // Старый процесс закрывает связь при выходе: после этого журнал ходов и SQLite принадлежат нам
+    setTimeouts(fd, ExitTimeoutMs);
+    char byte;
+    if (::read(fd, &byte, 1) != 0) {
+        qDebug() << "Handoff: the old server has not exited in" << ExitTimeoutMs << "ms, continuing";
+    }
+    ::close(fd);
+
+    mTakenOver = true;
+    mTakeOverMs = timer.elapsed();
+    qDebug() << "Handoff: received" << mDescriptors.size() << "descriptors and"
+             << mSession["clients"].toArray().size() << "sessions in" << mTakeOverMs << "ms";
+    return true;
+#else
+    Q_UNUSED(path);
+    qDebug() << "Handoff is supported on Linux only";
+    return true;
+#endif
+}
+
+bool SessionHandoff::hasSession() const
+{
+    return mTakenOver;
+}
+
+bool SessionHandoff::restore()
+{
+    bool ok = mServer->restoreSession(mSession, mDescriptors);
+    mRestoredClients = mSession["clients"].toArray().size();
+
+    // Порт проверки готовности тоже занят старым процессом - забираем его сокет
+    int health = mSession["health_fd"].toInt(-1);
+    if (mHealthServer && !mHealthServer->isListening() && health >= 0 && health < mDescriptors.size()
+        && mHealthServer->setSocketDescriptor(mDescriptors[health])) {
+        mDescriptors[health] = -1;
+        qDebug() << "Health endpoint is taken over from the old server";
+    }
+    closeDescriptors();
+    return ok;
+}
+
+bool SessionHandoff::listen(const QString &path)
+{
+#ifdef HANDOFF_SUPPORTED
+    sockaddr_un address;
+    if (!makeAddress(path, address)) {
+        return false;
+    }
+    mListenFd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC | SOCK_NONBLOCK, 0);
+    if (mListenFd < 0) {
+        qDebug() << "Handoff: cannot create socket:" << strerror(errno);
+        return false;
+    }
+    ::unlink(address.sun_path); // Путь остаётся от предыдущего процесса
+    if (::bind(mListenFd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0 || ::listen(mListenFd, 1) != 0) {
+        qDebug() << "Handoff: cannot listen at" << path << ":" << strerror(errno);
+        ::close(mListenFd);
+        mListenFd = -1;
+        return false;
+    }
+    mNotifier = new QSocketNotifier(mListenFd, QSocketNotifier::Read, this);
+    connect(mNotifier, &QSocketNotifier::activated, this, &SessionHandoff::slotRequest);
+    qDebug() << "Handoff: waiting for a new server at" << path;
+    return true;
+#else
+    Q_UNUSED(path);
+    qDebug() << "Handoff is supported on Linux only";
+    return true;
+#endif
+}
+
+void SessionHandoff::slotRequest()
+{
+#ifdef HANDOFF_SUPPORTED
+    int fd = ::accept4(mListenFd, nullptr, nullptr, SOCK_CLOEXEC);
+    if (fd < 0) {
+        return;
+    }
+    if (mPeerFd >= 0) {
+        ::close(fd); // Передача уже идёт
+        return;
+    }
+    setTimeouts(fd, PeerTimeoutMs);
+    char request[sizeof(TakeOverRequest) - 1];
+    if (!readFully(fd, request, sizeof(request)) || memcmp(request, TakeOverRequest, sizeof(request)) != 0) {
+        qDebug() << "Handoff: unexpected request, ignored";
+        ::close(fd);
+        return;
+    }
+
+    // Новые запросы не читаются, обработчики, ждущие БД, дорабатывают
+    qDebug() << "Handoff: a new server takes over, pausing";
+    mPeerFd = fd;
+    mNotifier->setEnabled(false);
+    mServer->pauseForHandoff();
+    mPauseTimer.start();
+    mDrainTimer->start(DrainPollMs);
+#endif
+}
+
+void SessionHandoff::slotDrain()
+{
+    if (!mServer->isIdle() && mPauseTimer.elapsed() < DrainTimeoutMs) {
+        return;
+    }
+    mDrainTimer->stop();
+    if (!mServer->isIdle()) {
+        qDebug() << "Handoff: handlers are still running after" << DrainTimeoutMs << "ms, their responses are lost";
+    }
+    transfer();
+}
+
+void SessionHandoff::transfer()
+{
+#ifdef HANDOFF_SUPPORTED
+    QVector<int> descriptors;
+    QJsonObject session = mServer->saveSession(descriptors);
+    session["health_fd"] = -1;
+    if (mHealthServer && mHealthServer->isListening()) {
+        session["health_fd"] = descriptors.size();
+        descriptors.append(int(mHealthServer->socketDescriptor()));
+    }
+
+    bool ok = true;
+    for (int offset = 0; ok && offset < descriptors.size(); offset += MaxFdsPerFrame) {
+        int count = qMin(MaxFdsPerFrame, int(descriptors.size()) - offset);
+        ok = sendFrame(mPeerFd, QByteArray(), descriptors.constData() + offset, count);
+    }
+    ok = ok && sendFrame(mPeerFd, QJsonDocument(session).toJson(QJsonDocument::Compact), nullptr, 0);
+    if (!ok) {
+        qDebug() << "Handoff: transfer failed:" << strerror(errno) << "- resuming";
+        abortTransfer();
+        return;
+    }
+
+    // Сокеты теперь и у нового процесса: закрытие своих копий соединения не разрывает.
+    // Связь с новым процессом остаётся открытой до выхода - это сигнал, что журнал свободен
+    mServer->detachHandedOff();
+    if (mHealthServer) {
+        mHealthServer->close();
+    }
+    delete mNotifier;
+    mNotifier = nullptr;
+    ::close(mListenFd);
+    mListenFd = -1;
+    qDebug() << "Handoff: passed" << descriptors.size() << "descriptors after a pause of" << mPauseTimer.elapsed() << "ms, exiting";
+    QCoreApplication::quit();
+#endif
+}
+
+void SessionHandoff::abortTransfer()
+{
+#ifdef HANDOFF_SUPPORTED
+    ::close(mPeerFd);
+    mPeerFd = -1;
+    mNotifier->setEnabled(true);
+    mServer->resumeAfterHandoff();
+#endif
+}
+
+void SessionHandoff::closeDescriptors()
+{
+#ifdef HANDOFF_SUPPORTED
+    for (int fd : mDescriptors) {
+        if (fd >= 0) {
+            ::close(fd);
+        }
+    }
+#endif
+    mDescriptors.clear();
+}
+
+QJsonObject SessionHandoff::stats() const
+{
+    QJsonObject stats;
+    stats["listening"] = mListenFd >= 0;
+    stats["taken_over"] = mTakenOver;
+    stats["take_over_ms"] = mTakeOverMs;
+    stats["restored_clients"] = mRestoredClients;
+    return stats;
+}
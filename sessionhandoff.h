@@ -0,0 +1,64 @@
+#ifndef SESSIONHANDOFF_H
+#define SESSIONHANDOFF_H
+
+#include <QObject>
+#include <QTcpServer>
+#include <QSocketNotifier>
+#include <QTimer>
+#include <QElapsedTimer>
+#include <QJsonObject>
+#include <QVector>
+
+class MyTcpServer;
+
+// Перезапуск без разрыва соединений (Linux): новый процесс забирает у работающего слушающие сокеты,
+// сокеты TCP-клиентов и снимок сессий и партий, старый процесс после этого завершается.
+// Процессы находят друг друга по пути HANDOFF_SOCKET (Unix domain socket). Протокол:
+//   новый -> старый: "takeover\n"
+//   старый: перестаёт читать запросы, дожидается обработчиков в DbWorker, затем кадрами
+//           [размер данных, число дескрипторов] передаёт дескрипторы (SCM_RIGHTS) и последним - снимок JSON
+//   старый закрывает свою связь только при выходе: новый ждёт этого, прежде чем читать журнал ходов.
+// Клиенты видят паузу на время запуска нового процесса; запросы за это время ждут в буферах ядра.
+// WebSocket-клиенты не передаются (состояние рукопожатия не переносится) - они переподключаются.
+class SessionHandoff : public QObject
+{
+    Q_OBJECT
+
+public:
+    SessionHandoff(MyTcpServer *server, QTcpServer *healthServer, QObject *parent = nullptr);
+    ~SessionHandoff();
+
+    // Новый процесс: забрать сессии у работающего сервера. Нет работающего - true, сессий нет
+    bool takeOver(const QString &path);
+    bool hasSession() const;
+    bool restore(); // Отдать сокеты и снимок серверу (вместо listen)
+
+    // Работающий процесс: ждать запросов на передачу
+    bool listen(const QString &path);
+    QJsonObject stats() const;
+
+private slots:
+    void slotRequest();
+    void slotDrain();
+
+private:
+    void transfer();
+    void abortTransfer();
+    void closeDescriptors();
+
+    MyTcpServer *mServer;
+    QTcpServer *mHealthServer; // nullptr - без HTTP-проверки готовности
+    int mListenFd;
+    int mPeerFd; // Связь с новым процессом во время передачи
+    QSocketNotifier *mNotifier;
+    QTimer *mDrainTimer;
+    QElapsedTimer mPauseTimer;
+
+    QJsonObject mSession; // Полученный снимок
+    QVector<int> mDescriptors; // Полученные дескрипторы, -1 - уже отданы серверу
+    bool mTakenOver;
+    qint64 mTakeOverMs;
+    int mRestoredClients;
+};
+
+#endif // SESSIONHANDOFF_H
@@ -0,0 +1,145 @@
+#include "shardlink.h"
+#include <QJsonDocument>
+#include <QDebug>
+
+namespace {
+
+const int ReconnectMs = 1000;
+
+} // namespace
+
+ShardLink::ShardLink(const QString &serverName, int shardIndex, QObject *parent)
+    : QObject(parent), mServerName(serverName), mShardIndex(shardIndex), mBotGame(false), mForwarded(0), mDelivered(0)
+{
+    mSocket = new QLocalSocket(this);
+    connect(mSocket, &QLocalSocket::connected, this, &ShardLink::slotConnected);
+    connect(mSocket, &QLocalSocket::readyRead, this, &ShardLink::slotReadyRead);
+    connect(mSocket, &QLocalSocket::disconnected, this, &ShardLink::slotReconnect);
+
+    mReconnectTimer = new QTimer(this);
+    mReconnectTimer->setSingleShot(true);
+    connect(mReconnectTimer, &QTimer::timeout, this, [this]() { mSocket->connectToServer(mServerName); });
+    connect(mSocket, &QLocalSocket::errorOccurred, this, &ShardLink::slotReconnect);
+}
+
+bool ShardLink::connectToRouter()
+{
+    mSocket->connectToServer(mServerName);
+    if (!mSocket->waitForConnected(ReconnectMs)) {
+        qDebug() << "Shard" << mShardIndex << "cannot reach router" << mServerName << ":" << mSocket->errorString();
+        return false;
+    }
+    return true;
+}
+
+bool ShardLink::isConnected() const
+{
+    return mSocket->state() == QLocalSocket::ConnectedState;
+}
+
+void ShardLink::announceUser(const QString &nickname)
+{
+    mUsers.insert(nickname);
+    send(QJsonObject{{"op", "user"}, {"nickname", nickname}});
+}
+
+void ShardLink::userGone(const QString &nickname)
+{
+    mUsers.remove(nickname);
+    send(QJsonObject{{"op", "gone"}, {"nickname", nickname}});
+}
+
+void ShardLink::forward(const QString &nickname, const QByteArray &message)
+{
+    ++mForwarded;
+    send(QJsonObject{{"op", "forward"}, {"nickname", nickname}, {"message", QString::fromUtf8(message)}});
+}
+
+void ShardLink::reportResult(int gameId, const QString &winner)
+{
+    send(QJsonObject{{"op", "result"}, {"game_id", gameId}, {"winner", winner}});
+}
+
+void ShardLink::setBotGame(bool active)
+{
+    if (mBotGame != active) {
+        mBotGame = active;
+        send(QJsonObject{{"op", "bot"}, {"active", active}});
+    }
+}
+
+QJsonObject ShardLink::stats() const
+{
+    QJsonObject stats;
+    stats["shard"] = mShardIndex;
+    stats["connected"] = isConnected();
+    stats["users"] = mUsers.size();
+    stats["forwarded"] = qint64(mForwarded);
+    stats["delivered"] = qint64(mDelivered);
+    return stats;
+}
+
+QByteArray ShardLink::encode(const QJsonObject &message)
+{
+    return QJsonDocument(message).toJson(QJsonDocument::Compact) + "\n";
+}
+
+bool ShardLink::takeMessage(QByteArray &buffer, QJsonObject &message)
+{
+    int newline;
+    while ((newline = buffer.indexOf('\n')) >= 0) {
+        QJsonDocument doc = QJsonDocument::fromJson(buffer.left(newline));
+        buffer.remove(0, newline + 1);
+        if (doc.isObject()) {
+            message = doc.object();
+            return true;
+        }
+    }
+    return false;
+}
+
+void ShardLink::slotConnected()
+{
+    qDebug() << "Shard" << mShardIndex << "linked to router" << mServerName;
+    send(QJsonObject{{"op", "hello"}, {"shard", mShardIndex}});
+    for (auto it = mUsers.constBegin(); it != mUsers.constEnd(); ++it) {
+        send(QJsonObject{{"op", "user"}, {"nickname", *it}});
+    }
+    if (mBotGame) {
+        send(QJsonObject{{"op", "bot"}, {"active", true}});
+    }
+}
+
+void ShardLink::slotReadyRead()
+{
+    mBuffer += mSocket->readAll();
+    QJsonObject message;
+    while (takeMessage(mBuffer, message)) {
+        QString op = message["op"].toString();
+        if (op == "deliver") {
+            ++mDelivered;
+            emit delivered(message["nickname"].toString(), message["message"].toString().toUtf8());
+        } else if (op == "match") {
+            emit matchAssigned(message["game_id"].toInt(-1), message["player1"].toString(), message["player2"].toString(),
+                               message["mode"].toString());
+        } else if (op == "cancel") {
+            emit matchCancelled(message["game_id"].toInt(-1), message["winner"].toString());
+        }
+    }
+}
+
+void ShardLink::slotReconnect()
+{
+    // Маршрутизатор перезапускается - шард продолжает обслуживать своих клиентов и ждёт его
+    if (!mReconnectTimer->isActive() && mSocket->state() == QLocalSocket::UnconnectedState) {
+        mBuffer.clear();
+        mReconnectTimer->start(ReconnectMs);
+    }
+}
+
+void ShardLink::send(const QJsonObject &message)
+{
+    if (isConnected()) {
+        mSocket->write(encode(message));
+    }
+}
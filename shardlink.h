@@ -0,0 +1,66 @@
+#ifndef SHARDLINK_H
+#define SHARDLINK_H
+
+#include <QObject>
+#include <QLocalSocket>
+#include <QJsonObject>
+#include <QTimer>
+#include <QSet>
+
+// Связь процесса-шарда с маршрутизатором (ShardRouter) через локальный сокет.
+// Сообщения - JSON в одну строку с полем "op":
+//   hello   {shard}                - шард принимает клиентов
+//   user    {nickname}             - игрок вошёл на этом шарде
+//   gone    {nickname}             - игрок отключился
+//   forward {nickname, message}    - шард -> маршрутизатор: сообщение игроку с другого шарда
+//   deliver {nickname, message}    - маршрутизатор -> шард: доставить своему клиенту
+//   match   {game_id, player1, player2, mode} - маршрутизатор -> шард: партия турнира для этого шарда
+//   result  {game_id, winner}      - шард -> маршрутизатор: партия турнира окончена
+//   cancel  {game_id, winner}      - маршрутизатор -> шард: партия турнира снята (неявка), победа присуждена
+//   bot     {active}               - шард -> маршрутизатор: лобби занято партией против бота (второй игрок не нужен)
+class ShardLink : public QObject
+{
+    Q_OBJECT
+
+public:
+    ShardLink(const QString &serverName, int shardIndex, QObject *parent = nullptr);
+
+    bool connectToRouter(); // Ждёт соединения не дольше секунды, затем переподключается в фоне
+    bool isConnected() const;
+    int shardIndex() const { return mShardIndex; }
+
+    void announceUser(const QString &nickname);
+    void userGone(const QString &nickname);
+    void forward(const QString &nickname, const QByteArray &message);
+    void reportResult(int gameId, const QString &winner);
+    void setBotGame(bool active); // Отправляется только при изменении и повторяется после переподключения
+    QJsonObject stats() const;
+
+    static QByteArray encode(const QJsonObject &message);
+    static bool takeMessage(QByteArray &buffer, QJsonObject &message); // Очередная целая строка из буфера
+
+signals:
+    void delivered(const QString &nickname, const QByteArray &message);
+    void matchAssigned(int gameId, const QString &player1, const QString &player2, const QString &mode);
+    void matchCancelled(int gameId, const QString &winner);
+
+private slots:
+    void slotConnected();
+    void slotReadyRead();
+    void slotReconnect();
+
+private:
+    void send(const QJsonObject &message);
+
+    QString mServerName;
+    int mShardIndex;
+    QLocalSocket *mSocket;
+    QTimer *mReconnectTimer;
+    QByteArray mBuffer;
+    QSet<QString> mUsers; // Повторно объявляются после переподключения
+    bool mBotGame;
+    quint64 mForwarded;
+    quint64 mDelivered;
+};
+
+#endif // SHARDLINK_H
@@ -0,0 +1,463 @@
+#include "shardrouter.h"
+#include "shardlink.h"
+#include "func2serv.h"
+#include "requestscanner.h"
+#include "DatabaseManager.h"
+#include "gamemode.h"
+#include <QCoreApplication>
+#include <QProcessEnvironment>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QTimer>
+#include <QDebug>
+
+namespace {
+
+const int LobbySize = 2; // Игроков в лобби одного шарда
+const int HealthPortOffset = 100; // Порт готовности шарда = порт шарда + смещение
+const int RestartDelayMs = 1000;
+const int StopTimeoutMs = 3000;
+const int MaxLoginPeek = 4096; // Первый запрос длиннее - соединение направляется как обычно
+const int DefaultForfeitMs = 120000;
+
+} // namespace
+
+ShardRouter::ShardRouter(int shardCount, quint16 shardBasePort, QObject *parent)
+    : QObject(parent), mTournament(nullptr), mStopping(false), mAccepted(0), mRejected(0), mForwarded(0), mUndeliverable(0)
+{
+    mForfeitMs = qEnvironmentVariableIsSet("TOURNAMENT_FORFEIT_MS") ? qEnvironmentVariableIntValue("TOURNAMENT_FORFEIT_MS")
+                                                                     : DefaultForfeitMs;
+    mShards.resize(qMax(1, shardCount));
+    for (int i = 0; i < mShards.size(); ++i) {
+        mShards[i].index = i;
+        mShards[i].port = quint16(shardBasePort + i);
+        mShards[i].forfeitTimer = new QTimer(this);
+        mShards[i].forfeitTimer->setSingleShot(true);
+        connect(mShards[i].forfeitTimer, &QTimer::timeout, this, [this, i]() { forfeitMatch(i); });
+    }
+
+    mServer = new QTcpServer(this);
+    connect(mServer, &QTcpServer::newConnection, this, &ShardRouter::slotNewConnection);
+
+    mLinkServer = new QLocalServer(this);
+    connect(mLinkServer, &QLocalServer::newConnection, this, &ShardRouter::slotNewLink);
+}
+
+ShardRouter::~ShardRouter()
+{
+    mStopping = true;
+    mServer->close();
+    for (Shard &shard : mShards) {
+        if (!shard.process) {
+            continue;
+        }
+        shard.process->disconnect(this);
+        shard.process->terminate();
+        if (!shard.process->waitForFinished(StopTimeoutMs)) {
+            shard.process->kill();
+            shard.process->waitForFinished(StopTimeoutMs);
+        }
+    }
+}
+
+bool ShardRouter::start(quint16 port)
+{
+    QString linkName = QString("battleship-router-%1").arg(port);
+    QLocalServer::removeServer(linkName); // Остался от упавшего маршрутизатора
+    if (!mLinkServer->listen(linkName)) {
+        qDebug() << "Router link is NOT started:" << mLinkServer->errorString();
+        return false;
+    }
+
+    for (int i = 0; i < mShards.size(); ++i) {
+        startShard(i);
+    }
+
+    if (!mServer->listen(QHostAddress::Any, port)) {
+        qDebug() << "Router is NOT started on port" << port << ":" << mServer->errorString();
+        return false;
+    }
+    qDebug() << "Router is started on port" << port << "with" << mShards.size() << "shards from port" << mShards[0].port;
+    return true;
+}
+
+bool ShardRouter::startTournament(TournamentScheduler::Format format, const QStringList &players, const GameMode &mode, int rounds)
+{
+    // Маршрутизатор пишет в ту же БД, что и шарды: туры, партии и их итоги
+    DatabaseManager *db = DatabaseManager::getInstance();
+    if (!db->isOpen() || !db->runMigrations() || !db->prepareStatements()) {
+        return false;
+    }
+
+    mTournament = new TournamentScheduler(this);
+    connect(mTournament, &TournamentScheduler::matchesQueued, this, &ShardRouter::dispatchMatches);
+    connect(mTournament, &TournamentScheduler::finished, this, [this](const QString &champion) {
+        qDebug() << "Tournament champion:" << champion << "- router stats:" << stats();
+    });
+    return mTournament->create(format, players, mode, rounds);
+}
+
+QJsonObject ShardRouter::stats() const
+{
+    QJsonArray shards;
+    for (const Shard &shard : mShards) {
+        QJsonObject obj;
+        obj["index"] = shard.index;
+        obj["port"] = shard.port;
+        obj["pid"] = shard.process ? qint64(shard.process->processId()) : 0;
+        obj["ready"] = shard.link != nullptr;
+        obj["connections"] = shard.connections;
+        obj["bot_game"] = shard.botGame;
+        obj["restarts"] = shard.restarts;
+        obj["tournament_game"] = shard.match.gameId;
+        shards.append(obj);
+    }
+
+    QJsonObject stats;
+    stats["shards"] = shards;
+    stats["accepted"] = qint64(mAccepted);
+    stats["rejected"] = qint64(mRejected);
+    stats["forwarded"] = qint64(mForwarded);
+    stats["undeliverable"] = qint64(mUndeliverable);
+    stats["users"] = mUserShards.size();
+    if (mTournament) {
+        stats["tournament"] = mTournament->stats();
+    }
+    return stats;
+}
+
+void ShardRouter::startShard(int index)
+{
+    Shard &shard = mShards[index];
+
+    // Шард - этот же исполняемый файл в обычном режиме сервера, настроенный окружением
+    QProcessEnvironment env = QProcessEnvironment::systemEnvironment();
+    env.insert("SERVER_PORT", QString::number(shard.port));
+    env.insert("HEALTH_PORT", QString::number(shard.port + HealthPortOffset));
+    env.insert("WS_PORT", "0"); // Браузерные клиенты - напрямую к одиночному серверу
+    env.insert("SHARD_INDEX", QString::number(index));
+    env.insert("SHARD_LINK", mLinkServer->serverName());
+    // Журнал ходов, запись трафика и сокет передачи сессий у каждого шарда свои; архиватор один на общую БД.
+    // С общим HANDOFF_SOCKET каждый шард при запуске забирал бы слушающий сокет и клиентов соседа
+    if (!env.value("HANDOFF_SOCKET").isEmpty()) {
+        env.insert("HANDOFF_SOCKET", env.value("HANDOFF_SOCKET") + QString(".shard-%1").arg(index));
+    }
+    if (!env.value("MOVE_JOURNAL_DIR").isEmpty()) {
+        env.insert("MOVE_JOURNAL_DIR", env.value("MOVE_JOURNAL_DIR") + QString("/shard-%1").arg(index));
+    }
+    if (!env.value("CAPTURE_FILE").isEmpty()) {
+        env.insert("CAPTURE_FILE", env.value("CAPTURE_FILE") + QString(".shard-%1").arg(index));
+    }
+    if (index > 0) {
+        env.insert("ARCHIVE_DIR", "");
+    }
+
+    QProcess *process = new QProcess(this);
+    process->setProcessEnvironment(env);
+    process->setProcessChannelMode(QProcess::ForwardedChannels);
+    connect(process, &QProcess::finished, this, [this, index, process](int exitCode, QProcess::ExitStatus exitStatus) {
+        qDebug() << "Shard" << index << "exited, code" << exitCode << (exitStatus == QProcess::CrashExit ? "(crash)" : "")
+                 << "- restarting in" << RestartDelayMs << "ms";
+        process->deleteLater();
+        Shard &exited = mShards[index];
+        exited.process = nullptr;
+        ++exited.restarts;
+        qDebug() << "Router stats:" << stats();
+        QTimer::singleShot(RestartDelayMs, this, [this, index]() {
+            if (!mStopping) {
+                startShard(index);
+            }
+        });
+    });
+    shard.process = process;
+    process->start(QCoreApplication::applicationFilePath(), QStringList());
+    qDebug() << "Shard" << index << "is starting on port" << shard.port << "pid" << process->processId();
+}
+
+int ShardRouter::pickShard() const
+{
+    // Сначала добираем начатое лобби, чтобы игроки встретились, затем - пустой шард
+    int empty = -1;
+    for (const Shard &shard : mShards) {
+        if (!shard.link || shard.connections >= LobbySize || shard.match.gameId != -1 || shard.botGame) {
+            continue;
+        }
+        if (shard.connections > 0) {
+            return shard.index;
+        }
+        if (empty < 0) {
+            empty = shard.index;
+        }
+    }
+    return empty;
+}
+
+void ShardRouter::slotNewConnection()
+{
+    while (QTcpSocket *client = mServer->nextPendingConnection()) {
+        ++mAccepted;
+        if (!mSeats.isEmpty()) {
+            // Игрок назначенного матча должен попасть в шард своего матча
+            connect(client, &QTcpSocket::readyRead, this, [this, client]() { routeByLogin(client); });
+            connect(client, &QTcpSocket::disconnected, client, &QTcpSocket::deleteLater);
+            continue;
+        }
+        int index = pickShard();
+        if (index < 0) {
+            ++mRejected;
+            client->write(createJsonResponse("error", "error", "Server is full"));
+            client->flush();
+            client->disconnectFromHost();
+            connect(client, &QTcpSocket::disconnected, client, &QTcpSocket::deleteLater);
+            continue;
+        }
+        proxy(client, index);
+    }
+}
+
+void ShardRouter::routeByLogin(QTcpSocket *client)
+{
+    // Запрос только просматривается: целиком он уйдёт в шард, когда тот примет соединение
+    QByteArray head = client->peek(MaxLoginPeek);
+    int newline = head.indexOf('\n');
+    if (newline < 0 && head.size() < MaxLoginPeek) {
+        return;
+    }
+    client->disconnect(this);
+    disconnect(client, &QTcpSocket::disconnected, client, &QTcpSocket::deleteLater);
+
+    ScannedRequest request;
+    int index = -1;
+    if (newline >= 0 && decodeRequest(head.left(newline), request)) {
+        index = mSeats.value(QString::fromUtf8(request.nickname), -1);
+    }
+    if (index < 0) {
+        index = pickShard();
+    }
+    if (index < 0 || !mShards[index].link) {
+        ++mRejected;
+        client->write(createJsonResponse("error", "error", "Server is full"));
+        client->flush();
+        client->disconnectFromHost();
+        connect(client, &QTcpSocket::disconnected, client, &QTcpSocket::deleteLater);
+        return;
+    }
+    proxy(client, index);
+}
+
+void ShardRouter::dispatchMatches()
+{
+    if (!mTournament) {
+        return;
+    }
+    for (Shard &shard : mShards) {
+        if (!mTournament->hasQueuedMatches()) {
+            break;
+        }
+        // Свободный шард: готов, пуст и без назначенного матча
+        if (!shard.link || shard.connections > 0 || shard.match.gameId != -1) {
+            continue;
+        }
+        mTournament->takeMatch(&shard.match, shard.index);
+        mSeats.insert(shard.match.player1, shard.index);
+        mSeats.insert(shard.match.player2, shard.index);
+        sendMatch(shard);
+        shard.forfeitTimer->start(mForfeitMs);
+
+        // Игрокам, которые сейчас на связи, - приглашение: переподключиться, вход приведёт их в шард матча
+        const QString players[2] = {shard.match.player1, shard.match.player2};
+        for (int i = 0; i < 2; ++i) {
+            int target = mUserShards.value(players[i], -1);
+            if (target < 0 || !mShards[target].link) {
+                continue;
+            }
+            QJsonObject invite;
+            invite["type"] = "tournament_match";
+            invite["status"] = "success";
+            invite["tournament_id"] = mTournament->tournamentId();
+            invite["round"] = shard.match.round;
+            invite["game_id"] = shard.match.gameId;
+            invite["opponent"] = players[1 - i];
+            invite["mode"] = QString(mTournament->mode().name);
+            QJsonObject deliver;
+            deliver["op"] = "deliver";
+            deliver["nickname"] = players[i];
+            deliver["message"] = QString::fromUtf8(QJsonDocument(invite).toJson(QJsonDocument::Compact) + "\r\n");
+            mShards[target].link->write(ShardLink::encode(deliver));
+        }
+    }
+}
+
+void ShardRouter::sendMatch(const Shard &shard)
+{
+    QJsonObject match;
+    match["op"] = "match";
+    match["game_id"] = shard.match.gameId;
+    match["player1"] = shard.match.player1;
+    match["player2"] = shard.match.player2;
+    match["mode"] = QString(mTournament->mode().name);
+    shard.link->write(ShardLink::encode(match));
+}
+
+void ShardRouter::forfeitMatch(int index)
+{
+    Shard &shard = mShards[index];
+    if (!mTournament || shard.match.gameId == -1) {
+        return;
+    }
+    bool present1 = mUserShards.value(shard.match.player1, -1) == index;
+    bool present2 = mUserShards.value(shard.match.player2, -1) == index;
+    if (present1 && present2) {
+        return; // Партия идёт; её итог шард пришлёт сам, в том числе при отключении игрока
+    }
+
+    // Не явились оба - проход получает первый игрок пары, иначе турнир остановился бы на этом матче
+    QString winner = present2 && !present1 ? shard.match.player2 : shard.match.player1;
+    int gameId = shard.match.gameId;
+    qDebug() << "Tournament game" << gameId << "forfeited after" << mForfeitMs << "ms, winner:" << winner;
+    if (shard.link) {
+        shard.link->write(ShardLink::encode(QJsonObject{{"op", "cancel"}, {"game_id", gameId}, {"winner", winner}}));
+    }
+    DatabaseManager::getInstance()->finishGame(gameId);
+    finishMatch(index, winner);
+}
+
+void ShardRouter::finishMatch(int index, const QString &winner)
+{
+    Shard &shard = mShards[index];
+    int gameId = shard.match.gameId;
+    shard.forfeitTimer->stop();
+    mSeats.remove(shard.match.player1);
+    mSeats.remove(shard.match.player2);
+    shard.match = TournamentScheduler::Match();
+    // Может запланировать следующий тур; его матчи займут шарды по мере отключения игроков
+    mTournament->gameFinished(gameId, winner);
+    dispatchMatches();
+}
+
+void ShardRouter::proxy(QTcpSocket *client, int index)
+{
+    Shard &shard = mShards[index];
+    ++shard.connections;
+
+    // Соединение с шардом принадлежит клиентскому сокету и удаляется вместе с ним.
+    // Данные, пришедшие до установления соединения, QTcpSocket буферизует сам.
+    QTcpSocket *upstream = new QTcpSocket(client);
+    client->setSocketOption(QAbstractSocket::LowDelayOption, 1);
+    upstream->setSocketOption(QAbstractSocket::LowDelayOption, 1);
+    connect(client, &QTcpSocket::readyRead, upstream, [client, upstream]() { upstream->write(client->readAll()); });
+    // Уже прочитанный маршрутизатором первый запрос (routeByLogin) нового readyRead не вызовет
+    connect(upstream, &QTcpSocket::connected, client, [client, upstream]() {
+        if (client->bytesAvailable() > 0) {
+            upstream->write(client->readAll());
+        }
+    });
+    connect(upstream, &QTcpSocket::readyRead, client, [client, upstream]() { client->write(upstream->readAll()); });
+    connect(upstream, &QTcpSocket::disconnected, client, &QTcpSocket::disconnectFromHost);
+    connect(upstream, &QTcpSocket::errorOccurred, client, [client](QAbstractSocket::SocketError) { client->disconnectFromHost(); });
+    connect(client, &QTcpSocket::disconnected, this, [this, client, upstream, index]() {
+        --mShards[index].connections;
+        upstream->disconnectFromHost();
+        client->deleteLater();
+        if (mShards[index].connections == 0) {
+            dispatchMatches(); // Шард освободился - в нём можно играть следующий матч
+        }
+    });
+    upstream->connectToHost(QHostAddress::LocalHost, shard.port);
+}
+
+void ShardRouter::slotNewLink()
+{
+    while (QLocalSocket *link = mLinkServer->nextPendingConnection()) {
+        connect(link, &QLocalSocket::readyRead, this, [this, link]() {
+            QByteArray &buffer = mLinkBuffers[link];
+            buffer += link->readAll();
+            QJsonObject message;
+            while (ShardLink::takeMessage(buffer, message)) {
+                onLinkMessage(link, message);
+            }
+        });
+        connect(link, &QLocalSocket::disconnected, this, [this, link]() { onLinkClosed(link); });
+    }
+}
+
+void ShardRouter::onLinkMessage(QLocalSocket *link, const QJsonObject &message)
+{
+    QString op = message["op"].toString();
+    if (op == "hello") {
+        int index = message["shard"].toInt(-1);
+        if (index < 0 || index >= mShards.size()) {
+            qDebug() << "Unknown shard" << index << "on router link";
+            link->disconnectFromServer();
+            return;
+        }
+        mShards[index].link = link;
+        mLinkShards.insert(link, index);
+        qDebug() << "Shard" << index << "is ready";
+        // Перезапущенный шард заново получает свой матч; свободный - берёт матч из очереди
+        if (mShards[index].match.gameId != -1) {
+            sendMatch(mShards[index]);
+            mShards[index].forfeitTimer->start(mForfeitMs);
+        }
+        dispatchMatches();
+        return;
+    }
+
+    int source = mLinkShards.value(link, -1);
+    if (source < 0) {
+        return; // До hello шард клиентов не принимает
+    }
+    QString nickname = message["nickname"].toString();
+    if (op == "user") {
+        mUserShards.insert(nickname, source);
+    } else if (op == "gone") {
+        if (mUserShards.value(nickname, -1) == source) {
+            mUserShards.remove(nickname);
+        }
+        // Игрок матча ушёл до начала партии: у него есть срок, чтобы вернуться
+        const Shard &shard = mShards[source];
+        if (shard.match.gameId != -1 && (nickname == shard.match.player1 || nickname == shard.match.player2)) {
+            shard.forfeitTimer->start(mForfeitMs);
+        }
+    } else if (op == "forward") {
+        int target = mUserShards.value(nickname, -1);
+        if (target < 0 || target == source || !mShards[target].link) {
+            ++mUndeliverable;
+            return;
+        }
+        QJsonObject deliver = message;
+        deliver["op"] = "deliver";
+        mShards[target].link->write(ShardLink::encode(deliver));
+        ++mForwarded;
+    } else if (op == "bot") {
+        mShards[source].botGame = message["active"].toBool();
+    } else if (op == "result") {
+        Shard &shard = mShards[source];
+        int gameId = message["game_id"].toInt(-1);
+        if (!mTournament || gameId == -1 || shard.match.gameId != gameId) {
+            return;
+        }
+        finishMatch(source, message["winner"].toString());
+    }
+}
+
+void ShardRouter::onLinkClosed(QLocalSocket *link)
+{
+    int index = mLinkShards.value(link, -1);
+    mLinkShards.remove(link);
+    mLinkBuffers.remove(link);
+    // Шард недоступен: новых клиентов к нему не направляем, его игроков забываем
+    if (index >= 0 && mShards[index].link == link) {
+        mShards[index].link = nullptr;
+        mShards[index].botGame = false; // Перезапущенный шард объявит партию с ботом заново, если она уцелела
+        for (auto it = mUserShards.begin(); it != mUserShards.end();) {
+            if (it.value() == index) {
+                it = mUserShards.erase(it);
+            } else {
+                ++it;
+            }
+        }
+        qDebug() << "Shard" << index << "link closed";
+    }
+    link->deleteLater();
+}
@@ -0,0 +1,85 @@
+#ifndef SHARDROUTER_H
+#define SHARDROUTER_H
+
+#include <QObject>
+#include <QTcpServer>
+#include <QTcpSocket>
+#include <QLocalServer>
+#include <QLocalSocket>
+#include <QProcess>
+#include <QTimer>
+#include <QHash>
+#include <QVector>
+#include <QJsonObject>
+#include "tournamentscheduler.h"
+
+// Маршрутизатор перед N процессами-шардами на одной машине.
+// Каждый шард - обычный сервер (одно лобби на процесс) на своём порту; маршрутизатор принимает
+// клиентов на общем порту и проксирует соединение в шард, где собирается лобби: сначала туда,
+// где уже ждёт один игрок, затем в пустой шард. Шарды связаны с маршрутизатором локальным
+// сокетом (ShardLink): сообщения игроку с другого шарда пересылаются через него.
+// Упавший шард перезапускается; игры остальных шардов это не затрагивает.
+// Партия против бота занимает лобби шарда целиком (бот и партия - одни на процесс): шард сообщает о ней,
+// и новые клиенты в этот шард не направляются, пока партия не окончится.
+// Турнир (startTournament): матчи тура раздаются свободным шардам, шард матча резервируется за его парой;
+// пока есть назначенные матчи, новое соединение направляется по нику из первого запроса (вход).
+// Если к шарду матча за TOURNAMENT_FORFEIT_MS не пришли оба игрока (неявка, отключение до начала партии),
+// матч снимается с шарда, а победа присуждается оставшемуся игроку.
+class ShardRouter : public QObject
+{
+    Q_OBJECT
+
+public:
+    ShardRouter(int shardCount, quint16 shardBasePort, QObject *parent = nullptr);
+    ~ShardRouter();
+
+    bool start(quint16 port); // Запустить шарды и начать приём клиентов
+    bool startTournament(TournamentScheduler::Format format, const QStringList &players, const GameMode &mode, int rounds);
+    QJsonObject stats() const;
+
+private slots:
+    void slotNewConnection();
+    void slotNewLink();
+
+private:
+    struct Shard {
+        int index = 0;
+        quint16 port = 0;
+        QProcess *process = nullptr;
+        QLocalSocket *link = nullptr; // nullptr - шард ещё не готов принимать клиентов
+        int connections = 0; // Проксируемые клиентские соединения
+        bool botGame = false; // Лобби занято партией против бота
+        int restarts = 0;
+        TournamentScheduler::Match match; // Назначенная партия турнира, gameId = -1 - нет
+        QTimer *forfeitTimer = nullptr; // Срок явки игроков матча
+    };
+
+    void startShard(int index);
+    int pickShard() const; // -1 - свободных лобби нет
+    void onLinkMessage(QLocalSocket *link, const QJsonObject &message);
+    void onLinkClosed(QLocalSocket *link);
+    void proxy(QTcpSocket *client, int index);
+    void routeByLogin(QTcpSocket *client); // Дождаться первого запроса и выбрать шард по нику
+    void dispatchMatches(); // Раздать свободным шардам матчи из очереди турнира
+    void sendMatch(const Shard &shard);
+    void forfeitMatch(int index); // Срок явки истёк: победа - игроку, который на шарде матча
+    void finishMatch(int index, const QString &winner); // Освободить шард и передать итог планировщику
+
+    QTcpServer *mServer;
+    QLocalServer *mLinkServer;
+    QVector<Shard> mShards;
+    QHash<QLocalSocket*, int> mLinkShards; // Соединение связи -> номер шарда (после hello)
+    QHash<QLocalSocket*, QByteArray> mLinkBuffers; // Неполные строки по соединениям связи
+    QHash<QString, int> mUserShards; // Игрок -> шард, где он вошёл
+    TournamentScheduler *mTournament; // nullptr - турнира нет
+    QHash<QString, int> mSeats; // Игрок назначенного матча -> шард матча
+    bool mStopping;
+    int mForfeitMs;
+
+    quint64 mAccepted;
+    quint64 mRejected;
+    quint64 mForwarded;
+    quint64 mUndeliverable;
+};
+
+#endif // SHARDROUTER_H
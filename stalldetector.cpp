@@ -0,0 +1,322 @@
+#include "stalldetector.h"
+#include <QCoreApplication>
+#include <QDateTime>
+#include <QJsonArray>
+#include <QHash>
+#include <QDebug>
+#include <algorithm>
+#include <cstring>
+
+#ifdef Q_OS_LINUX
+#include <execinfo.h>
+#include <pthread.h>
+#include <signal.h>
+#include <cstdlib>
+#define STALL_STACK_CAPTURE
+#endif
+
+namespace {
+
+const qint64 LagBucketsMs[] = {1, 2, 5, 10, 20, 50, 100, 200, 500, 1000}; // Плюс корзина "больше секунды"
+const int LagBucketCount = int(sizeof(LagBucketsMs) / sizeof(LagBucketsMs[0])) + 1;
+const int MaxRecentStalls = 32;
+const int ReportedStalls = 10;
+const int ReportedFrames = 24;
+const int TopHandlers = 10;
+const int StackWaitMs = 50; // Сколько ждать, пока основной поток снимет стек
+
+#ifdef STALL_STACK_CAPTURE
+const int MaxStackFrames = 48;
+const int SkippedFrames = 2; // Обработчик сигнала и трамплин ядра
+void *stackFrames[MaxStackFrames];
+QAtomicInt stackDepth(-1); // -1 - стек ещё не снят
+pthread_t mainThread;
+
+void stackSignalHandler(int)
+{
+    stackDepth.storeRelease(backtrace(stackFrames, MaxStackFrames));
+}
+#endif
+
+} // namespace
+
+StallDetector *StallDetector::sInstance = nullptr;
+
+StallDetector::StallDetector(QObject *parent)
+    : QObject(parent), mThresholdMs(100), mHeartbeatMs(10), mSlowHandlerMs(20), mSlowWindow(1000),
+      mThread(nullptr), mTimer(nullptr), mPendingSinceNs(-1), mStallCaptured(false),
+      mHeartbeats(0), mLagHistogram(LagBucketCount, 0), mMaxLagUs(0), mStalls(0)
+{
+    memset(&mContext, 0, sizeof(mContext));
+    if (qEnvironmentVariableIsSet("STALL_THRESHOLD_MS")) {
+        mThresholdMs = qEnvironmentVariableIntValue("STALL_THRESHOLD_MS");
+    }
+    if (qEnvironmentVariableIntValue("STALL_HEARTBEAT_MS") > 0) {
+        mHeartbeatMs = qEnvironmentVariableIntValue("STALL_HEARTBEAT_MS");
+    }
+    if (qEnvironmentVariableIntValue("STALL_SLOW_HANDLER_MS") > 0) {
+        mSlowHandlerMs = qEnvironmentVariableIntValue("STALL_SLOW_HANDLER_MS");
+    }
+}
+
+StallDetector::~StallDetector()
+{
+    if (sInstance == this) {
+        sInstance = nullptr;
+    }
+    if (mThread) {
+        mThread->quit();
+        mThread->wait();
+    }
+}
+
+StallDetector *StallDetector::instance()
+{
+    return sInstance;
+}
+
+bool StallDetector::start()
+{
+    if (mThresholdMs <= 0) {
+        qDebug() << "Stall detector is disabled";
+        return true;
+    }
+
+#ifdef STALL_STACK_CAPTURE
+    // Первый вызов backtrace подгружает libgcc (с выделением памяти) - делаем его здесь, а не в обработчике сигнала
+    void *warmup[1];
+    backtrace(warmup, 1);
+    mainThread = pthread_self();
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = stackSignalHandler;
+    action.sa_flags = SA_RESTART;
+    sigemptyset(&action.sa_mask);
+    if (sigaction(SIGUSR2, &action, nullptr) != 0) {
+        qDebug() << "Stall detector: stack capture is not available";
+    }
+#endif
+
+    mClock.start();
+    sInstance = this;
+
+    mThread = new QThread(this);
+    mTimer = new QTimer;
+    mTimer->moveToThread(mThread);
+    // Прямое соединение: проверка идёт в сторожевом потоке, даже когда основной занят
+    connect(mTimer, &QTimer::timeout, this, &StallDetector::slotTick, Qt::DirectConnection);
+    connect(mThread, &QThread::started, mTimer, [this]() { mTimer->start(mHeartbeatMs); });
+    connect(mThread, &QThread::finished, mTimer, &QObject::deleteLater);
+    mThread->start();
+
+    qDebug() << "Stall detector is started - threshold ms:" << mThresholdMs << "heartbeat ms:" << mHeartbeatMs
+             << "slow handler ms:" << mSlowHandlerMs;
+    return true;
+}
+
+void StallDetector::slotTick()
+{
+    qint64 now = mClock.nsecsElapsed();
+    bool post = false;
+    bool capture = false;
+    {
+        QMutexLocker locker(&mMutex);
+        if (mPendingSinceNs < 0) {
+            mPendingSinceNs = now;
+            post = true;
+        } else if (!mStallCaptured && now - mPendingSinceNs > qint64(mThresholdMs) * 1000000) {
+            // Пульс стоит в очереди дольше порога: запоминаем, кто сейчас держит основной поток
+            mStallCaptured = true;
+            capture = true;
+            mCurrentStall = Stall();
+            mCurrentStall.wallClockMs = QDateTime::currentMSecsSinceEpoch() - (now - mPendingSinceNs) / 1000000;
+            mCurrentStall.handler = handlerName(mContext);
+            mCurrentStall.gameId = mContext.gameId;
+            mCurrentStall.handlerElapsedUs = mContext.startedNs > 0 ? (now - mContext.startedNs) / 1000 : 0;
+        }
+    }
+
+    if (post) {
+        QMetaObject::invokeMethod(QCoreApplication::instance(), [this, now]() { heartbeat(now); }, Qt::QueuedConnection);
+    }
+    if (capture) {
+        QStringList stack = captureMainStack();
+        QMutexLocker locker(&mMutex);
+        if (mStallCaptured) {
+            mCurrentStall.stack = stack;
+        } else if (!mRecentStalls.isEmpty()) {
+            mRecentStalls.last().stack = stack; // Зависание уже закончилось, пока снимали стек
+        }
+    }
+}
+
+void StallDetector::heartbeat(qint64 sentNs)
+{
+    qint64 lagUs = (mClock.nsecsElapsed() - sentNs) / 1000;
+    int bucket = 0;
+    while (bucket < LagBucketCount - 1 && lagUs >= LagBucketsMs[bucket] * 1000) {
+        ++bucket;
+    }
+
+    QMutexLocker locker(&mMutex);
+    ++mHeartbeats;
+    ++mLagHistogram[bucket];
+    mMaxLagUs = qMax(mMaxLagUs, lagUs);
+    mPendingSinceNs = -1;
+    if (!mStallCaptured) {
+        return;
+    }
+
+    mStallCaptured = false;
+    mCurrentStall.durationUs = lagUs;
+    ++mStalls;
+    mRecentStalls.append(mCurrentStall);
+    if (mRecentStalls.size() > MaxRecentStalls) {
+        mRecentStalls.removeFirst();
+    }
+    qDebug() << "Event loop stalled for" << lagUs / 1000 << "ms in" << mCurrentStall.handler << "game" << mCurrentStall.gameId;
+}
+
+void StallDetector::enterHandler(QByteArrayView command, int gameId)
+{
+    qint64 now = mClock.nsecsElapsed();
+    QMutexLocker locker(&mMutex);
+    int length = int(qMin<qsizetype>(command.size(), sizeof(mContext.command) - 1));
+    memcpy(mContext.command, command.data(), length);
+    mContext.command[length] = '\0';
+    mContext.gameId = gameId;
+    mContext.dbMethod = nullptr;
+    mContext.startedNs = now;
+}
+
+void StallDetector::leaveHandler()
+{
+    qint64 now = mClock.nsecsElapsed();
+    QMutexLocker locker(&mMutex);
+    qint64 durationUs = (now - mContext.startedNs) / 1000;
+    if (durationUs >= qint64(mSlowHandlerMs) * 1000) {
+        addSlow(mContext, durationUs);
+    }
+    memset(&mContext, 0, sizeof(mContext));
+}
+
+const char *StallDetector::enterDb(const char *name)
+{
+    // Запросы DbWorker идут вне основного потока и его не задерживают
+    if (QThread::currentThread() != QCoreApplication::instance()->thread()) {
+        return nullptr;
+    }
+    QMutexLocker locker(&mMutex);
+    const char *previous = mContext.dbMethod;
+    mContext.dbMethod = name;
+    return previous;
+}
+
+void StallDetector::addSlow(const Context &context, qint64 durationUs)
+{
+    Stall slow;
+    slow.wallClockMs = QDateTime::currentMSecsSinceEpoch() - durationUs / 1000;
+    slow.durationUs = durationUs;
+    slow.handler = handlerName(context);
+    slow.gameId = context.gameId;
+    slow.handlerElapsedUs = durationUs;
+    mSlowHandlers.append(slow);
+    if (mSlowHandlers.size() > mSlowWindow) {
+        mSlowHandlers.removeFirst();
+    }
+}
+
+QString StallDetector::handlerName(const Context &context)
+{
+    // Вне обработчиков - таймеры, отрисовка логов и прочие события цикла
+    QString name = context.command[0] ? QString::fromUtf8(context.command) : QString("event_loop");
+    if (context.dbMethod) {
+        name += QString("/") + context.dbMethod;
+    }
+    return name;
+}
+
+QStringList StallDetector::captureMainStack()
+{
+    QStringList stack;
+#ifdef STALL_STACK_CAPTURE
+    stackDepth.storeRelease(-1);
+    if (pthread_kill(mainThread, SIGUSR2) != 0) {
+        return stack;
+    }
+    // Обработчик выполнится в основном потоке, как только тот получит сигнал (даже посреди вызова)
+    for (int waited = 0; waited < StackWaitMs && stackDepth.loadAcquire() < 0; ++waited) {
+        QThread::msleep(1);
+    }
+    int depth = stackDepth.loadAcquire();
+    if (depth <= SkippedFrames) {
+        return stack;
+    }
+    char **symbols = backtrace_symbols(stackFrames, depth);
+    if (symbols) {
+        for (int i = SkippedFrames; i < depth; ++i) {
+            stack.append(QString::fromLocal8Bit(symbols[i]));
+        }
+        free(symbols);
+    }
+#endif
+    return stack;
+}
+
+QJsonObject StallDetector::stats() const
+{
+    QMutexLocker locker(&mMutex);
+
+    QJsonArray histogram;
+    for (int i = 0; i < LagBucketCount; ++i) {
+        QJsonObject bucket;
+        bucket["le_ms"] = i < LagBucketCount - 1 ? QJsonValue(LagBucketsMs[i]) : QJsonValue("inf");
+        bucket["count"] = qint64(mLagHistogram[i]);
+        histogram.append(bucket);
+    }
+
+    QJsonArray recent;
+    for (int i = mRecentStalls.size() - 1; i >= 0 && recent.size() < ReportedStalls; --i) {
+        const Stall &stall = mRecentStalls[i];
+        QJsonObject obj;
+        obj["wall_clock_ms"] = stall.wallClockMs;
+        obj["duration_ms"] = stall.durationUs / 1000.0;
+        obj["handler"] = stall.handler;
+        obj["game_id"] = stall.gameId;
+        obj["handler_elapsed_ms"] = stall.handlerElapsedUs / 1000.0;
+        obj["stack"] = QJsonArray::fromStringList(stall.stack.mid(0, ReportedFrames));
+        recent.append(obj);
+    }
+
+    // Самые медленные обработчики за окно: по суммарному времени
+    QHash<QString, HandlerStats> byHandler;
+    for (const Stall &slow : mSlowHandlers) {
+        HandlerStats &handler = byHandler[slow.handler];
+        handler.handler = slow.handler;
+        ++handler.count;
+        handler.totalUs += slow.durationUs;
+        handler.maxUs = qMax(handler.maxUs, slow.durationUs);
+    }
+    QVector<HandlerStats> top(byHandler.begin(), byHandler.end());
+    std::sort(top.begin(), top.end(), [](const HandlerStats &a, const HandlerStats &b) { return a.totalUs > b.totalUs; });
+    QJsonArray topHandlers;
+    for (int i = 0; i < top.size() && i < TopHandlers; ++i) {
+        QJsonObject obj;
+        obj["handler"] = top[i].handler;
+        obj["count"] = top[i].count;
+        obj["total_ms"] = top[i].totalUs / 1000.0;
+        obj["max_ms"] = top[i].maxUs / 1000.0;
+        topHandlers.append(obj);
+    }
+
+    QJsonObject stats;
+    stats["threshold_ms"] = mThresholdMs;
+    stats["heartbeats"] = qint64(mHeartbeats);
+    stats["max_lag_ms"] = mMaxLagUs / 1000.0;
+    stats["lag_histogram"] = histogram;
+    stats["stalls"] = qint64(mStalls);
+    stats["recent_stalls"] = recent;
+    stats["slow_handlers"] = mSlowHandlers.size();
+    stats["top_slow_handlers"] = topHandlers;
+    return stats;
+}
@@ -0,0 +1,138 @@
+#ifndef STALLDETECTOR_H
+#define STALLDETECTOR_H
+
+#include <QObject>
+#include <QThread>
+#include <QTimer>
+#include <QMutex>
+#include <QElapsedTimer>
+#include <QByteArrayView>
+#include <QStringList>
+#include <QJsonObject>
+#include <QVector>
+#include "tracer.h"
+
+// Обнаружение зависаний цикла событий основного потока.
+// Сторожевой поток каждые STALL_HEARTBEAT_MS ставит в очередь основного потока «пульс»; задержка
+// его выполнения - лаг цикла событий (гистограмма). Если пульс не выполнен дольше STALL_THRESHOLD_MS,
+// сторож запоминает, какой обработчик сейчас работает (команда, номер игры, метод БД), и снимает
+// стек основного потока (Linux: сигнал + backtrace). Обработчики дольше STALL_SLOW_HANDLER_MS
+// попадают в скользящий список самых медленных.
+class StallDetector : public QObject
+{
+    Q_OBJECT
+
+public:
+    // Обработчик запроса или события основного потока
+    class HandlerScope
+    {
+    public:
+        HandlerScope(QByteArrayView command, int gameId) : mDetector(StallDetector::instance())
+        {
+            if (mDetector) {
+                mDetector->enterHandler(command, gameId);
+            }
+        }
+        ~HandlerScope()
+        {
+            if (mDetector) {
+                mDetector->leaveHandler();
+            }
+        }
+
+    private:
+        StallDetector *mDetector;
+    };
+
+    // Метод DatabaseManager внутри обработчика (name - строковый литерал; в DbWorker не учитывается).
+    // Для трассируемого запроса метод ещё и интервал категории "db"
+    class DbScope
+    {
+    public:
+        explicit DbScope(const char *name) : mSpan(name, "db"), mDetector(StallDetector::instance()), mPrevious(nullptr)
+        {
+            if (mDetector) {
+                mPrevious = mDetector->enterDb(name);
+            }
+        }
+        ~DbScope()
+        {
+            if (mDetector) {
+                mDetector->enterDb(mPrevious);
+            }
+        }
+
+    private:
+        Tracer::Span mSpan;
+        StallDetector *mDetector;
+        const char *mPrevious;
+    };
+
+    explicit StallDetector(QObject *parent = nullptr);
+    ~StallDetector();
+
+    static StallDetector *instance(); // nullptr - обнаружение выключено
+
+    bool start(); // Вызывать из основного потока перед запуском цикла событий
+    QJsonObject stats() const;
+
+private slots:
+    void slotTick(); // Сторожевой поток
+
+private:
+    struct Context {
+        char command[32]; // Тип запроса (обрезается)
+        int gameId;
+        const char *dbMethod;
+        qint64 startedNs; // Начало обработчика по mClock, 0 - обработчика нет
+    };
+
+    struct Stall {
+        qint64 wallClockMs; // Начало зависания, мс Unix
+        qint64 durationUs;
+        QString handler; // "make_move/applyMove"
+        int gameId;
+        qint64 handlerElapsedUs; // Сколько обработчик уже работал в момент обнаружения
+        QStringList stack;
+    };
+
+    struct HandlerStats {
+        QString handler;
+        int count = 0;
+        qint64 totalUs = 0;
+        qint64 maxUs = 0;
+    };
+
+    void enterHandler(QByteArrayView command, int gameId);
+    void leaveHandler();
+    const char *enterDb(const char *name); // Возвращает предыдущий метод
+    void heartbeat(qint64 sentNs); // Основной поток
+    void addSlow(const Context &context, qint64 durationUs); // Вызывать под mMutex
+    static QString handlerName(const Context &context);
+    QStringList captureMainStack(); // Сторожевой поток
+
+    static StallDetector *sInstance;
+
+    int mThresholdMs;
+    int mHeartbeatMs;
+    int mSlowHandlerMs; // Обработчик дольше этого попадает в список медленных
+    int mSlowWindow; // Сколько последних медленных обработчиков учитывать
+    QElapsedTimer mClock;
+    QThread *mThread;
+    QTimer *mTimer; // Живёт в сторожевом потоке
+
+    mutable QMutex mMutex;
+    Context mContext;
+    qint64 mPendingSinceNs; // Пульс в очереди с этого момента, -1 - пульса в очереди нет
+    bool mStallCaptured;
+    Stall mCurrentStall;
+
+    quint64 mHeartbeats;
+    QVector<quint64> mLagHistogram; // Корзины по LagBucketsMs
+    qint64 mMaxLagUs;
+    quint64 mStalls;
+    QVector<Stall> mRecentStalls; // Последние зависания
+    QVector<Stall> mSlowHandlers; // Последние mSlowWindow медленных обработчиков
+};
+
+#endif // STALLDETECTOR_H
@@ -0,0 +1,192 @@
+#include "startup.h"
+#include "mytcpserver.h"
+#include "DatabaseManager.h"
+#include "stalldetector.h"
+#include "dbworker.h"
+#include "sessionhandoff.h"
+#include "tracer.h"
+#include "allocstats.h"
+#include "requestarena.h"
+#include <QCoreApplication>
+#include <QTcpSocket>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QJsonArray>
+#include <QDebug>
+
+StartupSequence::StartupSequence(QObject *parent) : QObject(parent), mHealthServer(nullptr), mServer(nullptr), mHandoff(nullptr), mState(Starting)
+{
+    mUptime.start();
+}
+
+bool StartupSequence::startHealthEndpoint(quint16 port)
+{
+    // Отчёт раскрывает память, пользователей и трассы запросов - по умолчанию только локальным пробам (HEALTH_BIND)
+    QHostAddress address(qEnvironmentVariableIsSet("HEALTH_BIND") ? qEnvironmentVariable("HEALTH_BIND") : QString("127.0.0.1"));
+    if (address.isNull()) {
+        qDebug() << "Health endpoint is NOT started: bad HEALTH_BIND address" << qEnvironmentVariable("HEALTH_BIND");
+        return false;
+    }
+    mHealthServer = new QTcpServer(this);
+    connect(mHealthServer, &QTcpServer::newConnection, this, &StartupSequence::slotHealthConnection);
+    if (!mHealthServer->listen(address, port)) {
+        qDebug() << "Health endpoint is NOT started on port" << port << ":" << mHealthServer->errorString();
+        return false;
+    }
+    qDebug() << "Health endpoint is started on" << address.toString() << "port" << port;
+    return true;
+}
+
+bool StartupSequence::run(MyTcpServer *server, quint16 port)
+{
+    mServer = server;
+    DatabaseManager *db = nullptr;
+    int expectedClients = qEnvironmentVariableIsSet("EXPECTED_CLIENTS") ? qEnvironmentVariableIntValue("EXPECTED_CLIENTS") : 1024;
+    int wsPort = qEnvironmentVariableIsSet("WS_PORT") ? qEnvironmentVariableIntValue("WS_PORT") : 33335; // 0 - без WebSocket
+    QString journalDir = qEnvironmentVariable("MOVE_JOURNAL_DIR"); // Пусто - ходы пишутся прямо в SQLite
+    QString shardLink = qEnvironmentVariable("SHARD_LINK"); // Задаётся маршрутизатором для процессов-шардов
+    QString archiveDir = qEnvironmentVariable("ARCHIVE_DIR"); // Пусто (по умолчанию) - без архивации
+    QString handoffPath = qEnvironmentVariable("HANDOFF_SOCKET"); // Пусто - перезапуск разрывает соединения
+    if (!handoffPath.isEmpty()) {
+        mHandoff = new SessionHandoff(server, mHealthServer, this);
+    }
+
+    bool ok = runPhase("db_open", [&db]() {
+                  db = DatabaseManager::getInstance();
+                  return db->isOpen();
+              })
+              && runPhase("migrations", [&db]() { return db->runMigrations(); })
+              && runPhase("prepare_statements", [&db]() { return db->prepareStatements(); })
+              // Всё, что не требует слушающего сокета, - до передачи сессий: её клиенты ждут только
+              // дочитывания справочника, журнала и архиватора
+              && runPhase("warm_cache", [&db]() { return db->warmCache(); })
+              && runPhase("user_directory", [&db]() { return db->loadUsers(); })
+              && runPhase("server_warmup", [server, expectedClients]() { return server->warmUp(expectedClients); })
+              // Сессии работающего сервера забираются до чтения журнала: он пишет его до самого выхода
+              && (!mHandoff || runPhase("handoff", [this, handoffPath]() { return mHandoff->takeOver(handoffPath); }))
+              && (!mHandoff || runPhase("user_directory_catchup", [&db]() { return db->loadNewUsers(); }))
+              && (journalDir.isEmpty() || runPhase("journal_replay", [&db, journalDir]() { return db->openJournal(journalDir); }))
+              // Архиватор - после передачи: два архиватора на одной БД не запускаются
+              && (archiveDir.isEmpty() || runPhase("archiver", [&db, archiveDir]() { return db->startArchiver(archiveDir); }))
+              && (mHandoff && mHandoff->hasSession() ? runPhase("restore_sessions", [this]() { return mHandoff->restore(); })
+                                                     : runPhase("listen", [server, port]() { return server->startListening(port); }));
+    if (ok && wsPort > 0 && !server->isWebSocketListening()) {
+        ok = runPhase("listen_websocket", [server, wsPort]() { return server->startWebSocketListening(quint16(wsPort)); });
+    }
+    // Шард объявляет о готовности маршрутизатору последним: до этого клиенты к нему не направляются
+    if (ok && !shardLink.isEmpty()) {
+        ok = runPhase("router_link", [server, shardLink]() {
+            return server->connectShardLink(shardLink, qEnvironmentVariableIntValue("SHARD_INDEX"));
+        });
+    }
+    // Следующий перезапуск заберёт сессии уже у этого процесса
+    if (ok && mHandoff) {
+        ok = runPhase("handoff_listen", [this, handoffPath]() { return mHandoff->listen(handoffPath); });
+    }
+
+    mState = ok ? Ready : Failed;
+    qDebug() << "Startup" << (ok ? "completed" : "FAILED") << "in" << mUptime.elapsed() << "ms:" << statusJson();
+    return ok;
+}
+
+StartupSequence::State StartupSequence::state() const
+{
+    return mState;
+}
+
+QByteArray StartupSequence::statusJson() const
+{
+    QJsonArray phases;
+    for (const Phase &phase : mPhases) {
+        QJsonObject obj;
+        obj["name"] = phase.name;
+        obj["elapsed_us"] = phase.elapsedUs;
+        obj["ok"] = phase.ok;
+        phases.append(obj);
+    }
+
+    QJsonObject status;
+    status["state"] = stateName(mState);
+    status["uptime_ms"] = mUptime.elapsed();
+    status["phases"] = phases;
+    if (mServer && mState == Ready) {
+        status["load_shedding"] = mServer->getLoadSheddingStats();
+        QJsonObject journal = DatabaseManager::getInstance()->journalStats();
+        if (!journal.isEmpty()) {
+            status["journal"] = journal;
+        }
+        if (StallDetector *stallDetector = StallDetector::instance()) {
+            status["event_loop"] = stallDetector->stats();
+        }
+        if (DbWorker *dbWorker = DbWorker::instance()) {
+            status["db_worker"] = dbWorker->stats();
+        }
+        status["memory"] = mServer->getMemoryReport();
+        QJsonObject transport = mServer->getTransportStats();
+        if (!transport.isEmpty()) {
+            status["transport"] = transport;
+        }
+        QJsonObject shard = mServer->getShardStats();
+        if (!shard.isEmpty()) {
+            status["shard"] = shard;
+        }
+        QJsonObject archive = DatabaseManager::getInstance()->archiveStats();
+        if (!archive.isEmpty()) {
+            status["archive"] = archive;
+        }
+        if (mHandoff) {
+            status["handoff"] = mHandoff->stats();
+        }
+        status["users"] = DatabaseManager::getInstance()->userStats();
+        status["trace"] = Tracer::stats();
+        status["allocations"] = AllocStats::stats();
+        status["request_arena"] = RequestArena::stats();
+    }
+    return QJsonDocument(status).toJson(QJsonDocument::Compact);
+}
+
+void StartupSequence::slotHealthConnection()
+{
+    while (QTcpSocket *socket = mHealthServer->nextPendingConnection()) {
+        connect(socket, &QTcpSocket::disconnected, socket, &QTcpSocket::deleteLater);
+        // Отвечаем после получения запроса; по GET /trace - трасса запросов, иначе - состояние запуска
+        connect(socket, &QTcpSocket::readyRead, this, [this, socket]() {
+            QByteArray request = socket->readAll();
+            bool trace = request.startsWith("GET /trace ");
+            QByteArray body = trace ? Tracer::exportJson() : statusJson();
+            QByteArray response = (trace || mState == Ready ? "HTTP/1.1 200 OK\r\n" : "HTTP/1.1 503 Service Unavailable\r\n");
+            response += "Content-Type: application/json\r\n";
+            response += "Content-Length: " + QByteArray::number(body.size()) + "\r\n";
+            response += "Connection: close\r\n\r\n";
+            response += body;
+            socket->write(response);
+            socket->disconnectFromHost();
+        });
+    }
+}
+
+bool StartupSequence::runPhase(const QString &name, const std::function<bool()> &phase)
+{
+    QElapsedTimer timer;
+    timer.start();
+    bool ok = phase();
+    qint64 elapsedUs = timer.nsecsElapsed() / 1000;
+    mPhases.append(Phase{name, elapsedUs, ok});
+    qDebug() << "Startup phase" << name << (ok ? "done" : "FAILED") << "in" << elapsedUs << "us";
+
+    // Даём ответить на опросы готовности между этапами
+    QCoreApplication::processEvents();
+    return ok;
+}
+
+QString StartupSequence::stateName(State state)
+{
+    switch (state) {
+    case Ready:
+        return "ready";
+    case Failed:
+        return "failed";
+    default:
+        return "starting";
+    }
+}
@@ -0,0 +1,55 @@
+#ifndef STARTUP_H
+#define STARTUP_H
+
+#include <QObject>
+#include <QTcpServer>
+#include <QElapsedTimer>
+#include <QVector>
+#include <functional>
+
+class MyTcpServer;
+class SessionHandoff;
+
+// Явная последовательность запуска сервера: БД открывается и прогревается,
+// и только после этого начинается приём клиентов. Время каждого этапа и
+// состояние готовности отдаются по HTTP на отдельном порту (для оркестратора).
+class StartupSequence : public QObject
+{
+    Q_OBJECT
+
+public:
+    enum State {
+        Starting,
+        Ready,
+        Failed
+    };
+
+    struct Phase {
+        QString name;
+        qint64 elapsedUs;
+        bool ok;
+    };
+
+    explicit StartupSequence(QObject *parent = nullptr);
+
+    bool startHealthEndpoint(quint16 port); // GET на порт: 200 - готов, 503 - запуск или ошибка
+    bool run(MyTcpServer *server, quint16 port); // Выполнить все этапы и начать приём клиентов
+    State state() const;
+    QByteArray statusJson() const;
+
+private slots:
+    void slotHealthConnection();
+
+private:
+    bool runPhase(const QString &name, const std::function<bool()> &phase);
+    static QString stateName(State state);
+
+    QTcpServer *mHealthServer;
+    MyTcpServer *mServer;
+    SessionHandoff *mHandoff; // nullptr - HANDOFF_SOCKET не задан
+    State mState;
+    QVector<Phase> mPhases;
+    QElapsedTimer mUptime;
+};
+
+#endif // STARTUP_H
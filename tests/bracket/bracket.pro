@@ -0,0 +1,11 @@
+include(../tests.pri)
+include(../database.pri)
+
+TARGET = tst_bracket
+
+SOURCES += \
+    $$SERVER_DIR/tournamentscheduler.cpp \
+    tst_bracket.cpp
+
+HEADERS += \
+    $$SERVER_DIR/tournamentscheduler.h
@@ -0,0 +1,173 @@
+#include <QtTest>
+#include <QSignalSpy>
+#include <QTemporaryDir>
+#include <QJsonArray>
+#include "DatabaseManager.h"
+#include "tournamentscheduler.h"
+#include "gamemode.h"
+
+// Сетка олимпийской системы: стандартная расстановка посевов, свободные проходы старших посевов
+// при неполной сетке и переход победителей в следующий тур до финала
+class BracketTest : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void initTestCase();
+    void fullBracketSeeding();
+    void byesForMissingSeeds();
+    void byeOnlyInFirstRound();
+    void rejectsTooFewPlayers();
+    void rejectsUnknownWinner();
+
+private:
+    static QStringList seeds(int count); // p1..pN в порядке посева
+    static QVector<TournamentScheduler::Match> takeAll(TournamentScheduler &scheduler);
+    static QStringList pairs(const QVector<TournamentScheduler::Match> &matches); // "p1-p8" по порядку сетки
+
+    QTemporaryDir mDir;
+};
+
+void BracketTest::initTestCase()
+{
+    // DatabaseManager открывает server_db.sqlite в текущем каталоге
+    QVERIFY(mDir.isValid());
+    QVERIFY(QDir::setCurrent(mDir.path()));
+    DatabaseManager *db = DatabaseManager::getInstance();
+    QVERIFY(db->isOpen());
+    QVERIFY(db->runMigrations());
+    QVERIFY(db->prepareStatements());
+}
+
+void BracketTest::fullBracketSeeding()
+{
+    TournamentScheduler scheduler;
+    QSignalSpy finished(&scheduler, &TournamentScheduler::finished);
+    QVERIFY(scheduler.create(TournamentScheduler::SingleElimination, seeds(8), GameMode::classic(), 0));
+    QCOMPARE(scheduler.stats().value("rounds").toInt(), 3);
+
+    // Первый и второй посевы встречаются только в финале
+    QVector<TournamentScheduler::Match> round = takeAll(scheduler);
+    QCOMPARE(pairs(round), QStringList({"p1-p8", "p4-p5", "p2-p7", "p3-p6"}));
+    for (const TournamentScheduler::Match &match : round) {
+        QVERIFY(scheduler.gameFinished(match.gameId, match.player1));
+    }
+
+    round = takeAll(scheduler);
+    QCOMPARE(pairs(round), QStringList({"p1-p4", "p2-p3"}));
+    for (const TournamentScheduler::Match &match : round) {
+        QVERIFY(scheduler.gameFinished(match.gameId, match.player1));
+    }
+
+    round = takeAll(scheduler);
+    QCOMPARE(pairs(round), QStringList({"p1-p2"}));
+    QCOMPARE(finished.count(), 0);
+    QVERIFY(scheduler.gameFinished(round.first().gameId, round.first().player2));
+    QCOMPARE(finished.count(), 1);
+    QCOMPARE(finished.first().first().toString(), QString("p2"));
+    QVERIFY(!scheduler.isRunning());
+    QVERIFY(!scheduler.hasQueuedMatches());
+}
+
+void BracketTest::byesForMissingSeeds()
+{
+    // Пять игроков - сетка на восемь: посевы 1-3 проходят первый тур без игры, играют только 4 и 5
+    TournamentScheduler scheduler;
+    QVERIFY(scheduler.create(TournamentScheduler::SingleElimination, seeds(5), GameMode::classic(), 0));
+    QCOMPARE(scheduler.stats().value("round_games").toInt(), 1);
+
+    QJsonObject status = DatabaseManager::getInstance()->tournamentStatus(scheduler.tournamentId());
+    QJsonArray matches = status["matches"].toArray();
+    QCOMPARE(matches.size(), 4);
+    QCOMPARE(status["finished"].toInt(), 3);
+    QCOMPARE(status["queued"].toInt(), 1);
+    QStringList byes;
+    for (const QJsonValue &value : matches) {
+        QJsonObject match = value.toObject();
+        if (match["game_id"].toInt() == -1) {
+            QCOMPARE(match["winner"].toString(), match["player1"].toString());
+            byes << match["player1"].toString();
+        }
+    }
+    QCOMPARE(byes, QStringList({"p1", "p2", "p3"}));
+
+    QVector<TournamentScheduler::Match> round = takeAll(scheduler);
+    QCOMPARE(pairs(round), QStringList({"p4-p5"}));
+    status = DatabaseManager::getInstance()->tournamentStatus(scheduler.tournamentId());
+    QCOMPARE(status["queued"].toInt(), 0);
+    QVERIFY(scheduler.gameFinished(round.first().gameId, "p5"));
+
+    // Победитель занимает место своей пары: p5 выходит на первый посев
+    round = takeAll(scheduler);
+    QCOMPARE(pairs(round), QStringList({"p1-p5", "p2-p3"}));
+    QCOMPARE(scheduler.stats().value("round").toInt(), 2);
+}
+
+void BracketTest::byeOnlyInFirstRound()
+{
+    // Три игрока: проход у первого посева, дальше сетка полная
+    TournamentScheduler scheduler;
+    QSignalSpy finished(&scheduler, &TournamentScheduler::finished);
+    QVERIFY(scheduler.create(TournamentScheduler::SingleElimination, seeds(3), GameMode::classic(), 0));
+
+    QVector<TournamentScheduler::Match> round = takeAll(scheduler);
+    QCOMPARE(pairs(round), QStringList({"p2-p3"}));
+    QVERIFY(scheduler.gameFinished(round.first().gameId, "p3"));
+
+    round = takeAll(scheduler);
+    QCOMPARE(pairs(round), QStringList({"p1-p3"}));
+    QVERIFY(scheduler.gameFinished(round.first().gameId, "p1"));
+    QCOMPARE(finished.count(), 1);
+    QCOMPARE(finished.first().first().toString(), QString("p1"));
+}
+
+void BracketTest::rejectsTooFewPlayers()
+{
+    // Повторы и пустые ники отбрасываются до проверки числа участников
+    TournamentScheduler scheduler;
+    QVERIFY(!scheduler.create(TournamentScheduler::SingleElimination, QStringList({"p1", "p1", ""}), GameMode::classic(), 0));
+    QVERIFY(!scheduler.isRunning());
+}
+
+void BracketTest::rejectsUnknownWinner()
+{
+    TournamentScheduler scheduler;
+    QVERIFY(scheduler.create(TournamentScheduler::SingleElimination, seeds(2), GameMode::classic(), 0));
+    QVector<TournamentScheduler::Match> round = takeAll(scheduler);
+    QCOMPARE(pairs(round), QStringList({"p1-p2"}));
+    QVERIFY(!scheduler.gameFinished(round.first().gameId, "p3"));
+    QVERIFY(!scheduler.gameFinished(round.first().gameId + 1000, "p1"));
+    QVERIFY(scheduler.isRunning());
+}
+
+QStringList BracketTest::seeds(int count)
+{
+    QStringList players;
+    for (int i = 1; i <= count; ++i) {
+        players << QString("p%1").arg(i);
+    }
+    return players;
+}
+
+QVector<TournamentScheduler::Match> BracketTest::takeAll(TournamentScheduler &scheduler)
+{
+    QVector<TournamentScheduler::Match> matches;
+    TournamentScheduler::Match match;
+    while (scheduler.takeMatch(&match, 0)) {
+        matches.append(match);
+    }
+    return matches;
+}
+
+QStringList BracketTest::pairs(const QVector<TournamentScheduler::Match> &matches)
+{
+    QStringList result;
+    for (const TournamentScheduler::Match &match : matches) {
+        result << match.player1 + "-" + match.player2;
+    }
+    return result;
+}
+
+QTEST_GUILESS_MAIN(BracketTest)
+
+#include "tst_bracket.moc"
@@ -0,0 +1,25 @@
+# DatabaseManager и всё, что он подключает: для тестов, которым нужна настоящая схема SQLite
+QT += sql
+
+SOURCES += \
+    $$SERVER_DIR/DatabaseManager.cpp \
+    $$SERVER_DIR/gamearchiver.cpp \
+    $$SERVER_DIR/gamemode.cpp \
+    $$SERVER_DIR/leaderboard.cpp \
+    $$SERVER_DIR/movejournal.cpp \
+    $$SERVER_DIR/stalldetector.cpp \
+    $$SERVER_DIR/tracer.cpp \
+    $$SERVER_DIR/userdirectory.cpp
+
+HEADERS += \
+    $$SERVER_DIR/DatabaseManager.h \
+    $$SERVER_DIR/boardkernel.h \
+    $$SERVER_DIR/cpufeatures.h \
+    $$SERVER_DIR/gamearchiver.h \
+    $$SERVER_DIR/gamemode.h \
+    $$SERVER_DIR/leaderboard.h \
+    $$SERVER_DIR/movejournal.h \
+    $$SERVER_DIR/objectpool.h \
+    $$SERVER_DIR/stalldetector.h \
+    $$SERVER_DIR/tracer.h \
+    $$SERVER_DIR/userdirectory.h
@@ -0,0 +1,7 @@
+include(../tests.pri)
+include(../database.pri)
+
+TARGET = tst_journal
+
+SOURCES += \
+    tst_journal.cpp
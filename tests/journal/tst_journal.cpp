@@ -0,0 +1,209 @@
+#include <QtTest>
+#include <QTemporaryDir>
+#include <QSqlQuery>
+#include "DatabaseManager.h"
+#include "movejournal.h"
+#include "gamemode.h"
+
+// Журнал ходов после сбоя: незакрытый сегмент переносится в SQLite при запуске,
+// а повторный перенос уже применённых записей (сбой между commit и удалением сегмента) ничего не дублирует
+class JournalTest : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void initTestCase();
+    void replayAfterCrash();
+    void replayTwiceIsIdempotent();
+    void sequenceContinuesAfterReplay();
+    void incompleteBatchIsDropped();
+
+private:
+    static JournalRecord ship(int gameId, int player, int x, int y, int size, bool horizontal);
+    static JournalRecord move(int gameId, int player, int x, int y, int status);
+    QStringList activeSegments() const;
+    int moveCount() const;
+    int fleetSize(const QString &player) const;
+    QString currentTurn() const;
+    quint32 appliedSequence() const;
+
+    QTemporaryDir mDir;
+    QString mJournalDir;
+    QString mCrashedSegment; // Копия сегмента до первого переноса
+    int mGameId = -1;
+};
+
+void JournalTest::initTestCase()
+{
+    // DatabaseManager открывает server_db.sqlite в текущем каталоге
+    QVERIFY(mDir.isValid());
+    QVERIFY(QDir::setCurrent(mDir.path()));
+    DatabaseManager *db = DatabaseManager::getInstance();
+    QVERIFY(db->isOpen());
+    QVERIFY(db->runMigrations());
+    QVERIFY(db->prepareStatements());
+
+    mGameId = db->createGame("alice", "bob", GameMode::classic());
+    QVERIFY(mGameId != -1);
+    mJournalDir = mDir.filePath("journal");
+    mCrashedSegment = mDir.filePath("crashed.seg");
+}
+
+void JournalTest::replayAfterCrash()
+{
+    QSqlDatabase db = DatabaseManager::getInstance()->getDatabase();
+    {
+        MoveJournal journal(mJournalDir, db.databaseName());
+        QVERIFY(journal.replay(db));
+        QVERIFY(journal.append(ship(mGameId, 0, 0, 0, 4, true)));
+        QVERIFY(journal.append(ship(mGameId, 1, 2, 2, 3, false)));
+        QVERIFY(journal.append(move(mGameId, 0, 5, 5, 0))); // Промах: ход переходит к bob
+        const JournalRecord salvo[] = {move(mGameId, 1, 0, 0, 1), move(mGameId, 1, 1, 0, 2)};
+        QVERIFY(journal.append(salvo, 2));
+        QCOMPARE(journal.lastSequence(), quint32(5));
+        // Сбой: компактор не запущен, сегмент остаётся незакрытым на диске
+    }
+
+    QStringList segments = activeSegments();
+    QCOMPARE(segments.size(), 1);
+    QVERIFY(QFile::copy(QDir(mJournalDir).filePath(segments.first()), mCrashedSegment));
+    QCOMPARE(moveCount(), 0);
+
+    MoveJournal recovered(mJournalDir, db.databaseName());
+    QVERIFY(recovered.replay(db));
+    QCOMPARE(moveCount(), 3);
+    QCOMPARE(fleetSize("alice"), 1);
+    QCOMPARE(fleetSize("bob"), 1);
+    QCOMPARE(currentTurn(), QString("bob"));
+    QCOMPARE(appliedSequence(), quint32(5));
+    QCOMPARE(recovered.lastSequence(), quint32(5));
+    QVERIFY(activeSegments().isEmpty());
+}
+
+void JournalTest::replayTwiceIsIdempotent()
+{
+    // Сбой после commit переноса, но до удаления сегмента: тот же сегмент снова на диске
+    QVERIFY(QFile::copy(mCrashedSegment, QDir(mJournalDir).filePath("moves-00000099.seg")));
+
+    QSqlDatabase db = DatabaseManager::getInstance()->getDatabase();
+    MoveJournal journal(mJournalDir, db.databaseName());
+    QVERIFY(journal.replay(db));
+    QCOMPARE(moveCount(), 3);
+    QCOMPARE(fleetSize("alice"), 1);
+    QCOMPARE(fleetSize("bob"), 1);
+    QCOMPARE(currentTurn(), QString("bob"));
+    QCOMPARE(appliedSequence(), quint32(5));
+}
+
+void JournalTest::sequenceContinuesAfterReplay()
+{
+    // Сегменты уже удалены: нумерация продолжается от JournalState, иначе новые записи сочли бы применёнными
+    QSqlDatabase db = DatabaseManager::getInstance()->getDatabase();
+    {
+        MoveJournal journal(mJournalDir, db.databaseName());
+        QVERIFY(journal.replay(db));
+        QCOMPARE(journal.lastSequence(), quint32(5));
+        QVERIFY(journal.append(move(mGameId, 1, 2, 0, 0)));
+        QCOMPARE(journal.lastSequence(), quint32(6));
+    }
+
+    MoveJournal recovered(mJournalDir, db.databaseName());
+    QVERIFY(recovered.replay(db));
+    QCOMPARE(moveCount(), 4);
+    QCOMPARE(currentTurn(), QString("alice"));
+    QCOMPARE(appliedSequence(), quint32(6));
+}
+
+void JournalTest::incompleteBatchIsDropped()
+{
+    QSqlDatabase db = DatabaseManager::getInstance()->getDatabase();
+    {
+        MoveJournal journal(mJournalDir, db.databaseName());
+        QVERIFY(journal.replay(db));
+        QVERIFY(journal.append(move(mGameId, 0, 3, 3, 1)));
+        const JournalRecord salvo[] = {move(mGameId, 0, 4, 3, 1), move(mGameId, 0, 5, 3, 1), move(mGameId, 0, 6, 3, 0)};
+        QVERIFY(journal.append(salvo, 3));
+    }
+
+    // Последняя запись залпа не дописана до сбоя: весь залп отбрасывается, предыдущий ход - нет
+    QStringList segments = activeSegments();
+    QCOMPARE(segments.size(), 1);
+    QFile file(QDir(mJournalDir).filePath(segments.first()));
+    QVERIFY(file.open(QIODevice::ReadWrite));
+    QVERIFY(file.seek(3 * qint64(sizeof(JournalRecord))));
+    QCOMPARE(file.write(QByteArray(sizeof(JournalRecord), '\0')), qint64(sizeof(JournalRecord)));
+    file.close();
+
+    MoveJournal recovered(mJournalDir, db.databaseName());
+    QVERIFY(recovered.replay(db));
+    QCOMPARE(moveCount(), 5);
+    QCOMPARE(currentTurn(), QString("alice"));
+    QCOMPARE(appliedSequence(), quint32(7));
+}
+
+JournalRecord JournalTest::ship(int gameId, int player, int x, int y, int size, bool horizontal)
+{
+    JournalRecord record = {};
+    record.gameId = gameId;
+    record.type = JournalRecord::Ship;
+    record.player = quint8(player);
+    record.x = quint8(x);
+    record.y = quint8(y);
+    record.size = quint8(size);
+    record.value = horizontal ? 1 : 0;
+    return record;
+}
+
+JournalRecord JournalTest::move(int gameId, int player, int x, int y, int status)
+{
+    JournalRecord record = {};
+    record.gameId = gameId;
+    record.type = JournalRecord::Move;
+    record.player = quint8(player);
+    record.x = quint8(x);
+    record.y = quint8(y);
+    record.value = quint8(status); // MoveResult::Status: 0 - промах, 1 - попадание, 2 - потоплен
+    return record;
+}
+
+QStringList JournalTest::activeSegments() const
+{
+    return QDir(mJournalDir).entryList(QStringList() << "moves-*.seg", QDir::Files, QDir::Name);
+}
+
+int JournalTest::moveCount() const
+{
+    QSqlQuery query(DatabaseManager::getInstance()->getDatabase());
+    query.prepare("SELECT COUNT(*) FROM Move WHERE game_id = :game_id");
+    query.bindValue(":game_id", mGameId);
+    return query.exec() && query.next() ? query.value(0).toInt() : -1;
+}
+
+int JournalTest::fleetSize(const QString &player) const
+{
+    QSqlQuery query(DatabaseManager::getInstance()->getDatabase());
+    query.prepare("SELECT ships FROM Fleet WHERE game_id = :game_id AND player = :player");
+    query.bindValue(":game_id", mGameId);
+    query.bindValue(":player", player);
+    return query.exec() && query.next() ? DatabaseManager::decodeFleet(query.value(0).toByteArray()).size() : 0;
+}
+
+QString JournalTest::currentTurn() const
+{
+    QSqlQuery query(DatabaseManager::getInstance()->getDatabase());
+    query.prepare("SELECT current_turn FROM Game WHERE game_id = :game_id");
+    query.bindValue(":game_id", mGameId);
+    return query.exec() && query.next() ? query.value(0).toString() : QString();
+}
+
+quint32 JournalTest::appliedSequence() const
+{
+    QSqlDatabase db = DatabaseManager::getInstance()->getDatabase();
+    bool ok = false;
+    quint32 applied = JournalCompactor::appliedSequence(db, &ok);
+    return ok ? applied : 0;
+}
+
+QTEST_GUILESS_MAIN(JournalTest)
+
+#include "tst_journal.moc"
@@ -0,0 +1,10 @@
+include(../tests.pri)
+
+TARGET = tst_kernels
+
+SOURCES += \
+    tst_kernels.cpp
+
+HEADERS += \
+    $$SERVER_DIR/boardkernel.h \
+    $$SERVER_DIR/cpufeatures.h
@@ -0,0 +1,138 @@
+#include <QtTest>
+#include <QRandomGenerator>
+#include "boardkernel.h"
+
+// Ядра доски: специализации по размеру (SSE2, если он есть в сборке) и ядра AVX2 (если он есть у процессора)
+// на случайных досках дают те же ответы и те же биты, что скалярное обобщённое ядро
+class KernelsTest : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void classicBoard();
+    void largeBoard();
+    void hugeBoard();
+    void largeBoardAvx2();
+    void hugeBoardAvx2();
+
+private:
+    static const int Iterations = 2000;
+
+    template<typename Kernel>
+    static void compareWithGeneric(const Kernel &kernel);
+    static void randomBoard(const GenericBoardKernel &generic, BoardBits &bits, QRandomGenerator &rng);
+    static QByteArray bytes(const BoardBits &bits);
+};
+
+void KernelsTest::classicBoard()
+{
+    compareWithGeneric(BoardKernel<10>());
+}
+
+void KernelsTest::largeBoard()
+{
+    compareWithGeneric(BoardKernel<16>());
+}
+
+void KernelsTest::hugeBoard()
+{
+    compareWithGeneric(BoardKernel<32>());
+}
+
+void KernelsTest::largeBoardAvx2()
+{
+#if defined(CPU_AVX2_SUPPORTED)
+    if (!cpuHasAvx2()) {
+        QSKIP("CPU has no AVX2");
+    }
+    compareWithGeneric(BoardKernelAvx2<16>());
+#else
+    QSKIP("AVX2 kernels are not built for this compiler");
+#endif
+}
+
+void KernelsTest::hugeBoardAvx2()
+{
+#if defined(CPU_AVX2_SUPPORTED)
+    if (!cpuHasAvx2()) {
+        QSKIP("CPU has no AVX2");
+    }
+    compareWithGeneric(BoardKernelAvx2<32>());
+#else
+    QSKIP("AVX2 kernels are not built for this compiler");
+#endif
+}
+
+template<typename Kernel>
+void KernelsTest::compareWithGeneric(const Kernel &kernel)
+{
+    const int size = kernel.size();
+    const GenericBoardKernel generic(size);
+    QRandomGenerator rng(quint32(size));
+
+    for (int i = 0; i < Iterations; ++i) {
+        BoardBits a;
+        BoardBits b;
+        randomBoard(generic, a, rng);
+        randomBoard(generic, b, rng);
+
+        // Прямоугольник (ореол корабля) может выходить за края доски
+        int x0 = int(rng.bounded(size + 2)) - 1;
+        int y0 = int(rng.bounded(size + 2)) - 1;
+        int x1 = x0 + int(rng.bounded(7));
+        int y1 = y0 + int(rng.bounded(7));
+        BoardBits rect;
+        BoardBits genericRect;
+        kernel.setRect(rect, x0, y0, x1, y1);
+        generic.setRect(genericRect, x0, y0, x1, y1);
+        QCOMPARE(bytes(rect), bytes(genericRect));
+
+        QCOMPARE(kernel.intersects(a, b), generic.intersects(a, b));
+        QCOMPARE(kernel.intersects(a, rect), generic.intersects(a, rect));
+        QCOMPARE(kernel.isSubset(a, b), generic.isSubset(a, b));
+        QCOMPARE(kernel.isSubset(rect, a), generic.isSubset(rect, a));
+
+        BoardBits united = a;
+        BoardBits genericUnited = a;
+        kernel.unite(united, b);
+        generic.unite(genericUnited, b);
+        QCOMPARE(bytes(united), bytes(genericUnited));
+        QVERIFY(kernel.isSubset(a, united));
+        QVERIFY(kernel.isSubset(b, united));
+
+        BoardBits common = a;
+        BoardBits genericCommon = a;
+        kernel.intersect(common, b);
+        generic.intersect(genericCommon, b);
+        QCOMPARE(bytes(common), bytes(genericCommon));
+
+        for (int y = 0; y < size; ++y) {
+            for (int x = 0; x < size; ++x) {
+                QCOMPARE(kernel.test(a, x, y), generic.test(a, x, y));
+            }
+        }
+    }
+}
+
+void KernelsTest::randomBoard(const GenericBoardKernel &generic, BoardBits &bits, QRandomGenerator &rng)
+{
+    // Плотность от пустой доски до почти полной: пересечения встречаются и не встречаются
+    int size = generic.size();
+    quint32 percent = rng.bounded(101);
+    for (int y = 0; y < size; ++y) {
+        for (int x = 0; x < size; ++x) {
+            if (rng.bounded(100u) < percent) {
+                generic.set(bits, x, y);
+            }
+        }
+    }
+}
+
+QByteArray KernelsTest::bytes(const BoardBits &bits)
+{
+    return QByteArray(reinterpret_cast<const char*>(bits.words), sizeof(bits.words)).toHex();
+}
+
+QTEST_GUILESS_MAIN(KernelsTest)
+
+#include "tst_kernels.moc"
@@ -0,0 +1,11 @@
+include(../tests.pri)
+
+TARGET = tst_scanner
+
+SOURCES += \
+    $$SERVER_DIR/requestscanner.cpp \
+    tst_scanner.cpp
+
+HEADERS += \
+    $$SERVER_DIR/cpufeatures.h \
+    $$SERVER_DIR/requestscanner.h
@@ -0,0 +1,115 @@
+#include <QtTest>
+#include "requestscanner.h"
+
+// Сканер запросов против QJsonDocument: принятый сканером запрос должен разбираться поле в поле так же,
+// а отвергнутый - уходить на общий разбор без потерь (decodeRequest)
+class ScannerTest : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void matchesJson_data();
+    void matchesJson();
+    void fuzz_data();
+    void fuzz();
+
+private:
+    static void compareRequests(const ScannedRequest &actual, const ScannedRequest &expected);
+};
+
+void ScannerTest::matchesJson_data()
+{
+    QTest::addColumn<QByteArray>("input");
+    QTest::addColumn<bool>("fastPath"); // Разбирается сканером без QJsonDocument
+
+    QTest::newRow("register") << QByteArray("{\"type\":\"register\",\"nickname\":\"alice\",\"email\":\"alice@example.com\","
+                                            "\"password\":\"secret\"}") << true;
+    QTest::newRow("place_ship") << QByteArray("{\"type\":\"place_ship\",\"nickname\":\"alice\",\"game_id\":17,\"x\":3,\"y\":4,"
+                                              "\"size\":2,\"is_horizontal\":true}") << true;
+    QTest::newRow("vertical ship") << QByteArray("{\"type\":\"place_ship\",\"is_horizontal\":false,\"size\":4}") << true;
+    QTest::newRow("whitespace and CRLF")
+        << QByteArray(" { \"type\" : \"make_move\" ,\t\"game_id\" : -1 , \"x\" : 0 , \"y\" : 10 }\r\n") << true;
+    QTest::newRow("utf-8 nickname") << QByteArray("{\"type\":\"start_game\",\"nickname\":\"\xd0\xb8\xd0\xb3\xd1\x80\xd0\xbe\xd0\xba\"}")
+                                    << true;
+    QTest::newRow("nickname across SIMD blocks")
+        << QByteArray("{\"type\":\"leaderboard\",\"nickname\":\"a-rather-long-nickname-that-crosses-several-32-byte-blocks-"
+                      "\xe2\x82\xac-and-ends-here\"}") << true;
+    QTest::newRow("int limits") << QByteArray("{\"game_id\":2147483647,\"x\":-2147483648,\"y\":0}") << true;
+    QTest::newRow("empty object") << QByteArray("{}") << true;
+
+    QTest::newRow("escaped key") << QByteArray("{\"type\":\"login\",\"nickname\":\"alice\",\"pass\\u0077ord\":\"secret\"}") << false;
+    QTest::newRow("escaped value") << QByteArray("{\"type\":\"login\",\"nickname\":\"ali\\\"ce\"}") << false;
+    QTest::newRow("unknown field") << QByteArray("{\"type\":\"login\",\"extra\":1}") << false;
+    QTest::newRow("duplicate field") << QByteArray("{\"nickname\":\"alice\",\"nickname\":\"bob\"}") << false;
+    QTest::newRow("fraction") << QByteArray("{\"type\":\"make_move\",\"x\":1.5}") << false;
+    QTest::newRow("exponent") << QByteArray("{\"type\":\"make_move\",\"x\":1e3}") << false;
+    QTest::newRow("int overflow") << QByteArray("{\"game_id\":2147483648}") << false;
+    QTest::newRow("leading zero") << QByteArray("{\"game_id\":017}") << false;
+    QTest::newRow("string for number") << QByteArray("{\"game_id\":\"17\"}") << false;
+    QTest::newRow("null value") << QByteArray("{\"nickname\":null}") << false;
+    QTest::newRow("control character") << QByteArray("{\"nickname\":\"a\x01" "b\"}") << false;
+    QTest::newRow("invalid utf-8") << QByteArray("{\"nickname\":\"a\xff" "b\"}") << false;
+    QTest::newRow("trailing garbage") << QByteArray("{\"type\":\"login\"}x") << false;
+    QTest::newRow("not an object") << QByteArray("[1]") << false;
+}
+
+void ScannerTest::matchesJson()
+{
+    QFETCH(QByteArray, input);
+    QFETCH(bool, fastPath);
+
+    ScannedRequest expected;
+    bool json = decodeRequestJson(input, expected);
+
+    ScannedRequest scanned;
+    QCOMPARE(scanRequest(input, scanned), fastPath);
+    if (fastPath) {
+        QVERIFY(json);
+        compareRequests(scanned, expected);
+        if (QTest::currentTestFailed()) {
+            return;
+        }
+    }
+
+    // Полный путь сервера: сканер, а при отказе - тот же разбор QJsonDocument
+    ScannedRequest decoded;
+    QCOMPARE(decodeRequest(input, decoded), json);
+    QCOMPARE(decoded.fastPath, fastPath);
+    if (json) {
+        compareRequests(decoded, expected);
+    }
+}
+
+void ScannerTest::fuzz_data()
+{
+    QTest::addColumn<quint32>("seed");
+
+    QTest::newRow("seed 1") << quint32(1);
+    QTest::newRow("seed 2") << quint32(2);
+    QTest::newRow("seed 0x5eed") << quint32(0x5eed);
+}
+
+void ScannerTest::fuzz()
+{
+    // Мутации типовых запросов; каждый принятый сканером вход проверяется и на пути AVX2 (если он есть), и на SSE2
+    QFETCH(quint32, seed);
+    QVERIFY(fuzzRequestScanner(20000, seed));
+}
+
+void ScannerTest::compareRequests(const ScannedRequest &actual, const ScannedRequest &expected)
+{
+    QCOMPARE(actual.fields, expected.fields);
+    QCOMPARE(actual.type.toByteArray(), expected.type.toByteArray());
+    QCOMPARE(actual.nickname.toByteArray(), expected.nickname.toByteArray());
+    QCOMPARE(actual.email.toByteArray(), expected.email.toByteArray());
+    QCOMPARE(actual.password.toByteArray(), expected.password.toByteArray());
+    QCOMPARE(actual.gameId, expected.gameId);
+    QCOMPARE(actual.x, expected.x);
+    QCOMPARE(actual.y, expected.y);
+    QCOMPARE(actual.size, expected.size);
+    QCOMPARE(actual.isHorizontal, expected.isHorizontal);
+}
+
+QTEST_GUILESS_MAIN(ScannerTest)
+
+#include "tst_scanner.moc"
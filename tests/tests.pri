@@ -0,0 +1,12 @@
+# Общие настройки тестов: исходники сервера берутся из корня репозитория, а не копируются
+QT -= gui
+QT += testlib
+
+CONFIG += c++20 console testcase
+CONFIG -= app_bundle
+
+DEFINES += QT_DEPRECATED_WARNINGS
+
+SERVER_DIR = $$PWD/..
+INCLUDEPATH += $$SERVER_DIR
+DEPENDPATH += $$SERVER_DIR
@@ -0,0 +1,8 @@
+# Тесты QtTest (каждый - отдельная программа): qmake tests/tests.pro && make check
+TEMPLATE = subdirs
+
+SUBDIRS += \
+    bracket \
+    journal \
+    kernels \
+    scanner
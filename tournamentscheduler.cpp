@@ -0,0 +1,275 @@
+#include "tournamentscheduler.h"
+#include "DatabaseManager.h"
+#include "gamemode.h"
+#include <QDebug>
+#include <algorithm>
+
+TournamentScheduler::TournamentScheduler(QObject *parent)
+    : QObject(parent), mFormat(SingleElimination), mMode(&GameMode::classic()), mTournamentId(-1), mRound(0), mRounds(0),
+      mRunning(false), mGamesTotal(0), mGamesFinished(0), mRoundGames(0)
+{
+}
+
+bool TournamentScheduler::parseFormat(const QString &name, Format *format)
+{
+    if (name == "single") {
+        *format = SingleElimination;
+        return true;
+    }
+    if (name == "swiss") {
+        *format = Swiss;
+        return true;
+    }
+    return false;
+}
+
+QString TournamentScheduler::formatName(Format format)
+{
+    return format == Swiss ? "swiss" : "single";
+}
+
+bool TournamentScheduler::create(Format format, const QStringList &players, const GameMode &mode, int rounds)
+{
+    QStringList entrants = players;
+    entrants.removeDuplicates();
+    entrants.removeAll(QString());
+    if (entrants.size() < 2) {
+        qDebug() << "Tournament needs at least two players, got" << entrants.size();
+        return false;
+    }
+
+    // Туров олимпийской системы - столько, сколько удвоений до числа игроков; швейцарская по умолчанию так же
+    int bracketRounds = 0;
+    while ((1 << bracketRounds) < entrants.size()) {
+        ++bracketRounds;
+    }
+    mFormat = format;
+    mMode = &mode;
+    mRounds = format == Swiss && rounds > 0 ? qMin(rounds, entrants.size() - 1) : bracketRounds;
+    mPlayers = entrants;
+    mTournamentId = DatabaseManager::getInstance()->createTournament(formatName(format), mode, mRounds);
+    if (mTournamentId == -1) {
+        return false;
+    }
+
+    // Сетка олимпийской системы - стандартная расстановка посевов на 2^k мест (1-8, 4-5, 2-7, 3-6 для восьми):
+    // первый и второй посев могут встретиться только в финале. Недостающие посевы - пустые места,
+    // их соперники (старшие посевы) проходят первый тур без игры
+    int bracketSize = 1 << bracketRounds;
+    QVector<int> seeds = {1};
+    while (seeds.size() < bracketSize) {
+        int size = seeds.size() * 2;
+        QVector<int> next;
+        for (int seed : seeds) {
+            next.append(seed);
+            next.append(size + 1 - seed);
+        }
+        seeds = next;
+    }
+    mAlive.clear();
+    for (int seed : seeds) {
+        mAlive.append(seed <= entrants.size() ? entrants[seed - 1] : QString());
+    }
+    for (const QString &player : entrants) {
+        mScores.insert(player, 0);
+    }
+
+    mRunning = true;
+    qDebug() << "Tournament" << mTournamentId << "created:" << formatName(format) << entrants.size() << "players," << mRounds
+             << "rounds, mode" << mode.name;
+    return scheduleRound();
+}
+
+bool TournamentScheduler::isRunning() const
+{
+    return mRunning;
+}
+
+int TournamentScheduler::tournamentId() const
+{
+    return mTournamentId;
+}
+
+const GameMode &TournamentScheduler::mode() const
+{
+    return *mMode;
+}
+
+bool TournamentScheduler::hasQueuedMatches() const
+{
+    return !mQueue.isEmpty();
+}
+
+bool TournamentScheduler::takeMatch(Match *match, int shard)
+{
+    if (mQueue.isEmpty()) {
+        return false;
+    }
+    *match = mQueue.dequeue();
+    DatabaseManager::getInstance()->assignTournamentMatch(match->gameId, shard);
+    return true;
+}
+
+bool TournamentScheduler::gameFinished(int gameId, const QString &winner)
+{
+    auto it = mPending.find(gameId);
+    if (it == mPending.end()) {
+        return false;
+    }
+    Match match = it.value();
+    if (winner != match.player1 && winner != match.player2) {
+        qDebug() << "Tournament game" << gameId << "reported unknown winner" << winner;
+        return false;
+    }
+    mPending.erase(it);
+    ++mGamesFinished;
+    DatabaseManager::getInstance()->recordTournamentResult(gameId, winner);
+
+    mRoundWinners[match.slot] = winner;
+    mScores[winner] += 1;
+    mPlayed[match.player1].insert(match.player2);
+    mPlayed[match.player2].insert(match.player1);
+
+    if (!mPending.isEmpty()) {
+        return true;
+    }
+
+    // Тур сыгран целиком
+    qDebug() << "Tournament" << mTournamentId << "round" << mRound << "finished:" << mRoundGames << "games in"
+             << mRoundTimer.elapsed() << "ms";
+    if (mFormat == SingleElimination) {
+        mAlive = QStringList(mRoundWinners.cbegin(), mRoundWinners.cend());
+        if (mAlive.size() == 1) {
+            finish(mAlive.first());
+            return true;
+        }
+    } else if (mRound >= mRounds) {
+        finish(swissStandings().first());
+        return true;
+    }
+    scheduleRound();
+    return true;
+}
+
+QJsonObject TournamentScheduler::stats() const
+{
+    QJsonObject stats;
+    stats["tournament_id"] = mTournamentId;
+    stats["format"] = formatName(mFormat);
+    stats["mode"] = QString(mMode->name);
+    stats["players"] = mPlayers.size();
+    stats["round"] = mRound;
+    stats["rounds"] = mRounds;
+    stats["round_games"] = mRoundGames;
+    stats["round_remaining"] = mPending.size();
+    stats["queued"] = mQueue.size();
+    stats["games_total"] = qint64(mGamesTotal);
+    stats["games_finished"] = qint64(mGamesFinished);
+    stats["running"] = mRunning;
+    stats["champion"] = mChampion;
+    return stats;
+}
+
+bool TournamentScheduler::scheduleRound()
+{
+    ++mRound;
+    QVector<QPair<QString, QString>> pairs = mFormat == Swiss ? pairSwiss() : pairSingleElimination();
+    QVector<int> gameIds = DatabaseManager::getInstance()->createTournamentRound(mTournamentId, mRound, pairs, *mMode);
+    if (gameIds.size() != pairs.size()) {
+        qDebug() << "Tournament" << mTournamentId << "stopped: round" << mRound << "could not be created";
+        mRunning = false;
+        return false;
+    }
+
+    mRoundWinners.fill(QString(), pairs.size());
+    mRoundGames = 0;
+    mRoundTimer.start();
+    for (int slot = 0; slot < pairs.size(); ++slot) {
+        const QPair<QString, QString> &pair = pairs[slot];
+        if (pair.second.isEmpty()) {
+            // Свободный проход засчитывается победой сразу
+            mRoundWinners[slot] = pair.first;
+            mScores[pair.first] += 1;
+            mByes.insert(pair.first);
+            continue;
+        }
+        Match match;
+        match.gameId = gameIds[slot];
+        match.round = mRound;
+        match.slot = slot;
+        match.player1 = pair.first;
+        match.player2 = pair.second;
+        mPending.insert(match.gameId, match);
+        mQueue.enqueue(match);
+        ++mRoundGames;
+    }
+    mGamesTotal += mRoundGames;
+    qDebug() << "Tournament" << mTournamentId << "round" << mRound << "scheduled:" << mRoundGames << "games";
+    emit matchesQueued();
+    return true;
+}
+
+QVector<QPair<QString, QString>> TournamentScheduler::pairSingleElimination()
+{
+    // Соседи по сетке играют между собой; победитель занимает место пары, поэтому сетка сохраняется до финала.
+    // Пустое место - свободный проход соседа
+    QVector<QPair<QString, QString>> pairs;
+    for (int i = 0; i + 1 < mAlive.size(); i += 2) {
+        if (mAlive[i].isEmpty()) {
+            pairs.append(qMakePair(mAlive[i + 1], QString()));
+        } else {
+            pairs.append(qMakePair(mAlive[i], mAlive[i + 1]));
+        }
+    }
+    return pairs;
+}
+
+QVector<QPair<QString, QString>> TournamentScheduler::pairSwiss()
+{
+    QStringList standings = swissStandings();
+    QVector<QPair<QString, QString>> pairs;
+
+    // Нечётное число: проход - последнему в таблице из тех, кто его ещё не получал
+    if (standings.size() % 2 != 0) {
+        int bye = standings.size() - 1;
+        for (int i = standings.size() - 1; i >= 0; --i) {
+            if (!mByes.contains(standings[i])) {
+                bye = i;
+                break;
+            }
+        }
+        pairs.append(qMakePair(standings.takeAt(bye), QString()));
+    }
+
+    // Жадно: соседний по таблице соперник, с которым ещё не играли (если таких нет - ближайший)
+    while (!standings.isEmpty()) {
+        QString player = standings.takeFirst();
+        const QSet<QString> &played = mPlayed[player];
+        int opponent = 0;
+        for (int i = 0; i < standings.size(); ++i) {
+            if (!played.contains(standings[i])) {
+                opponent = i;
+                break;
+            }
+        }
+        pairs.append(qMakePair(player, standings.takeAt(opponent)));
+    }
+    return pairs;
+}
+
+QStringList TournamentScheduler::swissStandings() const
+{
+    QStringList standings = mPlayers;
+    std::stable_sort(standings.begin(), standings.end(),
+                     [this](const QString &a, const QString &b) { return mScores.value(a) > mScores.value(b); });
+    return standings;
+}
+
+void TournamentScheduler::finish(const QString &champion)
+{
+    mChampion = champion;
+    mRunning = false;
+    DatabaseManager::getInstance()->finishTournament(mTournamentId, champion);
+    qDebug() << "Tournament" << mTournamentId << "finished after" << mRound << "rounds, champion:" << champion;
+    emit finished(champion);
+}
@@ -0,0 +1,89 @@
+#ifndef TOURNAMENTSCHEDULER_H
+#define TOURNAMENTSCHEDULER_H
+
+#include <QObject>
+#include <QHash>
+#include <QSet>
+#include <QQueue>
+#include <QVector>
+#include <QPair>
+#include <QStringList>
+#include <QElapsedTimer>
+#include <QJsonObject>
+
+struct GameMode;
+
+// Турнир на маршрутизаторе (ShardRouter): олимпийская система или швейцарская.
+// Тур - пакет партий, созданных одной транзакцией (createTournamentRound). Матчи тура встают в очередь,
+// маршрутизатор раздаёт их свободным шардам; итог партии шард присылает сам по game_over,
+// поэтому ни одна партия не опрашивается. Когда итогов тура набралось столько же, сколько партий,
+// сразу планируется следующий тур. В шарде одно лобби, поэтому тур идёт не более чем по партии на шард;
+// остальные матчи ждут в очереди, их число - "queued" в stats() и в tournament_status.
+class TournamentScheduler : public QObject
+{
+    Q_OBJECT
+
+public:
+    enum Format {
+        SingleElimination,
+        Swiss
+    };
+
+    struct Match
+    {
+        int gameId = -1;
+        int round = 0;
+        int slot = 0; // Место в сетке тура
+        QString player1;
+        QString player2;
+    };
+
+    explicit TournamentScheduler(QObject *parent = nullptr);
+
+    static bool parseFormat(const QString &name, Format *format); // "single" или "swiss"
+    static QString formatName(Format format);
+
+    bool create(Format format, const QStringList &players, const GameMode &mode, int rounds); // rounds <= 0 - по числу игроков
+    bool isRunning() const;
+    int tournamentId() const;
+    const GameMode &mode() const;
+
+    bool hasQueuedMatches() const;
+    bool takeMatch(Match *match, int shard); // Следующий матч, ожидающий шарда; шард матча сохраняется в БД
+    bool gameFinished(int gameId, const QString &winner); // false - партия не из текущего тура
+    QJsonObject stats() const;
+
+signals:
+    void matchesQueued(); // Запланирован тур: матчи ждут свободных шардов
+    void finished(const QString &champion);
+
+private:
+    bool scheduleRound();
+    QVector<QPair<QString, QString>> pairSingleElimination(); // Пустой второй игрок - свободный проход
+    QVector<QPair<QString, QString>> pairSwiss();
+    QStringList swissStandings() const; // Очки по убыванию, при равенстве - порядок посева
+    void finish(const QString &champion);
+
+    Format mFormat;
+    const GameMode *mMode;
+    int mTournamentId;
+    int mRound;
+    int mRounds;
+    QStringList mPlayers; // Порядок посева
+    QStringList mAlive; // Олимпийская система: оставшиеся игроки в порядке сетки (2^k мест, пусто - проход)
+    QHash<QString, int> mScores; // Швейцарская система: победы (свободный проход - победа)
+    QHash<QString, QSet<QString>> mPlayed; // Швейцарская система: уже сыгранные пары
+    QSet<QString> mByes; // Кто уже получал свободный проход
+    QVector<QString> mRoundWinners; // Победители текущего тура по слотам сетки
+    QHash<int, Match> mPending; // Партия текущего тура без итога -> матч
+    QQueue<Match> mQueue;
+    QString mChampion;
+    bool mRunning;
+
+    quint64 mGamesTotal;
+    quint64 mGamesFinished;
+    int mRoundGames;
+    QElapsedTimer mRoundTimer;
+};
+
+#endif // TOURNAMENTSCHEDULER_H
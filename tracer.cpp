@@ -0,0 +1,174 @@
+#include "tracer.h"
+#include <QThread>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QElapsedTimer>
+#include <QCoreApplication>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QVector>
+#include <QList>
+#include <QAtomicInteger>
+#include <QDebug>
+
+namespace {
+
+struct Event
+{
+    const char *name;
+    const char *category;
+    quint64 traceId;
+    qint64 startNs;
+    qint64 endNs;
+};
+
+// Кольцевой буфер потока. Мьютекс захватывает только владелец и выгрузка - без конкуренции в обычной работе
+struct ThreadBuffer
+{
+    QMutex mutex;
+    QVector<Event> events;
+    int next = 0;
+    quint64 written = 0;
+    int tid = 0;
+    QString threadName;
+};
+
+int bufferEvents = 65536;
+QElapsedTimer clock;
+QAtomicInteger<quint64> sampled(0);
+
+QMutex registryMutex;
+QList<ThreadBuffer*> registry; // Буферы живут до конца процесса: потоков немного
+thread_local ThreadBuffer *localBuffer = nullptr;
+
+ThreadBuffer *threadBuffer()
+{
+    if (!localBuffer) {
+        ThreadBuffer *buffer = new ThreadBuffer;
+        buffer->events.resize(bufferEvents);
+        QThread *thread = QThread::currentThread();
+        if (QCoreApplication::instance() && thread == QCoreApplication::instance()->thread()) {
+            buffer->threadName = "main";
+        } else {
+            buffer->threadName = thread->objectName().isEmpty() ? QString("thread") : thread->objectName();
+        }
+
+        QMutexLocker locker(&registryMutex);
+        buffer->tid = registry.size() + 1;
+        registry.append(buffer);
+        localBuffer = buffer;
+    }
+    return localBuffer;
+}
+
+} // namespace
+
+void Tracer::configure()
+{
+    clock.start();
+    if (qEnvironmentVariableIntValue("TRACE_BUFFER_EVENTS") > 0) {
+        bufferEvents = qEnvironmentVariableIntValue("TRACE_BUFFER_EVENTS");
+    }
+    sSampleEvery = qMax(0, qEnvironmentVariableIntValue("TRACE_SAMPLE_EVERY"));
+    if (sSampleEvery > 0) {
+        qDebug() << "Tracing every" << sSampleEvery << "request(s)";
+    }
+}
+
+quint64 Tracer::nextSample()
+{
+    quint64 request = ++sampled;
+    return request % quint64(sSampleEvery) == 0 ? request : 0;
+}
+
+qint64 Tracer::now()
+{
+    return clock.nsecsElapsed();
+}
+
+void Tracer::record(const char *name, const char *category, quint64 traceId, qint64 startNs, qint64 endNs)
+{
+    ThreadBuffer *buffer = threadBuffer();
+    QMutexLocker locker(&buffer->mutex);
+    buffer->events[buffer->next] = Event{name, category, traceId, startNs, endNs};
+    buffer->next = (buffer->next + 1) % buffer->events.size();
+    ++buffer->written;
+}
+
+QByteArray Tracer::exportJson()
+{
+    QList<ThreadBuffer*> buffers;
+    {
+        QMutexLocker locker(&registryMutex);
+        buffers = registry;
+    }
+
+    qint64 pid = QCoreApplication::applicationPid();
+    QJsonArray events;
+    for (ThreadBuffer *buffer : buffers) {
+        QJsonObject threadName;
+        threadName["name"] = "thread_name";
+        threadName["ph"] = "M";
+        threadName["pid"] = pid;
+        threadName["tid"] = buffer->tid;
+        threadName["args"] = QJsonObject{{"name", buffer->threadName}};
+        events.append(threadName);
+
+        QVector<Event> copy;
+        int first = 0;
+        int count;
+        {
+            QMutexLocker locker(&buffer->mutex);
+            copy = buffer->events;
+            count = buffer->next;
+            if (buffer->written >= quint64(copy.size())) {
+                first = buffer->next;
+                count = copy.size();
+            }
+        }
+
+        // От старых событий к новым
+        for (int i = 0; i < count; ++i) {
+            const Event &event = copy[(first + i) % copy.size()];
+            QJsonObject span;
+            span["name"] = event.name;
+            span["cat"] = event.category;
+            span["ph"] = "X";
+            span["ts"] = event.startNs / 1000.0;
+            span["dur"] = (event.endNs - event.startNs) / 1000.0;
+            span["pid"] = pid;
+            span["tid"] = buffer->tid;
+            span["args"] = QJsonObject{{"request", qint64(event.traceId)}};
+            events.append(span);
+        }
+    }
+
+    QJsonObject trace;
+    trace["traceEvents"] = events;
+    trace["displayTimeUnit"] = "ms";
+    return QJsonDocument(trace).toJson(QJsonDocument::Compact);
+}
+
+QJsonObject Tracer::stats()
+{
+    quint64 written = 0;
+    quint64 dropped = 0;
+    int threads;
+    {
+        QMutexLocker locker(&registryMutex);
+        threads = registry.size();
+        for (ThreadBuffer *buffer : registry) {
+            QMutexLocker bufferLocker(&buffer->mutex);
+            written += buffer->written;
+            dropped += buffer->written > quint64(buffer->events.size()) ? buffer->written - buffer->events.size() : 0;
+        }
+    }
+
+    QJsonObject stats;
+    stats["sample_every"] = sSampleEvery;
+    stats["sampled_requests"] = qint64(sSampleEvery ? sampled.loadRelaxed() / sSampleEvery : 0);
+    stats["spans"] = qint64(written);
+    stats["overwritten"] = qint64(dropped);
+    stats["threads"] = threads;
+    return stats;
+}
@@ -0,0 +1,101 @@
+#ifndef TRACER_H
+#define TRACER_H
+
+#include <QtGlobal>
+#include <QByteArray>
+#include <QJsonObject>
+
+// Трассировка запросов: интервалы (span) стадий чтения, декодирования, обработки, БД и записи.
+// Трассируется каждый TRACE_SAMPLE_EVERY-й запрос (0 - выключено). Номер трассы запроса лежит
+// в thread_local и переносится сопрограммами в DbWorker и обратно; вне выбранных запросов
+// каждый Span - одна проверка этого номера. Интервалы копятся в кольцевом буфере своего потока
+// (TRACE_BUFFER_EVENTS) и выгружаются в формате Chrome trace (GET /trace на порту проверки готовности),
+// который открывают chrome://tracing и ui.perfetto.dev.
+class Tracer
+{
+public:
+    // Интервал от создания до разрушения (name и category - строковые литералы)
+    class Span
+    {
+    public:
+        explicit Span(const char *name, const char *category = "server") : mTraceId(sCurrent), mName(name), mCategory(category)
+        {
+            if (mTraceId) {
+                mStartNs = now();
+            }
+        }
+        ~Span()
+        {
+            if (mTraceId) {
+                record(mName, mCategory, mTraceId, mStartNs, now());
+            }
+        }
+
+    private:
+        quint64 mTraceId;
+        const char *mName;
+        const char *mCategory;
+        qint64 mStartNs = 0;
+    };
+
+    // Последовательные стадии одной функции: next() закрывает текущую и открывает следующую
+    class StageSpan
+    {
+    public:
+        explicit StageSpan(const char *name, const char *category = "server") : mTraceId(sCurrent), mName(name), mCategory(category)
+        {
+            if (mTraceId) {
+                mStartNs = now();
+            }
+        }
+        ~StageSpan()
+        {
+            if (mTraceId) {
+                record(mName, mCategory, mTraceId, mStartNs, now());
+            }
+        }
+        void next(const char *name)
+        {
+            if (mTraceId) {
+                qint64 stageEnd = now();
+                record(mName, mCategory, mTraceId, mStartNs, stageEnd);
+                mStartNs = stageEnd;
+            }
+            mName = name;
+        }
+
+    private:
+        quint64 mTraceId;
+        const char *mName;
+        const char *mCategory;
+        qint64 mStartNs = 0;
+    };
+
+    // Текущая трасса потока на время области: начало запроса или возобновление сопрограммы
+    class Scope
+    {
+    public:
+        explicit Scope(quint64 traceId) : mPrevious(sCurrent) { sCurrent = traceId; }
+        ~Scope() { sCurrent = mPrevious; }
+
+    private:
+        quint64 mPrevious;
+    };
+
+    static void configure(); // Из переменных окружения, до запуска потоков
+    // Номер трассы нового запроса, 0 - запрос не трассируется
+    static quint64 sampleRequest() { return sSampleEvery ? nextSample() : 0; }
+    static quint64 current() { return sCurrent; }
+    static qint64 now(); // нс от configure()
+    static void record(const char *name, const char *category, quint64 traceId, qint64 startNs, qint64 endNs);
+    static QByteArray exportJson(); // {"traceEvents": [...]} по всем потокам
+    static QJsonObject stats();
+
+private:
+    static quint64 nextSample();
+
+    static inline int sSampleEvery = 0;
+    static inline thread_local quint64 sCurrent = 0;
+};
+
+#endif // TRACER_H
@@ -0,0 +1,186 @@
+#include "trafficcapture.h"
+#include "requestscanner.h"
+#include <QJsonDocument>
+#include <QtEndian>
+#include <QDebug>
+#include <cstring>
+
+const char TrafficCapture::Magic[4] = {'B', 'S', 'C', 'P'};
+const char TrafficCapture::RedactedPassword[4] = "***";
+
+namespace {
+
+const int FlushThreshold = 64 * 1024; // Сброс буфера на диск по объёму
+const int FlushIntervalMs = 200; // ... и по времени
+
+// Транспорт соединения - данные кадра Open (воспроизведение идёт по TCP и сообщает о расхождении)
+QByteArray transportName(const QObject *client)
+{
+    if (client->inherits("QWebSocket")) {
+        return "websocket";
+    }
+    return client->inherits("NetConnection") ? "epoll" : "tcp";
+}
+
+} // namespace
+
+TrafficCapture::TrafficCapture(QObject *parent)
+    : QObject(parent), mFile(nullptr), mNextConnection(1), mFrames(0), mBytes(0), mRedacted(0)
+{
+    mFlushTimer = new QTimer(this);
+    connect(mFlushTimer, &QTimer::timeout, this, &TrafficCapture::slotFlush);
+
+    mStopTimer = new QTimer(this);
+    mStopTimer->setSingleShot(true);
+    connect(mStopTimer, &QTimer::timeout, this, &TrafficCapture::stop);
+}
+
+TrafficCapture::~TrafficCapture()
+{
+    stop();
+}
+
+bool TrafficCapture::start(const QString &path, int seconds)
+{
+    stop();
+
+    // Без буфера QFile: кадры и так копятся в mBuffer
+    mFile = new QFile(path);
+    if (!mFile->open(QIODevice::WriteOnly | QIODevice::Truncate | QIODevice::Unbuffered)) {
+        qDebug() << "Error opening capture file" << path << ":" << mFile->errorString();
+        delete mFile;
+        mFile = nullptr;
+        return false;
+    }
+
+    char header[HeaderSize] = {};
+    memcpy(header, Magic, sizeof(Magic));
+    qToLittleEndian<quint16>(Version, header + 4);
+    mFile->write(header, HeaderSize);
+
+    mBuffer.reserve(FlushThreshold * 2);
+    mConnections.clear();
+    mFrames = 0;
+    mBytes = 0;
+    mRedacted = 0;
+    mClock.start();
+    mFlushTimer->start(FlushIntervalMs);
+    if (seconds > 0) {
+        mStopTimer->start(seconds * 1000);
+    }
+    qDebug() << "Traffic capture started:" << path << (seconds > 0 ? QString("for %1 s").arg(seconds) : QString("until shutdown"));
+    return true;
+}
+
+void TrafficCapture::stop()
+{
+    if (!mFile) {
+        return;
+    }
+    slotFlush();
+    mFlushTimer->stop();
+    mStopTimer->stop();
+    mFile->close();
+    qDebug() << "Traffic capture stopped:" << mFile->fileName() << "frames:" << mFrames << "bytes:" << mBytes << "redacted:" << mRedacted;
+    delete mFile;
+    mFile = nullptr;
+    mConnections.clear();
+}
+
+QJsonObject TrafficCapture::stats() const
+{
+    QJsonObject stats;
+    stats["active"] = isActive();
+    stats["frames"] = qint64(mFrames);
+    stats["bytes"] = qint64(mBytes);
+    stats["redacted"] = qint64(mRedacted);
+    stats["connections"] = mConnections.size();
+    return stats;
+}
+
+QByteArray TrafficCapture::redact(const QByteArray &frame, bool *changed, const ScannedRequest *scanned)
+{
+    *changed = true;
+    // Обычный запрос: заменяем значение пароля на месте, остальные байты не трогаем.
+    // Сканер не принимает экранирование, поэтому его ключи - ровно то, что видит сервер
+    ScannedRequest request;
+    if (scanned || scanRequest(frame, request)) {
+        const ScannedRequest &fields = scanned ? *scanned : request;
+        if (!fields.has(ScannedRequest::Password)) {
+            *changed = false;
+            return frame;
+        }
+        QByteArray result = frame;
+        result.replace(fields.password.data() - frame.constData(), fields.password.size(), RedactedPassword);
+        return result;
+    }
+
+    QJsonDocument doc = QJsonDocument::fromJson(QString::fromUtf8(frame).trimmed().toUtf8());
+    if (doc.isObject()) {
+        QJsonObject jsonObj = doc.object(); // Ключи уже без экранирования
+        if (!jsonObj.contains("password")) {
+            *changed = false;
+            return frame;
+        }
+        jsonObj["password"] = RedactedPassword;
+        return QJsonDocument(jsonObj).toJson(QJsonDocument::Compact);
+    }
+    // Не разобрать - не сохраняем вовсе (сервер ответит на такое "Invalid JSON format")
+    return QByteArray("[redacted]");
+}
+
+void TrafficCapture::slotFlush()
+{
+    if (!mFile || mBuffer.isEmpty()) {
+        return;
+    }
+    if (mFile->write(mBuffer) != mBuffer.size()) {
+        qDebug() << "Error writing capture file:" << mFile->errorString();
+    }
+    mBuffer.truncate(0);
+}
+
+void TrafficCapture::append(QObject *client, Kind kind, const QByteArray &payload, const ScannedRequest *scanned)
+{
+    quint32 connection;
+    auto it = mConnections.constFind(client);
+    if (it == mConnections.constEnd()) {
+        if (kind == Close) {
+            return; // Соединение открылось и закрылось вне записи
+        }
+        connection = mNextConnection++;
+        mConnections.insert(client, connection);
+        writeFrame(connection, Open, transportName(client));
+    } else {
+        connection = it.value();
+    }
+
+    if (kind == Inbound) {
+        bool changed = false;
+        QByteArray frame = redact(payload, &changed, scanned);
+        mRedacted += changed ? 1 : 0;
+        writeFrame(connection, kind, frame);
+    } else {
+        writeFrame(connection, kind, payload);
+    }
+
+    if (kind == Close) {
+        mConnections.remove(client);
+    }
+    if (mBuffer.size() >= FlushThreshold) {
+        slotFlush();
+    }
+}
+
+void TrafficCapture::writeFrame(quint32 connection, Kind kind, const QByteArray &payload)
+{
+    char header[FrameHeaderSize];
+    qToLittleEndian<qint64>(mClock.nsecsElapsed() / 1000, header);
+    qToLittleEndian<quint32>(connection, header + 8);
+    header[12] = char(kind);
+    qToLittleEndian<quint32>(quint32(payload.size()), header + 13);
+    mBuffer.append(header, FrameHeaderSize);
+    mBuffer.append(payload);
+    ++mFrames;
+    mBytes += FrameHeaderSize + payload.size();
+}
@@ -0,0 +1,78 @@
+#ifndef TRAFFICCAPTURE_H
+#define TRAFFICCAPTURE_H
+
+#include <QObject>
+#include <QFile>
+#include <QHash>
+#include <QTimer>
+#include <QElapsedTimer>
+#include <QJsonObject>
+
+struct ScannedRequest;
+
+// Запись трафика для воспроизведения (см. TrafficReplay).
+// Формат файла: заголовок "BSCP" + версия (quint16) + 2 байта резерва, затем кадры
+// [время от начала записи, мкс: qint64][соединение: quint32][вид: quint8][длина: quint32][данные],
+// все числа little-endian. Кадры копируются в буфер и сбрасываются на диск пачками.
+// Данные кадра Open - транспорт соединения: "tcp", "epoll" или "websocket" (в ранних записях пусто).
+// Пароли во входящих кадрах заменяются на "***". Каждый входящий кадр разбирается (сканером или
+// QJsonDocument), поэтому ключ, записанный с экранированием ("pass\u0077ord"), тоже находится;
+// кадр, который не удалось разобрать, не сохраняется. Запросы, отклонённые ограничением частоты, не записываются.
+class TrafficCapture : public QObject
+{
+    Q_OBJECT
+
+public:
+    enum Kind : quint8 {
+        Open,     // Первое появление соединения
+        Inbound,  // Запрос клиента
+        Outbound, // Ответ или уведомление сервера
+        Close     // Соединение закрыто
+    };
+
+    static const char Magic[4];
+    static const char RedactedPassword[4]; // Чем заменяется пароль во входящих кадрах
+    static const quint16 Version = 1;
+    static const int HeaderSize = 8;
+    static const int FrameHeaderSize = 17;
+
+    explicit TrafficCapture(QObject *parent = nullptr);
+    ~TrafficCapture();
+
+    bool start(const QString &path, int seconds); // seconds = 0 - до остановки сервера
+    void stop();
+    bool isActive() const { return mFile != nullptr; }
+
+    // Вне записи - одна проверка указателя. scanned - входящий кадр, уже разобранный сканером (не сканировать повторно)
+    void record(QObject *client, Kind kind, const QByteArray &payload = QByteArray(), const ScannedRequest *scanned = nullptr)
+    {
+        if (mFile) {
+            append(client, kind, payload, scanned);
+        }
+    }
+
+    QJsonObject stats() const;
+    // Заменить пароль в запросе на "***"; *changed - кадр изменён (пароль убран или кадр отброшен)
+    static QByteArray redact(const QByteArray &frame, bool *changed, const ScannedRequest *scanned = nullptr);
+
+private slots:
+    void slotFlush();
+
+private:
+    void append(QObject *client, Kind kind, const QByteArray &payload, const ScannedRequest *scanned);
+    void writeFrame(quint32 connection, Kind kind, const QByteArray &payload);
+
+    QFile *mFile;
+    QByteArray mBuffer; // Кадры, ещё не записанные в файл
+    QElapsedTimer mClock;
+    QHash<QObject*, quint32> mConnections; // Клиент -> номер соединения в записи
+    quint32 mNextConnection;
+    QTimer *mFlushTimer;
+    QTimer *mStopTimer;
+
+    quint64 mFrames;
+    quint64 mBytes;
+    quint64 mRedacted;
+};
+
+#endif // TRAFFICCAPTURE_H
@@ -0,0 +1,339 @@
+#include "trafficreplay.h"
+#include "trafficcapture.h"
+#include "requestscanner.h"
+#include <QFile>
+#include <QMap>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QJsonArray>
+#include <QtEndian>
+#include <QDebug>
+#include <algorithm>
+#include <cstring>
+
+namespace {
+
+const int DrainMs = 2000; // Сколько ждать ответов после последнего кадра
+const int MaxReportedDiffs = 10;
+
+struct NumberSpan {
+    qsizetype offset;
+    qsizetype length;
+    qint64 value;
+};
+
+// Числовые значения ключа "game_id" в запросе или сообщении сервера - без разбора JSON,
+// чтобы номер заменялся на месте, а остальные байты сравнивались как есть
+QVector<NumberSpan> gameIdSpans(const QByteArray &message)
+{
+    static const QByteArray key = "\"game_id\"";
+    QVector<NumberSpan> spans;
+    qsizetype from = 0;
+    while ((from = message.indexOf(key, from)) >= 0) {
+        qsizetype i = from + key.size();
+        from = i;
+        while (i < message.size() && (message[i] == ' ' || message[i] == ':')) {
+            ++i;
+        }
+        qsizetype start = i;
+        if (i < message.size() && message[i] == '-') {
+            ++i;
+        }
+        while (i < message.size() && message[i] >= '0' && message[i] <= '9') {
+            ++i;
+        }
+        bool ok = false;
+        qint64 value = message.mid(start, i - start).toLongLong(&ok);
+        if (ok) {
+            spans.append(NumberSpan{start, i - start, value});
+        }
+    }
+    return spans;
+}
+
+} // namespace
+
+TrafficReplay::TrafficReplay(const QString &host, quint16 port, double speed, const QString &password, QObject *parent)
+    : QObject(parent), mHost(host), mPort(port), mSpeed(speed > 0 ? speed : 1.0), mPassword(password), mNext(0)
+{
+    mTimer = new QTimer(this);
+    mTimer->setSingleShot(true);
+    mTimer->setTimerType(Qt::PreciseTimer);
+    connect(mTimer, &QTimer::timeout, this, &TrafficReplay::slotTick);
+}
+
+bool TrafficReplay::load(const QString &path)
+{
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly)) {
+        qDebug() << "Error opening capture" << path << ":" << file.errorString();
+        return false;
+    }
+    QByteArray data = file.readAll();
+    const char *p = data.constData();
+    const char *end = p + data.size();
+
+    if (data.size() < TrafficCapture::HeaderSize || memcmp(p, TrafficCapture::Magic, sizeof(TrafficCapture::Magic)) != 0
+        || qFromLittleEndian<quint16>(p + 4) != TrafficCapture::Version) {
+        qDebug() << "Not a traffic capture (or unsupported version):" << path;
+        return false;
+    }
+    p += TrafficCapture::HeaderSize;
+
+    QHash<quint32, qint64> inboundAtUs; // Последний запрос без ответа по соединению
+    while (end - p >= TrafficCapture::FrameHeaderSize) {
+        Frame frame;
+        frame.timestampUs = qFromLittleEndian<qint64>(p);
+        frame.connection = qFromLittleEndian<quint32>(p + 8);
+        frame.kind = quint8(p[12]);
+        quint32 length = qFromLittleEndian<quint32>(p + 13);
+        p += TrafficCapture::FrameHeaderSize;
+        if (quint32(end - p) < length) {
+            qDebug() << "Capture is truncated after" << mFrames.size() << "frames";
+            break;
+        }
+        frame.payload = QByteArray(p, length);
+        p += length;
+
+        Session &session = mSessions[frame.connection];
+        if (frame.kind == TrafficCapture::Open) {
+            session.transport = frame.payload;
+        } else if (frame.kind == TrafficCapture::Inbound) {
+            // Ответ на вход со скрытым паролем - следующее сообщение сервера этому соединению
+            if (restorePassword(frame.payload) && mPassword.isEmpty()) {
+                session.credentialReplies.insert(session.recorded.size());
+            }
+            // Кадр WebSocket - запрос без разделителя; в потоке TCP сервер (NET_TRANSPORT=epoll) ждёт конца строки
+            if (session.transport == "websocket" && !frame.payload.endsWith('\n')) {
+                frame.payload += "\r\n";
+            }
+            inboundAtUs.insert(frame.connection, frame.timestampUs);
+        } else if (frame.kind == TrafficCapture::Outbound) {
+            splitMessages(frame.payload, session.recorded);
+            auto it = inboundAtUs.find(frame.connection);
+            if (it != inboundAtUs.end()) {
+                session.recordedLatencyUs.append(frame.timestampUs - it.value());
+                inboundAtUs.erase(it);
+            }
+        }
+        mFrames.append(frame);
+    }
+
+    qDebug() << "Loaded capture" << path << ":" << mFrames.size() << "frames," << mSessions.size() << "connections";
+    return !mFrames.isEmpty();
+}
+
+void TrafficReplay::start()
+{
+    qDebug() << "Replaying to" << mHost << ":" << mPort << "at" << mSpeed << "x";
+    mClock.start();
+    slotTick();
+}
+
+void TrafficReplay::slotTick()
+{
+    qint64 nowUs = mClock.nsecsElapsed() / 1000;
+    while (mNext < mFrames.size()) {
+        const Frame &frame = mFrames[mNext];
+        qint64 dueUs = qint64(frame.timestampUs / mSpeed);
+        if (dueUs > nowUs) {
+            mTimer->start(int((dueUs - nowUs) / 1000));
+            return;
+        }
+        ++mNext;
+
+        switch (frame.kind) {
+        case TrafficCapture::Open:
+            session(frame.connection);
+            break;
+        case TrafficCapture::Inbound: {
+            Session &target = session(frame.connection);
+            target.sentAtUs = nowUs;
+            target.socket->write(mapGameIds(frame.payload));
+            break;
+        }
+        case TrafficCapture::Close:
+            session(frame.connection).socket->disconnectFromHost();
+            break;
+        default:
+            break; // Ответы сервера только сравниваются
+        }
+    }
+
+    // Все запросы отправлены - ждём последние ответы и подводим итог
+    QTimer::singleShot(DrainMs, this, &TrafficReplay::report);
+}
+
+TrafficReplay::Session &TrafficReplay::session(quint32 connection)
+{
+    Session &session = mSessions[connection];
+    if (!session.socket) {
+        session.socket = new QTcpSocket(this);
+        connect(session.socket, &QTcpSocket::readyRead, this, [this, connection]() { onReadyRead(connection); });
+        session.socket->connectToHost(mHost, mPort); // Запись до установления соединения буферизуется
+    }
+    return session;
+}
+
+void TrafficReplay::onReadyRead(quint32 connection)
+{
+    Session &session = mSessions[connection];
+    if (session.sentAtUs >= 0) {
+        session.replayedLatencyUs.append(mClock.nsecsElapsed() / 1000 - session.sentAtUs);
+        session.sentAtUs = -1;
+    }
+
+    session.pending += session.socket->readAll();
+    int newline;
+    while ((newline = session.pending.indexOf('\n')) >= 0) {
+        QByteArray line = session.pending.left(newline).trimmed();
+        session.pending.remove(0, newline + 1);
+        if (!line.isEmpty()) {
+            // Ответ на том же месте, что в записи: из пары узнаём, какой номер партии выдан вместо записанного
+            if (session.replayed.size() < session.recorded.size()) {
+                learnGameIds(session.recorded[session.replayed.size()], line);
+            }
+            session.replayed.append(line);
+        }
+    }
+}
+
+void TrafficReplay::report()
+{
+    int matched = 0;
+    int mismatched = 0;
+    int expected = 0; // Ответы на вход со скрытым паролем
+    int missing = 0;
+    int extra = 0;
+    QVector<qint64> recordedLatency;
+    QVector<qint64> replayedLatency;
+    QMap<QByteArray, int> transports; // Транспорт записи -> соединений
+
+    for (auto it = mSessions.begin(); it != mSessions.end(); ++it) {
+        Session &session = it.value();
+        if (session.socket) {
+            session.socket->abort();
+        }
+        transports[session.transport.isEmpty() ? QByteArray("unknown") : session.transport] += 1;
+
+        int common = qMin(session.recorded.size(), session.replayed.size());
+        for (int i = 0; i < common; ++i) {
+            QByteArray recorded = mapGameIds(session.recorded[i]);
+            if (recorded == session.replayed[i]) {
+                ++matched;
+                continue;
+            }
+            if (session.credentialReplies.contains(i)) {
+                ++expected;
+                continue;
+            }
+            if (mismatched < MaxReportedDiffs) {
+                qDebug().noquote() << "Connection" << it.key() << "(" + session.transport + ")" << "message" << i
+                                   << "differs:\n  recorded:" << recorded << "\n  replayed:" << session.replayed[i];
+            }
+            ++mismatched;
+        }
+        missing += session.recorded.size() - common;
+        extra += session.replayed.size() - common;
+        recordedLatency += session.recordedLatencyUs;
+        replayedLatency += session.replayedLatencyUs;
+    }
+
+    QStringList recordedOver;
+    for (auto it = transports.constBegin(); it != transports.constEnd(); ++it) {
+        recordedOver << QString("%1 %2").arg(it.value()).arg(QString::fromUtf8(it.key()));
+    }
+    qDebug().noquote() << "Connections recorded over" << recordedOver.join(", ") << "- replayed over tcp";
+    if (transports.contains("websocket")) {
+        qDebug() << "WebSocket sessions were replayed as TCP lines: framing and latencies differ from the recording";
+    }
+    qDebug() << "Replay finished: matched" << matched << "mismatched" << mismatched << "expected (hidden password)" << expected
+             << "missing" << missing << "extra" << extra;
+    if (expected > 0) {
+        qDebug() << "Requests with a hidden password were sent as recorded; pass --replay-password to log in for real";
+    }
+    qDebug() << "Latency us (recorded -> replayed): p50" << percentile(recordedLatency, 0.5) << "->" << percentile(replayedLatency, 0.5)
+             << "p99" << percentile(recordedLatency, 0.99) << "->" << percentile(replayedLatency, 0.99);
+    emit finished(mismatched || missing || extra ? 1 : 0);
+}
+
+bool TrafficReplay::restorePassword(QByteArray &frame) const
+{
+    // Запись хранит пароль так, как его заменил TrafficCapture: на месте (сканер) или в пересобранном JSON
+    ScannedRequest request;
+    if (scanRequest(frame, request)) {
+        if (!request.has(ScannedRequest::Password) || request.password != QByteArrayView(TrafficCapture::RedactedPassword)) {
+            return false;
+        }
+        if (!mPassword.isEmpty()) {
+            // Значение с JSON-экранированием: ["..."] без скобок
+            QByteArray value = QJsonDocument(QJsonArray{mPassword}).toJson(QJsonDocument::Compact);
+            frame.replace(request.password.data() - frame.constData() - 1, request.password.size() + 2, value.mid(1, value.size() - 2));
+        }
+        return true;
+    }
+
+    QJsonDocument doc = QJsonDocument::fromJson(frame);
+    QJsonObject jsonObj = doc.object();
+    if (!doc.isObject() || jsonObj["password"].toString() != TrafficCapture::RedactedPassword) {
+        return false;
+    }
+    if (!mPassword.isEmpty()) {
+        jsonObj["password"] = mPassword;
+        frame = QJsonDocument(jsonObj).toJson(QJsonDocument::Compact);
+    }
+    return true;
+}
+
+void TrafficReplay::learnGameIds(const QByteArray &recorded, const QByteArray &replayed)
+{
+    QVector<NumberSpan> from = gameIdSpans(recorded);
+    QVector<NumberSpan> to = gameIdSpans(replayed);
+    if (from.size() != to.size()) {
+        return; // Сообщения разные по составу - соответствие не установить
+    }
+    for (int i = 0; i < from.size(); ++i) {
+        if (from[i].value >= 0 && to[i].value >= 0) {
+            mGameIds.insert(from[i].value, to[i].value);
+        }
+    }
+}
+
+QByteArray TrafficReplay::mapGameIds(const QByteArray &message) const
+{
+    if (mGameIds.isEmpty()) {
+        return message;
+    }
+    QByteArray result = message;
+    QVector<NumberSpan> spans = gameIdSpans(message);
+    // С конца, чтобы замена не сдвигала ещё не заменённые номера
+    for (int i = spans.size() - 1; i >= 0; --i) {
+        auto it = mGameIds.constFind(spans[i].value);
+        if (it != mGameIds.constEnd()) {
+            result.replace(spans[i].offset, spans[i].length, QByteArray::number(it.value()));
+        }
+    }
+    return result;
+}
+
+void TrafficReplay::splitMessages(const QByteArray &data, QList<QByteArray> &out)
+{
+    // TCP-ответы разделены "\r\n", кадр WebSocket - одно сообщение без разделителя
+    const QList<QByteArray> lines = data.split('\n');
+    for (const QByteArray &line : lines) {
+        QByteArray message = line.trimmed();
+        if (!message.isEmpty()) {
+            out.append(message);
+        }
+    }
+}
+
+qint64 TrafficReplay::percentile(QVector<qint64> values, double fraction)
+{
+    if (values.isEmpty()) {
+        return 0;
+    }
+    int index = qMin(int(values.size() * fraction), int(values.size()) - 1);
+    std::nth_element(values.begin(), values.begin() + index, values.end());
+    return values[index];
+}
@@ -0,0 +1,79 @@
+#ifndef TRAFFICREPLAY_H
+#define TRAFFICREPLAY_H
+
+#include <QObject>
+#include <QTcpSocket>
+#include <QTimer>
+#include <QElapsedTimer>
+#include <QHash>
+#include <QSet>
+#include <QVector>
+#include <QList>
+
+// Воспроизведение записи TrafficCapture на работающий сервер.
+// Каждое записанное соединение открывается своим QTcpSocket, запросы отправляются
+// в записанные моменты времени (делённые на коэффициент ускорения).
+// В конце ответы сравниваются с записанными по порядку, задержки - по перцентилям.
+// Сервер воспроизведения выдаёт свои номера партий: соответствие записанных номерам воспроизведения
+// запоминается по ответам, подставляется в следующие запросы и учитывается при сравнении.
+// Пароли в записи скрыты: с password они подставляются в запросы, без него ответ на такой запрос
+// считается ожидаемым расхождением. Соединения WebSocket воспроизводятся по TCP (кадр - строка),
+// и итог сообщает, сколько соединений записано на каком транспорте.
+class TrafficReplay : public QObject
+{
+    Q_OBJECT
+
+public:
+    TrafficReplay(const QString &host, quint16 port, double speed, const QString &password = QString(), QObject *parent = nullptr);
+
+    bool load(const QString &path);
+    void start();
+
+signals:
+    void finished(int exitCode); // 0 - ответы совпали с записью
+
+private slots:
+    void slotTick();
+
+private:
+    struct Frame {
+        qint64 timestampUs;
+        quint32 connection;
+        quint8 kind;
+        QByteArray payload;
+    };
+
+    struct Session {
+        QTcpSocket *socket = nullptr;
+        QByteArray transport; // Транспорт записанного соединения (кадр Open), пусто - запись без него
+        QList<QByteArray> recorded; // Сообщения сервера из записи
+        QList<QByteArray> replayed; // Сообщения сервера при воспроизведении
+        QByteArray pending; // Неполная строка ответа
+        QVector<qint64> recordedLatencyUs; // Запрос -> первый ответ
+        QVector<qint64> replayedLatencyUs;
+        qint64 sentAtUs = -1;
+        QSet<int> credentialReplies; // Записанные ответы на запросы со скрытым паролем (без password)
+    };
+
+    Session &session(quint32 connection);
+    void onReadyRead(quint32 connection);
+    void report();
+    bool restorePassword(QByteArray &frame) const; // false - в запросе нет скрытого пароля
+    void learnGameIds(const QByteArray &recorded, const QByteArray &replayed);
+    QByteArray mapGameIds(const QByteArray &message) const; // Записанные номера партий -> номера воспроизведения
+    static void splitMessages(const QByteArray &data, QList<QByteArray> &out);
+    static qint64 percentile(QVector<qint64> values, double fraction);
+
+    QString mHost;
+    quint16 mPort;
+    double mSpeed;
+    QString mPassword; // Пусто - ответы на запросы со скрытым паролем не сравниваются
+    QHash<qint64, qint64> mGameIds; // Записанный номер партии -> номер при воспроизведении
+    QVector<Frame> mFrames;
+    int mNext;
+    QHash<quint32, Session> mSessions;
+    QElapsedTimer mClock;
+    QTimer *mTimer;
+};
+
+#endif // TRAFFICREPLAY_H
@@ -0,0 +1,163 @@
+#include "userdirectory.h"
+#include <QCryptographicHash>
+#include <QReadLocker>
+#include <QWriteLocker>
+
+namespace {
+
+const int BitsPerUser = 10; // При 7 хэшах - около 1% ложных "возможно да"
+const int FilterHashes = 7;
+const int MinFilterBits = 1 << 16;
+const size_t NicknameSeeds[2] = {0x9e3779b9u, 0x85ebca6bu};
+const size_t EmailSeeds[2] = {0xc2b2ae35u, 0x27d4eb2fu};
+
+} // namespace
+
+UserDirectory::UserDirectory()
+    : mFilterMask(0), mFilterCapacity(0), mLookups(0), mFilterNegatives(0), mFalsePositives(0)
+{
+    resizeFilter(0);
+}
+
+void UserDirectory::reset(int expectedUsers)
+{
+    QWriteLocker locker(&mLock);
+    mPasswords.clear();
+    mEmails.clear();
+    mPasswords.reserve(expectedUsers);
+    mEmails.reserve(expectedUsers);
+    resizeFilter(expectedUsers);
+}
+
+void UserDirectory::insert(const QString &nickname, const QString &email, const QString &password)
+{
+    QByteArray hash = passwordHash(password); // Вне блокировки
+    QWriteLocker locker(&mLock);
+    insertLocked(nickname, email, hash);
+}
+
+void UserDirectory::insertLocked(const QString &nickname, const QString &email, const QByteArray &hash)
+{
+    mPasswords.insert(nickname, hash);
+    mEmails.insert(email);
+    if (mPasswords.size() > mFilterCapacity) {
+        resizeFilter(mPasswords.size() * 2); // Заново добавляет все ключи, включая этот
+        return;
+    }
+    addToFilter(Nickname, nickname);
+    addToFilter(Email, email);
+}
+
+bool UserDirectory::isTaken(const QString &nickname, const QString &email) const
+{
+    ++mLookups;
+    QReadLocker locker(&mLock);
+    bool maybeNickname = mayContain(Nickname, nickname);
+    bool maybeEmail = mayContain(Email, email);
+    if (!maybeNickname && !maybeEmail) {
+        ++mFilterNegatives;
+        return false;
+    }
+    bool taken = (maybeNickname && mPasswords.contains(nickname)) || (maybeEmail && mEmails.contains(email));
+    if (!taken) {
+        ++mFalsePositives;
+    }
+    return taken;
+}
+
+bool UserDirectory::containsNickname(const QString &nickname) const
+{
+    ++mLookups;
+    QReadLocker locker(&mLock);
+    if (!mayContain(Nickname, nickname)) {
+        ++mFilterNegatives;
+        return false;
+    }
+    return mPasswords.contains(nickname);
+}
+
+bool UserDirectory::checkPassword(const QString &nickname, const QString &password) const
+{
+    ++mLookups;
+    {
+        QReadLocker locker(&mLock);
+        if (!mayContain(Nickname, nickname)) {
+            ++mFilterNegatives;
+            return false;
+        }
+        if (!mPasswords.contains(nickname)) {
+            ++mFalsePositives;
+            return false;
+        }
+    }
+    QByteArray hash = passwordHash(password);
+    QReadLocker locker(&mLock);
+    return mPasswords.value(nickname) == hash;
+}
+
+int UserDirectory::size() const
+{
+    QReadLocker locker(&mLock);
+    return mPasswords.size();
+}
+
+QJsonObject UserDirectory::stats() const
+{
+    QReadLocker locker(&mLock);
+    QJsonObject stats;
+    stats["users"] = mPasswords.size();
+    stats["filter_bits"] = qint64(mFilter.size()) * 64;
+    stats["lookups"] = qint64(mLookups.loadRelaxed());
+    stats["filter_negatives"] = qint64(mFilterNegatives.loadRelaxed());
+    stats["false_positives"] = qint64(mFalsePositives.loadRelaxed());
+    return stats;
+}
+
+QByteArray UserDirectory::passwordHash(const QString &password)
+{
+    return QCryptographicHash::hash(password.toUtf8(), QCryptographicHash::Sha256);
+}
+
+void UserDirectory::resizeFilter(int users)
+{
+    quint64 bits = MinFilterBits;
+    while (bits < quint64(qMax(users, 1)) * BitsPerUser) {
+        bits <<= 1;
+    }
+    mFilter.fill(0, int(bits / 64));
+    mFilterMask = bits - 1;
+    mFilterCapacity = int(bits / BitsPerUser);
+
+    for (auto it = mPasswords.cbegin(); it != mPasswords.cend(); ++it) {
+        addToFilter(Nickname, it.key());
+    }
+    for (const QString &email : mEmails) {
+        addToFilter(Email, email);
+    }
+}
+
+// Двойное хэширование: i-й бит - h1 + i * h2
+void UserDirectory::addToFilter(Key key, const QString &value)
+{
+    const size_t *seeds = key == Nickname ? NicknameSeeds : EmailSeeds;
+    quint64 h1 = qHash(value, seeds[0]);
+    quint64 h2 = qHash(value, seeds[1]) | 1;
+    for (int i = 0; i < FilterHashes; ++i) {
+        quint64 bit = (h1 + i * h2) & mFilterMask;
+        mFilter[int(bit >> 6)] |= quint64(1) << (bit & 63);
+    }
+}
+
+bool UserDirectory::mayContain(Key key, const QString &value) const
+{
+    const size_t *seeds = key == Nickname ? NicknameSeeds : EmailSeeds;
+    quint64 h1 = qHash(value, seeds[0]);
+    quint64 h2 = qHash(value, seeds[1]) | 1;
+    for (int i = 0; i < FilterHashes; ++i) {
+        quint64 bit = (h1 + i * h2) & mFilterMask;
+        if (!(mFilter[int(bit >> 6)] & (quint64(1) << (bit & 63)))) {
+            return false;
+        }
+    }
+    return true;
+}
@@ -0,0 +1,56 @@
+#ifndef USERDIRECTORY_H
+#define USERDIRECTORY_H
+
+#include <QHash>
+#include <QSet>
+#include <QString>
+#include <QVector>
+#include <QByteArray>
+#include <QReadWriteLock>
+#include <QAtomicInteger>
+#include <QJsonObject>
+
+// Справочник пользователей в памяти: индексы по нику и e-mail и фильтр Блума перед ними.
+// Заполняется из таблицы User при старте и дополняется после каждой успешной вставки, поэтому
+// "ник или e-mail заняты?" и проверка пароля при входе не обращаются к SQLite.
+// Фильтр отвечает "точно нет" без поиска в хэшах; ложные "возможно да" перепроверяются по индексу.
+// Пароль хранится только как SHA-256. Методы потокобезопасны (основной поток и DbWorker).
+class UserDirectory
+{
+public:
+    UserDirectory();
+
+    void reset(int expectedUsers); // Очистить перед полной загрузкой, фильтр - под expectedUsers
+    void insert(const QString &nickname, const QString &email, const QString &password);
+
+    bool isTaken(const QString &nickname, const QString &email) const;
+    bool containsNickname(const QString &nickname) const;
+    bool checkPassword(const QString &nickname, const QString &password) const; // false и для неизвестного ника
+    int size() const;
+    QJsonObject stats() const;
+
+private:
+    enum Key {
+        Nickname,
+        Email
+    };
+
+    static QByteArray passwordHash(const QString &password);
+    void insertLocked(const QString &nickname, const QString &email, const QByteArray &hash);
+    void resizeFilter(int users); // Под мьютексом на запись
+    void addToFilter(Key key, const QString &value);
+    bool mayContain(Key key, const QString &value) const;
+
+    mutable QReadWriteLock mLock;
+    QHash<QString, QByteArray> mPasswords; // Ник -> SHA-256 пароля
+    QSet<QString> mEmails;
+    QVector<quint64> mFilter; // Биты фильтра Блума (размер - степень двойки)
+    quint64 mFilterMask;
+    int mFilterCapacity; // Сколько пользователей помещается при целевой доле ложных срабатываний
+
+    mutable QAtomicInteger<quint64> mLookups;
+    mutable QAtomicInteger<quint64> mFilterNegatives;
+    mutable QAtomicInteger<quint64> mFalsePositives;
+};
+
+#endif // USERDIRECTORY_H